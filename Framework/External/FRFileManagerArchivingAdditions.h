@@ -30,15 +30,59 @@
 
 /*!
  \brief		Compress a files and/or directories
- \details	Create a tar/bzip2 compressed version of the sources at the destination.
+ \details	Create a tar/bzip2 compressed version of the sources at the destination. The archive is
+			compressed in parallel on all processors. If any source can't be read or the archive can't be
+			written, no archive is left at the destination and the error is in the POSIX domain.
  */
 - (BOOL)compressItems:(NSArray *)relativePaths relativeToDirectory:(NSString *)directory
 				   to:(NSString *)destinationPath
 				error:(NSError **)error;
 
+/*!
+ \brief		Compress a files and/or directories
+ \details	Create a tar/bzip2 compressed version of the sources at the destination using the given
+			compression (see archiving.h).
+ */
+- (BOOL)compressItems:(NSArray *)relativePaths relativeToDirectory:(NSString *)directory
+				   to:(NSString *)destinationPath
+		  compression:(int)compression
+				error:(NSError **)error;
+
+/*!
+ \brief		Compress files and data
+ \details	Create a tar/bzip2 archive at the destination straight from the contents, without copying
+			anything into place first. The keys of the contents are the paths in the archive and the
+			values are either paths of the files to add or data to add as a file.
+ */
+- (BOOL)compressContents:(NSDictionary *)contents
+					  to:(NSString *)destinationPath
+				   error:(NSError **)error;
+
+/*!
+ \brief		Compress files and data with an index
+ \details	Like compressContents:to:error:, but the archive ends with an index at the given path in the
+			archive so single files can be read from it without extracting it (see archiving.h).
+ */
+- (BOOL)compressContents:(NSDictionary *)contents
+					  to:(NSString *)destinationPath
+			   indexPath:(NSString *)indexPath
+				   error:(NSError **)error;
+
+/*!
+ \brief		Compress files and data in memory
+ \details	Like compressContents:to:error:, but the archive is returned instead of written to a file.
+ */
+- (NSData *)compressedDataWithContents:(NSDictionary *)contents
+								 error:(NSError **)error;
+
 /*!
  \brief		Uncompress a file or directory
- \details	Create a tar/bzip2 compressed version of the source at the destination.
+ \details	Extract a tar/bzip2 archive to the destination. If the archive holds a single item and the
+			destination doesn't exist, that item becomes the destination, otherwise the destination is a
+			directory with all of the items. The archive is extracted right into the destination. Each file
+			is written to a temporary name and renamed into place, and a destination created for the
+			archive is removed again if extraction fails, so nothing partial is left behind. Extracting
+			into an existing directory that fails can leave some of the (complete) files.
  */
 
 - (BOOL)uncompressItemAtPath:(NSString *)sourcePath
@@ -24,6 +24,9 @@
 #elif defined(REDLINKED_FILE_MANAGER_ARCHIVING_ADDITIONS) // not needed, linked in
 #else
 
+static int FRCompressContents(NSDictionary *contents, NSString *indexPath, archiving_output output, void *context);
+static int FRArchivingOutputData(void *context, const void *buffer, size_t length);
+
 @implementation NSFileManager (FRFileManagerArchivingAdditions)
 
 - (BOOL)compressItemAtPath:(NSString *)source
@@ -36,7 +39,12 @@
 
 - (BOOL)compressItems:(NSArray *)relativePathnames relativeToDirectory:(NSString *)directory
 				   to:(NSString *)destination error:(NSError **)error {
-	
+	return [self compressItems:relativePathnames relativeToDirectory:directory to:destination
+				   compression:archiving_compression_parallel_bzip2 error:error];
+}
+
+- (BOOL)compressItems:(NSArray *)relativePathnames relativeToDirectory:(NSString *)directory
+				   to:(NSString *)destination compression:(int)compression error:(NSError **)error {
 	
 	BOOL success = FALSE;
 	
@@ -44,7 +52,7 @@
 	int flag = O_WRONLY | O_CREAT | O_EXCL;
 	int write_fd = open([destination fileSystemRepresentation], flag, mode);
 	if (write_fd < 0) {
-		if (error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:write_fd userInfo:nil]; }
+		if (error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]; }
 		success = FALSE;
 	}
 	else {
@@ -57,13 +65,19 @@
 		
 		// create the compression task
 		char *chdir_location = strdup([directory fileSystemRepresentation]);
-		int status = archive_create_tar_bzip2(write_fd, chdir_location, pathnames);
+		int status = archive_create_tar(write_fd, chdir_location, pathnames, compression);
+		if (close(write_fd) != 0 && status == 0) { status = errno; }
 		success = (status == 0);
-		close(write_fd);
-
+		
 		if (success) { } // nothing to do on success
 		else {
-			if (error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:status userInfo:nil]; }
+			// don't leave an incomplete archive behind
+			unlink([destination fileSystemRepresentation]);
+			if (error) {
+				NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
+										  destination, NSFilePathErrorKey, nil];
+				*error = [NSError errorWithDomain:NSPOSIXErrorDomain code:status userInfo:userInfo];
+			}
 		}
 		
 		// free memory
@@ -75,58 +89,104 @@
 	return success;
 }
 
+- (BOOL)compressContents:(NSDictionary *)contents to:(NSString *)destination error:(NSError **)error {
+	return [self compressContents:contents to:destination indexPath:nil error:error];
+}
+
+- (BOOL)compressContents:(NSDictionary *)contents
+					  to:(NSString *)destination
+			   indexPath:(NSString *)indexPath
+				   error:(NSError **)error {
+	mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+	int flag = O_WRONLY | O_CREAT | O_EXCL;
+	int write_fd = open([destination fileSystemRepresentation], flag, mode);
+	if (write_fd < 0) {
+		if (error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]; }
+		return FALSE;
+	}
+	
+	int status = FRCompressContents(contents, indexPath, archiving_output_fd, &write_fd);
+	if (close(write_fd) != 0 && status == 0) { status = errno; }
+	if (status != 0) {
+		// don't leave an incomplete archive behind
+		unlink([destination fileSystemRepresentation]);
+		if (error) {
+			NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
+									  destination, NSFilePathErrorKey, nil];
+			*error = [NSError errorWithDomain:NSPOSIXErrorDomain code:status userInfo:userInfo];
+		}
+	}
+	return (status == 0);
+}
+
+- (NSData *)compressedDataWithContents:(NSDictionary *)contents error:(NSError **)error {
+	NSMutableData *data = [NSMutableData data];
+	int status = FRCompressContents(contents, nil, FRArchivingOutputData, (__bridge void *)data);
+	if (status != 0) {
+		if (error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:status userInfo:nil]; }
+		return nil;
+	}
+	return data;
+}
+
 - (BOOL)uncompressItemAtPath:(NSString *)source
 						  to:(NSString *)destination
 					   error:(NSError **)error {
 	
-	BOOL success = FALSE;
-	
 	int read_fd = open([source fileSystemRepresentation], O_RDONLY);
 	if (read_fd < 0) {
-		if (error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:read_fd userInfo:nil]; }
-		success = FALSE;
+		if (error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]; }
+		return FALSE;
 	}
-	else {
-		// get a unique temp directory
-		char *dirname = NULL;
-		asprintf(&dirname, "%s/XXXXXX", [NSTemporaryDirectory() fileSystemRepresentation]);
-		char *chdir_location = mkdtemp(dirname);
-
-		// create the extraction task
-		int status = archive_extract_tar_bzip2(read_fd, chdir_location);
+	
+	// extract right into the destination. every file is written to a temporary name and renamed into
+	// place, and a destination that's created here is removed again if extraction fails.
+	BOOL created = ![self fileExistsAtPath:destination];
+	BOOL success = [self createDirectoryAtPath:destination withIntermediateDirectories:YES attributes:nil error:error];
+	if (success) {
+		int status = archive_extract_tar_bzip2(read_fd, [destination fileSystemRepresentation]);
 		success = (status == 0);
-		close(read_fd);
-		
-		if (success) {
-			NSFileManager *manager = [NSFileManager defaultManager];
-			NSString *extractPath = [manager stringWithFileSystemRepresentation:chdir_location
-																		 length:strlen(chdir_location)];
-			NSArray *extractedItems = [self contentsOfDirectoryAtPath:extractPath error:error];
-			if ([extractedItems count] == 1) {
-				NSString *extractedItemName = [extractedItems lastObject];
-				NSString *extractedItemPath = [extractPath stringByAppendingPathComponent:extractedItemName];
-				if (extractedItemPath) {
-					success = [self moveItemAtPath:extractedItemPath toPath:destination error:error];
-				}
-			}
-			else {
-				success = [self createDirectoryAtPath:destination withIntermediateDirectories:YES
-										   attributes:nil error:error];
-				if (success) {
-					for (NSString *itemName in extractedItems) {
-						NSString *moveFrom = [extractPath stringByAppendingPathComponent:itemName];
-						NSString *moveTo = [destination stringByAppendingPathComponent:itemName];
-						success = [self moveItemAtPath:moveFrom toPath:moveTo error:error];
-						if (!success) { break; }
-					}
-				}
-			}
+		if (!success && error) {
+			NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:source, NSFilePathErrorKey, nil];
+			*error = [NSError errorWithDomain:NSPOSIXErrorDomain code:status userInfo:userInfo];
+		}
+	}
+	close(read_fd);
+	
+	// an archive with a single item extracts to the item itself rather than a directory holding it. the
+	// directory is renamed over an empty temporary one next to it so the item can take its place.
+	NSArray *items = (success && created) ? [self contentsOfDirectoryAtPath:destination error:error] : nil;
+	if (success && created && !items) { success = FALSE; }
+	if (success && [items count] == 1) {
+		NSString *parent = [destination stringByDeletingLastPathComponent];
+		if (![parent length]) { parent = @"."; }
+		char *holder = NULL;
+		int status = 0;
+		if (asprintf(&holder, "%s/.%s.XXXXXX", [parent fileSystemRepresentation],
+					 [[destination lastPathComponent] fileSystemRepresentation]) < 0) {
+			holder = NULL;
+			status = ENOMEM;
+		}
+		else if (!mkdtemp(holder) || rename([destination fileSystemRepresentation], holder) != 0) {
+			status = errno;
 		}
 		else {
-			if (error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:status userInfo:nil]; }
+			NSString *holderPath = [self stringWithFileSystemRepresentation:holder length:strlen(holder)];
+			NSString *itemPath = [holderPath stringByAppendingPathComponent:[items lastObject]];
+			if (rename([itemPath fileSystemRepresentation], [destination fileSystemRepresentation]) != 0) {
+				status = errno;
+				rename(holder, [destination fileSystemRepresentation]);
+			}
 		}
+		if (holder) { rmdir(holder); } // empty once the item has moved
+		free(holder);
 		
-		free(chdir_location);
+		success = (status == 0);
+		if (!success && error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:status userInfo:nil]; }
+	}
+	
+	if (!success && created) {
+		[self removeItemAtPath:destination error:NULL];
 	}
 	
 	return success;
@@ -134,4 +194,48 @@
 
 @end
 
+static int FRCompressContents(NSDictionary *contents, NSString *indexPath, archiving_output output, void *context) {
+	// sorting keeps items from the same directory together and makes the archive the same every time
+	NSArray *archivePaths = [[contents allKeys] sortedArrayUsingSelector:@selector(compare:)];
+	size_t count = [archivePaths count];
+	archiving_item *items = calloc(count ? count : 1, sizeof(archiving_item));
+	if (!items) { return ENOMEM; }
+	
+	int status = 0;
+	for (size_t index = 0; index < count && status == 0; index++) {
+		NSString *archivePath = [archivePaths objectAtIndex:index];
+		id content = [contents objectForKey:archivePath];
+		items[index].archive_path = strdup([archivePath fileSystemRepresentation]);
+		if ([content isKindOfClass:[NSData class]]) {
+			items[index].data = [content bytes];
+			items[index].length = [content length];
+		}
+		else if ([content isKindOfClass:[NSString class]]) {
+			items[index].source_path = strdup([content fileSystemRepresentation]);
+		}
+		else { status = EINVAL; }
+	}
+	
+	if (status == 0 && indexPath) {
+		status = archive_create_indexed_tar_items(items, count, [indexPath fileSystemRepresentation], output, context);
+	}
+	else if (status == 0) {
+		status = archive_create_tar_items(items, count, archiving_compression_parallel_bzip2, output, context);
+	}
+	
+	// free memory
+	for (size_t index = 0; index < count; index++) {
+		free((char *)items[index].archive_path);
+		free((char *)items[index].source_path);
+	}
+	free(items);
+	
+	return status;
+}
+
+static int FRArchivingOutputData(void *context, const void *buffer, size_t length) {
+	[(__bridge NSMutableData *)context appendBytes:buffer length:length];
+	return 0;
+}
+
 #endif
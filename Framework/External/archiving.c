@@ -21,156 +21,1298 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
 #include <fcntl.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include <bzlib.h>
 #include <archive.h>
 #include <archive_entry.h>
 
 #import "archiving.h"
+#import "parallel_bzip2.h"
 
-static int append_path_recursively(const char *relative_to, const char *pathname, struct archive *a);
+/*!
+ \brief		Index entry
+ \details	A bzip2 stream (compressed and uncompressed offset) or a member (data offset and length).
+ */
+typedef struct {
+	uint64_t offset;
+	uint64_t length;
+	const char *path;
+} archiving_index_entry;
+
+/*!
+ \brief		Archiving job
+ \details	Everything needed while adding files to an archive. Each archive gets its own job so that
+			several archives can be created at the same time.
+ */
+typedef struct {
+	struct archive *archive;
+	const char *relative_to;
+	char *buffer;
+	size_t buffer_size;
+	archiving_output output;
+	void *context;
+	parallel_bzip2 *compressor;
+	int output_error; // libarchive doesn't pass on errors from closing the stream
+	char **directories; // directories added for items
+	size_t directory_count;
+	size_t directory_capacity;
+	int indexed;
+	uint64_t tar_position; // uncompressed bytes passed on by libarchive
+	uint64_t compressed_position;
+	uint64_t streamed_position; // uncompressed bytes in the streams written so far
+	archiving_index_entry *streams;
+	size_t stream_count;
+	size_t stream_capacity;
+	archiving_index_entry *members;
+	size_t member_count;
+	size_t member_capacity;
+} archiving_job;
+
+static const size_t kReadBufferSize = 256 * 1024; // large reads keep the compressor busy
+static const char * const kArchivingIndexHeader = "greenwich-index 1";
+static const size_t kArchivingIndexLimit = 64 * 1024 * 1024; // far more than the index of any real archive
+enum { kDecompressedBufferCount = 4 }; // how far decompression can get ahead of writing files
+static const size_t kDecompressedBufferSize = 1024 * 1024;
+
+/*!
+ \brief		Decompressing reader
+ \details	Decompresses a bzip2 file on a separate thread into a ring of buffers that libarchive reads
+			from, so decompressing the archive and writing out its files happen at the same time.
+ */
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	int fd;
+	char *buffers[kDecompressedBufferCount];
+	size_t lengths[kDecompressedBufferCount];
+	size_t produced;	// number of buffers filled by the thread
+	size_t consumed;	// number of buffers libarchive is done with
+	int holding;		// whether libarchive is using the buffer after the consumed ones
+	int started;
+	int stopping;
+	int finished;
+	int error;
+} bzip2_reader;
+
+static int archiving_job_open(archiving_job *job, archiving_compression compression, int indexed,
+							  archiving_output output, void *context);
+static int archiving_create_items(const archiving_item *items, size_t count, archiving_compression compression,
+								  const char *index_path, archiving_output output, void *context);
+static int archiving_append_index(archiving_job *job, const char *index_path);
+static int archiving_index_add(archiving_index_entry **entries, size_t *count, size_t *capacity,
+							   uint64_t offset, uint64_t length, const char *path);
+static int archiving_indexed_output(void *context, const void *buffer, size_t length);
+static void archiving_indexed_stream(void *context, size_t length);
+static int archiving_job_close(archiving_job *job, int error);
+static int append_path_recursively(archiving_job *job, const char *pathname);
+static int append_item(archiving_job *job, const archiving_item *item);
+static int append_item_directories(archiving_job *job, const char *archive_path, const struct stat *file_st);
+static int append_file_data(archiving_job *job, const char *fullpath);
+static int archiving_error(struct archive *a);
+static int archiving_write_fd(int fd, const void *buffer, size_t length);
+static ssize_t archiving_archive_write(struct archive *a, void *context, const void *buffer, size_t length);
+static int archiving_archive_close(struct archive *a, void *context);
+static int extract_entry(struct archive *a, struct archive_entry *entry, const char *relative_to);
+static int extract_parent_directories(char *fullpath, size_t start);
+static int extract_directory(const char *fullpath, mode_t mode);
+static int extract_file(struct archive *a, const char *fullpath, mode_t mode);
+static int extract_symlink(const char *fullpath, const char *pathname, const char *target);
+static char *extract_temp_path(const char *fullpath);
+static bzip2_reader *bzip2_reader_create(int fd);
+static void bzip2_reader_free(bzip2_reader *reader);
+static ssize_t bzip2_reader_read(struct archive *a, void *context, const void **buffer);
+static void *bzip2_reader_thread(void *info);
+static int archiving_reader_load_index(archiving_reader *reader, const char *index_name);
+static int archiving_reader_check_index(const char *tar, size_t tar_length, const char *index_name, size_t *size);
+static int archiving_reader_parse_index(archiving_reader *reader, const char *text, size_t size);
+static int archiving_reader_load_contents(archiving_reader *reader);
+static ssize_t archiving_reader_pass_read(struct archive *a, void *context, const void **buffer);
+static int archiving_reader_cache_stream(archiving_reader *reader, size_t index);
+static int archiving_reader_inflate(archiving_reader *reader, size_t offset, size_t limit,
+									char **buffer, size_t *length, size_t *capacity);
+static int archiving_reader_compare(const void *first, const void *second);
+
+
+#pragma mark -
+#pragma mark creating
+// ----------------------------------------------------------------------------------------------------
+// creating
+// ----------------------------------------------------------------------------------------------------
 
 int archive_create_tar_bzip2(int fd, const char *relative_to, const char **pathnames) {
-	int error = 0;
-	
-	struct archive *a = archive_write_new();
-	archive_write_set_compression_bzip2(a);
-	archive_write_set_format_ustar(a);
-	archive_write_open_fd(a, fd);
+	return archive_create_tar(fd, relative_to, pathnames, archiving_compression_bzip2);
+}
+
+int archive_create_tar(int fd, const char *relative_to, const char **pathnames, archiving_compression compression) {
+	archiving_job job;
+	int error = archiving_job_open(&job, compression, 0, archiving_output_fd, &fd);
+	if (error != 0) { return error; }
 	
-	while (*pathnames) {
-		append_path_recursively(relative_to, *pathnames, a);
+	job.relative_to = relative_to;
+	while (error == 0 && *pathnames) {
+		error = append_path_recursively(&job, *pathnames);
 		pathnames++;
 	}
 	
-	archive_write_close(a);
+	return archiving_job_close(&job, error);
+}
+
+int archive_create_tar_items(const archiving_item *items, size_t count, archiving_compression compression,
+							 archiving_output output, void *context) {
+	return archiving_create_items(items, count, compression, NULL, output, context);
+}
+
+int archive_create_indexed_tar_items(const archiving_item *items, size_t count, const char *index_path,
+									 archiving_output output, void *context) {
+	return archiving_create_items(items, count, archiving_compression_parallel_bzip2, index_path, output, context);
+}
+
+static int archiving_create_items(const archiving_item *items, size_t count, archiving_compression compression,
+								  const char *index_path, archiving_output output, void *context) {
+	archiving_job job;
+	int error = archiving_job_open(&job, compression, (index_path != NULL), output, context);
+	if (error != 0) { return error; }
+	
+	for (size_t index = 0; error == 0 && index < count; index++) {
+		error = append_item(&job, &items[index]);
+	}
+	if (error == 0 && index_path) {
+		error = archiving_append_index(&job, index_path);
+	}
+	
+	return archiving_job_close(&job, error);
+}
+
+int archiving_output_fd(void *context, const void *buffer, size_t length) {
+	return archiving_write_fd(*(int *)context, buffer, length);
+}
+
+static int archiving_job_open(archiving_job *job, archiving_compression compression, int indexed,
+							  archiving_output output, void *context) {
+	memset(job, 0, sizeof(archiving_job));
+	job->archive = archive_write_new();
+	job->buffer = malloc(kReadBufferSize);
+	job->buffer_size = kReadBufferSize;
+	job->output = output;
+	job->context = context;
+	job->indexed = indexed;
+	if (compression == archiving_compression_parallel_bzip2 && indexed) {
+		// the index needs to know where every stream ends up, so the compressor's output is counted
+		job->compressor = parallel_bzip2_create(archiving_indexed_output, job, 0);
+		if (job->compressor) { parallel_bzip2_set_stream_handler(job->compressor, archiving_indexed_stream); }
+	}
+	else if (compression == archiving_compression_parallel_bzip2) {
+		// libarchive writes an uncompressed tar stream that's compressed block by block
+		job->compressor = parallel_bzip2_create(output, context, 0);
+	}
+	if (!job->archive || !job->buffer ||
+		(compression == archiving_compression_parallel_bzip2 && !job->compressor)) {
+		if (job->archive) { archive_write_finish(job->archive); }
+		if (job->compressor) { parallel_bzip2_finish(job->compressor); }
+		free(job->buffer);
+		return ENOMEM;
+	}
+	
+	struct archive *a = job->archive;
+	archive_write_set_format_ustar(a);
+	archive_write_set_bytes_in_last_block(a, 1); // padding the output would leave garbage after the bzip2 data
+	if (indexed) { archive_write_set_bytes_per_block(a, 0); } // so positions in the tar are known exactly
+	int result = job->compressor ?
+		archive_write_set_compression_none(a) :
+		archive_write_set_compression_bzip2(a);
+	if (result != ARCHIVE_OK ||
+		archive_write_open(a, job, NULL, archiving_archive_write, archiving_archive_close) != ARCHIVE_OK) {
+		return archiving_job_close(job, archiving_error(a));
+	}
+	return 0;
+}
+
+static int archiving_job_close(archiving_job *job, int error) {
+	struct archive *a = job->archive;
+	
+	// closing flushes the last blocks, so it can still fail after everything was added
+	if (archive_write_close(a) != ARCHIVE_OK && error == 0) {
+		error = archiving_error(a);
+	}
 	archive_write_finish(a);
+	if (job->compressor) { // never opened
+		parallel_bzip2_finish(job->compressor);
+	}
+	if (error == 0) { error = job->output_error; }
+	
+	for (size_t index = 0; index < job->directory_count; index++) {
+		free(job->directories[index]);
+	}
+	free(job->directories);
+	free(job->streams);
+	free(job->members);
+	free(job->buffer);
 	
 	return error;
 }
 
-static int append_path_recursively(const char *relative_to, const char *pathname, struct archive *a) {
+static int append_item(archiving_job *job, const archiving_item *item) {
 	int error = 0;
+	struct archive *a = job->archive;
 	
-	char *fullpath = NULL;
-	asprintf(&fullpath, "%s/%s", relative_to, pathname);
+	struct stat st;
+	if (item->source_path) {
+		if (stat(item->source_path, &st) != 0) { return errno; }
+		if (!S_ISREG(st.st_mode)) { return EINVAL; }
+	}
+	else {
+		memset(&st, 0, sizeof(st));
+		st.st_mode = S_IFREG | S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+		st.st_size = (off_t)item->length;
+		st.st_mtime = time(NULL);
+		st.st_uid = getuid();
+		st.st_gid = getgid();
+	}
+	
+	error = append_item_directories(job, item->archive_path, &st);
+	if (error != 0) { return error; }
+	
+	struct archive_entry *entry = archive_entry_new();
+	if (!entry) { return ENOMEM; }
+	archive_entry_set_pathname(entry, item->archive_path);
+	archive_entry_copy_stat(entry, &st);
+	if (archive_write_header(a, entry) != ARCHIVE_OK) { error = archiving_error(a); }
+	else if (job->indexed && (error = archiving_index_add(&job->members, &job->member_count, &job->member_capacity,
+														  job->tar_position, (uint64_t)st.st_size,
+														  item->archive_path))) { }
+	else if (item->source_path) {
+		if (st.st_size > 0) { error = append_file_data(job, item->source_path); }
+	}
+	else if (item->length > 0) {
+		ssize_t written = archive_write_data(a, item->data, item->length);
+		if (written < 0) { error = archiving_error(a); }
+	}
+	archive_entry_free(entry);
+	
+	return error;
+}
 
+static int append_item_directories(archiving_job *job, const char *archive_path, const struct stat *file_st) {
+	int error = 0;
+	
+	// items only name files, but archives have always listed the directories leading to them as well
+	const char *separator = archive_path;
+	while (error == 0 && (separator = strchr(separator, '/'))) {
+		size_t length = (size_t)(separator - archive_path);
+		separator++;
+		if (length == 0) { continue; }
+		
+		int found = 0;
+		for (size_t index = 0; !found && index < job->directory_count; index++) {
+			found = (strncmp(job->directories[index], archive_path, length) == 0 &&
+					 job->directories[index][length] == '\0');
+		}
+		if (found) { continue; }
+		
+		if (job->directory_count == job->directory_capacity) {
+			size_t capacity = job->directory_capacity ? job->directory_capacity * 2 : 16;
+			char **directories = realloc(job->directories, capacity * sizeof(char *));
+			if (!directories) { return ENOMEM; }
+			job->directories = directories;
+			job->directory_capacity = capacity;
+		}
+		char *directory = malloc(length + 1);
+		if (!directory) { return ENOMEM; }
+		memcpy(directory, archive_path, length);
+		directory[length] = '\0';
+		job->directories[job->directory_count++] = directory;
+		
+		struct stat st = *file_st;
+		st.st_mode = S_IFDIR | S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+		st.st_size = 0;
+		struct archive_entry *entry = archive_entry_new();
+		if (!entry) { return ENOMEM; }
+		archive_entry_set_pathname(entry, directory);
+		archive_entry_copy_stat(entry, &st);
+		if (archive_write_header(job->archive, entry) != ARCHIVE_OK) { error = archiving_error(job->archive); }
+		archive_entry_free(entry);
+	}
+	
+	return error;
+}
+
+static int append_path_recursively(archiving_job *job, const char *pathname) {
+	int error = 0;
+	struct archive *a = job->archive;
+	
+	char *fullpath = NULL;
+	if (asprintf(&fullpath, "%s/%s", job->relative_to, pathname) < 0) { return ENOMEM; }
+	
+	struct stat st;
+	if (stat(fullpath, &st) != 0) {
+		error = errno;
+		free(fullpath);
+		return error;
+	}
+	
 	struct archive_entry *entry = archive_entry_new();
+	if (!entry) {
+		free(fullpath);
+		return ENOMEM;
+	}
 	archive_entry_set_pathname(entry, pathname);
-	struct stat st;
-	stat(fullpath, &st);
 	archive_entry_copy_stat(entry, &st);
 	// if we want to add uname/gname, we should do something like:
 	// archive_entry_copy_uname(entry, uname);
 	// archive_entry_copy_gname(entry, gname);
-	archive_write_header(a, entry);
-	int fd = open(fullpath, O_RDONLY);
-	ssize_t amt = 0;
-	static char buffer[16*1024];
-	while ((amt = read(fd, buffer, sizeof(buffer))) > 0) {
-		archive_write_data(a, buffer, amt);
-	}
-	close(fd);
+	if (archive_write_header(a, entry) != ARCHIVE_OK) { error = archiving_error(a); }
+	else if (S_ISREG(st.st_mode) && st.st_size > 0) { error = append_file_data(job, fullpath); }
 	archive_entry_free(entry);
 	
-	if (S_ISLNK(st.st_mode)) { } // don't recurse into symbolic link dirs
+	if (error != 0) { } // don't continue after a failure
+	else if (S_ISLNK(st.st_mode)) { } // don't recurse into symbolic link dirs
 	else if (S_ISDIR(st.st_mode)) {
 		DIR *dir = opendir(fullpath);
+		if (!dir) { error = errno; }
 		struct dirent *dirent = NULL;
-		while ((dirent = readdir(dir))) {
+		while (dir && (dirent = readdir(dir))) {
 			if (strcmp(dirent->d_name, ".") == 0 ||
 				strcmp(dirent->d_name, "..") == 0) { continue; }
 			
 			char *subpath = NULL;
-			asprintf(&subpath, "%s/%s", pathname, dirent->d_name);
-			error = append_path_recursively(relative_to, subpath, a);
-			free(subpath);
+			if (asprintf(&subpath, "%s/%s", pathname, dirent->d_name) < 0) { error = ENOMEM; }
+			else {
+				error = append_path_recursively(job, subpath);
+				free(subpath);
+			}
 			
 			if (error != 0) { break; }
 		}
+		if (dir) { closedir(dir); }
 	}
 	
 	free(fullpath);
 	return error;
 }
 
+static int append_file_data(archiving_job *job, const char *fullpath) {
+	int error = 0;
+	
+	int fd = open(fullpath, O_RDONLY);
+	if (fd < 0) { return errno; }
+	
+	// files are read once from start to end, so let the system read ahead as far as it likes
+#if defined(POSIX_FADV_SEQUENTIAL)
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#elif defined(F_RDAHEAD)
+	fcntl(fd, F_RDAHEAD, 1);
+#endif
+	
+	for (;;) {
+		ssize_t amount = read(fd, job->buffer, job->buffer_size);
+		if (amount < 0 && errno == EINTR) { continue; }
+		if (amount < 0) { error = errno; break; }
+		if (amount == 0) { break; }
+		
+		// the header already recorded the size, so data beyond it (if the file grew) is dropped
+		ssize_t written = archive_write_data(job->archive, job->buffer, (size_t)amount);
+		if (written < 0) { error = archiving_error(job->archive); break; }
+		if (written < amount) { break; }
+	}
+	
+	close(fd);
+	return error;
+}
+
+static int archiving_error(struct archive *a) {
+	int error = archive_errno(a);
+	return (error > 0) ? error : EIO;
+}
+
+static int archiving_append_index(archiving_job *job, const char *index_path) {
+	// the index goes in a stream of its own at the end, so it can be found without reading anything else.
+	// the last entry is finished first so its padding stays in the earlier stream.
+	int error = (archive_write_finish_entry(job->archive) == ARCHIVE_OK) ? 0 : archiving_error(job->archive);
+	if (error == 0) { error = parallel_bzip2_flush(job->compressor); }
+	if (error != 0) { return error; }
+	
+	size_t length = 0;
+	size_t capacity = 64;
+	for (size_t index = 0; index < job->member_count; index++) {
+		capacity += strlen(job->members[index].path) + 64;
+	}
+	capacity += job->stream_count * 64;
+	char *text = malloc(capacity);
+	if (!text) { return ENOMEM; }
+	
+	length += (size_t)snprintf(text + length, capacity - length, "%s\n", kArchivingIndexHeader);
+	for (size_t index = 0; index < job->stream_count; index++) {
+		length += (size_t)snprintf(text + length, capacity - length, "stream %llu %llu\n",
+								   (unsigned long long)job->streams[index].offset,
+								   (unsigned long long)job->streams[index].length);
+	}
+	for (size_t index = 0; index < job->member_count; index++) {
+		length += (size_t)snprintf(text + length, capacity - length, "member %llu %llu %s\n",
+								   (unsigned long long)job->members[index].offset,
+								   (unsigned long long)job->members[index].length, job->members[index].path);
+	}
+	
+	archiving_item item = { .archive_path = index_path, .data = text, .length = length };
+	job->indexed = 0; // the index doesn't list itself
+	error = append_item(job, &item);
+	free(text);
+	
+	return error;
+}
+
+static int archiving_index_add(archiving_index_entry **entries, size_t *count, size_t *capacity,
+							   uint64_t offset, uint64_t length, const char *path) {
+	if (*count == *capacity) {
+		size_t new_capacity = *capacity ? *capacity * 2 : 64;
+		archiving_index_entry *new_entries = realloc(*entries, new_capacity * sizeof(archiving_index_entry));
+		if (!new_entries) { return ENOMEM; }
+		*entries = new_entries;
+		*capacity = new_capacity;
+	}
+	archiving_index_entry entry = { .offset = offset, .length = length, .path = path };
+	(*entries)[(*count)++] = entry;
+	return 0;
+}
+
+static int archiving_indexed_output(void *context, const void *buffer, size_t length) {
+	archiving_job *job = context;
+	job->compressed_position += length;
+	return job->output(job->context, buffer, length);
+}
+
+static void archiving_indexed_stream(void *context, size_t length) {
+	// streams are listed by compressed offset with the uncompressed offset they start at
+	archiving_job *job = context;
+	if (archiving_index_add(&job->streams, &job->stream_count, &job->stream_capacity,
+							job->compressed_position, job->streamed_position, NULL) != 0) {
+		job->output_error = ENOMEM;
+	}
+	job->streamed_position += length;
+}
+
+static int archiving_write_fd(int fd, const void *buffer, size_t length) {
+	const char *bytes = buffer;
+	while (length) {
+		ssize_t amount = write(fd, bytes, length);
+		if (amount < 0 && errno == EINTR) { continue; }
+		if (amount <= 0) { return errno ? errno : EIO; }
+		bytes += amount;
+		length -= (size_t)amount;
+	}
+	return 0;
+}
+
+static ssize_t archiving_archive_write(struct archive *a, void *context, const void *buffer, size_t length) {
+	archiving_job *job = context;
+	job->tar_position += length;
+	int error = job->compressor ?
+		parallel_bzip2_write(job->compressor, buffer, length) :
+		job->output(job->context, buffer, length);
+	if (error) {
+		if (!job->output_error) { job->output_error = error; }
+		archive_set_error(a, error, "writing archive failed");
+		return -1;
+	}
+	return (ssize_t)length;
+}
+
+static int archiving_archive_close(struct archive *a, void *context) {
+	archiving_job *job = context;
+	int error = job->compressor ? parallel_bzip2_finish(job->compressor) : 0;
+	job->compressor = NULL;
+	if (error) {
+		if (!job->output_error) { job->output_error = error; }
+		archive_set_error(a, error, "compression failed");
+		return ARCHIVE_FATAL;
+	}
+	return ARCHIVE_OK;
+}
+
+
+#pragma mark -
+#pragma mark extracting
+// ----------------------------------------------------------------------------------------------------
+// extracting
+// ----------------------------------------------------------------------------------------------------
+
 int archive_extract_tar_bzip2(int fd, const char *relative_to) {
-	struct archive *a;
-	struct archive *ext;
-	int r = 0;
-	int flags = 0;
 	int error = 0;
+	if (!relative_to) { relative_to = "."; }
 	
-	a = archive_read_new();
+	// decompression happens on its own thread so that it overlaps with writing the files
+	bzip2_reader *reader = bzip2_reader_create(fd);
+	if (!reader) { return ENOMEM; }
+	
+	struct archive *a = archive_read_new();
+	if (!a) {
+		bzip2_reader_free(reader);
+		return ENOMEM;
+	}
 	archive_read_support_format_tar(a);
-	archive_read_support_compression_bzip2(a);
+	archive_read_support_compression_none(a);
+	
+	if (archive_read_open(a, reader, NULL, bzip2_reader_read, NULL) != ARCHIVE_OK) {
+		error = archiving_error(a);
+	}
+	while (error == 0) {
+		struct archive_entry *entry = NULL;
+		int result = archive_read_next_header(a, &entry);
+		if (result == ARCHIVE_EOF) { break; }
+		if (result < ARCHIVE_WARN) { error = archiving_error(a); }
+		else { error = extract_entry(a, entry, relative_to); }
+	}
+	
+	archive_read_close(a);
+	archive_read_finish(a);
+	bzip2_reader_free(reader);
+	
+	return error;
+}
+
+int archive_check_path(const char *relative_to, const char *pathname) {
+	if (pathname[0] == '\0' || pathname[0] == '/') { return EINVAL; }
+	for (const char *component = pathname; component; component = strchr(component, '/')) {
+		if (*component == '/') { component++; }
+		size_t length = strcspn(component, "/");
+		if (length == 0 || (length == 1 && component[0] == '.') ||
+			(length == 2 && component[0] == '.' && component[1] == '.')) { return EINVAL; }
+	}
+	
+	// each part that's there has to be the real thing. once a part is missing, so is the rest.
+	char *fullpath = NULL;
+	if (asprintf(&fullpath, "%s/%s", relative_to, pathname) < 0) { return ENOMEM; }
+	int error = 0;
+	char *separator = fullpath + strlen(relative_to);
+	while (separator && !error) {
+		separator = strchr(separator + 1, '/');
+		if (separator) { *separator = '\0'; }
+		
+		struct stat st;
+		if (lstat(fullpath, &st) != 0) {
+			if (errno != ENOENT) { error = errno; }
+			break;
+		}
+		else if (S_ISLNK(st.st_mode)) { error = EINVAL; }
+		
+		if (separator) { *separator = '/'; }
+	}
+	free(fullpath);
+	return error;
+}
+
+static int extract_entry(struct archive *a, struct archive_entry *entry, const char *relative_to) {
+	int error = 0;
+	
+	// entries must stay inside the directory they're extracted to
+	const char *pathname = archive_entry_pathname(entry);
+	while (pathname[0] == '.' && pathname[1] == '/') { pathname += 2; }
+	if (pathname[0] == '/') { return EINVAL; }
+	for (const char *component = pathname; component; component = strchr(component, '/')) {
+		if (*component == '/') { component++; }
+		if (strncmp(component, "..", 2) == 0 && (component[2] == '/' || component[2] == '\0')) { return EINVAL; }
+	}
+	
+	char *fullpath = NULL;
+	if (asprintf(&fullpath, "%s/%s", relative_to, pathname) < 0) { return ENOMEM; }
+	size_t length = strlen(fullpath);
+	while (length > strlen(relative_to) + 1 && fullpath[length - 1] == '/') { fullpath[--length] = '\0'; }
+	if (length <= strlen(relative_to) + 1) { // the entry for the directory itself
+		free(fullpath);
+		return 0;
+	}
+	
+	// group and other write permissions are dropped the way the default umask would
+	mode_t mode = archive_entry_mode(entry) & (S_IRWXU | S_IRWXG | S_IRWXO) & ~(S_IWGRP | S_IWOTH);
+	mode_t type = archive_entry_filetype(entry);
+	
+	error = extract_parent_directories(fullpath, strlen(relative_to) + 1);
+	if (error != 0) { }
+	else if (type == AE_IFDIR) { error = extract_directory(fullpath, mode); }
+	else if (type == AE_IFREG) { error = extract_file(a, fullpath, mode); }
+	else if (type == AE_IFLNK) { error = extract_symlink(fullpath, pathname, archive_entry_symlink(entry)); }
+	else { } // the archiver never writes other kinds of entries, so they're skipped
+	
+	free(fullpath);
+	return error;
+}
+
+static int extract_parent_directories(char *fullpath, size_t start) {
+	int error = 0;
+	for (char *separator = strchr(fullpath + start, '/'); separator && !error; separator = strchr(separator + 1, '/')) {
+		*separator = '\0';
+		
+		// directories that are already there have to be real ones. going through a link (which an
+		// earlier entry could have created) could put the rest of the entry anywhere.
+		struct stat st;
+		if (mkdir(fullpath, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) == 0) { }
+		else if (errno != EEXIST) { error = errno; }
+		else if (lstat(fullpath, &st) != 0) { error = errno; }
+		else if (S_ISLNK(st.st_mode)) { error = EINVAL; }
+		else if (!S_ISDIR(st.st_mode)) { error = ENOTDIR; }
+		
+		*separator = '/';
+	}
+	return error;
+}
+
+static int extract_directory(const char *fullpath, mode_t mode) {
+	if (mkdir(fullpath, mode | S_IRWXU) == 0) { return 0; }
+	
+	int error = errno;
+	struct stat st;
+	if (error == EEXIST && lstat(fullpath, &st) == 0 && S_ISDIR(st.st_mode)) { error = 0; }
+	return error;
+}
+
+static int extract_file(struct archive *a, const char *fullpath, mode_t mode) {
+	int error = 0;
+	
+	// the data goes to a temporary file next to the final one that's renamed into place once it's
+	// complete. existing files are replaced atomically and failures never leave partial files.
+	char *temp = extract_temp_path(fullpath);
+	if (!temp) { return ENOMEM; }
+	int fd = mkstemp(temp);
+	if (fd < 0) {
+		error = errno;
+		free(temp);
+		return error;
+	}
+	
+	off_t position = 0;
+	for (;;) {
+		const void *block = NULL;
+		size_t size = 0;
+		off_t offset = 0;
+		int result = archive_read_data_block(a, &block, &size, &offset);
+		if (result == ARCHIVE_EOF) { break; }
+		if (result < ARCHIVE_WARN) { error = archiving_error(a); break; }
+		if (offset != position && lseek(fd, offset, SEEK_SET) < 0) { error = errno; break; }
+		if ((error = archiving_write_fd(fd, block, size))) { break; }
+		position = offset + (off_t)size;
+	}
+	
+	if (error == 0 && fchmod(fd, mode) != 0) { error = errno; }
+	if (close(fd) != 0 && error == 0) { error = errno; }
+	if (error == 0 && rename(temp, fullpath) != 0) { error = errno; }
+	if (error != 0) { unlink(temp); }
+	free(temp);
 	
-	ext = archive_write_disk_new();
-	archive_write_disk_set_options(ext, flags);
+	return error;
+}
 
-	if ((r = archive_read_open_fd(a, fd, 10240))) {
-		fprintf(stderr, "archiving: %s", archive_error_string(a));
-		error = r;
+static int extract_symlink(const char *fullpath, const char *pathname, const char *target) {
+	int error = 0;
+	if (!target || target[0] == '\0' || target[0] == '/') { return EINVAL; }
+	
+	// the target is relative to the directory holding the link and has to stay inside the path as well.
+	// .. is only allowed at the start of the target (and no more often than the number of directories
+	// the link is in), where it goes through the real directories the link was created in. after a
+	// name, .. could go up from wherever another link leads.
+	long depth = -1; // the link itself isn't a directory
+	for (const char *component = pathname; component; component = strchr(component, '/')) {
+		if (*component == '/') { component++; }
+		size_t length = strcspn(component, "/");
+		if (length && !(length == 1 && component[0] == '.')) { depth++; }
+	}
+	int descended = 0;
+	for (const char *component = target; component; component = strchr(component, '/')) {
+		if (*component == '/') { component++; }
+		size_t length = strcspn(component, "/");
+		if (length == 0 || (length == 1 && component[0] == '.')) { continue; }
+		if (length == 2 && component[0] == '.' && component[1] == '.') {
+			if (descended || --depth < 0) { return EINVAL; }
+		}
+		else { descended = 1; }
 	}
+	
+	// there's no mkstemp for links, so reserve a name with a file and put the link in its place
+	char *temp = extract_temp_path(fullpath);
+	if (!temp) { return ENOMEM; }
+	int fd = mkstemp(temp);
+	if (fd < 0) { error = errno; }
 	else {
-		for (;;) {
-			struct archive_entry *entry;
-			r = archive_read_next_header(a, &entry);
-			if (r == ARCHIVE_EOF) { break; }
-			if (r != ARCHIVE_OK) {
-				fprintf(stderr, "archiving: %s", archive_error_string(a));
-				error = 1;
-				break;
-			}
-			
-			// update path to the full pathname
-			const char *pathname = archive_entry_pathname(entry);
-			char *fullpath = NULL;
-			asprintf(&fullpath, "%s/%s", relative_to ? relative_to : ".", pathname);
-			archive_entry_set_pathname(entry, fullpath);
-			
-			if (archive_write_header(ext, entry) != ARCHIVE_OK) {
-				fprintf(stderr, "archiving: %s", archive_error_string(ext));
+		close(fd);
+		if (unlink(temp) != 0 || symlink(target, temp) != 0) { error = errno; }
+		else if (rename(temp, fullpath) != 0) {
+			error = errno;
+			unlink(temp);
+		}
+	}
+	free(temp);
+	
+	return error;
+}
+
+static char *extract_temp_path(const char *fullpath) {
+	char *temp = NULL;
+	const char *name = strrchr(fullpath, '/');
+	int length = (int)(name - fullpath);
+	if (asprintf(&temp, "%.*s/.%s.XXXXXX", length, fullpath, name + 1) < 0) { return NULL; }
+	return temp;
+}
+
+
+#pragma mark -
+#pragma mark decompressing
+// ----------------------------------------------------------------------------------------------------
+// decompressing
+// ----------------------------------------------------------------------------------------------------
+
+static bzip2_reader *bzip2_reader_create(int fd) {
+	bzip2_reader *reader = calloc(1, sizeof(bzip2_reader));
+	if (!reader) { return NULL; }
+	
+	reader->fd = fd;
+	int success = 1;
+	for (size_t index = 0; success && index < kDecompressedBufferCount; index++) {
+		reader->buffers[index] = malloc(kDecompressedBufferSize);
+		success = (reader->buffers[index] != NULL);
+	}
+	pthread_mutex_init(&reader->lock, NULL);
+	pthread_cond_init(&reader->changed, NULL);
+	
+	success = success && (pthread_create(&reader->thread, NULL, bzip2_reader_thread, reader) == 0);
+	reader->started = success;
+	
+	if (!success) {
+		bzip2_reader_free(reader);
+		reader = NULL;
+	}
+	return reader;
+}
+
+static void bzip2_reader_free(bzip2_reader *reader) {
+	if (reader->started) {
+		pthread_mutex_lock(&reader->lock);
+		reader->stopping = 1;
+		pthread_cond_broadcast(&reader->changed);
+		pthread_mutex_unlock(&reader->lock);
+		pthread_join(reader->thread, NULL);
+	}
+	
+	for (size_t index = 0; index < kDecompressedBufferCount; index++) {
+		free(reader->buffers[index]);
+	}
+	pthread_cond_destroy(&reader->changed);
+	pthread_mutex_destroy(&reader->lock);
+	free(reader);
+}
+
+static ssize_t bzip2_reader_read(struct archive *a, void *context, const void **buffer) {
+	bzip2_reader *reader = context;
+	ssize_t length = 0;
+	int error = 0;
+	
+	pthread_mutex_lock(&reader->lock);
+	
+	// libarchive is done with the buffer it got last time, so the thread can reuse it
+	if (reader->holding) {
+		reader->holding = 0;
+		reader->consumed++;
+		pthread_cond_broadcast(&reader->changed);
+	}
+	
+	while (reader->produced == reader->consumed && !reader->finished) {
+		pthread_cond_wait(&reader->changed, &reader->lock);
+	}
+	if (reader->produced != reader->consumed) {
+		size_t index = reader->consumed % kDecompressedBufferCount;
+		*buffer = reader->buffers[index];
+		length = (ssize_t)reader->lengths[index];
+		reader->holding = 1;
+	}
+	else {
+		error = reader->error;
+	}
+	
+	pthread_mutex_unlock(&reader->lock);
+	
+	if (error) {
+		archive_set_error(a, error, "decompression failed");
+		return -1;
+	}
+	return length;
+}
+
+static void *bzip2_reader_thread(void *info) {
+	bzip2_reader *reader = info;
+	
+	bz_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	char *input = malloc(kReadBufferSize);
+	int error = input ? 0 : ENOMEM;
+	int in_stream = 0;
+	int stream_count = 0;
+	int end_of_file = 0;
+	char *output = NULL;
+	size_t index = 0;
+	size_t length = 0;
+	
+	while (error == 0) {
+		if (!output) {
+			pthread_mutex_lock(&reader->lock);
+			while (reader->produced - reader->consumed == kDecompressedBufferCount && !reader->stopping) {
+				pthread_cond_wait(&reader->changed, &reader->lock);
 			}
-			else {
-				const void *buff;
-				size_t size;
-				off_t offset;
-				
-				for (;;) {
-					r = archive_read_data_block(a, &buff, &size, &offset);
-					if (r == ARCHIVE_EOF) { r = ARCHIVE_OK; break; }
-					if (r != ARCHIVE_OK) {
-						fprintf(stderr, "archiving: %s", archive_error_string(ext));
-						break;
-					}
-					r = archive_write_data_block(ext, buff, size, offset);
-					if (r != ARCHIVE_OK) {
-						fprintf(stderr, "archiving: %s", archive_error_string(ext));
-						break;
-					}
-				}
-				if (r != ARCHIVE_OK) {
-					error = 1;
-					break;
-				}
-				
-				r = archive_write_finish_entry(ext);
-				if (r != ARCHIVE_OK) {
-					fprintf(stderr, "archiving: %s", archive_error_string(ext));
-					error = 1;
-					break;
-				}
+			int stopping = reader->stopping;
+			index = reader->produced % kDecompressedBufferCount;
+			pthread_mutex_unlock(&reader->lock);
+			if (stopping) { break; }
+			output = reader->buffers[index];
+			length = 0;
+		}
+		
+		if (stream.avail_in == 0 && !end_of_file) {
+			ssize_t amount = read(reader->fd, input, kReadBufferSize);
+			if (amount < 0 && errno == EINTR) { continue; }
+			if (amount < 0) { error = errno; break; }
+			if (amount == 0) { end_of_file = 1; }
+			stream.next_in = input;
+			stream.avail_in = (unsigned int)amount;
+		}
+		if (stream.avail_in == 0 && end_of_file) {
+			if (in_stream) { error = EIO; } // truncated
+			break;
+		}
+		
+		// the parallel compressor writes one bzip2 stream after another. anything after the last stream
+		// is padding that older versions of the archiver wrote.
+		if (!in_stream && stream_count > 0 && stream.next_in[0] != 'B') { break; }
+		if (!in_stream) {
+			if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK) { error = ENOMEM; break; }
+			in_stream = 1;
+		}
+		stream.next_out = output + length;
+		stream.avail_out = (unsigned int)(kDecompressedBufferSize - length);
+		int result = BZ2_bzDecompress(&stream);
+		length = kDecompressedBufferSize - stream.avail_out;
+		if (result == BZ_STREAM_END) {
+			BZ2_bzDecompressEnd(&stream);
+			in_stream = 0;
+			stream_count++;
+		}
+		else if (result != BZ_OK) {
+			error = (result == BZ_MEM_ERROR) ? ENOMEM : EIO;
+			break;
+		}
+		
+		if (length == kDecompressedBufferSize) {
+			pthread_mutex_lock(&reader->lock);
+			reader->lengths[index] = length;
+			reader->produced++;
+			pthread_cond_broadcast(&reader->changed);
+			pthread_mutex_unlock(&reader->lock);
+			output = NULL;
+		}
+	}
+	
+	if (in_stream) { BZ2_bzDecompressEnd(&stream); }
+	free(input);
+	
+	pthread_mutex_lock(&reader->lock);
+	if (output && length && error == 0) {
+		reader->lengths[index] = length;
+		reader->produced++;
+	}
+	reader->error = error;
+	reader->finished = 1;
+	pthread_cond_broadcast(&reader->changed);
+	pthread_mutex_unlock(&reader->lock);
+	
+	return NULL;
+}
+
+
+#pragma mark -
+#pragma mark reading
+// ----------------------------------------------------------------------------------------------------
+// reading
+// ----------------------------------------------------------------------------------------------------
+
+struct archiving_reader {
+	const unsigned char *bytes;
+	size_t length;
+	char *index_text;
+	archiving_index_entry *streams; // compressed offset and the uncompressed offset the stream starts at
+	size_t stream_count;
+	size_t stream_capacity;
+	archiving_index_entry *members; // data offset and length, sorted by path
+	size_t member_count;
+	size_t member_capacity;
+	void **contents; // the data of each member for archives without an index (the offset is the position)
+	size_t cached_stream;
+	char *cache;
+	size_t cache_length;
+	size_t cache_capacity;
+};
+
+/*!
+ \brief		Streaming decompression
+ \details	Feeds libarchive with the decompressed contents of a bzip2 archive in memory.
+ */
+typedef struct {
+	archiving_reader *reader;
+	bz_stream stream;
+	int in_stream;
+	char *buffer;
+} archiving_reader_pass;
+
+int archiving_reader_create(const void *bytes, size_t length, const char *index_name, archiving_reader **result) {
+	archiving_reader *reader = calloc(1, sizeof(archiving_reader));
+	if (!reader) { return ENOMEM; }
+	reader->bytes = bytes;
+	reader->length = length;
+	reader->cached_stream = SIZE_MAX;
+	
+	int error = archiving_reader_load_index(reader, index_name);
+	if (error == ENOENT) { error = archiving_reader_load_contents(reader); }
+	if (error == 0) {
+		qsort(reader->members, reader->member_count, sizeof(archiving_index_entry), archiving_reader_compare);
+		*result = reader;
+	}
+	else { archiving_reader_free(reader); }
+	
+	return error;
+}
+
+void archiving_reader_free(archiving_reader *reader) {
+	if (reader->contents) {
+		for (size_t index = 0; index < reader->member_count; index++) {
+			free(reader->contents[index]);
+			free((char *)reader->members[index].path);
+		}
+	}
+	free(reader->contents);
+	free(reader->index_text);
+	free(reader->streams);
+	free(reader->members);
+	free(reader->cache);
+	free(reader);
+}
+
+size_t archiving_reader_count(const archiving_reader *reader) {
+	return reader->member_count;
+}
+
+const char *archiving_reader_path(const archiving_reader *reader, size_t index) {
+	return reader->members[index].path;
+}
+
+int archiving_reader_read(archiving_reader *reader, const char *path, void **buffer, size_t *length) {
+	archiving_index_entry key = { .path = path };
+	archiving_index_entry *member = bsearch(&key, reader->members, reader->member_count,
+											sizeof(archiving_index_entry), archiving_reader_compare);
+	if (!member) { return ENOENT; }
+	
+	char *data = malloc(member->length ? (size_t)member->length : 1);
+	if (!data) { return ENOMEM; }
+	if (reader->contents) {
+		memcpy(data, reader->contents[member->offset], (size_t)member->length);
+		*buffer = data;
+		*length = (size_t)member->length;
+		return 0;
+	}
+	
+	// start at the last stream that begins before the data and continue through the following streams
+	// until all of the data has been copied
+	size_t low = 0;
+	size_t high = reader->stream_count;
+	while (high - low > 1) {
+		size_t middle = (low + high) / 2;
+		if (reader->streams[middle].length <= member->offset) { low = middle; }
+		else { high = middle; }
+	}
+	
+	int error = 0;
+	uint64_t position = member->offset;
+	uint64_t end = member->offset + member->length;
+	for (size_t index = low; error == 0 && position < end; index++) {
+		if (index >= reader->stream_count) { error = EIO; break; }
+		error = archiving_reader_cache_stream(reader, index);
+		if (error != 0) { break; }
+		
+		uint64_t start = reader->streams[index].length;
+		uint64_t stop = start + reader->cache_length;
+		if (position < start) { error = EIO; break; }
+		if (position >= stop) { continue; }
+		size_t amount = (size_t)(((end < stop) ? end : stop) - position);
+		memcpy(data + (position - member->offset), reader->cache + (position - start), amount);
+		position += amount;
+	}
+	
+	if (error != 0) { free(data); }
+	else {
+		*buffer = data;
+		*length = (size_t)member->length;
+	}
+	return error;
+}
+
+static int archiving_reader_load_index(archiving_reader *reader, const char *index_name) {
+	// the index is a tar entry in the last stream. streams start with a bzip2 header that's followed
+	// directly by the magic number of the first block.
+	static const unsigned char block_magic[] = { 0x31, 0x41, 0x59, 0x26, 0x53, 0x59 };
+	for (size_t remaining = (reader->length >= 10) ? reader->length - 9 : 0; remaining > 0; remaining--) {
+		size_t offset = remaining - 1;
+		const unsigned char *candidate = reader->bytes + offset;
+		if (candidate[0] != 'B' || candidate[1] != 'Z' || candidate[2] != 'h' ||
+			candidate[3] < '1' || candidate[3] > '9' ||
+			memcmp(candidate + 4, block_magic, sizeof(block_magic)) != 0) { continue; }
+		
+		// only the first header is decompressed to tell whether the stream holds the index. the single
+		// stream of an archive without one is then left alone until its contents are read.
+		char *tar = NULL;
+		size_t tar_length = 0;
+		size_t size = 0;
+		int error = archiving_reader_inflate(reader, offset, 512 + strlen(kArchivingIndexHeader) + 1,
+											 &tar, &tar_length, NULL);
+		if (error == 0) { error = archiving_reader_check_index(tar, tar_length, index_name, &size); }
+		free(tar);
+		tar = NULL;
+		if (error == 0) { error = archiving_reader_inflate(reader, offset, 512 + size, &tar, &tar_length, NULL); }
+		if (error == 0) { error = (tar_length == 512 + size) ? 0 : EINVAL; }
+		if (error == 0) { error = archiving_reader_parse_index(reader, tar + 512, size); }
+		free(tar);
+		if (error == 0) { return 0; }
+		if (error == ENOMEM) { return error; }
+		
+		// something that only looked like a stream or a stream without an index
+		reader->stream_count = 0;
+		reader->member_count = 0;
+		break;
+	}
+	return ENOENT;
+}
+
+static int archiving_reader_check_index(const char *tar, size_t tar_length, const char *index_name, size_t *size) {
+	// the index is a regular file with the given name that starts with the index header
+	size_t header_length = strlen(kArchivingIndexHeader);
+	if (tar_length < 512 + header_length + 1 || memcmp(tar + 257, "ustar", 5) != 0 ||
+		(tar[156] != '0' && tar[156] != '\0') ||
+		memcmp(tar + 512, kArchivingIndexHeader, header_length) != 0 || tar[512 + header_length] != '\n') {
+		return EINVAL;
+	}
+	
+	// the last component of a path is always in the name field, the prefix field only has directories
+	size_t name_length = strnlen(tar, 100);
+	size_t index_length = strlen(index_name);
+	if (name_length < index_length || memcmp(tar + name_length - index_length, index_name, index_length) != 0 ||
+		(name_length > index_length && tar[name_length - index_length - 1] != '/')) {
+		return EINVAL;
+	}
+	
+	char *end = NULL;
+	unsigned long long value = strtoull(tar + 124, &end, 8);
+	if (end == tar + 124 || value <= header_length || value > kArchivingIndexLimit) { return EINVAL; }
+	*size = (size_t)value;
+	return 0;
+}
+
+static int archiving_reader_parse_index(archiving_reader *reader, const char *text, size_t size) {
+	reader->index_text = malloc(size + 1);
+	if (!reader->index_text) { return ENOMEM; }
+	memcpy(reader->index_text, text, size);
+	reader->index_text[size] = '\0';
+	
+	// member paths point into the index text
+	char *line = reader->index_text + strlen(kArchivingIndexHeader) + 1;
+	while (*line) {
+		char *next = strchr(line, '\n');
+		if (!next) { return EINVAL; }
+		*next = '\0';
+		
+		char *end = NULL;
+		int error = 0;
+		if (strncmp(line, "stream ", 7) == 0) {
+			uint64_t offset = strtoull(line + 7, &end, 10);
+			uint64_t start = strtoull(end, &end, 10);
+			if (offset >= reader->length) { return EINVAL; }
+			error = archiving_index_add(&reader->streams, &reader->stream_count, &reader->stream_capacity,
+										offset, start, NULL);
+		}
+		else if (strncmp(line, "member ", 7) == 0) {
+			uint64_t offset = strtoull(line + 7, &end, 10);
+			uint64_t length = strtoull(end, &end, 10);
+			if (*end != ' ') { return EINVAL; }
+			error = archiving_index_add(&reader->members, &reader->member_count, &reader->member_capacity,
+										offset, length, end + 1);
+		}
+		if (error != 0) { return error; }
+		line = next + 1;
+	}
+	return 0;
+}
+
+static int archiving_reader_load_contents(archiving_reader *reader) {
+	// archives without an index are read in a single pass that keeps the data of every file
+	int error = 0;
+	archiving_reader_pass pass = { .reader = reader };
+	pass.buffer = malloc(kDecompressedBufferSize);
+	struct archive *a = archive_read_new();
+	if (!pass.buffer || !a) { error = ENOMEM; }
+	else {
+		archive_read_support_format_tar(a);
+		archive_read_support_compression_none(a);
+		if (archive_read_open(a, &pass, NULL, archiving_reader_pass_read, NULL) != ARCHIVE_OK) {
+			error = archiving_error(a);
+		}
+	}
+	
+	size_t contents_capacity = 0;
+	while (error == 0) {
+		struct archive_entry *entry = NULL;
+		int result = archive_read_next_header(a, &entry);
+		if (result == ARCHIVE_EOF) { break; }
+		if (result < ARCHIVE_WARN) { error = archiving_error(a); break; }
+		if (archive_entry_filetype(entry) != AE_IFREG) { continue; }
+		
+		size_t length = (size_t)archive_entry_size(entry);
+		char *path = malloc(strlen(archive_entry_pathname(entry)) + 1);
+		char *data = malloc(length ? length : 1);
+		if (path) { strcpy(path, archive_entry_pathname(entry)); }
+		if (path && data && contents_capacity == reader->member_count) {
+			contents_capacity = contents_capacity ? contents_capacity * 2 : 64;
+			void **contents = realloc(reader->contents, contents_capacity * sizeof(void *));
+			if (contents) { reader->contents = contents; }
+			else { contents_capacity = reader->member_count; }
+		}
+		if (!path || !data || contents_capacity == reader->member_count ||
+			archiving_index_add(&reader->members, &reader->member_count, &reader->member_capacity,
+								reader->member_count, length, path) != 0) {
+			free(path);
+			free(data);
+			error = ENOMEM;
+			break;
+		}
+		reader->contents[reader->member_count - 1] = data;
+		
+		for (size_t position = 0; position < length;) {
+			ssize_t amount = archive_read_data(a, data + position, length - position);
+			if (amount <= 0) { error = (amount < 0) ? archiving_error(a) : EIO; break; }
+			position += (size_t)amount;
+		}
+	}
+	
+	if (a) {
+		archive_read_close(a);
+		archive_read_finish(a);
+	}
+	if (pass.in_stream) { BZ2_bzDecompressEnd(&pass.stream); }
+	free(pass.buffer);
+	
+	return error;
+}
+
+static ssize_t archiving_reader_pass_read(struct archive *a, void *context, const void **buffer) {
+	archiving_reader_pass *pass = context;
+	archiving_reader *reader = pass->reader;
+	
+	pass->stream.next_out = pass->buffer;
+	pass->stream.avail_out = (unsigned int)kDecompressedBufferSize;
+	while (pass->stream.avail_out == kDecompressedBufferSize) {
+		if (!pass->in_stream) {
+			// the next stream starts where the last one ended, anything else is padding
+			const unsigned char *next_in = (const unsigned char *)pass->stream.next_in;
+			size_t offset = next_in ? (size_t)(next_in - reader->bytes) : 0;
+			if (offset >= reader->length || reader->bytes[offset] != 'B') { break; }
+			char *next_out = pass->stream.next_out;
+			unsigned int avail_out = pass->stream.avail_out;
+			memset(&pass->stream, 0, sizeof(bz_stream));
+			if (BZ2_bzDecompressInit(&pass->stream, 0, 0) != BZ_OK) {
+				archive_set_error(a, ENOMEM, "decompression failed");
+				return -1;
 			}
-			
-			free(fullpath);
+			pass->in_stream = 1;
+			pass->stream.next_in = (char *)reader->bytes + offset;
+			pass->stream.avail_in = (unsigned int)(reader->length - offset);
+			pass->stream.next_out = next_out;
+			pass->stream.avail_out = avail_out;
+		}
+		int result = BZ2_bzDecompress(&pass->stream);
+		if (result == BZ_STREAM_END) {
+			BZ2_bzDecompressEnd(&pass->stream);
+			pass->in_stream = 0;
+		}
+		else if (result != BZ_OK || (pass->stream.avail_in == 0 && pass->stream.avail_out != 0)) {
+			archive_set_error(a, (result == BZ_MEM_ERROR) ? ENOMEM : EIO, "decompression failed");
+			return -1;
 		}
 	}
-	archive_read_close(a);
-	archive_read_finish(a);
 	
+	*buffer = pass->buffer;
+	return (ssize_t)(kDecompressedBufferSize - pass->stream.avail_out);
+}
+
+static int archiving_reader_cache_stream(archiving_reader *reader, size_t index) {
+	if (reader->cached_stream == index) { return 0; }
+	reader->cached_stream = SIZE_MAX;
+	int error = archiving_reader_inflate(reader, (size_t)reader->streams[index].offset, SIZE_MAX,
+										 &reader->cache, &reader->cache_length, &reader->cache_capacity);
+	if (error == 0) { reader->cached_stream = index; }
 	return error;
 }
 
+static int archiving_reader_inflate(archiving_reader *reader, size_t offset, size_t limit,
+									char **buffer, size_t *length, size_t *capacity) {
+	// decompresses a single stream (or its first bytes up to the limit) into a buffer that's grown as needed
+	size_t local_capacity = 0;
+	if (!capacity) {
+		capacity = &local_capacity;
+		*buffer = NULL;
+	}
+	if (*capacity == 0) {
+		size_t initial = (limit < kDecompressedBufferSize) ? limit : kDecompressedBufferSize;
+		free(*buffer);
+		*buffer = malloc(initial);
+		if (!*buffer) { return ENOMEM; }
+		*capacity = initial;
+	}
+	
+	bz_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK) { return ENOMEM; }
+	stream.next_in = (char *)reader->bytes + offset;
+	stream.avail_in = (unsigned int)(reader->length - offset);
+	
+	int error = 0;
+	size_t produced = 0;
+	for (;;) {
+		if (produced == limit) { break; }
+		if (produced == *capacity) {
+			size_t grown_capacity = (*capacity > limit / 2) ? limit : *capacity * 2;
+			char *grown = realloc(*buffer, grown_capacity);
+			if (!grown) { error = ENOMEM; break; }
+			*buffer = grown;
+			*capacity = grown_capacity;
+		}
+		stream.next_out = *buffer + produced;
+		stream.avail_out = (unsigned int)(*capacity - produced);
+		int result = BZ2_bzDecompress(&stream);
+		produced = *capacity - stream.avail_out;
+		if (result == BZ_STREAM_END) { break; }
+		if (result != BZ_OK || (stream.avail_in == 0 && stream.avail_out != 0)) {
+			error = (result == BZ_MEM_ERROR) ? ENOMEM : EIO;
+			break;
+		}
+	}
+	BZ2_bzDecompressEnd(&stream);
+	
+	*length = produced;
+	return error;
+}
+
+static int archiving_reader_compare(const void *first, const void *second) {
+	return strcmp(((const archiving_index_entry *)first)->path, ((const archiving_index_entry *)second)->path);
+}
+
 #endif
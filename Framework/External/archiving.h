@@ -18,18 +18,145 @@
 #if defined(REDFOUNDATION_LEOPARD_BASE) // not supported
 #else
 
+#include <stddef.h>
+
+/*!
+ \brief		Archive compression
+ \details	Both produce archives that can be extracted as tar bzip2 archives. Parallel compression
+			splits the archive into blocks that are compressed as separate bzip2 streams on all
+			processors (the way pbzip2 does).
+ */
+typedef enum {
+	archiving_compression_bzip2,
+	archiving_compression_parallel_bzip2,
+} archiving_compression;
+
+/*!
+ \brief		Archive output
+ \details	Called with each piece of a compressed archive in order. Returns 0 on success or an errno value
+			to stop creating the archive.
+ */
+typedef int (*archiving_output)(void *context, const void *buffer, size_t length);
+
+/*!
+ \brief		Archive item
+ \details	A file that's added to an archive under the given path. The contents are read from the source
+			path or, if there's no source path, taken from the data. Directories leading to the archive path
+			are added to the archive automatically.
+ */
+typedef struct {
+	const char *archive_path;
+	const char *source_path;
+	const void *data;
+	size_t length;
+} archiving_item;
+
 /*!
  \brief		Create a bzip2 compressed archive
  \details	Create a tar bzip2 archive from the pathnames relative to a given path and write the archive
-			to a file descriptor. Pathnames should be NULL terminated.
+			to a file descriptor. Pathnames should be NULL terminated. Returns 0 on success or the errno
+			value of the first failure.
  */
 int archive_create_tar_bzip2(int fd, const char *relative_to, const char **pathnames);
 
+/*!
+ \brief		Create a compressed archive
+ \details	Create a tar archive from the pathnames relative to a given path, compress it in the given
+			way, and write the archive to a file descriptor. Pathnames should be NULL terminated. Returns 0
+			on success or the errno value of the first failure (reading a file, writing the archive, or
+			compressing it), in which case the archive is incomplete. Each call keeps its own state, so
+			archives can be created on several threads at once.
+ */
+int archive_create_tar(int fd, const char *relative_to, const char **pathnames, archiving_compression compression);
+
+/*!
+ \brief		Create a compressed archive from items
+ \details	Create a tar archive with the items, compress it in the given way, and pass it to the output
+			as it's created. No copies of the items are made, so the cost is reading each source file once
+			plus compressing. Returns 0 on success or the errno value of the first failure (including ones
+			returned by the output).
+ */
+int archive_create_tar_items(const archiving_item *items, size_t count, archiving_compression compression,
+							 archiving_output output, void *context);
+
+/*!
+ \brief		Create an indexed archive from items
+ \details	Like archive_create_tar_items with parallel compression, but the archive ends with an extra
+			item at the index path that lists where each bzip2 stream and each item's data are in the
+			archive. The index is in a bzip2 stream of its own, so readers can find it at the end of the
+			archive and then decompress just the streams holding the items they need. Archives with an
+			index are still regular tar bzip2 archives.
+ */
+int archive_create_indexed_tar_items(const archiving_item *items, size_t count, const char *index_path,
+									 archiving_output output, void *context);
+
+/*!
+ \brief		File descriptor output
+ \details	An output that writes to the file descriptor pointed to by the context.
+ */
+int archiving_output_fd(void *context, const void *buffer, size_t length);
+
 /*!
  \brief		Extract a bzip2 compressed archive
  \details	Extracts a tar bzip2 archive by reading from a file descriptor and writing the archive out
-			relative to a given path.
+			relative to a given (existing) path. Decompression runs on a separate thread while the files
+			are written. Each file is written to a temporary name in its directory and renamed into place
+			when it's complete. Entries are never written through links, and links have to point inside
+			the path. Returns 0 on success or the errno value of the first failure (EINVAL for entries
+			or links that would end up outside of the path, EIO for damaged archives).
  */
 int archive_extract_tar_bzip2(int fd, const char *relative_to);
 
+/*!
+ \brief		Check a path inside a directory
+ \details	Checks a path that came from an archive (or something listing its contents) before it's used
+			relative to a given path. The path has to be relative and can't have empty, . or .. components,
+			and none of the parts of it that exist in the given path can be links. Returns 0 if the path is
+			fine, EINVAL if it isn't or the errno value of the first failure looking at it.
+ */
+int archive_check_path(const char *relative_to, const char *pathname);
+
+/*!
+ \brief		Archive reader
+ \details	Reads single files from a tar bzip2 archive in memory without extracting it. For archives
+			with an index, only the index is decompressed up front and each file is read by decompressing
+			the streams that hold it. Other archives are decompressed in a single pass that keeps the
+			contents of every file. A reader can only be used on one thread at a time.
+ */
+typedef struct archiving_reader archiving_reader;
+
+/*!
+ \brief		Create a reader
+ \details	The bytes must stay valid until the reader is freed. The index is expected at the end of the
+			archive as written by archive_create_indexed_tar_items, with the given file name (the last
+			component of its path). Returns 0 on success or an errno value (EIO for damaged archives).
+ */
+int archiving_reader_create(const void *bytes, size_t length, const char *index_name, archiving_reader **reader);
+
+/*!
+ \brief		Free a reader
+ \details	Free a reader
+ */
+void archiving_reader_free(archiving_reader *reader);
+
+/*!
+ \brief		Number of files
+ \details	The number of regular files in the archive (not counting an index).
+ */
+size_t archiving_reader_count(const archiving_reader *reader);
+
+/*!
+ \brief		Path of a file
+ \details	Files are sorted by path. The path is owned by the reader.
+ */
+const char *archiving_reader_path(const archiving_reader *reader, size_t index);
+
+/*!
+ \brief		Read a file
+ \details	Returns the contents of the file at the given path in the archive in a buffer that must be
+			freed by the caller. Returns 0 on success, ENOENT if there's no such file or another errno
+			value if it couldn't be read.
+ */
+int archiving_reader_read(archiving_reader *reader, const char *path, void **buffer, size_t *length);
+
 #endif
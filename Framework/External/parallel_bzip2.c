@@ -0,0 +1,274 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#if defined(REDFOUNDATION_LEOPARD_BASE) // not supported
+#elif defined(REDLINKED_ARCHIVING) // not needed, linked in
+#else
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <bzlib.h>
+
+#import "parallel_bzip2.h"
+
+static const size_t kBlockSize = 900 * 1000; // the input that bzip2 -9 puts in a single block
+static const int kBlocksPerThread = 2; // blocks that can be in flight for each thread
+static const int kCompressionLevel = 9;
+
+enum {
+	block_free,
+	block_queued,
+	block_compressing,
+	block_done,
+};
+
+struct parallel_bzip2_block {
+	int state;
+	int error;
+	char *input;
+	size_t input_length;
+	char *output;
+	unsigned int output_length;
+};
+
+struct parallel_bzip2 {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	pthread_t *threads;
+	int thread_count;
+	struct parallel_bzip2_block *blocks;
+	size_t block_count;
+	size_t filled;		// number of blocks handed to the threads
+	size_t written;		// number of blocks written to the output
+	int filling;		// whether the block after the handed over blocks has data in it
+	int stopping;
+	int error;
+	parallel_bzip2_output output;
+	parallel_bzip2_stream_handler stream_handler;
+	void *context;
+};
+
+static void *parallel_bzip2_thread(void *info);
+static int parallel_bzip2_submit(parallel_bzip2 *compressor);
+static int parallel_bzip2_write_done(parallel_bzip2 *compressor, int wait, size_t until);
+static void parallel_bzip2_free(parallel_bzip2 *compressor);
+
+
+#pragma mark -
+#pragma mark creating
+// ----------------------------------------------------------------------------------------------------
+// creating
+// ----------------------------------------------------------------------------------------------------
+
+parallel_bzip2 *parallel_bzip2_create(parallel_bzip2_output output, void *context, int threads) {
+	if (threads <= 0) {
+		long processors = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (processors > 0) ? (int)processors : 1;
+	}
+	
+	parallel_bzip2 *compressor = calloc(1, sizeof(parallel_bzip2));
+	if (!compressor) { return NULL; }
+	
+	compressor->output = output;
+	compressor->context = context;
+	compressor->block_count = (size_t)threads * kBlocksPerThread;
+	compressor->blocks = calloc(compressor->block_count, sizeof(struct parallel_bzip2_block));
+	compressor->threads = calloc((size_t)threads, sizeof(pthread_t));
+	pthread_mutex_init(&compressor->lock, NULL);
+	pthread_cond_init(&compressor->work, NULL);
+	pthread_cond_init(&compressor->done, NULL);
+	
+	int success = (compressor->blocks && compressor->threads);
+	for (int thread = 0; success && thread < threads; thread++) {
+		success = (pthread_create(&compressor->threads[thread], NULL, parallel_bzip2_thread, compressor) == 0);
+		if (success) { compressor->thread_count++; }
+	}
+	
+	if (!success) {
+		parallel_bzip2_free(compressor);
+		compressor = NULL;
+	}
+	return compressor;
+}
+
+static void parallel_bzip2_free(parallel_bzip2 *compressor) {
+	pthread_mutex_lock(&compressor->lock);
+	compressor->stopping = 1;
+	pthread_cond_broadcast(&compressor->work);
+	pthread_mutex_unlock(&compressor->lock);
+	for (int thread = 0; thread < compressor->thread_count; thread++) {
+		pthread_join(compressor->threads[thread], NULL);
+	}
+	
+	for (size_t index = 0; compressor->blocks && index < compressor->block_count; index++) {
+		free(compressor->blocks[index].input);
+		free(compressor->blocks[index].output);
+	}
+	pthread_cond_destroy(&compressor->done);
+	pthread_cond_destroy(&compressor->work);
+	pthread_mutex_destroy(&compressor->lock);
+	free(compressor->blocks);
+	free(compressor->threads);
+	free(compressor);
+}
+
+
+#pragma mark -
+#pragma mark compressing
+// ----------------------------------------------------------------------------------------------------
+// compressing
+// ----------------------------------------------------------------------------------------------------
+
+int parallel_bzip2_write(parallel_bzip2 *compressor, const void *buffer, size_t length) {
+	const char *bytes = buffer;
+	while (length && !compressor->error) {
+		struct parallel_bzip2_block *block = &compressor->blocks[compressor->filled % compressor->block_count];
+		
+		// a block is only reused once it's been written out, which waits for the oldest block when
+		// all of them are in flight
+		if (!compressor->filling) {
+			if (compressor->filled >= compressor->block_count) {
+				size_t until = compressor->filled + 1 - compressor->block_count;
+				int error = parallel_bzip2_write_done(compressor, 1, until);
+				if (error) { return error; }
+			}
+			if (!block->input) {
+				block->input = malloc(kBlockSize);
+				block->output = malloc(kBlockSize + kBlockSize / 100 + 600);
+				if (!block->input || !block->output) { return (compressor->error = ENOMEM); }
+			}
+			block->input_length = 0;
+			compressor->filling = 1;
+		}
+		
+		size_t amount = kBlockSize - block->input_length;
+		if (amount > length) { amount = length; }
+		memcpy(block->input + block->input_length, bytes, amount);
+		block->input_length += amount;
+		bytes += amount;
+		length -= amount;
+		
+		if (block->input_length == kBlockSize) {
+			int error = parallel_bzip2_submit(compressor);
+			if (error) { return error; }
+		}
+	}
+	return compressor->error;
+}
+
+void parallel_bzip2_set_stream_handler(parallel_bzip2 *compressor, parallel_bzip2_stream_handler handler) {
+	compressor->stream_handler = handler;
+}
+
+int parallel_bzip2_flush(parallel_bzip2 *compressor) {
+	if (!compressor->error && compressor->filling) {
+		parallel_bzip2_submit(compressor);
+	}
+	if (!compressor->error) {
+		parallel_bzip2_write_done(compressor, 1, compressor->filled);
+	}
+	return compressor->error;
+}
+
+int parallel_bzip2_finish(parallel_bzip2 *compressor) {
+	int error = parallel_bzip2_flush(compressor);
+	parallel_bzip2_free(compressor);
+	return error;
+}
+
+static int parallel_bzip2_submit(parallel_bzip2 *compressor) {
+	pthread_mutex_lock(&compressor->lock);
+	compressor->blocks[compressor->filled % compressor->block_count].state = block_queued;
+	compressor->filled++;
+	compressor->filling = 0;
+	pthread_cond_signal(&compressor->work);
+	pthread_mutex_unlock(&compressor->lock);
+	
+	// write out whatever is already finished without waiting for anything
+	return parallel_bzip2_write_done(compressor, 0, compressor->filled);
+}
+
+static int parallel_bzip2_write_done(parallel_bzip2 *compressor, int wait, size_t until) {
+	while (!compressor->error && compressor->written < until && compressor->written < compressor->filled) {
+		struct parallel_bzip2_block *block = &compressor->blocks[compressor->written % compressor->block_count];
+		
+		pthread_mutex_lock(&compressor->lock);
+		while (wait && block->state != block_done) {
+			pthread_cond_wait(&compressor->done, &compressor->lock);
+		}
+		int ready = (block->state == block_done);
+		pthread_mutex_unlock(&compressor->lock);
+		if (!ready) { break; }
+		
+		// the threads leave blocks that are done alone, so the output happens without the lock
+		compressor->error = block->error;
+		if (!compressor->error && compressor->stream_handler) {
+			compressor->stream_handler(compressor->context, block->input_length);
+		}
+		if (!compressor->error) {
+			compressor->error = compressor->output(compressor->context, block->output, block->output_length);
+		}
+		
+		pthread_mutex_lock(&compressor->lock);
+		block->state = block_free;
+		compressor->written++;
+		pthread_mutex_unlock(&compressor->lock);
+	}
+	return compressor->error;
+}
+
+static void *parallel_bzip2_thread(void *info) {
+	parallel_bzip2 *compressor = info;
+	
+	pthread_mutex_lock(&compressor->lock);
+	for (;;) {
+		// take the oldest queued block so that blocks finish roughly in the order they're written
+		struct parallel_bzip2_block *block = NULL;
+		for (size_t sequence = compressor->written; !block && sequence < compressor->filled; sequence++) {
+			struct parallel_bzip2_block *candidate = &compressor->blocks[sequence % compressor->block_count];
+			if (candidate->state == block_queued) { block = candidate; }
+		}
+		if (!block) {
+			if (compressor->stopping) { break; }
+			pthread_cond_wait(&compressor->work, &compressor->lock);
+			continue;
+		}
+		
+		block->state = block_compressing;
+		pthread_mutex_unlock(&compressor->lock);
+		
+		unsigned int length = (unsigned int)(kBlockSize + kBlockSize / 100 + 600);
+		int result = BZ2_bzBuffToBuffCompress(block->output, &length, block->input,
+											  (unsigned int)block->input_length, kCompressionLevel, 0, 0);
+		
+		pthread_mutex_lock(&compressor->lock);
+		block->output_length = length;
+		block->error = (result == BZ_OK) ? 0 : ((result == BZ_MEM_ERROR) ? ENOMEM : EIO);
+		block->state = block_done;
+		pthread_cond_broadcast(&compressor->done);
+	}
+	pthread_mutex_unlock(&compressor->lock);
+	
+	return NULL;
+}
+
+#endif
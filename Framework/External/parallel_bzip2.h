@@ -0,0 +1,81 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#if defined(REDFOUNDATION_LEOPARD_BASE) // not supported
+#else
+
+#include <stddef.h>
+
+/*!
+ \brief		Parallel bzip2 compressor
+ \details	Splits the data written to it into blocks and compresses each block as an independent bzip2
+			stream on its own thread. The streams are written out in order, so the output is a series of
+			concatenated bzip2 streams (the same thing pbzip2 produces) that any bzip2 decompressor can
+			read.
+ */
+typedef struct parallel_bzip2 parallel_bzip2;
+
+/*!
+ \brief		Output function
+ \details	Called with compressed data in order. Should return 0 on success or an errno value.
+ */
+typedef int (*parallel_bzip2_output)(void *context, const void *buffer, size_t length);
+
+/*!
+ \brief		Stream handler
+ \details	Called right before each bzip2 stream is passed to the output with the number of uncompressed
+			bytes the stream holds.
+ */
+typedef void (*parallel_bzip2_stream_handler)(void *context, size_t length);
+
+/*!
+ \brief		Create a compressor
+ \details	Creates a compressor that uses the given number of threads (or one for each processor when
+			threads is 0) and passes compressed data to the output function. Returns NULL if the
+			compressor could not be created.
+ */
+parallel_bzip2 *parallel_bzip2_create(parallel_bzip2_output output, void *context, int threads);
+
+/*!
+ \brief		Compress data
+ \details	Adds data to compress. Returns 0 on success or an errno value if compressing or writing
+			previous data failed.
+ */
+int parallel_bzip2_write(parallel_bzip2 *compressor, const void *buffer, size_t length);
+
+/*!
+ \brief		Set the stream handler
+ \details	The handler is called with the same context as the output function.
+ */
+void parallel_bzip2_set_stream_handler(parallel_bzip2 *compressor, parallel_bzip2_stream_handler handler);
+
+/*!
+ \brief		Flush compressed data
+ \details	Compresses and writes out all data written so far, so that the data written next starts a new
+			bzip2 stream. Returns 0 on success or an errno value if compressing or writing failed.
+ */
+int parallel_bzip2_flush(parallel_bzip2 *compressor);
+
+/*!
+ \brief		Finish compressing
+ \details	Compresses and writes out any remaining data and frees the compressor. Returns 0 on success or
+			an errno value if compressing or writing failed at any point.
+ */
+int parallel_bzip2_finish(parallel_bzip2 *compressor);
+
+#endif
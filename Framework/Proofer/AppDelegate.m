@@ -16,7 +16,7 @@
 // 
 
 #import "AppDelegate.h"
-#import "FRFileManagerArchivingAdditions.h"
+#import "FRTranslationPackage.h"
 #import "FRProofer.h"
 #import "FRBundleAdditions.h"
 
@@ -25,6 +25,7 @@
 - (void)importFromStringsFileAtPath:(NSString *)fromPath toPath:(NSString *)toPath;
 - (BOOL)validateInputs;
 - (void)presentSavePanel;
+- (NSString *)packagesDirectory;
 @end
 
 @implementation AppDelegate
@@ -118,9 +119,13 @@
 	NSFileManager *fileManager = [NSFileManager defaultManager];
 	NSError *error = nil;
 
-	NSString *exportPath = [[self newTempDir] stringByAppendingPathComponent:@"extracted"];
-	[fileManager uncompressItemAtPath:path to:exportPath error:&error];
-	if (error) { 
+	// every package is applied to a copy kept for the application and language it translates, which is
+	// what a delta package (holding only the files changed since the previous one) is built on. packages
+	// that don't say what they translate get a copy of their own that's only kept while they're proofed.
+	NSString *identifier = [FRTranslationPackage identifierOfPackageAtPath:path];
+	NSString *exportPath = [[self packagesDirectory] stringByAppendingPathComponent:
+							identifier ? identifier : [[NSProcessInfo processInfo] globallyUniqueString]];
+	if (![FRTranslationPackage applyPackageAtPath:path toDirectory:exportPath error:&error]) { 
 		NSAlert *alert = [NSAlert alertWithMessageText:@"Error" defaultButton:NULL 
 									   alternateButton:NULL otherButton:NULL 
 							 informativeTextWithFormat:@"Error decompressing translation archive."];
@@ -145,22 +150,16 @@
 			[self importFromStringsFileAtPath:fullFilePath toPath:newFilePath];
 		}
 	}
-	[fileManager removeItemAtPath:[exportPath stringByDeletingLastPathComponent] error:NULL];
+	
+	if (!identifier) { [fileManager removeItemAtPath:exportPath error:NULL]; }
 }
 
-- (NSString *)newTempDir {
-	NSString *tempDirectory = NSTemporaryDirectory();
-	char *dirname = NULL;
-	asprintf(&dirname, "%sPROOF_TEMP.XXXXX", [tempDirectory fileSystemRepresentation]);
-	char *chdir_location = mkdtemp(dirname);
-	
-	if (!chdir_location) {
-		NSLog(@"Temp directory creation failed.");
-	}
-	
-	tempDirectory = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:chdir_location
-																				length:strlen(chdir_location)];
-	return tempDirectory;
+- (NSString *)packagesDirectory {
+	NSArray *paths = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES);
+	NSString *directory = [[paths lastObject] stringByAppendingPathComponent:@"Proofer/Packages"];
+	[[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES
+											   attributes:nil error:NULL];
+	return directory;
 }
 
 
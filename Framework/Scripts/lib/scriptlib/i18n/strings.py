@@ -21,6 +21,28 @@ import sys
 import os
 import re
 
+UNTRANSLATED = 'untranslated'
+TRANSLATED = 'translated'
+EQUAL = 'equal'
+
+def translation_status(key, trans, comment):
+  """
+  Classifies an entry. It's translated when the translation differs from the
+  key. Otherwise it's untranslated unless the comment right before it (which
+  may be None) contains ==, which marks it as meant to be equal. This is the
+  same rule the framework uses, where interface builder comments count too.
+  """
+  if key != trans: return TRANSLATED
+  elif comment is not None and '==' in comment: return EQUAL
+  else: return UNTRANSLATED
+
+def count_statuses(translations):
+  'Counts the entries of each status in an iterable of Parser.Translation objects'
+  counts = { UNTRANSLATED: 0, TRANSLATED: 0, EQUAL: 0 }
+  for value in translations:
+    counts[value.status()] += 1
+  return counts
+
 class Strings(object):
   def __init__(self, name, lang, config, resources=None):
     self.name = clean_name(name)
@@ -80,6 +102,10 @@ class Strings(object):
           value.key = value.trans
       self._index[value.key] = value
   
+  def counts(self):
+    'Counts of untranslated, translated and equal entries'
+    return count_statuses(self.translation().index.values())
+  
   def normalize(self, source=None):
     """
     Normalizes strings to an expected format. If given, it will use source
@@ -154,27 +180,35 @@ class Parser(object):
     self.index = {}
     
     comments = []
+    last_comment = None
     for line in self.lines:
       match = re.search(Parser.LINE, line, re.UNICODE)
       if match:
         key = match.group(1)
         trans = match.group(2)
-        self.index[key] = Parser.Translation(key, trans, comments, linenumber)
+        self.index[key] = Parser.Translation(key, trans, comments, linenumber, last_comment)
         comments = []
+        last_comment = None
       else:
+        match = re.search(Parser.COMMENT, line, re.UNICODE)
+        if match: last_comment = match.group(1)
+        elif line.strip(): last_comment = None
         if not re.match(Parser.INTERFACE, line, re.UNICODE):
-          match = re.search(Parser.COMMENT, line, re.UNICODE)
           if match: comments.append(match.group(1))
-          else: comments = []
+          elif line.strip(): comments = []
       linenumber += 1
   
   @staticmethod
   def cmp(a, b): return cmp(a.linenum, b.linenum)
   
   class Translation(object):
-    def __init__(self, key, trans, comments, linenum):
+    def __init__(self, key, trans, comments, linenum, last_comment=None):
       self.key = key
       self.trans = trans
       self.comments = comments
       self.linenum = linenum
+      self.last_comment = last_comment
+    
+    def status(self):
+      return translation_status(self.key, self.trans, self.last_comment)
   
\ No newline at end of file
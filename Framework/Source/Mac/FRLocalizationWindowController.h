@@ -16,12 +16,31 @@
 // 
 
 @class
-	FRTranslationContainer;
+	FRTranslationContainer,
+	FRTranslationMemoryIndex,
+	FRTranslationSearchIndex,
+	FRStrings;
 
 
 @interface FRLocalizationWindowController : NSWindowController {
 	NSTimer *saveTimer;
+	struct FRStringsLexer *lexer;
+	FRStrings *editedStrings;
+	NSString *editedPath;
+	uint32_t savedGeneration;
+	BOOL structureChanged;
+	dispatch_queue_t saveQueue;
+	NSMutableDictionary *pendingSaves;
+	NSMutableDictionary *diskHashes;
+	NSMutableDictionary *visibleEntries;
+	NSMutableData *entryIndex;
+	NSUInteger loadGeneration;
 	CGFloat initialLanguagePosition;
+	FRTranslationSearchIndex *searchIndex;
+	NSString *searchQuery;
+	NSDictionary *searchMatches;
+	NSSearchField *searchField;
+	FRTranslationMemoryIndex *memoryIndex;
 
 	IBOutlet NSArrayController *stringsFiles;
 	IBOutlet NSArrayController *languages;
@@ -41,6 +60,7 @@
 
 - (IBAction)packageStringsFiles:(id)sender;
 - (IBAction)sendToDevice:(id)sender;
+- (IBAction)searchStringsFiles:(id)sender;
 
 @end
 
@@ -16,6 +16,7 @@
 // 
 
 #include <sys/stat.h>
+#include <CommonCrypto/CommonDigest.h>
 
 #import "FRLocalizationWindowController.h"
 #import "FRUntranslatedCountCell.h"
@@ -23,9 +24,14 @@
 #import "FRLocalizationBundleAdditions__.h"
 #import "FRTranslationContainer__.h"
 #import "FRTranslationInfo__.h"
+#import "FRTranslationMemoryIndex.h"
+#import "FRTranslationPackage.h"
+#import "FRTranslationSearchIndex.h"
 #import "FRBundleAdditions.h"
 #import "FRFileManagerArchivingAdditions.h"
 #import "FRStrings.h"
+#import "FRStringsJournal.h"
+#import "FRStringsTokenizer.h"
 
 #define COMMENT [NSColor colorWithCalibratedWhite:0.70 alpha:1]
 #define TRANSLATION [NSColor colorWithCalibratedRed:0.75 green:0.72 blue:0.65 alpha:1.00]
@@ -35,36 +41,75 @@
 #define UNKNOWN_BACKGROUND [NSColor colorWithCalibratedRed:0.72 green:0.12 blue:0.20 alpha:1.00]
 
 static NSString * gSystemLanguage = nil;
+static NSDictionary * gCommentAttributes = nil;
+static NSDictionary * gEntryAttributes = nil;
+static NSDictionary * gCompleteAttributes = nil;
+static NSDictionary * gIncompleteAttributes = nil;
+static NSDictionary * gUnknownAttributes = nil;
 static NSString * const kPathKey = @"path"; 
 static NSString * const kDisplayNameKey = @"displayName"; 
 static NSString * const kFileNameKey = @"fileName"; 
 static NSString * const kBundleKey = @"bundleName"; 
 static NSString * const FRLocalizationTypePreferenceKey = @"FRLocalizationType";
+static NSString * const FRLocalizationDeltaPackagesPreferenceKey = @"FRLocalizationDeltaPackages";
 static void * const FRStringsFileCollectionDidChangeContext = @"FRStringsFileCollectionDidChangeContext";
 static void * const FRStringsFileDidChangeContext = @"FRStringsFileDidChangeContext";
 static void * const FRSelectedContainerDidChangeContext = @"FRSelectedContainerDidChangeContext";
 static void * const FRSelectedLanguageDidChangeContext = @"FRSelectedLanguageDidChangeContext";
+static NSString * const kPendingStringsKey = @"strings";
+static NSString * const kPendingChangesKey = @"changes";
+static NSString * const kPendingRewriteKey = @"rewrite";
 static const NSTimeInterval kSaveTimeout = 0.5;
+static const NSUInteger kJournalCompactionThreshold = 128;
+static const unsigned long long kChunkedLoadingThreshold = 512 * 1024;
+static const NSUInteger kFirstBatchLength = 200;
+static const NSUInteger kBatchLength = 2000;
+static const NSUInteger kSearchResultLimit = 5000;
+static const CGFloat kSearchFieldHeight = 22;
+static const CGFloat kSearchFieldSpacing = 8;
+static const NSUInteger kSuggestionLimit = 5;
 static const NSSize kTextContainerInset = { .width = 15, .height = 10 };
 NSString * const FRLocalizationErrorDomain = @"FRLocalizationErrorDomain";
 
 @protocol FRApplicationDelegateOptional <NSObject>
 - (void)sendStringsFilesToDevice:(NSArray *)objects;
+- (void)sendStringsEdits:(NSDictionary *)edits inStringsFile:(FRTranslationInfo *)info;
 @end
 
 @interface FRLocalizationWindowController ()
 - (void)loadLanguages;
 - (void)loadStringsFiles;
 - (void)loadTextView;
+- (void)addSearchField;
+- (void)buildSearchIndex;
+- (void)updateSearchResults;
+- (void)appendLoadedContents:(NSString *)contents entryLocations:(NSData *)locations;
+- (void)finishLoadingStrings:(FRStrings *)strings path:(NSString *)path;
+- (void)scrollToEntryAtIndex:(NSUInteger)index;
+- (NSString *)visibleEntryString;
 - (void)updateSendButtonVisibility;
 - (void)updateContainersPopupVisibility;
 - (void)persistSelectedLanguage;
+- (void)saveSelectedStringsFile;
+- (void)sendEdits:(NSSet *)changes inStrings:(FRStrings *)strings path:(NSString *)path;
+- (BOOL)savePendingChanges:(NSDictionary *)pending toPath:(NSString *)path error:(NSError **)error;
+- (BOOL)writeStrings:(FRStrings *)strings toPath:(NSString *)path error:(NSError **)error;
+- (void)compactStringsFileAtPath:(NSString *)path;
+- (void)compactStringsFiles:(NSArray *)infos completionHandler:(void (^)(void))handler;
+- (void)editedStringsFileWillClose:(NSNotification *)notification;
+- (NSData *)diskHashForPath:(NSString *)path;
+- (void)updateEditedStrings;
+- (NSArray *)commentsForLineAtIndex:(NSUInteger)index inText:(NSString *)text;
 - (void)processEditing:(NSNotification *)notification;
-- (void)colorTextInRange:(NSRange)range ofString:(NSMutableAttributedString *)string;
-- (void)addAttributesForLineInRange:(NSRange)range ofString:(NSMutableAttributedString *)string
-						andContinue:(BOOL *)shouldContinue;
+- (void)colorLinesInRange:(NSRange)lines ofString:(NSMutableAttributedString *)string;
+- (void)useSuggestion:(NSMenuItem *)sender;
 @end
 
+static void FRTextStorageCharacters(void *info, size_t location, size_t length, FRStringsChar *buffer);
+static NSString *FRUnescapedSubstring(NSString *string, NSUInteger location, NSUInteger length);
+static NSData *FRContentHash(NSData *data);
+static NSUInteger FRIndexOfString(FRStrings *strings, NSString *string, NSRange range);
+
 @implementation FRLocalizationWindowController
 
 + (void)initialize {
@@ -73,7 +118,21 @@ NSString * const FRLocalizationErrorDomain = @"FRLocalizationErrorDomain";
 		gSystemLanguage = ([languages count]) ? [languages objectAtIndex:0] : GREENWICH_DEFAULT_LANGUAGE;
 		[[NSUserDefaults standardUserDefaults] registerDefaults:
 		 [NSDictionary dictionaryWithObjectsAndKeys:
-		  gSystemLanguage, FRLocalizationTypePreferenceKey, nil]];
+		  gSystemLanguage, FRLocalizationTypePreferenceKey,
+		  [NSNumber numberWithBool:NO], FRLocalizationDeltaPackagesPreferenceKey, nil]];
+		
+		// attributes are shared by every line that gets colored
+		gCommentAttributes = [NSDictionary dictionaryWithObjectsAndKeys:
+							  COMMENT, NSForegroundColorAttributeName, nil];
+		gEntryAttributes = [NSDictionary dictionaryWithObjectsAndKeys:
+							TRANSLATION, NSForegroundColorAttributeName, nil];
+		gCompleteAttributes = [NSDictionary dictionaryWithObjectsAndKeys:
+							   TRANSLATION_COMPLETE, NSForegroundColorAttributeName, nil];
+		gIncompleteAttributes = [NSDictionary dictionaryWithObjectsAndKeys:
+								 TRANSLATION_INCOMPLETE, NSForegroundColorAttributeName, nil];
+		gUnknownAttributes = [NSDictionary dictionaryWithObjectsAndKeys:
+							  UNKNOWN, NSForegroundColorAttributeName,
+							  UNKNOWN_BACKGROUND, NSBackgroundColorAttributeName, nil];
 	}
 }
 
@@ -86,19 +145,37 @@ NSString * const FRLocalizationErrorDomain = @"FRLocalizationErrorDomain";
 
 - (id)init {
 	if ((self = [super initWithWindowNibName:@"Localization"])) {
-		// placeholder
+		lexer = FRStringsLexerCreate();
+		saveQueue = dispatch_queue_create("com.fadingred.Greenwich.save", DISPATCH_QUEUE_SERIAL);
+		pendingSaves = [[NSMutableDictionary alloc] init];
+		diskHashes = [[NSMutableDictionary alloc] init];
+		visibleEntries = [[NSMutableDictionary alloc] init];
+		entryIndex = [[NSMutableData alloc] init];
 	}
 	return self;
 }
 
 #if !__OBJC_GC__
 - (void)dealloc {
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
 	[stringsFiles setContent:nil];
 	[stringsFiles removeObserver:self forKeyPath:@"arrangedObjects"];
 	[saveTimer invalidate];
+	FRStringsLexerFree(lexer);
+#if !OS_OBJECT_USE_OBJC
+	dispatch_release(saveQueue);
+#endif
 }
 #endif
 
+- (void)finalize {
+	FRStringsLexerFree(lexer);
+#if !OS_OBJECT_USE_OBJC
+	dispatch_release(saveQueue);
+#endif
+	[super finalize];
+}
+
 
 #pragma mark -
 #pragma mark loading
@@ -120,11 +197,23 @@ NSString * const FRLocalizationErrorDomain = @"FRLocalizationErrorDomain";
 	
 	[textView setFont:[NSFont fontWithName:@"Menlo" size:12]];
 	[textView setTextContainerInset:kTextContainerInset];
+	[[textView layoutManager] setAllowsNonContiguousLayout:TRUE];
 	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(processEditing:)
 												 name:NSTextStorageDidProcessEditingNotification
 											   object:[textView textStorage]];
+	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(editedStringsFileWillClose:)
+												 name:NSWindowWillCloseNotification
+											   object:[self window]];
+	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(editedStringsFileWillClose:)
+												 name:NSApplicationWillTerminateNotification
+											   object:nil];
 	
+	[self addSearchField];
 	[tableView sizeLastColumnToFit];
+	
+	// previous translations from every bundle are offered while editing, see the text view's menu
+	memoryIndex = [FRTranslationMemoryIndex memoryIndex];
+	[memoryIndex buildWithCompletionHandler:nil];
 	[tableView setSortDescriptors:
 	 [NSArray arrayWithObject:
 	  [[NSSortDescriptor alloc] initWithKey:kDisplayNameKey ascending:YES]]];
@@ -186,10 +275,13 @@ NSString * const FRLocalizationErrorDomain = @"FRLocalizationErrorDomain";
 		[tableView setNeedsDisplay];
 	}
 	else if (context == FRSelectedContainerDidChangeContext) {
+		searchIndex = nil;
+		[self buildSearchIndex];
 		[self updateSendButtonVisibility];
 		[self loadLanguages];
 	}
 	else if (context == FRSelectedLanguageDidChangeContext) {
+		[self updateSearchResults];
 		[self loadStringsFiles];
 		[self persistSelectedLanguage];
 	}
@@ -206,23 +298,237 @@ NSString * const FRLocalizationErrorDomain = @"FRLocalizationErrorDomain";
 // ----------------------------------------------------------------------------------------------------
 
 - (void)saveSelectedStringsFile {
-	FRTranslationInfo *info = [[stringsFiles selectedObjects] lastObject];
-	if (info) {
-		NSString *path = info.path;
-		NSError *error = nil;
-		BOOL written = FALSE;
-		FRStringsFormat format = FRStringsFormatQuoted;
-		NSData *data = [[textView string] dataUsingEncoding:NSUTF8StringEncoding];
-		FRStrings *strings = [[FRStrings alloc] initWithData:data usedFormat:&format error:&error];
-		if (strings) {
-			written = [strings writeToFile:path format:FRStringsFormatQuoted error:&error];
+	if (!editedStrings) { return; }
+	
+	// bring the model up to date with the lines that were edited since the last save. if nothing
+	// actually changed (for instance only whitespace moved around), there's nothing to write.
+	[self updateEditedStrings];
+	if (!structureChanged && ![[editedStrings changedStrings] count]) { return; }
+	
+	FRStrings *snapshot = [editedStrings copy];
+	NSString *path = editedPath;
+	BOOL rewrite = structureChanged;
+	[editedStrings clearChanges];
+	structureChanged = FALSE;
+	
+	// translations show up on the device as they're edited. entries that were added or removed can't
+	// be sent this way, so those only get there when the whole file is sent.
+	if (!rewrite) { [self sendEdits:[snapshot changedStrings] inStrings:snapshot path:path]; }
+	
+	// only the latest snapshot for a path needs to be written. when several saves get queued up
+	// before the queue gets to them, the first one writes the latest snapshot (along with the
+	// changes from all of them) and the rest find nothing left to do.
+	@synchronized(pendingSaves) {
+		NSMutableDictionary *pending = [pendingSaves objectForKey:path];
+		if (!pending) {
+			pending = [NSMutableDictionary dictionary];
+			[pending setObject:[NSMutableSet set] forKey:kPendingChangesKey];
+			[pendingSaves setObject:pending forKey:path];
 		}
-		if (!written) {
-			[[self window] presentError:error];
+		[pending setObject:snapshot forKey:kPendingStringsKey];
+		[[pending objectForKey:kPendingChangesKey] unionSet:[snapshot changedStrings]];
+		if (rewrite) { [pending setObject:[NSNumber numberWithBool:TRUE] forKey:kPendingRewriteKey]; }
+	}
+	
+	dispatch_async(saveQueue, ^{
+		NSDictionary *pending = nil;
+		@synchronized(pendingSaves) {
+			pending = [pendingSaves objectForKey:path];
+			[pendingSaves removeObjectForKey:path];
 		}
+		if (pending) {
+			NSError *error = nil;
+			if (![self savePendingChanges:pending toPath:path error:&error]) {
+				dispatch_async(dispatch_get_main_queue(), ^{
+					[[self window] presentError:error];
+				});
+			}
+			[memoryIndex updateStringsFileAtPath:path];
+		}
+	});
+}
+
+- (void)sendEdits:(NSSet *)changes inStrings:(FRStrings *)strings path:(NSString *)path {
+	id delegate = [NSApp delegate];
+	if (![delegate respondsToSelector:@selector(sendStringsEdits:inStringsFile:)]) { return; }
+	
+	FRTranslationInfo *file = nil;
+	for (FRTranslationInfo *info in [stringsFiles arrangedObjects]) {
+		if ([[info path] isEqualToString:path]) { file = info; break; }
+	}
+	
+	NSMutableDictionary *edits = [NSMutableDictionary dictionaryWithCapacity:[changes count]];
+	for (NSString *string in changes) {
+		NSString *translation = [strings translationForString:string];
+		if (translation) { [edits setObject:translation forKey:string]; }
+	}
+	if (file && [edits count]) { [delegate sendStringsEdits:edits inStringsFile:file]; }
+}
+
+- (BOOL)savePendingChanges:(NSDictionary *)pending toPath:(NSString *)path error:(NSError **)error {
+	FRStrings *strings = [pending objectForKey:kPendingStringsKey];
+	NSSet *changes = [pending objectForKey:kPendingChangesKey];
+	BOOL rewrite = [[pending objectForKey:kPendingRewriteKey] boolValue];
+	FRStringsJournal *journal = [[FRStringsJournal alloc] initWithStringsFileAtPath:path];
+	BOOL success = TRUE;
+	
+	if (rewrite) {
+		// entries were added, removed or reordered, which the journal can't express. the new contents
+		// include everything the journal recorded, so it's no longer needed.
+		success = [self writeStrings:strings toPath:path error:error] && [journal discardWithError:error];
+	}
+	else {
+		success = [journal appendChanges:changes inStrings:strings error:error];
+		if (success && [journal recordCount] >= kJournalCompactionThreshold) {
+			success = [journal compactWithError:error];
+		}
+	}
+	
+	return success;
+}
+
+- (void)compactStringsFileAtPath:(NSString *)path {
+	NSError *error = nil;
+	FRStringsJournal *journal = [[FRStringsJournal alloc] initWithStringsFileAtPath:path];
+	if (![journal compactWithError:&error]) {
+		NSLog(@"Problem compacting strings file journal with error: %@", error);
 	}
 }
 
+- (void)compactStringsFiles:(NSArray *)infos completionHandler:(void (^)(void))handler {
+	[saveTimer invalidate];
+	saveTimer = nil;
+	[self saveSelectedStringsFile];
+	
+	// the save queue may still be writing, so compacting happens there and the handler is called on the
+	// main thread once it's done rather than holding up the main thread
+	NSArray *paths = [infos valueForKey:@"path"];
+	dispatch_async(saveQueue, ^{
+		for (NSString *path in paths) {
+			[self compactStringsFileAtPath:path];
+		}
+		dispatch_async(dispatch_get_main_queue(), handler);
+	});
+}
+
+- (void)editedStringsFileWillClose:(NSNotification *)notification {
+	NSString *path = editedPath;
+	[saveTimer invalidate];
+	saveTimer = nil;
+	[self saveSelectedStringsFile];
+	if (path) {
+		dispatch_sync(saveQueue, ^{
+			[self compactStringsFileAtPath:path];
+		});
+	}
+}
+
+- (BOOL)writeStrings:(FRStrings *)strings toPath:(NSString *)path error:(NSError **)error {
+	NSData *data = [[strings contentsInFormat:FRStringsFormatQuoted] dataUsingEncoding:NSUTF8StringEncoding];
+	NSData *hash = FRContentHash(data);
+	BOOL success = TRUE;
+	
+	if (![hash isEqualToData:[self diskHashForPath:path]]) {
+		success = [data writeToFile:path options:NSDataWritingAtomic error:error];
+		[diskHashes removeObjectForKey:path];
+		if (success) {
+			NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL];
+			if (attributes) {
+				[diskHashes setObject:[NSArray arrayWithObjects:hash, attributes, nil] forKey:path];
+			}
+		}
+	}
+	
+	return success;
+}
+
+- (NSData *)diskHashForPath:(NSString *)path {
+	// hashes are cached along with the attributes of the file when they were calculated and only
+	// calculated again when the file has been modified since.
+	NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL];
+	NSArray *cached = [diskHashes objectForKey:path];
+	NSDictionary *cachedAttributes = [cached lastObject];
+	NSData *hash = nil;
+	
+	if (attributes && cachedAttributes &&
+		[[attributes fileModificationDate] isEqualToDate:[cachedAttributes fileModificationDate]] &&
+		[attributes fileSize] == [cachedAttributes fileSize]) {
+		hash = [cached objectAtIndex:0];
+	}
+	else if (attributes) {
+		NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:NULL];
+		if (data) {
+			hash = FRContentHash(data);
+			[diskHashes setObject:[NSArray arrayWithObjects:hash, attributes, nil] forKey:path];
+		}
+	}
+	
+	return hash;
+}
+
+- (void)updateEditedStrings {
+	NSString *text = [[textView textStorage] string];
+	NSUInteger lineCount = FRStringsLexerLineCount(lexer);
+	NSUInteger entries = 0;
+	BOOL commentsChanged = FALSE;
+	
+	// walk the lines looking for entries that were tokenized since the last save or that follow
+	// lines that were. only those entries are read back out of the text.
+	for (NSUInteger index = 0; index < lineCount && !structureChanged; index++) {
+		const FRStringsLine *line = FRStringsLexerLineAtIndex(lexer, index);
+		BOOL changed = line->generation > savedGeneration;
+		if (line->kind == FRStringsLineEntry) {
+			if (changed || commentsChanged) {
+				NSString *string = FRUnescapedSubstring(text, line->location + line->keyLocation, line->keyLength);
+				NSString *translation =
+					FRUnescapedSubstring(text, line->location + line->valueLocation, line->valueLength);
+				
+				// entries that moved, appeared or had their key edited change the structure of the file
+				if (entries >= [editedStrings count] ||
+					![[editedStrings stringAtIndex:entries] isEqualToString:string]) {
+					structureChanged = TRUE;
+				}
+				else {
+					[editedStrings setTranslation:translation forString:string];
+					[editedStrings setComments:[self commentsForLineAtIndex:index inText:text] forString:string];
+				}
+			}
+			entries++;
+			commentsChanged = FALSE;
+		}
+		else if (changed) {
+			commentsChanged = TRUE;
+		}
+	}
+	
+	if (entries != [editedStrings count]) {
+		structureChanged = TRUE;
+	}
+	
+	// structural changes are rare (translators edit values, not keys), so just parse everything again
+	if (structureChanged) {
+		FRStrings *strings = [[FRStrings alloc] initWithString:text usedFormat:NULL error:NULL];
+		if (strings) { editedStrings = strings; }
+	}
+	
+	savedGeneration = FRStringsLexerGeneration(lexer);
+}
+
+- (NSArray *)commentsForLineAtIndex:(NSUInteger)index inText:(NSString *)text {
+	// the same rule the tokenizer and the parser follow: comments belong to the next entry, even with
+	// blank lines in between
+	NSMutableArray *comments = [NSMutableArray array];
+	while (index > 0) {
+		const FRStringsLine *line = FRStringsLexerLineAtIndex(lexer, --index);
+		if (line->kind == FRStringsLineBlank) { continue; }
+		if (line->kind != FRStringsLineComment) { break; }
+		NSString *comment = [text substringWithRange:NSMakeRange(line->location + line->keyLocation, line->keyLength)];
+		[comments insertObject:[comment stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]]
+					   atIndex:0];
+	}
+	return comments;
+}
+
 - (void)loadLanguages {
 	FRTranslationContainer *container = [[containers selectedObjects] lastObject];
 	NSMutableArray *languagesArray = [[container launagues] mutableCopy];
@@ -256,21 +562,193 @@ NSString * const FRLocalizationErrorDomain = @"FRLocalizationErrorDomain";
 }
 
 - (void)loadTextView {
-	NSString *contents = nil;
 	FRTranslationInfo *info = [[stringsFiles selectedObjects] lastObject];
-	NSError *error = nil;
+	NSString *previousPath = editedPath;
+	
+	// the file that was being edited won't see any more changes for a while, so fold its journal
+	// back into it in the background
+	if (previousPath && ![previousPath isEqualToString:info.path]) {
+		dispatch_async(saveQueue, ^{
+			[self compactStringsFileAtPath:previousPath];
+		});
+	}
+	
+	// remember where the previous file was scrolled to so it can be restored when it's shown again
+	NSString *visibleString = [self visibleEntryString];
+	if (previousPath && visibleString) { [visibleEntries setObject:visibleString forKey:previousPath]; }
+	else if (previousPath) { [visibleEntries removeObjectForKey:previousPath]; }
+	
+	loadGeneration++;
+	editedStrings = nil;
+	editedPath = nil;
+	structureChanged = FALSE;
+	[entryIndex setLength:0];
+	[textView setString:@""];
+	[textView setEditable:TRUE];
+	
 	if (info) {
-		NSData *data = [NSData dataWithContentsOfFile:info.path options:0 error:&error];
-		if (data) {
-			FRStringsFormat format = FRStringsFormatQuoted;
-			FRStrings *strings = [[FRStrings alloc] initWithData:data usedFormat:&format error:&error];
-			contents = [strings contentsInFormat:FRStringsFormatQuoted];
+		NSString *path = [info.path copy];
+		NSUInteger generation = loadGeneration;
+		visibleString = [searchMatches objectForKey:path];
+		if (!visibleString) { visibleString = [visibleEntries objectForKey:path]; }
+		
+		// files are parsed in the background and each batch of entries is shown as soon as it has been
+		// read, so the start of a large file shows up before the rest of it is parsed. the first batch
+		// is small so something shows up right away (small files are shown in one go). the loader waits
+		// for each batch to be added before reading on, so the main thread gets to handle events in
+		// between and never has a backlog of text to add. editing is only possible once the whole file
+		// is there since saving relies on the full contents.
+		[textView setEditable:FALSE];
+		
+		// loading starts on the save queue so it waits for any save that's still being written and
+		// applies any journal that was left behind (for instance if the application quit unexpectedly)
+		// without holding up the main thread. parsing then moves off the save queue so saves of other
+		// files don't wait for it.
+		dispatch_async(saveQueue, ^{
+			[self compactStringsFileAtPath:path];
+			
+			dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+				NSError *error = nil;
+				NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:&error];
+				FRStringsFormat format = FRStringsFormatQuoted;
+				NSUInteger firstLength = ([data length] < kChunkedLoadingThreshold) ? NSUIntegerMax : kFirstBatchLength;
+				BOOL (^handler)(FRStrings *, NSRange) = ^BOOL(FRStrings *loading, NSRange range) {
+					NSMutableData *locations = [NSMutableData dataWithLength:range.length * sizeof(NSUInteger)];
+					NSString *contents = [loading quotedContentsOfStringsInRange:range
+																 entryLocations:[locations mutableBytes]];
+					NSUInteger visible = FRIndexOfString(loading, visibleString, range);
+					
+					dispatch_sync(dispatch_get_main_queue(), ^{
+						if (generation == loadGeneration) {
+							[self appendLoadedContents:contents entryLocations:locations];
+							if (visible != NSNotFound) { [self scrollToEntryAtIndex:visible]; }
+						}
+					});
+					return (generation == loadGeneration);
+				};
+				FRStrings *strings = data ? [[FRStrings alloc] initWithData:data usedFormat:&format
+														   firstBatchLength:firstLength batchLength:kBatchLength
+																	handler:handler error:&error] : nil;
+				
+				dispatch_async(dispatch_get_main_queue(), ^{
+					if (generation != loadGeneration) { return; }
+					if (strings) { [self finishLoadingStrings:strings path:path]; }
+					else {
+						[textView setEditable:TRUE];
+						[[self window] presentError:error];
+					}
+				});
+			});
+		});
+	}
+}
+
+- (void)addSearchField {
+	// the search field goes above the list of files, which only shows the files with matches while
+	// there's something to search for
+	NSScrollView *scrollView = [tableView enclosingScrollView];
+	NSRect frame = [scrollView frame];
+	NSRect fieldFrame = frame;
+	fieldFrame.size.height = kSearchFieldHeight;
+	fieldFrame.origin.y = NSMaxY(frame) - kSearchFieldHeight;
+	frame.size.height -= kSearchFieldHeight + kSearchFieldSpacing;
+	[scrollView setFrame:frame];
+	
+	searchField = [[NSSearchField alloc] initWithFrame:fieldFrame];
+	[searchField setAutoresizingMask:NSViewWidthSizable | NSViewMinYMargin];
+	[[searchField cell] setPlaceholderString:FRLocalizedString(@"Search All Files", nil)];
+	[searchField setTarget:self];
+	[searchField setAction:@selector(searchStringsFiles:)];
+	[[scrollView superview] addSubview:searchField];
+}
+
+- (void)buildSearchIndex {
+	// the index covers every file of every language in the container. it's only built once there's
+	// something to search for and then kept up to date as files change.
+	FRTranslationContainer *container = [[containers selectedObjects] lastObject];
+	if (searchIndex || !searchQuery || !container) { return; }
+	
+	FRTranslationSearchIndex *index = [FRTranslationSearchIndex indexWithContainer:container];
+	searchIndex = index;
+	[index buildWithCompletionHandler:^{
+		if (searchIndex == index) { [self updateSearchResults]; }
+	}];
+}
+
+- (void)updateSearchResults {
+	// the first match in each file of the selected language is where the file is shown from
+	NSString *language = [[languages selectedObjects] lastObject];
+	NSMutableDictionary *matches = nil;
+	if (searchQuery) {
+		matches = [NSMutableDictionary dictionary];
+		for (NSDictionary *result in [searchIndex resultsForQuery:searchQuery options:0 limit:kSearchResultLimit]) {
+			NSString *path = [result objectForKey:FRTranslationSearchPathKey];
+			if ([[result objectForKey:FRTranslationSearchLanguageKey] isEqualToString:language] &&
+				![matches objectForKey:path]) {
+				[matches setObject:[result objectForKey:FRTranslationSearchStringKey] forKey:path];
+			}
 		}
-		if (!contents) {
-			[[self window] presentError:error];
+	}
+	searchMatches = matches;
+	[stringsFiles setFilterPredicate:
+	 matches ? [NSPredicate predicateWithFormat:@"path IN %@", [matches allKeys]] : nil];
+}
+
+- (void)appendLoadedContents:(NSString *)contents entryLocations:(NSData *)locations {
+	NSTextStorage *storage = [textView textStorage];
+	NSUInteger offset = [storage length];
+	const NSUInteger *relative = [locations bytes];
+	NSUInteger count = [locations length] / sizeof(NSUInteger);
+	
+	// the entry index maps entries to where they start in the text. it's built as the text comes in,
+	// so entries can be found (and scrolled to) before the rest of the file has been added.
+	for (NSUInteger index = 0; index < count; index++) {
+		NSUInteger location = (relative[index] == NSNotFound) ? NSNotFound : offset + relative[index];
+		[entryIndex appendBytes:&location length:sizeof(location)];
+	}
+	
+	if (offset) { [storage replaceCharactersInRange:NSMakeRange(offset, 0) withString:contents]; }
+	else { [textView setString:contents]; }
+}
+
+- (void)finishLoadingStrings:(FRStrings *)strings path:(NSString *)path {
+	editedStrings = strings;
+	editedPath = path;
+	savedGeneration = FRStringsLexerGeneration(lexer);
+	[textView setEditable:TRUE];
+}
+
+- (void)scrollToEntryAtIndex:(NSUInteger)index {
+	NSUInteger count = [entryIndex length] / sizeof(NSUInteger);
+	NSUInteger location = (index < count) ? ((const NSUInteger *)[entryIndex bytes])[index] : NSNotFound;
+	if (location != NSNotFound && location < [[textView textStorage] length]) {
+		NSLayoutManager *layoutManager = [textView layoutManager];
+		NSRange glyphs = [layoutManager glyphRangeForCharacterRange:NSMakeRange(location, 1) actualCharacterRange:NULL];
+		NSRect rect = [layoutManager boundingRectForGlyphRange:glyphs inTextContainer:[textView textContainer]];
+		[textView scrollPoint:NSMakePoint(0, NSMinY(rect))];
+	}
+}
+
+- (NSString *)visibleEntryString {
+	NSString *text = [[textView textStorage] string];
+	if (![text length]) { return nil; }
+	
+	// find the first entry at or after the top of the visible area
+	NSLayoutManager *layoutManager = [textView layoutManager];
+	NSPoint origin = [textView visibleRect].origin;
+	origin.x -= [textView textContainerOrigin].x;
+	origin.y -= [textView textContainerOrigin].y;
+	NSUInteger glyph = [layoutManager glyphIndexForPoint:origin inTextContainer:[textView textContainer]];
+	NSUInteger character = [layoutManager characterIndexForGlyphAtIndex:glyph];
+	size_t count = FRStringsLexerLineCount(lexer);
+	
+	for (size_t index = FRStringsLexerLineIndexForLocation(lexer, character); index < count; index++) {
+		const FRStringsLine *line = FRStringsLexerLineAtIndex(lexer, index);
+		if (line->kind == FRStringsLineEntry) {
+			return FRUnescapedSubstring(text, line->location + line->keyLocation, line->keyLength);
 		}
 	}
-	[textView setString:contents ? contents : @""];
+	return nil;
 }
 
 - (void)updateSendButtonVisibility {
@@ -323,59 +801,47 @@ NSString * const FRLocalizationErrorDomain = @"FRLocalizationErrorDomain";
 
 	void (^completion)(NSInteger) = ^(NSInteger returnCode) {
 		if (returnCode == NSFileHandlingPanelOKButton) {
-			NSError *error = nil;
-			NSFileManager *fileManager = [NSFileManager defaultManager];
-			char *tmpname = NULL;
-			asprintf(&tmpname, "%s/translation.XXXXXX", [NSTemporaryDirectory() UTF8String]);
-			mkdtemp(tmpname);
-			NSString *temp = [[NSString stringWithUTF8String:tmpname] stringByAppendingPathComponent:
-							  [[NSBundle mainBundle] name]];
-			free(tmpname);
-
-			// make the folder that the strings files will be packaged into
-			if (![fileManager createDirectoryAtPath:temp
-						withIntermediateDirectories:YES
-										 attributes:nil
-											  error:&error]) {
-				NSLog(@"Problem creating destination folder with error: %@", error);
-			}
+			NSString *name = [[NSBundle mainBundle] name];
+			NSArray *infos = [[stringsFiles arrangedObjects] copy];
+			NSString *language = [[languages selectedObjects] lastObject];
+			NSString *archiveDestination = [[panel URL] path];
 			
-			// copy strings files to the folder that will be packaged
-			for (FRTranslationInfo *info in [stringsFiles arrangedObjects]) {
-				NSString *path = info.path;
-				NSString *bundle = info.bundleName;
-				NSString *fileName = info.fileName;
-				if (![bundle length]) { bundle = [[NSBundle mainBundle] name]; }
-				NSString *destinationDirectory = [temp stringByAppendingPathComponent:bundle];
-				NSString *destinationPath = [destinationDirectory stringByAppendingPathComponent:fileName];
-				BOOL result =
-					[fileManager createDirectoryAtPath:destinationDirectory
-						   withIntermediateDirectories:YES
-											attributes:nil
-												 error:&error] &&
-					[fileManager copyItemAtPath:path
-										 toPath:destinationPath
-										  error:&error];
-				if (!result) {
-					NSLog(@"Problem copying strings files with error: %@", error);
+			// make sure no changes are left in journals, then package the strings files straight from
+			// where they are, laid out by bundle
+			[self compactStringsFiles:infos completionHandler:^{
+				NSError *error = nil;
+				NSMutableDictionary *contents = [NSMutableDictionary dictionary];
+				for (FRTranslationInfo *info in infos) {
+					NSString *bundle = info.bundleName;
+					if (![bundle length]) { bundle = name; }
+					[contents setObject:info.path forKey:[bundle stringByAppendingPathComponent:info.fileName]];
 				}
-			}
-			
-			// package the folder into a .tbz for emailing
-			NSString *archiveDestination = [[panel URL] path];
-			[fileManager removeItemAtPath:archiveDestination error:NULL];
-#if REDFOUNDATION_LEOPARD_BASE
-			BOOL result = [fileManager compressFileAtPath:temp to:archiveDestination error:&error];
-#else
-			BOOL result = [fileManager compressItemAtPath:temp to:archiveDestination error:&error];
-#endif
-			if (!result) {
-				NSLog(@"Problem archiving strings files package with error: %@", error);
-			} else {
-				if (![fileManager removeItemAtPath:temp error:&error]) {
-					NSLog(@"Problem removing file package temp directory with error: %@", error);
+				
+				// the manifest of the last package for the language is the base for a delta package that
+				// only holds what changed since then
+				NSString *manifestPath = [[NSBundle translactionStoragePath] stringByAppendingPathComponent:
+										  [NSString stringWithFormat:@".%@.manifest", language]];
+				NSDictionary *base = nil;
+				if ([[NSUserDefaults standardUserDefaults] boolForKey:FRLocalizationDeltaPackagesPreferenceKey]) {
+					base = [FRTranslationPackage manifestAtPath:manifestPath];
 				}
-			}
+				
+				// package the strings files into a .tbz for emailing. the identifier lets the package be told
+				// apart from ones for other applications and languages, whatever the file is called.
+				NSString *bundleIdentifier = [[NSBundle mainBundle] bundleIdentifier];
+				if (!bundleIdentifier) { bundleIdentifier = name; }
+				NSString *identifier = [NSString stringWithFormat:@"%@.%@", bundleIdentifier, language];
+				NSDictionary *manifest = nil;
+				[[NSFileManager defaultManager] removeItemAtPath:archiveDestination error:NULL];
+				if (![FRTranslationPackage createPackageAtPath:archiveDestination name:name identifier:identifier
+													  contents:contents baseManifest:base manifest:&manifest
+														 error:&error]) {
+					NSLog(@"Problem archiving strings files package with error: %@", error);
+				}
+				else if (![FRTranslationPackage writeManifest:manifest toPath:manifestPath error:&error]) {
+					NSLog(@"Problem saving strings files package manifest with error: %@", error);
+				}
+			}];
 		}
 	};
 
@@ -396,10 +862,20 @@ NSString * const FRLocalizationErrorDomain = @"FRLocalizationErrorDomain";
 #endif
 }
 
+- (IBAction)searchStringsFiles:(id)sender {
+	NSString *query = [sender stringValue];
+	searchQuery = [query length] ? [query copy] : nil;
+	[self buildSearchIndex];
+	[self updateSearchResults];
+}
+
 - (IBAction)sendToDevice:(id)sender {
 	id delegate = [NSApp delegate];
 	if ([delegate respondsToSelector:@selector(sendStringsFilesToDevice:)]) {
-		[delegate sendStringsFilesToDevice:[stringsFiles arrangedObjects]];
+		NSArray *infos = [[stringsFiles arrangedObjects] copy];
+		[self compactStringsFiles:infos completionHandler:^{
+			[delegate sendStringsFilesToDevice:infos];
+		}];
 	}
 
 }
@@ -451,145 +927,113 @@ NSString * const FRLocalizationErrorDomain = @"FRLocalizationErrorDomain";
 											   userInfo:nil repeats:NO];
 }
 
+- (NSMenu *)textView:(NSTextView *)view menu:(NSMenu *)menu forEvent:(NSEvent *)event atIndex:(NSUInteger)charIndex {
+	// the closest previous translations of the entry that was clicked go at the top of the menu.
+	// choosing one replaces the translation of the entry.
+	NSString *text = [[textView textStorage] string];
+	if (![textView isEditable] || !FRStringsLexerLineCount(lexer)) { return menu; }
+	const FRStringsLine *line = FRStringsLexerLineAtIndex(lexer, FRStringsLexerLineIndexForLocation(lexer, charIndex));
+	if (line->kind != FRStringsLineEntry || !(line->flags & FRStringsLineFlagTerminated)) { return menu; }
+	
+	NSString *string = FRUnescapedSubstring(text, line->location + line->keyLocation, line->keyLength);
+	NSString *current = FRUnescapedSubstring(text, line->location + line->valueLocation, line->valueLength);
+	NSValue *range = [NSValue valueWithRange:NSMakeRange(line->location + line->valueLocation, line->valueLength)];
+	NSString *language = [[languages selectedObjects] lastObject];
+	NSArray *suggestions = [memoryIndex suggestionsForString:string language:language limit:kSuggestionLimit];
+	NSUInteger position = 0;
+	for (NSDictionary *suggestion in suggestions) {
+		NSString *translation = [suggestion objectForKey:FRTranslationMemoryTranslationKey];
+		if ([translation isEqualToString:current]) { continue; }
+		NSMenuItem *item = [[NSMenuItem alloc] initWithTitle:translation action:@selector(useSuggestion:)
+											   keyEquivalent:@""];
+		[item setTarget:self];
+		[item setRepresentedObject:[NSArray arrayWithObjects:range, translation, nil]];
+		[menu insertItem:item atIndex:position++];
+	}
+	if (position) { [menu insertItem:[NSMenuItem separatorItem] atIndex:position]; }
+	return menu;
+}
+
+- (void)useSuggestion:(NSMenuItem *)sender {
+	NSRange range = [[[sender representedObject] objectAtIndex:0] rangeValue];
+	NSString *translation = [[[sender representedObject] objectAtIndex:1]
+							 stringByReplacingOccurrencesOfString:@"\"" withString:@"\\\""];
+	
+	// going through the text view keeps undo, saving and coloring working like for typed changes
+	if (NSMaxRange(range) <= [[textView textStorage] length] &&
+		[textView shouldChangeTextInRange:range replacementString:translation]) {
+		[[textView textStorage] replaceCharactersInRange:range withString:translation];
+		[textView didChangeText];
+	}
+}
+
 - (void)processEditing:(NSNotification *)notification {
 	NSTextStorage *contents = [textView textStorage];
-	[self colorTextInRange:[contents editedRange] ofString:contents];
+	
+	// attribute only changes (including the ones made while coloring) don't need to be lexed again
+	if ([contents editedMask] & NSTextStorageEditedCharacters) {
+		NSRange edited = [contents editedRange];
+		NSInteger change = [contents changeInLength];
+		size_t count = 0;
+		size_t first = FRStringsLexerEdit(lexer, FRTextStorageCharacters, (__bridge void *)[contents string],
+										  [contents length], edited.location, edited.length - change, edited.length,
+										  &count);
+		[self colorLinesInRange:NSMakeRange(first, count) ofString:contents];
+	}
 }
 
-- (void)colorTextInRange:(NSRange)range ofString:(NSMutableAttributedString *)attributedString {
-	NSString *string = [attributedString string];
-	NSUInteger stringLength = [string length];
-	NSRange subrange = NSMakeRange(range.location, 0);
+- (void)colorLinesInRange:(NSRange)lines ofString:(NSMutableAttributedString *)attributedString {
+	[attributedString beginEditing];
 	
-	// find the start of the string
-	while (subrange.location > 0) {
-		char character = [string characterAtIndex:subrange.location-1];
-		if (character == '\n') { break; }
-		else {
-			subrange.location--;
-			subrange.length++;
-		}
-	}
+	for (NSUInteger index = lines.location; index < NSMaxRange(lines); index++) {
+		const FRStringsLine *line = FRStringsLexerLineAtIndex(lexer, index);
+		NSRange range = NSMakeRange(line->location, line->contentLength);
 		
-	// find the ends of strings and add attributes. stop once we've gotten past the end of the requested range and
-	// the add attributes method doesn't request continuing to the next line.
-	while (subrange.location + subrange.length < stringLength) {
-		BOOL shouldContinue = FALSE;
-		char character = [string characterAtIndex:subrange.location + subrange.length];
-		subrange.length++;
+		// remove background color
+		[attributedString removeAttribute:NSBackgroundColorAttributeName
+									range:NSMakeRange(line->location, line->length)];
 		
-		if (character == '\n') {
-			[self addAttributesForLineInRange:subrange ofString:attributedString andContinue:&shouldContinue];
-			subrange.location += subrange.length;
-			subrange.length = 0;
-			shouldContinue = shouldContinue || subrange.location + subrange.length < range.location + range.length;
-			if (shouldContinue == FALSE) {
-				break;
-			}
+		if (line->kind == FRStringsLineComment) {
+			[attributedString addAttributes:gCommentAttributes range:range];
+		}
+		else if (line->kind == FRStringsLineEntry && (line->flags & FRStringsLineFlagTerminated)) {
+			// color the key and value including their quotes
+			NSRange lhs = NSMakeRange(line->location + line->keyLocation - 1, line->keyLength + 2);
+			NSRange rhs = NSMakeRange(line->location + line->valueLocation - 1, line->valueLength + 2);
+			BOOL translated = (line->flags & FRStringsLineFlagTranslated) != 0;
+			[attributedString addAttributes:gEntryAttributes range:range];
+			[attributedString addAttributes:translated ? gCompleteAttributes : gIncompleteAttributes range:rhs];
+			[attributedString addAttributes:gCompleteAttributes range:lhs];
+		}
+		else if (line->kind != FRStringsLineBlank) {
+			[attributedString addAttributes:gUnknownAttributes range:range];
 		}
 	}
+	
+	[attributedString endEditing];
 }
 
-- (void)addAttributesForLineInRange:(NSRange)range ofString:(NSMutableAttributedString *)attributedString
-						andContinue:(BOOL *)shouldContinue {
-	
-	NSAssert(range.length >= 1, @"Expected range to have a length");
-	NSParameterAssert(shouldContinue);
-	
-	NSString *string = [attributedString string];
-	BOOL colored = FALSE;
+static void FRTextStorageCharacters(void *info, size_t location, size_t length, FRStringsChar *buffer) {
+	[(__bridge NSString *)info getCharacters:buffer range:NSMakeRange(location, length)];
+}
 
-	// remove background color
-	[attributedString removeAttribute:NSBackgroundColorAttributeName range:range];
+static NSString *FRUnescapedSubstring(NSString *string, NSUInteger location, NSUInteger length) {
+	NSString *substring = [string substringWithRange:NSMakeRange(location, length)];
+	return [substring stringByReplacingOccurrencesOfString:@"\\\"" withString:@"\""];
+}
 
-	if ([string characterAtIndex:range.location + range.length - 1] == '\n') {
-		range.length--;
+static NSUInteger FRIndexOfString(FRStrings *strings, NSString *string, NSRange range) {
+	NSUInteger end = string ? NSMaxRange(range) : 0;
+	for (NSUInteger index = range.location; index < end; index++) {
+		if ([[strings stringAtIndex:index] isEqualToString:string]) { return index; }
 	}
-	
-	if (range.length) {
-		if (range.length >= 4) { // check for comment. needs at least: /**/
-			char startSlash = [string characterAtIndex:range.location + 0];
-			char startStar = [string characterAtIndex:range.location + 1];
-			char endSlash = [string characterAtIndex:range.location + range.length - 1];
-			char endStar = [string characterAtIndex:range.location + range.length - 2];
-			if (startSlash == '/' && startStar == '*' && endSlash == '/' && endStar == '*') {
-				NSDictionary *attributes = [NSDictionary dictionaryWithObjectsAndKeys:
-											COMMENT, NSForegroundColorAttributeName, nil];
-				[attributedString addAttributes:attributes range:range];
-				colored = TRUE;
-				*shouldContinue = TRUE;
-			}
-		}
-		
-		if (range.length >= 8) { // check for string. needs at least: "" = "";
-			char startQuote = [string characterAtIndex:range.location + 0];
-			char endSemicolon = [string characterAtIndex:range.location + range.length - 1];
-			char endQuote = [string characterAtIndex:range.location + range.length - 2];
-			if (startQuote == '"' && endQuote == '"' && endSemicolon == ';') {
-				
-				NSString *equalityCheck = @"\" = \"";
-				NSRange equalityRange = [string rangeOfString:equalityCheck options:0 range:range];
-				if (equalityRange.location != NSNotFound) {
-					equalityRange.location += 1;
-					equalityRange.length -= 2;
-
-					NSRange rangeNoSemicolon = range;
-					NSRange lhs = range;
-					NSRange rhs = range;
-					rangeNoSemicolon.length -= 1;
-					lhs.length = equalityRange.location - rangeNoSemicolon.location;
-					rhs.location = equalityRange.location + equalityRange.length;
-					rhs.length =
-						(rangeNoSemicolon.location + rangeNoSemicolon.length) -
-						(equalityRange.location + equalityRange.length);
-					
-					NSString *rhsString = [string substringWithRange:rhs];
-					BOOL translated = [string compare:rhsString options:0 range:lhs] != NSOrderedSame;
-					if (!translated) {
-						// go back through the previous line and look for a ==
-						NSUInteger thisLineStart = range.location;
-						NSRange previousLine = NSMakeRange(NSNotFound, 0);
-						if (thisLineStart > 0) {
-							previousLine = [string rangeOfString:@"\n" options:NSBackwardsSearch
-														   range:NSMakeRange(0, thisLineStart-1)];
-						}
-						if (previousLine.location != NSNotFound) {
-							NSUInteger previousLineStart = previousLine.location + previousLine.length;
-							NSRange search = NSMakeRange(previousLineStart, thisLineStart - previousLineStart);
-							translated = [string rangeOfString:@"==" options:0 range:search].location != NSNotFound;
-						}
-						
-					}
-
-					NSColor *lhsColor = TRANSLATION_COMPLETE;
-					NSColor *rhsColor = TRANSLATION_COMPLETE;
-					
-					if (!translated) {
-						rhsColor = TRANSLATION_INCOMPLETE;
-					}
+	return NSNotFound;
+}
 
-					NSDictionary *attributes = nil;
-					attributes = [NSDictionary dictionaryWithObjectsAndKeys:
-								  TRANSLATION, NSForegroundColorAttributeName, nil];
-					[attributedString addAttributes:attributes range:range];
-					attributes = [NSDictionary dictionaryWithObjectsAndKeys:
-								  rhsColor, NSForegroundColorAttributeName, nil];
-					[attributedString addAttributes:attributes range:rhs];
-					attributes = [NSDictionary dictionaryWithObjectsAndKeys:
-								  lhsColor, NSForegroundColorAttributeName, nil];
-					[attributedString addAttributes:attributes range:lhs];
-					colored = TRUE;
-				}
-			}
-		}
-	}
-	
-	if (!colored) {
-		NSDictionary *attributes = [NSDictionary dictionaryWithObjectsAndKeys:
-									UNKNOWN, NSForegroundColorAttributeName,
-									UNKNOWN_BACKGROUND, NSBackgroundColorAttributeName, nil];
-		[attributedString addAttributes:attributes range:range];
-	}
+static NSData *FRContentHash(NSData *data) {
+	unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+	CC_SHA1([data bytes], (CC_LONG)[data length], digest);
+	return [NSData dataWithBytes:digest length:sizeof(digest)];
 }
 
 @end
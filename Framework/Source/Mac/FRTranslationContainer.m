@@ -22,8 +22,24 @@
 #import "FRLocalizationBundleAdditions.h"
 #import "FRLocalizationBundleAdditions__.h"
 
+NSString * const FRTranslationReportFilesKey = @"files";
+NSString * const FRTranslationReportBundlesKey = @"bundles";
+NSString * const FRTranslationReportLanguagesKey = @"languages";
+NSString * const FRTranslationReportPathKey = @"path";
+NSString * const FRTranslationReportBundleKey = @"bundle";
+NSString * const FRTranslationReportLanguageKey = @"language";
+NSString * const FRTranslationReportTranslatedKey = @"translated";
+NSString * const FRTranslationReportUntranslatedKey = @"untranslated";
+NSString * const FRTranslationReportEqualKey = @"equal";
 static NSString * const FRLocalizationIgnoreBundlesKey = @"FRLocalizationIgnoreBundles";
 
+static void FRTranslationReportAddCounts(NSMutableDictionary *totals, NSString *key, FRTranslationCounts counts);
+
+@interface FRTranslationContainer ()
+- (BOOL)enumerateStringsFilesForLanguage:(NSString *)language error:(NSError **)error
+							  usingBlock:(void (^)(NSString *path, NSString *bundleIdentifier))block;
+@end
+
 @implementation FRTranslationContainer
 
 @synthesize name;
@@ -74,7 +90,7 @@ static NSString * const FRLocalizationIgnoreBundlesKey = @"FRLocalizationIgnoreB
 		NSMutableArray *result = [NSMutableArray array];
 		NSFileManager *manager = [NSFileManager defaultManager];
 		for (NSString *fileName in [manager contentsOfDirectoryAtPath:[resourcesURL path] error:NULL]) {
-			if ([fileName isEqualToString:@"Greenwich.details"]) { continue; }
+			if ([fileName isEqualToString:@"Greenwich.details"] || [fileName hasPrefix:@"."]) { continue; }
 			NSBundle *bundle = [NSBundle bundleWithURL:[resourcesURL URLByAppendingPathComponent:fileName]];
 			NSBundle *translateBundle =
 				[bundle bundleUsingContentsForTranslationsWithIdentifier:[[bundle bundlePath] lastPathComponent]
@@ -113,12 +129,9 @@ static NSString * const FRLocalizationIgnoreBundlesKey = @"FRLocalizationIgnoreB
 	return [languages allObjects];
 }
 
-- (NSArray *)infoItemsForLanguage:(NSString *)language error:(NSError **)error {
-	error = error ? error : &(NSError * __autoreleasing){ nil };
-	
+- (BOOL)enumerateStringsFilesForLanguage:(NSString *)language error:(NSError **)error
+							  usingBlock:(void (^)(NSString *path, NSString *bundleIdentifier))block {
 	NSArray *translateBundles = [self translateBundlesForLanguage:language];
-	NSMutableArray *content = [NSMutableArray array];
-	BOOL success = TRUE;
 	
 	for (NSBundle *bundle in translateBundles) {
 		NSArray *paths = [[NSFileManager defaultManager] subpathsOfDirectoryAtPath:[bundle bundlePath] error:error];
@@ -128,20 +141,145 @@ static NSString * const FRLocalizationIgnoreBundlesKey = @"FRLocalizationIgnoreB
 				NSString *directoryName = [[directoryPath lastPathComponent] stringByDeletingPathExtension];
 				NSString *fileExtension = [path pathExtension];
 				if ([directoryName isEqualToString:language] && [fileExtension isEqualToString:@"strings"]) {
-					NSString *infoPath = [[bundle bundlePath] stringByAppendingPathComponent:path];
-					FRTranslationInfo *info = [FRTranslationInfo infoWithLanguage:language path:infoPath];
-					[content addObject:info];
+					block([[bundle bundlePath] stringByAppendingPathComponent:path],
+						  [[bundle bundlePath] lastPathComponent]);
 				}
 			}
 		}
-		else { success = FALSE; break; }
+		else { return FALSE; }
 	}
 	
+	return TRUE;
+}
+
+- (NSArray *)infoItemsForLanguage:(NSString *)language error:(NSError **)error {
+	error = error ? error : &(NSError * __autoreleasing){ nil };
+	
+	NSMutableArray *content = [NSMutableArray array];
+	BOOL success = [self enumerateStringsFilesForLanguage:language error:error
+											   usingBlock:^(NSString *path, NSString *bundleIdentifier) {
+		[content addObject:[FRTranslationInfo infoWithLanguage:language path:path]];
+	}];
+	
 	return success ? content : nil;
 }
 
+
+#pragma mark -
+#pragma mark reports
+// ----------------------------------------------------------------------------------------------------
+// reports
+// ----------------------------------------------------------------------------------------------------
+
+- (NSDictionary *)reportWithError:(NSError **)error {
+	error = error ? error : &(NSError * __autoreleasing){ nil };
+	
+	NSArray *languages = [self launagues];
+	NSUInteger languageCount = [languages count];
+	NSMutableArray *files = [NSMutableArray array];
+	__block NSError *firstError = nil;
+	
+	// finding the files updates the translations for each language, which only touches that language's
+	// files, so all languages can be handled at once.
+	dispatch_apply(languageCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+		NSString *language = [languages objectAtIndex:index];
+		NSMutableArray *languageFiles = [NSMutableArray array];
+		NSError *languageError = nil;
+		BOOL success = [self enumerateStringsFilesForLanguage:language error:&languageError
+												   usingBlock:^(NSString *path, NSString *bundleIdentifier) {
+			[languageFiles addObject:[NSMutableDictionary dictionaryWithObjectsAndKeys:
+									  path, FRTranslationReportPathKey,
+									  bundleIdentifier, FRTranslationReportBundleKey,
+									  language, FRTranslationReportLanguageKey, nil]];
+		}];
+		@synchronized(files) {
+			if (success) { [files addObjectsFromArray:languageFiles]; }
+			else if (!firstError) { firstError = languageError; }
+		}
+	});
+	
+	NSUInteger fileCount = [files count];
+	FRTranslationCounts *counts = calloc(fileCount ? fileCount : 1, sizeof(FRTranslationCounts));
+	if (firstError || !counts) {
+		*error = firstError;
+		free(counts);
+		return nil;
+	}
+	
+	dispatch_apply(fileCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+		NSString *path = [[files objectAtIndex:index] objectForKey:FRTranslationReportPathKey];
+		NSError *fileError = nil;
+		if (![FRTranslationInfo getCounts:&counts[index] forStringsFileAtPath:path error:&fileError]) {
+			@synchronized(files) {
+				if (!firstError) { firstError = fileError; }
+			}
+		}
+	});
+	
+	NSMutableDictionary *bundles = [NSMutableDictionary dictionary];
+	NSMutableDictionary *languageTotals = [NSMutableDictionary dictionary];
+	for (NSUInteger index = 0; index < fileCount && !firstError; index++) {
+		NSMutableDictionary *file = [files objectAtIndex:index];
+		NSString *bundleIdentifier = [file objectForKey:FRTranslationReportBundleKey];
+		NSString *language = [file objectForKey:FRTranslationReportLanguageKey];
+		NSMutableDictionary *bundle = [bundles objectForKey:bundleIdentifier];
+		if (!bundle) {
+			bundle = [NSMutableDictionary dictionary];
+			[bundles setObject:bundle forKey:bundleIdentifier];
+		}
+		[file setObject:[NSNumber numberWithUnsignedInteger:counts[index].translated]
+				 forKey:FRTranslationReportTranslatedKey];
+		[file setObject:[NSNumber numberWithUnsignedInteger:counts[index].untranslated]
+				 forKey:FRTranslationReportUntranslatedKey];
+		[file setObject:[NSNumber numberWithUnsignedInteger:counts[index].equal]
+				 forKey:FRTranslationReportEqualKey];
+		FRTranslationReportAddCounts(bundle, language, counts[index]);
+		FRTranslationReportAddCounts(languageTotals, language, counts[index]);
+	}
+	free(counts);
+	
+	if (firstError) {
+		*error = firstError;
+		return nil;
+	}
+	
+	[files sortUsingDescriptors:[NSArray arrayWithObjects:
+								 [NSSortDescriptor sortDescriptorWithKey:FRTranslationReportLanguageKey ascending:YES],
+								 [NSSortDescriptor sortDescriptorWithKey:FRTranslationReportPathKey ascending:YES],
+								 nil]];
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+			files, FRTranslationReportFilesKey,
+			bundles, FRTranslationReportBundlesKey,
+			languageTotals, FRTranslationReportLanguagesKey, nil];
+}
+
+- (void)generateReportWithCompletionHandler:(void (^)(NSDictionary *report, NSError *error))handler {
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		NSError *error = nil;
+		NSDictionary *report = [self reportWithError:&error];
+		dispatch_async(dispatch_get_main_queue(), ^{
+			handler(report, error);
+		});
+	});
+}
+
 - (BOOL)isSynced {
 	return (resourcesURL != nil);
 }
 
 @end
+
+static void FRTranslationReportAddCounts(NSMutableDictionary *totals, NSString *key, FRTranslationCounts counts) {
+	NSDictionary *current = [totals objectForKey:key];
+	NSUInteger translated = [[current objectForKey:FRTranslationReportTranslatedKey] unsignedIntegerValue];
+	NSUInteger untranslated = [[current objectForKey:FRTranslationReportUntranslatedKey] unsignedIntegerValue];
+	NSUInteger equal = [[current objectForKey:FRTranslationReportEqualKey] unsignedIntegerValue];
+	[totals setObject:[NSDictionary dictionaryWithObjectsAndKeys:
+					   [NSNumber numberWithUnsignedInteger:translated + counts.translated],
+					   FRTranslationReportTranslatedKey,
+					   [NSNumber numberWithUnsignedInteger:untranslated + counts.untranslated],
+					   FRTranslationReportUntranslatedKey,
+					   [NSNumber numberWithUnsignedInteger:equal + counts.equal],
+					   FRTranslationReportEqualKey, nil]
+			   forKey:key];
+}
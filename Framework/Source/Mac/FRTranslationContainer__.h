@@ -15,6 +15,16 @@
 // OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 // 
 
+extern NSString * const FRTranslationReportFilesKey;
+extern NSString * const FRTranslationReportBundlesKey;
+extern NSString * const FRTranslationReportLanguagesKey;
+extern NSString * const FRTranslationReportPathKey;
+extern NSString * const FRTranslationReportBundleKey;
+extern NSString * const FRTranslationReportLanguageKey;
+extern NSString * const FRTranslationReportTranslatedKey;
+extern NSString * const FRTranslationReportUntranslatedKey;
+extern NSString * const FRTranslationReportEqualKey;
+
 @interface FRTranslationContainer : NSObject {
 @private;
 	NSBundle *applicationBundle;
@@ -57,6 +67,23 @@
  */
 - (NSArray *)infoItemsForLanguage:(NSString *)language error:(NSError **)error;
 
+/*!
+ \brief		Create a translation progress report
+ \details	Counts the translated, untranslated and equal entries of every strings file for every bundle
+			and language in the container. All languages and files are handled in parallel. The report
+			contains a list of files (each with its path, bundle, language and counts), the counts for each
+			bundle by language, and the counts for each language. The report is plist and JSON compatible.
+			It could be slow, so it shouldn't be called on the main thread.
+ */
+- (NSDictionary *)reportWithError:(NSError **)error;
+
+/*!
+ \brief		Create a translation progress report in the background
+ \details	Creates the report in the background and calls the handler on the main thread with the report
+			or the error that occurred.
+ */
+- (void)generateReportWithCompletionHandler:(void (^)(NSDictionary *report, NSError *error))handler;
+
 /*!
  \brief		Check if this container is synced
  \details	This is a synced container if it was created as such. These containers
@@ -18,6 +18,8 @@
 #import "FRTranslationInfo__.h"
 #import "FRBundleAdditions.h"
 #import "FRStrings.h"
+#import "FRStringsJournal.h"
+#import "FRTranslationStatus.h"
 
 static void filechange(ConstFSEventStreamRef, void *, size_t, void *,
 					   const FSEventStreamEventFlags[], const FSEventStreamEventId[]);
@@ -131,26 +133,34 @@ static void filechange(ConstFSEventStreamRef, void *, size_t, void *,
 	[super finalize];
 }
 
++ (BOOL)getCounts:(FRTranslationCounts *)counts forStringsFileAtPath:(NSString *)path error:(NSError **)error {
+	FRStrings *contents = [FRStringsJournal stringsWithContentsOfFile:path
+														   usedFormat:&(FRStringsFormat){0}
+																error:error];
+	if (!contents) { return FALSE; }
+	
+	FRTranslationStatusMap *map = [contents createTranslationStatusMap];
+	if (!map) {
+		if (error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:ENOMEM userInfo:nil]; }
+		return FALSE;
+	}
+	
+	counts->translated = FRTranslationStatusMapCount(map, FRTranslationStatusTranslated);
+	counts->untranslated = FRTranslationStatusMapCount(map, FRTranslationStatusUntranslated);
+	counts->equal = FRTranslationStatusMapCount(map, FRTranslationStatusEqual);
+	FRTranslationStatusMapFree(map);
+	return TRUE;
+}
+
 - (NSUInteger)untranslatedCount {
 	if (!untranslatedKnown) {
 		untranslatedCount = 0;
 		
-		// calculate
+		// calculate (including changes that are still in the journal)
 		NSError *error = nil;
-		FRStrings *contents = [[FRStrings alloc] initWithContentsOfFile:self.path
-															 usedFormat:&(FRStringsFormat){0}
-																  error:&error];
-		if (contents) {
-			for (NSString *string in contents) {
-				NSString *translation = [contents translationForString:string];
-				NSArray *comments = [contents commentsForString:string];
-				NSString *lastComment = [comments lastObject];
-				BOOL untranslated = [string isEqualToString:translation];
-				BOOL equalComment = lastComment ? [lastComment rangeOfString:@"=="].location != NSNotFound : NO;
-				if (untranslated && !equalComment) {
-					untranslatedCount++;
-				}
-			}
+		FRTranslationCounts counts;
+		if ([[self class] getCounts:&counts forStringsFileAtPath:self.path error:&error]) {
+			untranslatedCount = counts.untranslated;
 		}
 		else { NSLog(@"Error getting untranslated count: %@", error); }
 		untranslatedKnown = TRUE;
@@ -15,6 +15,18 @@
 // OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 // 
 
+/*!
+ \brief		Entry counts for a strings file
+ \details	Entries whose translation differs from their key are translated. Entries whose translation is
+			the same as their key are untranslated unless their last comment contains ==, in which case
+			they're meant to be equal.
+ */
+typedef struct FRTranslationCounts {
+	NSUInteger translated;
+	NSUInteger untranslated;
+	NSUInteger equal;
+} FRTranslationCounts;
+
 @interface FRTranslationInfo : NSObject {
 	FSEventStreamRef stream;
 	BOOL untranslatedKnown;
@@ -31,6 +43,13 @@
 
 + (id)infoWithLanguage:(NSString *)language path:(NSString *)path;
 
+/*!
+ \brief		Count the entries in a strings file
+ \details	Counts the translated, untranslated and equal entries in the strings file at the given path,
+			including changes that are still in its journal. This can be called from any thread.
+ */
++ (BOOL)getCounts:(FRTranslationCounts *)counts forStringsFileAtPath:(NSString *)path error:(NSError **)error;
+
 @property (readonly) NSString *path;
 
 @property (readonly) NSString *fileName;
@@ -0,0 +1,75 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+extern NSString * const FRTranslationMemorySourceKey;
+extern NSString * const FRTranslationMemoryTranslationKey;
+extern NSString * const FRTranslationMemoryDistanceKey;
+extern NSString * const FRTranslationMemoryPathKey;
+
+/*!
+ \brief		Translation memory for previously translated strings
+ \details	Indexes every translated entry (source string, translation and language) of the strings files in
+			the translations storage so that translators can be offered the closest previous translations
+			of a string, no matter which bundle or table they were made in.
+ */
+@interface FRTranslationMemoryIndex : NSObject {
+	NSString *storagePath;
+	struct FRTranslationMemory *memory;
+	dispatch_queue_t queue;
+	NSMutableDictionary *languageIDs;
+	NSMutableDictionary *fileEntries;
+	NSMutableArray *entryPaths;
+}
+
+/*!
+ \brief		Create a translation memory for the translations storage
+ \details	The memory is empty until it is built.
+ */
++ (id)memoryIndex;
+
+/*!
+ \brief		Create a translation memory for a directory
+ \details	All strings files in lproj directories anywhere inside the directory are indexed. The memory is
+			empty until it is built.
+ */
++ (id)memoryIndexWithContentsOfDirectory:(NSString *)path;
+
+/*!
+ \brief		Build the memory
+ \details	Reads all strings files in the background. The handler is called on the main thread once the
+			memory is ready.
+ */
+- (void)buildWithCompletionHandler:(void (^)(void))handler;
+
+/*!
+ \brief		Update a single file
+ \details	Replaces the entries from the strings file at the given path with its current contents (or
+			removes them if the file no longer exists). This happens in the background.
+ */
+- (void)updateStringsFileAtPath:(NSString *)path;
+
+/*!
+ \brief		Closest previous translations
+ \details	Returns up to limit suggestions for translating the string into the given language, closest
+			first. Each suggestion is a dictionary with the source string, its translation, the edit
+			distance to the string and the path of the file it came from. Only sources that are within the
+			suggestion distance of the string are suggested (see FRTranslationMemorySuggestionDistance).
+ */
+- (NSArray *)suggestionsForString:(NSString *)string language:(NSString *)language limit:(NSUInteger)limit;
+
+@end
@@ -0,0 +1,269 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#import "FRTranslationMemoryIndex.h"
+#import "FRLocalizationBundleAdditions__.h"
+#import "FRStrings.h"
+#import "FRStringsJournal.h"
+#import "FRTranslationMemory.h"
+#import "FRTranslationStatus.h"
+
+NSString * const FRTranslationMemorySourceKey = @"source";
+NSString * const FRTranslationMemoryTranslationKey = @"translation";
+NSString * const FRTranslationMemoryDistanceKey = @"distance";
+NSString * const FRTranslationMemoryPathKey = @"path";
+
+@interface FRTranslationMemoryIndex ()
+- (id)initWithStoragePath:(NSString *)path;
+- (void)indexFiles:(NSArray *)paths completionHandler:(void (^)(void))handler;
+- (NSArray *)translatedPairsInStringsFileAtPath:(NSString *)path;
+- (void)removeEntriesForFileAtPath:(NSString *)path;
+- (void)compactMemory;
+@end
+
+@implementation FRTranslationMemoryIndex
+
++ (id)memoryIndex {
+	return [[self alloc] initWithStoragePath:[NSBundle translactionStoragePath]];
+}
+
++ (id)memoryIndexWithContentsOfDirectory:(NSString *)path {
+	return [[self alloc] initWithStoragePath:path];
+}
+
+- (id)init {
+	[self doesNotRecognizeSelector:_cmd];
+	return nil;
+}
+
+- (id)initWithStoragePath:(NSString *)path {
+	if ((self = [super init])) {
+		storagePath = [path copy];
+		memory = FRTranslationMemoryCreate();
+		queue = dispatch_queue_create("com.fadingred.Greenwich.memory", DISPATCH_QUEUE_SERIAL);
+		languageIDs = [[NSMutableDictionary alloc] init];
+		fileEntries = [[NSMutableDictionary alloc] init];
+		entryPaths = [[NSMutableArray alloc] init];
+	}
+	return self;
+}
+
+#if !__OBJC_GC__
+- (void)dealloc {
+	FRTranslationMemoryFree(memory);
+#if !OS_OBJECT_USE_OBJC
+	dispatch_release(queue);
+#endif
+}
+#endif
+
+- (void)finalize {
+	FRTranslationMemoryFree(memory);
+#if !OS_OBJECT_USE_OBJC
+	dispatch_release(queue);
+#endif
+	[super finalize];
+}
+
+
+#pragma mark -
+#pragma mark building
+// ----------------------------------------------------------------------------------------------------
+// building
+// ----------------------------------------------------------------------------------------------------
+
+- (void)buildWithCompletionHandler:(void (^)(void))handler {
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		NSMutableArray *paths = [NSMutableArray array];
+		NSDirectoryEnumerator *enumerator = [[NSFileManager defaultManager] enumeratorAtPath:storagePath];
+		for (NSString *subpath in enumerator) {
+			if ([[subpath pathExtension] isEqualToString:@"strings"] &&
+				[[[subpath stringByDeletingLastPathComponent] pathExtension] isEqualToString:@"lproj"]) {
+				[paths addObject:[storagePath stringByAppendingPathComponent:subpath]];
+			}
+		}
+		[self indexFiles:paths completionHandler:handler];
+	});
+}
+
+- (void)updateStringsFileAtPath:(NSString *)path {
+	NSArray *paths = [NSArray arrayWithObject:[path copy]];
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		[self indexFiles:paths completionHandler:nil];
+	});
+}
+
+- (void)indexFiles:(NSArray *)paths completionHandler:(void (^)(void))handler {
+	NSUInteger count = [paths count];
+	NSMutableArray *contents = [NSMutableArray arrayWithCapacity:count];
+	for (NSUInteger position = 0; position < count; position++) { [contents addObject:[NSNull null]]; }
+	
+	// reading the files is independent for each file. the memory itself is only modified on the queue.
+	dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t position) {
+		NSArray *pairs = [self translatedPairsInStringsFileAtPath:[paths objectAtIndex:position]];
+		if (pairs) {
+			@synchronized(contents) {
+				[contents replaceObjectAtIndex:position withObject:pairs];
+			}
+		}
+	});
+	
+	dispatch_sync(queue, ^{
+		NSMutableData *buffer = [NSMutableData data];
+		for (NSUInteger position = 0; position < count; position++) {
+			NSString *path = [paths objectAtIndex:position];
+			NSArray *pairs = [contents objectAtIndex:position];
+			[self removeEntriesForFileAtPath:path];
+			if ((id)pairs == [NSNull null]) { continue; }
+			
+			NSString *language = [[[path stringByDeletingLastPathComponent] lastPathComponent]
+								  stringByDeletingPathExtension];
+			NSNumber *languageID = [languageIDs objectForKey:language];
+			if (!languageID) {
+				languageID = [NSNumber numberWithUnsignedInt:(uint32_t)[languageIDs count]];
+				[languageIDs setObject:languageID forKey:language];
+			}
+			
+			NSMutableIndexSet *entries = [NSMutableIndexSet indexSet];
+			for (NSArray *pair in pairs) {
+				NSString *source = [pair objectAtIndex:0];
+				NSString *translation = [pair objectAtIndex:1];
+				NSUInteger sourceLength = [source length];
+				NSUInteger translationLength = [translation length];
+				[buffer setLength:(sourceLength + translationLength) * sizeof(FRStringsChar)];
+				FRStringsChar *chars = [buffer mutableBytes];
+				[source getCharacters:chars range:NSMakeRange(0, sourceLength)];
+				[translation getCharacters:chars + sourceLength range:NSMakeRange(0, translationLength)];
+				uint32_t entry = FRTranslationMemoryAdd(memory, [languageID unsignedIntValue],
+														chars, sourceLength, chars + sourceLength, translationLength);
+				if (entry == UINT32_MAX) { break; }
+				[entryPaths addObject:path];
+				[entries addIndex:entry];
+			}
+			[fileEntries setObject:entries forKey:path];
+		}
+		
+		// files that are edited get indexed again after every save, which leaves their old entries behind
+		if (FRTranslationMemoryNeedsCompaction(memory)) { [self compactMemory]; }
+	});
+	
+	if (handler) {
+		dispatch_async(dispatch_get_main_queue(), handler);
+	}
+}
+
+- (NSArray *)translatedPairsInStringsFileAtPath:(NSString *)path {
+	FRStrings *strings = [FRStringsJournal stringsWithContentsOfFile:path usedFormat:NULL error:NULL];
+	if (!strings) { return nil; }
+	
+	// only entries that have actually been translated are useful as suggestions. these are the same
+	// entries that don't count as untranslated in the translation info.
+	FRTranslationStatusMap *map = [strings createTranslationStatusMap];
+	if (!map) { return nil; }
+	
+	NSUInteger count = [strings count];
+	NSMutableArray *pairs = [NSMutableArray arrayWithCapacity:count];
+	for (NSUInteger index = 0; index < count; index++) {
+		NSString *string = [strings stringAtIndex:index];
+		NSString *translation = [strings translationForString:string];
+		if ([string length] && translation &&
+			FRTranslationStatusMapGet(map, index) != FRTranslationStatusUntranslated) {
+			[pairs addObject:[NSArray arrayWithObjects:string, translation, nil]];
+		}
+	}
+	FRTranslationStatusMapFree(map);
+	return pairs;
+}
+
+- (void)removeEntriesForFileAtPath:(NSString *)path {
+	[[fileEntries objectForKey:path] enumerateIndexesUsingBlock:^(NSUInteger entry, BOOL *stop) {
+		FRTranslationMemoryRemove(memory, (uint32_t)entry);
+	}];
+	[fileEntries removeObjectForKey:path];
+}
+
+- (void)compactMemory {
+	// compacting renumbers the entries, so the paths of the entries and the entries of each file follow
+	size_t count = FRTranslationMemoryCount(memory);
+	uint32_t *moved = malloc((count ? count : 1) * sizeof(uint32_t));
+	if (moved && FRTranslationMemoryCompact(memory, moved)) {
+		NSMutableArray *paths = [NSMutableArray arrayWithCapacity:FRTranslationMemoryCount(memory)];
+		for (size_t entry = 0; entry < count; entry++) {
+			if (moved[entry] != UINT32_MAX) { [paths addObject:[entryPaths objectAtIndex:entry]]; }
+		}
+		[entryPaths setArray:paths];
+		
+		for (NSString *path in [fileEntries allKeys]) {
+			NSMutableIndexSet *entries = [NSMutableIndexSet indexSet];
+			[[fileEntries objectForKey:path] enumerateIndexesUsingBlock:^(NSUInteger entry, BOOL *stop) {
+				[entries addIndex:moved[entry]];
+			}];
+			[fileEntries setObject:entries forKey:path];
+		}
+	}
+	free(moved);
+}
+
+
+#pragma mark -
+#pragma mark suggestions
+// ----------------------------------------------------------------------------------------------------
+// suggestions
+// ----------------------------------------------------------------------------------------------------
+
+- (NSArray *)suggestionsForString:(NSString *)string language:(NSString *)language limit:(NSUInteger)limit {
+	NSUInteger length = [string length];
+	NSMutableArray *results = [NSMutableArray array];
+	if (!length || !limit) { return results; }
+	
+	FRStringsChar *chars = malloc(length * sizeof(FRStringsChar));
+	FRTranslationMemoryMatch *matches = malloc(limit * sizeof(FRTranslationMemoryMatch));
+	uint32_t maximumDistance = FRTranslationMemorySuggestionDistance(length);
+	
+	if (chars && matches) {
+		[string getCharacters:chars range:NSMakeRange(0, length)];
+		dispatch_sync(queue, ^{
+			NSNumber *languageID = [languageIDs objectForKey:language];
+			if (!languageID) { return; }
+			
+			size_t count = FRTranslationMemorySearch(memory, [languageID unsignedIntValue], chars, length,
+													 maximumDistance, matches, limit);
+			for (size_t position = 0; position < count; position++) {
+				uint32_t entry = matches[position].entry;
+				size_t sourceLength = 0;
+				size_t translationLength = 0;
+				const FRStringsChar *source = FRTranslationMemorySource(memory, entry, &sourceLength);
+				const FRStringsChar *translation = FRTranslationMemoryTranslation(memory, entry, &translationLength);
+				[results addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+									[NSString stringWithCharacters:source length:sourceLength],
+									FRTranslationMemorySourceKey,
+									[NSString stringWithCharacters:translation length:translationLength],
+									FRTranslationMemoryTranslationKey,
+									[NSNumber numberWithUnsignedInt:matches[position].distance],
+									FRTranslationMemoryDistanceKey,
+									[entryPaths objectAtIndex:entry], FRTranslationMemoryPathKey, nil]];
+			}
+		});
+	}
+	
+	free(chars);
+	free(matches);
+	return results;
+}
+
+@end
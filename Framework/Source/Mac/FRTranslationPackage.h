@@ -0,0 +1,86 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+extern NSString * const FRTranslationPackageErrorDomain;
+extern NSString * const FRTranslationPackageManifestName;
+extern NSString * const FRTranslationPackageIndexName;
+
+enum {
+	FRTranslationPackageDamagedError = 1,		// the package contents don't match its manifest
+	FRTranslationPackageBaseMismatchError = 2,	// a delta package was made for different contents
+};
+
+/*!
+ \brief		Translation packages
+ \details	A package is a tar/bzip2 archive with a single folder holding strings files and a manifest of
+			the content hash of every file. A delta package only holds the files that differ from an
+			earlier (base) manifest, along with the full manifest and the hash of the base manifest.
+			Packages end with an index for reading them without extracting (see FRTranslationPackageReader).
+			Manifests are dictionaries from paths inside the folder to content hashes. Packages made before
+			there were manifests don't have one and are treated as full packages.
+ */
+@interface FRTranslationPackage : NSObject
+
+/*!
+ \brief		Create a package
+ \details	The contents map paths inside the package folder to paths of the files to add. With a base
+			manifest, only the files that are new or changed since the base are added. The manifest for
+			all of the contents is returned so it can be used as the base of the next package. The
+			identifier (like the bundle identifier and language) tells packages of the same translations
+			apart from others with the same name (see identifierOfPackageAtPath:).
+ */
++ (BOOL)createPackageAtPath:(NSString *)path
+					   name:(NSString *)name
+				 identifier:(NSString *)identifier
+				   contents:(NSDictionary *)contents
+			   baseManifest:(NSDictionary *)base
+				   manifest:(NSDictionary **)manifest
+					  error:(NSError **)error;
+
+/*!
+ \brief		Apply a package
+ \details	Replaces the directory with the contents of the package. A delta package is only applied
+			if the directory still holds exactly the contents of its base; the unchanged files are then
+			carried over from the directory. All files are checked against the manifest, and the
+			directory is only replaced once the complete new contents are in place next to it. Replacing
+			it takes two renames; if the application quits in between, the directory is missing until
+			the next apply to it restores the old contents (kept next to it) first. Packages listing paths
+			that aren't plain paths inside the directory, or that go through links, are damaged.
+ */
++ (BOOL)applyPackageAtPath:(NSString *)path toDirectory:(NSString *)directory error:(NSError **)error;
+
+/*!
+ \brief		Identifier of a package
+ \details	Returns the identifier the package was created with or nil if it doesn't have one that can be
+			used as a file name.
+ */
++ (NSString *)identifierOfPackageAtPath:(NSString *)path;
+
+/*!
+ \brief		Read a manifest
+ \details	Returns the manifest stored at the given path or nil if there's none.
+ */
++ (NSDictionary *)manifestAtPath:(NSString *)path;
+
+/*!
+ \brief		Write a manifest
+ \details	Write a manifest
+ */
++ (BOOL)writeManifest:(NSDictionary *)manifest toPath:(NSString *)path error:(NSError **)error;
+
+@end
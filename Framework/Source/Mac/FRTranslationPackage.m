@@ -0,0 +1,370 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <CommonCrypto/CommonDigest.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#import "FRTranslationPackage.h"
+#import "FRTranslationPackageReader.h"
+#import "FRFileManagerArchivingAdditions.h"
+#import "archiving.h"
+
+NSString * const FRTranslationPackageErrorDomain = @"FRTranslationPackageErrorDomain";
+NSString * const FRTranslationPackageManifestName = @".manifest";
+NSString * const FRTranslationPackageIndexName = @".index";
+static NSString * const FRManifestHeader = @"greenwich-manifest 1";
+static NSString * const FRManifestBasePrefix = @"base ";
+static NSString * const FRManifestIdentifierPrefix = @"package ";
+static const size_t kFileHashBufferSize = 64 * 1024;
+
+static NSString *FRDigestString(const unsigned char *digest);
+static NSString *FRContentHash(NSData *data);
+static NSString *FRFileHash(NSString *path, NSError **error);
+static NSString *FRManifestDigest(NSDictionary *manifest);
+static NSData *FRManifestData(NSDictionary *manifest, NSString *baseDigest, NSString *identifier);
+static NSDictionary *FRReadManifest(NSString *path, NSString **baseDigest);
+static NSDictionary *FRParseManifest(NSData *data, NSString **baseDigest, NSString **identifier);
+static BOOL FRReadPackageManifest(FRTranslationPackageReader *reader,
+								  NSDictionary **manifest, NSString **baseDigest, NSString **identifier);
+static BOOL FRManifestPathIsValid(NSString *directory, NSString *subpath);
+static BOOL FRDirectoryMatchesManifest(NSString *directory, NSDictionary *manifest);
+static NSError *FRPackageError(NSInteger code);
+
+@implementation FRTranslationPackage
+
+- (id)init {
+	[self doesNotRecognizeSelector:_cmd];
+	return nil;
+}
+
+
+#pragma mark -
+#pragma mark creating
+// ----------------------------------------------------------------------------------------------------
+// creating
+// ----------------------------------------------------------------------------------------------------
+
++ (BOOL)createPackageAtPath:(NSString *)path
+					   name:(NSString *)name
+				 identifier:(NSString *)identifier
+				   contents:(NSDictionary *)contents
+			   baseManifest:(NSDictionary *)base
+				   manifest:(NSDictionary **)result
+					  error:(NSError **)error {
+	
+	// files are hashed a piece at a time and archived straight from where they are, so neither holds a
+	// whole file in memory. a file that changes in between no longer matches the manifest, which makes
+	// applying the package fail rather than use the wrong contents.
+	NSMutableDictionary *manifest = [NSMutableDictionary dictionaryWithCapacity:[contents count]];
+	NSMutableDictionary *items = [NSMutableDictionary dictionary];
+	for (NSString *subpath in contents) {
+		NSString *source = [contents objectForKey:subpath];
+		NSString *hash = FRFileHash(source, error);
+		if (!hash) { return FALSE; }
+		
+		[manifest setObject:hash forKey:subpath];
+		if (![[base objectForKey:subpath] isEqualToString:hash]) {
+			[items setObject:source forKey:[name stringByAppendingPathComponent:subpath]];
+		}
+	}
+	
+	NSString *baseDigest = base ? FRManifestDigest(base) : nil;
+	[items setObject:FRManifestData(manifest, baseDigest, identifier)
+			  forKey:[name stringByAppendingPathComponent:FRTranslationPackageManifestName]];
+	
+	// the index lets FRTranslationPackageReader read single files without extracting the package
+	NSString *indexPath = [name stringByAppendingPathComponent:FRTranslationPackageIndexName];
+	BOOL success = [[NSFileManager defaultManager] compressContents:items to:path indexPath:indexPath error:error];
+	if (success && result) { *result = manifest; }
+	return success;
+}
+
+
+#pragma mark -
+#pragma mark applying
+// ----------------------------------------------------------------------------------------------------
+// applying
+// ----------------------------------------------------------------------------------------------------
+
++ (BOOL)applyPackageAtPath:(NSString *)path toDirectory:(NSString *)directory error:(NSError **)error {
+	NSFileManager *manager = [NSFileManager defaultManager];
+	BOOL success = TRUE;
+	
+	// everything is put together next to the directory, so swapping it in is just a rename
+	NSString *parent = [directory stringByDeletingLastPathComponent];
+	if (![parent length]) { parent = @"."; }
+	NSString *previous = [parent stringByAppendingPathComponent:
+						  [NSString stringWithFormat:@".%@.previous", [directory lastPathComponent]]];
+	
+	// the old contents are moved aside before the new ones take their place. if an earlier apply was
+	// interrupted in between, the directory is missing and gets its old contents back here.
+	if (![manager fileExistsAtPath:directory] && [manager fileExistsAtPath:previous] &&
+		![manager moveItemAtPath:previous toPath:directory error:error]) {
+		return FALSE;
+	}
+	[manager removeItemAtPath:previous error:NULL];
+	
+	// a delta that doesn't fit the directory is turned down before anything is extracted. thanks to the
+	// index, reading the manifest only decompresses the end of the package. packages from before there
+	// were manifests hold all of the contents and are extracted as they are.
+	FRTranslationPackageReader *reader = [FRTranslationPackageReader readerWithContentsOfFile:path error:error];
+	if (!reader) { return FALSE; }
+	NSString *baseDigest = nil;
+	NSDictionary *manifest = nil;
+	BOOL hasManifest = FRReadPackageManifest(reader, &manifest, &baseDigest, NULL);
+	
+	// the paths in the manifest come from the package and are used to read from the directory, so ones
+	// that could lead out of it (or through a link) mean the package is damaged
+	BOOL damaged = (hasManifest && !manifest);
+	for (NSString *subpath in manifest) {
+		if (!FRManifestPathIsValid(directory, subpath)) { damaged = TRUE; }
+	}
+	if (damaged) {
+		if (error) { *error = FRPackageError(FRTranslationPackageDamagedError); }
+		return FALSE;
+	}
+	if (baseDigest) {
+		NSDictionary *current = FRReadManifest([directory stringByAppendingPathComponent:
+												FRTranslationPackageManifestName], NULL);
+		if (!current || ![FRManifestDigest(current) isEqualToString:baseDigest] ||
+			!FRDirectoryMatchesManifest(directory, current)) {
+			if (error) { *error = FRPackageError(FRTranslationPackageBaseMismatchError); }
+			return FALSE;
+		}
+	}
+	
+	char *dirname = NULL;
+	asprintf(&dirname, "%s/.%s.XXXXXX",
+			 [parent fileSystemRepresentation], [[directory lastPathComponent] fileSystemRepresentation]);
+	char *temp_location = dirname ? mkdtemp(dirname) : NULL;
+	if (!temp_location) {
+		if (error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]; }
+		free(dirname);
+		return FALSE;
+	}
+	NSString *temp = [manager stringWithFileSystemRepresentation:temp_location length:strlen(temp_location)];
+	NSString *staging = [temp stringByAppendingPathComponent:@"new"];
+	free(dirname);
+	
+	success = [manager uncompressItemAtPath:path to:staging error:error];
+	
+	// the files a delta doesn't include are carried over with hard links, so nothing gets copied
+	if (success && baseDigest) {
+		for (NSString *subpath in manifest) {
+			if (!success) { break; }
+			
+			// links in the package could send the files that are carried over somewhere else
+			if (!FRManifestPathIsValid(staging, subpath)) {
+				if (error) { *error = FRPackageError(FRTranslationPackageDamagedError); }
+				success = FALSE;
+				break;
+			}
+			NSString *destination = [staging stringByAppendingPathComponent:subpath];
+			if ([manager fileExistsAtPath:destination]) { continue; }
+			
+			NSString *source = [directory stringByAppendingPathComponent:subpath];
+			success = ([manager createDirectoryAtPath:[destination stringByDeletingLastPathComponent]
+						  withIntermediateDirectories:YES attributes:nil error:error] &&
+					   ([manager linkItemAtPath:source toPath:destination error:NULL] ||
+						[manager copyItemAtPath:source toPath:destination error:error]));
+		}
+	}
+	
+	if (success && hasManifest && !FRDirectoryMatchesManifest(staging, manifest)) {
+		if (error) { *error = FRPackageError(FRTranslationPackageDamagedError); }
+		success = FALSE;
+	}
+	
+	// the staged directory now holds the full new contents, so its manifest doesn't need the base
+	if (success && hasManifest) {
+		success = [self writeManifest:manifest
+							   toPath:[staging stringByAppendingPathComponent:FRTranslationPackageManifestName]
+								error:error];
+	}
+	
+	// there's no way to swap two directories in one step, so the old contents are kept next to the
+	// directory until the new ones are in place. see above for picking up after a crash in between.
+	if (success) {
+		BOOL exists = [manager fileExistsAtPath:directory];
+		success = (!exists || [manager moveItemAtPath:directory toPath:previous error:error]);
+		if (success && ![manager moveItemAtPath:staging toPath:directory error:error]) {
+			if (exists) { [manager moveItemAtPath:previous toPath:directory error:NULL]; }
+			success = FALSE;
+		}
+		if (success) { [manager removeItemAtPath:previous error:NULL]; }
+	}
+	
+	[manager removeItemAtPath:temp error:NULL];
+	return success;
+}
+
+
+#pragma mark -
+#pragma mark manifests
+// ----------------------------------------------------------------------------------------------------
+// manifests
+// ----------------------------------------------------------------------------------------------------
+
++ (NSDictionary *)manifestAtPath:(NSString *)path {
+	return FRReadManifest(path, NULL);
+}
+
++ (BOOL)writeManifest:(NSDictionary *)manifest toPath:(NSString *)path error:(NSError **)error {
+	return [FRManifestData(manifest, nil, nil) writeToFile:path options:NSDataWritingAtomic error:error];
+}
+
++ (NSString *)identifierOfPackageAtPath:(NSString *)path {
+	FRTranslationPackageReader *reader = [FRTranslationPackageReader readerWithContentsOfFile:path error:NULL];
+	NSString *identifier = nil;
+	if (reader) { FRReadPackageManifest(reader, NULL, NULL, &identifier); }
+	
+	// it's used as a file name, so it can't hold anything that would make it a path
+	if (![identifier length] || [identifier hasPrefix:@"."] ||
+		[identifier rangeOfString:@"/"].location != NSNotFound) { return nil; }
+	return identifier;
+}
+
+@end
+
+static NSString *FRDigestString(const unsigned char *digest) {
+	NSMutableString *hash = [NSMutableString stringWithCapacity:CC_SHA1_DIGEST_LENGTH * 2];
+	for (size_t index = 0; index < CC_SHA1_DIGEST_LENGTH; index++) { [hash appendFormat:@"%02x", digest[index]]; }
+	return hash;
+}
+
+static NSString *FRContentHash(NSData *data) {
+	unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+	CC_SHA1([data bytes], (CC_LONG)[data length], digest);
+	return FRDigestString(digest);
+}
+
+static NSString *FRFileHash(NSString *path, NSError **error) {
+	int fd = open([path fileSystemRepresentation], O_RDONLY);
+	if (fd < 0) {
+		if (error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]; }
+		return nil;
+	}
+	
+	CC_SHA1_CTX context;
+	CC_SHA1_Init(&context);
+	unsigned char buffer[kFileHashBufferSize];
+	int failure = 0;
+	while (TRUE) {
+		ssize_t length = read(fd, buffer, sizeof(buffer));
+		if (length > 0) { CC_SHA1_Update(&context, buffer, (CC_LONG)length); }
+		else if (length == 0) { break; }
+		else if (errno != EINTR) { failure = errno; break; }
+	}
+	close(fd);
+	if (failure) {
+		if (error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:failure userInfo:nil]; }
+		return nil;
+	}
+	
+	unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+	CC_SHA1_Final(digest, &context);
+	return FRDigestString(digest);
+}
+
+static NSString *FRManifestDigest(NSDictionary *manifest) {
+	// the digest only covers the entries, so a manifest keeps its digest whatever base it names
+	return FRContentHash(FRManifestData(manifest, nil, nil));
+}
+
+static NSData *FRManifestData(NSDictionary *manifest, NSString *baseDigest, NSString *identifier) {
+	NSMutableString *string = [NSMutableString stringWithFormat:@"%@\n", FRManifestHeader];
+	if (identifier) { [string appendFormat:@"%@%@\n", FRManifestIdentifierPrefix, identifier]; }
+	if (baseDigest) { [string appendFormat:@"%@%@\n", FRManifestBasePrefix, baseDigest]; }
+	for (NSString *subpath in [[manifest allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+		[string appendFormat:@"%@ %@\n", [manifest objectForKey:subpath], subpath];
+	}
+	return [string dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+static NSDictionary *FRReadManifest(NSString *path, NSString **baseDigest) {
+	return FRParseManifest([NSData dataWithContentsOfFile:path], baseDigest, NULL);
+}
+
+static NSDictionary *FRParseManifest(NSData *data, NSString **baseDigest, NSString **identifier) {
+	if (!data) { return nil; }
+	NSString *string = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+	NSArray *lines = [string componentsSeparatedByString:@"\n"];
+	if (![[lines objectAtIndex:0] isEqualToString:FRManifestHeader]) { return nil; }
+	
+	NSMutableDictionary *manifest = [NSMutableDictionary dictionary];
+	for (NSString *line in [lines subarrayWithRange:NSMakeRange(1, [lines count] - 1)]) {
+		if ([line hasPrefix:FRManifestBasePrefix]) {
+			if (baseDigest) { *baseDigest = [line substringFromIndex:[FRManifestBasePrefix length]]; }
+			continue;
+		}
+		if ([line hasPrefix:FRManifestIdentifierPrefix]) {
+			if (identifier) { *identifier = [line substringFromIndex:[FRManifestIdentifierPrefix length]]; }
+			continue;
+		}
+		NSRange separator = [line rangeOfString:@" "];
+		if (separator.location == NSNotFound) { continue; }
+		[manifest setObject:[line substringToIndex:separator.location]
+					 forKey:[line substringFromIndex:NSMaxRange(separator)]];
+	}
+	return manifest;
+}
+
+static BOOL FRReadPackageManifest(FRTranslationPackageReader *reader,
+								  NSDictionary **manifest, NSString **baseDigest, NSString **identifier) {
+	// the manifest is at the top of the package folder. a package holding one that can't be read gives
+	// a nil manifest, but still has one.
+	for (NSString *subpath in [reader paths]) {
+		if ([[subpath pathComponents] count] == 2 &&
+			[[subpath lastPathComponent] isEqualToString:FRTranslationPackageManifestName]) {
+			NSDictionary *result = FRParseManifest([reader dataForPath:subpath error:NULL], baseDigest, identifier);
+			if (manifest) { *manifest = result; }
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static BOOL FRManifestPathIsValid(NSString *directory, NSString *subpath) {
+	char path[PATH_MAX];
+	return ([subpath getFileSystemRepresentation:path maxLength:sizeof(path)] &&
+			archive_check_path([directory fileSystemRepresentation], path) == 0);
+}
+
+static BOOL FRDirectoryMatchesManifest(NSString *directory, NSDictionary *manifest) {
+	NSMutableSet *remaining = [NSMutableSet setWithArray:[manifest allKeys]];
+	NSDirectoryEnumerator *enumerator = [[NSFileManager defaultManager] enumeratorAtPath:directory];
+	for (NSString *subpath in enumerator) {
+		if (![[[enumerator fileAttributes] fileType] isEqualToString:NSFileTypeRegular]) { continue; }
+		if ([[subpath lastPathComponent] hasPrefix:@"."]) { continue; } // the manifest and finder files
+		
+		NSString *hash = [manifest objectForKey:subpath];
+		NSString *actual = hash ? FRFileHash([directory stringByAppendingPathComponent:subpath], NULL) : nil;
+		if (![actual isEqualToString:hash]) { return FALSE; }
+		[remaining removeObject:subpath];
+	}
+	return ([remaining count] == 0);
+}
+
+static NSError *FRPackageError(NSInteger code) {
+	NSString *description = (code == FRTranslationPackageBaseMismatchError) ?
+		@"The package was made for different translations than the ones it's applied to." :
+		@"The package is damaged.";
+	NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
+							  description, NSLocalizedDescriptionKey, nil];
+	return [NSError errorWithDomain:FRTranslationPackageErrorDomain code:code userInfo:userInfo];
+}
@@ -0,0 +1,50 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+/*!
+ \brief		Translation package reader
+ \details	Reads single files straight from a translation package without extracting it. Packages with an
+			index only decompress the parts that hold the requested file, so opening even a large package
+			is instant. Older packages are read in a single pass when the reader is created. A reader must
+			only be used on one thread at a time.
+ */
+@interface FRTranslationPackageReader : NSObject {
+	NSData *data;
+	struct archiving_reader *reader;
+	NSArray *paths;
+}
+
+/*!
+ \brief		Create a reader
+ \details	The package is mapped into memory rather than read.
+ */
++ (id)readerWithContentsOfFile:(NSString *)path error:(NSError **)error;
+
+/*!
+ \brief		Files in the package
+ \details	The paths of all files in the package, sorted.
+ */
+- (NSArray *)paths;
+
+/*!
+ \brief		Contents of a file
+ \details	Returns the contents of the file at the given path in the package, or nil if it couldn't be
+			read (the error is in the POSIX domain).
+ */
+- (NSData *)dataForPath:(NSString *)path error:(NSError **)error;
+
+@end
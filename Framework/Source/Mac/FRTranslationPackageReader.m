@@ -0,0 +1,92 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#import "FRTranslationPackageReader.h"
+#import "FRTranslationPackage.h"
+#import "archiving.h"
+
+@interface FRTranslationPackageReader ()
+- (id)initWithData:(NSData *)data error:(NSError **)error;
+@end
+
+@implementation FRTranslationPackageReader
+
++ (id)readerWithContentsOfFile:(NSString *)path error:(NSError **)error {
+	NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:error];
+	return data ? [[self alloc] initWithData:data error:error] : nil;
+}
+
+- (id)init {
+	[self doesNotRecognizeSelector:_cmd];
+	return nil;
+}
+
+- (id)initWithData:(NSData *)packageData error:(NSError **)error {
+	if ((self = [super init])) {
+		// the reader points into the data, so it's kept for as long as the reader
+		data = packageData;
+		int status = archiving_reader_create([data bytes], [data length],
+											 [FRTranslationPackageIndexName fileSystemRepresentation], &reader);
+		if (status != 0) {
+			if (error) { *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:status userInfo:nil]; }
+			reader = NULL;
+			return nil;
+		}
+		
+		NSFileManager *manager = [NSFileManager defaultManager];
+		size_t count = archiving_reader_count(reader);
+		NSMutableArray *result = [NSMutableArray arrayWithCapacity:count];
+		for (size_t index = 0; index < count; index++) {
+			const char *path = archiving_reader_path(reader, index);
+			[result addObject:[manager stringWithFileSystemRepresentation:path length:strlen(path)]];
+		}
+		paths = [result copy];
+	}
+	return self;
+}
+
+#if !__OBJC_GC__
+- (void)dealloc {
+	if (reader) { archiving_reader_free(reader); }
+}
+#endif
+
+- (void)finalize {
+	if (reader) { archiving_reader_free(reader); }
+	[super finalize];
+}
+
+- (NSArray *)paths {
+	return paths;
+}
+
+- (NSData *)dataForPath:(NSString *)path error:(NSError **)error {
+	void *buffer = NULL;
+	size_t length = 0;
+	int status = archiving_reader_read(reader, [path fileSystemRepresentation], &buffer, &length);
+	if (status != 0) {
+		if (error) {
+			NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:path, NSFilePathErrorKey, nil];
+			*error = [NSError errorWithDomain:NSPOSIXErrorDomain code:status userInfo:userInfo];
+		}
+		return nil;
+	}
+	return [NSData dataWithBytesNoCopy:buffer length:length freeWhenDone:YES];
+}
+
+@end
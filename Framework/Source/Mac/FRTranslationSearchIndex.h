@@ -0,0 +1,79 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+@class
+	FRTranslationContainer;
+
+enum {
+	FRTranslationSearchFieldKey,
+	FRTranslationSearchFieldTranslation,
+	FRTranslationSearchFieldComment,
+};
+typedef NSUInteger FRTranslationSearchField;
+
+enum {
+	FRTranslationSearchPrefix = 1 << 0,	// only match at the start of keys, translations and comments
+};
+typedef NSUInteger FRTranslationSearchOptions;
+
+extern NSString * const FRTranslationSearchPathKey;
+extern NSString * const FRTranslationSearchLanguageKey;
+extern NSString * const FRTranslationSearchStringKey;
+extern NSString * const FRTranslationSearchFieldKey;
+
+/*!
+ \brief		Full text search across a container
+ \details	Indexes the keys, translations and comments of every strings file that a translation
+			container exposes (for all of its languages) so they can be searched without opening each file.
+			Searches are case and diacritic insensitive. Files are indexed in parallel and the index is
+			kept up to date as files change on disk.
+ */
+@interface FRTranslationSearchIndex : NSObject {
+	FRTranslationContainer *container;
+	struct FRTextIndex *textIndex;
+	dispatch_queue_t queue;
+	NSMutableDictionary *documentIDs;
+	NSMutableDictionary *documents;
+	uint32_t nextDocumentID;
+	NSSet *languages;
+	NSSet *watchedPaths;
+	FSEventStreamRef stream;
+}
+
+/*!
+ \brief		Create a search index
+ \details	The index is empty until it is built.
+ */
++ (id)indexWithContainer:(FRTranslationContainer *)container;
+
+/*!
+ \brief		Build the index
+ \details	Looks up all strings files in the container and indexes them in the background. The handler
+			is called on the main thread once the index is ready.
+ */
+- (void)buildWithCompletionHandler:(void (^)(void))handler;
+
+/*!
+ \brief		Search the index
+ \details	Returns up to limit results, each a dictionary with the path and language of the file, the
+			string (key) of the entry and the field that matched. Results are grouped by file and ordered
+			the way the entries are in the file.
+ */
+- (NSArray *)resultsForQuery:(NSString *)query options:(FRTranslationSearchOptions)options limit:(NSUInteger)limit;
+
+@end
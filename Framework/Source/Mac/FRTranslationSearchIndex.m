@@ -0,0 +1,376 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#import "FRTranslationSearchIndex.h"
+#import "FRTranslationContainer__.h"
+#import "FRTranslationInfo__.h"
+#import "FRStrings.h"
+#import "FRStringsJournal.h"
+#import "FRTextIndex.h"
+
+NSString * const FRTranslationSearchPathKey = @"path";
+NSString * const FRTranslationSearchLanguageKey = @"language";
+NSString * const FRTranslationSearchStringKey = @"string";
+NSString * const FRTranslationSearchFieldKey = @"field";
+static NSString * const kStringsKey = @"strings";
+static NSString * const kAttributesKey = @"attributes";
+static const NSStringCompareOptions kFoldingOptions = NSCaseInsensitiveSearch | NSDiacriticInsensitiveSearch;
+
+static void filechange(ConstFSEventStreamRef, void *, size_t, void *,
+					   const FSEventStreamEventFlags[], const FSEventStreamEventId[]);
+
+@interface FRTranslationSearchIndex ()
+- (id)initWithContainer:(FRTranslationContainer *)container;
+- (void)indexFiles:(NSArray *)files completionHandler:(void (^)(void))handler;
+- (FRTextIndexSegment *)createSegmentForFile:(NSDictionary *)file document:(uint32_t)document
+									  record:(NSDictionary **)record;
+- (void)updateForChangesInDirectories:(NSSet *)directories;
+- (void)watchPaths:(NSSet *)paths;
+- (void)destroyEventStream;
+@end
+
+@implementation FRTranslationSearchIndex
+
++ (id)indexWithContainer:(FRTranslationContainer *)container {
+	return [[self alloc] initWithContainer:container];
+}
+
+- (id)init {
+	[self doesNotRecognizeSelector:_cmd];
+	return nil;
+}
+
+- (id)initWithContainer:(FRTranslationContainer *)aContainer {
+	if ((self = [super init])) {
+		container = aContainer;
+		textIndex = FRTextIndexCreate();
+		queue = dispatch_queue_create("com.fadingred.Greenwich.search", DISPATCH_QUEUE_SERIAL);
+		documentIDs = [[NSMutableDictionary alloc] init];
+		documents = [[NSMutableDictionary alloc] init];
+		languages = [NSSet set];
+	}
+	return self;
+}
+
+#if !__OBJC_GC__
+- (void)dealloc {
+	[self destroyEventStream];
+	FRTextIndexFree(textIndex);
+#if !OS_OBJECT_USE_OBJC
+	dispatch_release(queue);
+#endif
+}
+#endif
+
+- (void)finalize {
+	[self destroyEventStream];
+	FRTextIndexFree(textIndex);
+#if !OS_OBJECT_USE_OBJC
+	dispatch_release(queue);
+#endif
+	[super finalize];
+}
+
+
+#pragma mark -
+#pragma mark building
+// ----------------------------------------------------------------------------------------------------
+// building
+// ----------------------------------------------------------------------------------------------------
+
+- (void)buildWithCompletionHandler:(void (^)(void))handler {
+	NSMutableArray *files = [NSMutableArray array];
+	NSMutableSet *directories = [NSMutableSet set];
+	NSArray *containerLanguages = [container launagues];
+	
+	for (NSString *language in containerLanguages) {
+		for (FRTranslationInfo *info in [container infoItemsForLanguage:language error:NULL]) {
+			[files addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+							  info.path, FRTranslationSearchPathKey,
+							  language, FRTranslationSearchLanguageKey, nil]];
+			[directories addObject:[info.path stringByDeletingLastPathComponent]];
+		}
+	}
+	
+	languages = [NSSet setWithArray:containerLanguages];
+	[self watchPaths:directories];
+	[self indexFiles:files completionHandler:handler];
+}
+
+- (void)indexFiles:(NSArray *)files completionHandler:(void (^)(void))handler {
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		NSUInteger count = [files count];
+		uint32_t *identifiers = malloc((count ? count : 1) * sizeof(uint32_t));
+		FRTextIndexSegment **segments = calloc(count ? count : 1, sizeof(FRTextIndexSegment *));
+		NSMutableArray *records = [NSMutableArray arrayWithCapacity:count];
+		
+		// documents keep their identifier for as long as the index exists so that an updated file
+		// replaces its previous segment
+		dispatch_sync(queue, ^{
+			for (NSUInteger position = 0; position < count; position++) {
+				NSString *path = [[files objectAtIndex:position] objectForKey:FRTranslationSearchPathKey];
+				NSNumber *identifier = [documentIDs objectForKey:path];
+				if (!identifier) {
+					identifier = [NSNumber numberWithUnsignedInt:nextDocumentID++];
+					[documentIDs setObject:identifier forKey:path];
+				}
+				identifiers[position] = [identifier unsignedIntValue];
+				[records addObject:[NSNull null]];
+			}
+		});
+		
+		// reading and tokenizing the files is independent for each file. the segments are only added
+		// to the index once they're all done.
+		dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t position) {
+			NSDictionary *record = nil;
+			segments[position] = [self createSegmentForFile:[files objectAtIndex:position]
+												   document:identifiers[position] record:&record];
+			if (record) {
+				@synchronized(records) {
+					[records replaceObjectAtIndex:position withObject:record];
+				}
+			}
+		});
+		
+		dispatch_sync(queue, ^{
+			for (NSUInteger position = 0; position < count; position++) {
+				NSNumber *identifier = [NSNumber numberWithUnsignedInt:identifiers[position]];
+				if (segments[position] && FRTextIndexAddSegment(textIndex, segments[position])) {
+					[documents setObject:[records objectAtIndex:position] forKey:identifier];
+				}
+				else {
+					FRTextIndexRemoveDocument(textIndex, identifiers[position]);
+					[documents removeObjectForKey:identifier];
+				}
+			}
+		});
+		
+		free(identifiers);
+		free(segments);
+		
+		if (handler) {
+			dispatch_async(dispatch_get_main_queue(), handler);
+		}
+	});
+}
+
+- (FRTextIndexSegment *)createSegmentForFile:(NSDictionary *)file document:(uint32_t)document
+									  record:(NSDictionary **)record {
+	NSString *path = [file objectForKey:FRTranslationSearchPathKey];
+	NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL];
+	FRStrings *strings = [FRStringsJournal stringsWithContentsOfFile:path usedFormat:NULL error:NULL];
+	if (!strings || !attributes) { return NULL; }
+	
+	// fold everything into one buffer first and only point the items at it once it won't move anymore
+	NSUInteger count = [strings count];
+	NSMutableArray *keys = [NSMutableArray arrayWithCapacity:count];
+	NSMutableData *characters = [NSMutableData data];
+	NSMutableData *ranges = [NSMutableData data];
+	for (NSUInteger position = 0; position < count; position++) {
+		NSString *string = [strings stringAtIndex:position];
+		NSString *fields[] = {
+			[FRTextIndexFieldKey] = string,
+			[FRTextIndexFieldTranslation] = [strings translationForString:string],
+			[FRTextIndexFieldComment] = [[strings commentsForString:string] componentsJoinedByString:@"\n"],
+		};
+		for (FRTextIndexField field = 0; field < sizeof(fields) / sizeof(*fields); field++) {
+			NSString *folded = [fields[field] stringByFoldingWithOptions:kFoldingOptions locale:nil];
+			NSUInteger length = [folded length];
+			if (!length) { continue; }
+			NSUInteger location = [characters length] / sizeof(FRStringsChar);
+			[characters increaseLengthBy:length * sizeof(FRStringsChar)];
+			[folded getCharacters:(unichar *)[characters mutableBytes] + location range:NSMakeRange(0, length)];
+			FRTextIndexItem item = { .chars = NULL, .length = length, .entry = (uint32_t)position, .field = field };
+			[ranges appendBytes:&item length:sizeof(item)];
+			[ranges appendBytes:&location length:sizeof(location)];
+		}
+		[keys addObject:string];
+	}
+	
+	NSUInteger itemCount = [ranges length] / (sizeof(FRTextIndexItem) + sizeof(NSUInteger));
+	FRTextIndexItem *items = malloc((itemCount ? itemCount : 1) * sizeof(FRTextIndexItem));
+	const uint8_t *bytes = [ranges bytes];
+	const FRStringsChar *chars = [characters bytes];
+	for (NSUInteger position = 0; position < itemCount; position++) {
+		NSUInteger location = 0;
+		memcpy(&items[position], bytes, sizeof(FRTextIndexItem));
+		memcpy(&location, bytes + sizeof(FRTextIndexItem), sizeof(location));
+		items[position].chars = chars + location;
+		bytes += sizeof(FRTextIndexItem) + sizeof(NSUInteger);
+	}
+	
+	FRTextIndexSegment *segment = items ? FRTextIndexSegmentCreate(document, items, itemCount) : NULL;
+	free(items);
+	
+	*record = [NSDictionary dictionaryWithObjectsAndKeys:
+			   path, FRTranslationSearchPathKey,
+			   [file objectForKey:FRTranslationSearchLanguageKey], FRTranslationSearchLanguageKey,
+			   keys, kStringsKey,
+			   attributes, kAttributesKey, nil];
+	return segment;
+}
+
+
+#pragma mark -
+#pragma mark searching
+// ----------------------------------------------------------------------------------------------------
+// searching
+// ----------------------------------------------------------------------------------------------------
+
+- (NSArray *)resultsForQuery:(NSString *)query options:(FRTranslationSearchOptions)options limit:(NSUInteger)limit {
+	NSString *folded = [query stringByFoldingWithOptions:kFoldingOptions locale:nil];
+	NSUInteger length = [folded length];
+	NSMutableArray *results = [NSMutableArray array];
+	if (!length || !limit) { return results; }
+	
+	FRStringsChar *chars = malloc(length * sizeof(FRStringsChar));
+	FRTextIndexMatch *matches = malloc(limit * sizeof(FRTextIndexMatch));
+	FRTextIndexMatchMode mode =
+		(options & FRTranslationSearchPrefix) ? FRTextIndexMatchPrefix : FRTextIndexMatchSubstring;
+	[folded getCharacters:chars range:NSMakeRange(0, length)];
+	
+	if (chars && matches) {
+		dispatch_sync(queue, ^{
+			size_t count = FRTextIndexSearch(textIndex, chars, length, mode, matches, limit);
+			for (size_t position = 0; position < count; position++) {
+				NSDictionary *record = [documents objectForKey:
+										[NSNumber numberWithUnsignedInt:matches[position].document]];
+				[results addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+									[record objectForKey:FRTranslationSearchPathKey], FRTranslationSearchPathKey,
+									[record objectForKey:FRTranslationSearchLanguageKey],
+									FRTranslationSearchLanguageKey,
+									[[record objectForKey:kStringsKey] objectAtIndex:matches[position].entry],
+									FRTranslationSearchStringKey,
+									[NSNumber numberWithUnsignedInteger:matches[position].field],
+									FRTranslationSearchFieldKey, nil]];
+			}
+		});
+	}
+	
+	free(chars);
+	free(matches);
+	return results;
+}
+
+
+#pragma mark -
+#pragma mark file changes
+// ----------------------------------------------------------------------------------------------------
+// file changes
+// ----------------------------------------------------------------------------------------------------
+
+- (void)updateForChangesInDirectories:(NSSet *)directories {
+	NSSet *indexedLanguages = languages;
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		NSFileManager *manager = [NSFileManager defaultManager];
+		NSMutableDictionary *indexed = [NSMutableDictionary dictionary];
+		NSMutableArray *files = [NSMutableArray array];
+		NSMutableArray *removed = [NSMutableArray array];
+		
+		dispatch_sync(queue, ^{
+			for (NSDictionary *record in [documents allValues]) {
+				[indexed setObject:record forKey:[record objectForKey:FRTranslationSearchPathKey]];
+			}
+		});
+		
+		// only files that were added or whose size or modification date changed need to be indexed
+		// again. journals get written next to the strings files, so edits show up here as well.
+		for (NSString *directory in directories) {
+			NSString *language = [[directory lastPathComponent] stringByDeletingPathExtension];
+			if (![indexedLanguages containsObject:language]) { continue; }
+			
+			NSMutableSet *fileNames = [NSMutableSet set];
+			for (NSString *fileName in [manager contentsOfDirectoryAtPath:directory error:NULL]) {
+				if ([[fileName pathExtension] isEqualToString:@"strings"]) { [fileNames addObject:fileName]; }
+			}
+			for (NSString *path in indexed) {
+				if ([[path stringByDeletingLastPathComponent] isEqualToString:directory] &&
+					![fileNames containsObject:[path lastPathComponent]]) {
+					[removed addObject:path];
+				}
+			}
+			for (NSString *fileName in fileNames) {
+				NSString *path = [directory stringByAppendingPathComponent:fileName];
+				NSDictionary *current = [[indexed objectForKey:path] objectForKey:kAttributesKey];
+				NSDictionary *attributes = [manager attributesOfItemAtPath:path error:NULL];
+				if (!current ||
+					![[current fileModificationDate] isEqualToDate:[attributes fileModificationDate]] ||
+					[current fileSize] != [attributes fileSize] ||
+					[manager fileExistsAtPath:[FRStringsJournal journalPathForStringsFileAtPath:path]]) {
+					[files addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+									  path, FRTranslationSearchPathKey,
+									  language, FRTranslationSearchLanguageKey, nil]];
+				}
+			}
+		}
+		
+		dispatch_sync(queue, ^{
+			for (NSString *path in removed) {
+				NSNumber *identifier = [documentIDs objectForKey:path];
+				FRTextIndexRemoveDocument(textIndex, [identifier unsignedIntValue]);
+				[documents removeObjectForKey:identifier];
+			}
+		});
+		
+		if ([files count]) {
+			[self indexFiles:files completionHandler:nil];
+		}
+	});
+}
+
+- (void)watchPaths:(NSSet *)paths {
+	if ([paths isEqualToSet:watchedPaths]) { return; }
+	
+	[self destroyEventStream];
+	watchedPaths = [paths copy];
+	if (![paths count]) { return; }
+	
+	CFAbsoluteTime latency = 1; // latency in seconds
+	FSEventStreamContext context = {
+		.version = 0,
+		.info = (__bridge void *)self,
+		.retain = NULL,
+		.release = NULL,
+		.copyDescription = NULL,
+	};
+	stream = FSEventStreamCreate(NULL, filechange, &context, (__bridge CFArrayRef)[paths allObjects],
+								 kFSEventStreamEventIdSinceNow, latency,
+								 kFSEventStreamCreateFlagNoDefer);
+	FSEventStreamScheduleWithRunLoop(stream, CFRunLoopGetCurrent(), kCFRunLoopDefaultMode);
+	FSEventStreamStart(stream);
+}
+
+- (void)destroyEventStream {
+	if (stream) { FSEventStreamStop(stream); }
+	if (stream) { FSEventStreamInvalidate(stream); }
+	if (stream) { FSEventStreamRelease(stream); }
+	stream = NULL;
+}
+
+@end
+
+static void filechange(ConstFSEventStreamRef streamRef, void *clientCallBackInfo, size_t numEvents, void *eventPaths,
+					   const FSEventStreamEventFlags eventFlags[], const FSEventStreamEventId eventIds[]) {
+	FRTranslationSearchIndex *index = (__bridge id)clientCallBackInfo;
+	NSMutableSet *directories = [NSMutableSet set];
+	for (size_t event = 0; event < numEvents; event++) {
+		NSString *path = [NSString stringWithUTF8String:((char **)eventPaths)[event]];
+		[directories addObject:[path stringByStandardizingPath]];
+	}
+	[index updateForChangesInDirectories:directories];
+}
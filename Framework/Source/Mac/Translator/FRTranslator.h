@@ -21,6 +21,9 @@
 @interface FRTranslator : NSObject <NSApplicationDelegate> {
 	FRNetworkClient *client;
 	NSMutableSet *knownContainers;
+	NSMutableDictionary *deviceTranslations;
+	NSUInteger requestedResourceCount;
+	dispatch_queue_t storageQueue;
 }
 
 @end
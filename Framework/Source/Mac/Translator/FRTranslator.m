@@ -15,6 +15,9 @@
 // OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 // 
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
 #import <SystemConfiguration/SystemConfiguration.h>
 
 #import "FRTranslator.h"
@@ -26,11 +29,16 @@
 #import "FRTranslationInfo__.h"
 
 static NSString * const kApplicationNameKey = @"FRApplicationName";
+static NSString * const kPartialDirectoryName = @".partial";
 
 static NSString *DeviceGUIDString(void);
+static NSString *PartialPathForDigest(NSString *applicationStorage, NSString *digest);
+static BOOL WritePartialResource(NSString *path, NSData *data, unsigned long long offset);
 static NSString *DeviceNameString(void);
 
 @interface FRTranslator () <FRNetworkClientDelegate>
+- (NSString *)storagePathForApplicationIdentifier:(NSString *)applicationIdentifier;
+- (void)requestResourcesForManifestMessage:(NSDictionary *)message connection:(FRConnection *)connection;
 - (void)extractStringsFromResourcesMessage:(NSDictionary *)message;
 - (void)queryDidUpdate:(NSNotification *)notification;
 - (void)queryDidFinishGathering:(NSNotification *)notification;
@@ -51,10 +59,22 @@ static NSString *DeviceNameString(void);
 		knownContainers = [[NSMutableSet alloc] init];
 		client = [[FRNetworkClient alloc] init];
 		client.delegate = self;
+		storageQueue = dispatch_queue_create("com.fadingred.Greenwich.storage", DISPATCH_QUEUE_SERIAL);
 	}
 	return self;
 }
 
+#if !__OBJC_GC__
+- (void)dealloc {
+	dispatch_release(storageQueue);
+}
+#endif
+
+- (void)finalize {
+	dispatch_release(storageQueue);
+	[super finalize];
+}
+
 - (void)applicationDidFinishLaunching:(NSNotification *)aNotification {
 	FRLocalizationWindowController *windowController = [[self class] sharedLocalizationWindowController];
 	[windowController setConnectionMessageString:FRLocalizedString(@"Not Connected", nil)];
@@ -138,6 +158,15 @@ static NSString *DeviceNameString(void);
 		NSString *language = [info language];
 		NSString *filePath = [info path];
 		NSData *data = [NSData dataWithContentsOfFile:filePath options:0 error:NULL];
+		
+		// files the device already has (from its manifest or sent earlier) aren't sent again
+		NSString *resourcePath = FRMessageResourcePath(bundleIdentifier, language, name);
+		NSString *digest = data ? FRMessageResourceDigest(data) : nil;
+		if (digest && resourcePath) {
+			if ([[deviceTranslations objectForKey:resourcePath] isEqualToString:digest]) { continue; }
+			[deviceTranslations setObject:digest forKey:resourcePath];
+		}
+		
 		[resources addObject:
 		 [NSDictionary dictionaryWithObjectsAndKeys:
 		  bundleIdentifier, FRLocalizationChangesMessage.keys.resource.bundleIdentifier,
@@ -146,12 +175,40 @@ static NSString *DeviceNameString(void);
 		  data, FRLocalizationChangesMessage.keys.resource.data, nil]];
 	}
 	
+	if (![resources count]) { return; }
 	[connection sendMessage:
 	 [NSDictionary dictionaryWithObjectsAndKeys:
 	  FRLocalizationChangesMessage.messageID, FRLocalizationChangesMessage.messageID,
 	  resources, FRLocalizationChangesMessage.keys.resources, nil]];
 }
 
+- (void)sendStringsEdits:(NSDictionary *)edits inStringsFile:(FRTranslationInfo *)info {
+	FRConnection *connection = [client activeConnection];
+	if (!connection) { return; }
+	
+	NSString *bundleIdentifier = [info bundleIdentifier];
+	NSString *name = [[info fileName] stringByDeletingPathExtension];
+	NSString *language = [info language];
+	NSData *data = [NSPropertyListSerialization dataWithPropertyList:edits format:NSPropertyListBinaryFormat_v1_0
+															 options:0 error:NULL];
+	NSString *resourcePath = FRMessageResourcePath(bundleIdentifier, language, name);
+	if (!data || !resourcePath) { return; }
+	
+	// the device's copy of the file no longer matches anything that was sent, so the whole file goes
+	// along the next time strings files are sent
+	[deviceTranslations removeObjectForKey:resourcePath];
+	
+	[connection sendMessage:
+	 [NSDictionary dictionaryWithObjectsAndKeys:
+	  FRLocalizationEditsMessage.messageID, FRLocalizationEditsMessage.messageID,
+	  [NSArray arrayWithObject:
+	   [NSDictionary dictionaryWithObjectsAndKeys:
+		bundleIdentifier, FRLocalizationEditsMessage.keys.resource.bundleIdentifier,
+		language, FRLocalizationEditsMessage.keys.resource.language,
+		name, FRLocalizationEditsMessage.keys.resource.name,
+		data, FRLocalizationEditsMessage.keys.resource.data, nil]], FRLocalizationEditsMessage.keys.resources, nil]];
+}
+
 
 #pragma mark -
 #pragma mark network connections
@@ -165,6 +222,7 @@ static NSString *DeviceNameString(void);
 	FRLocalizationWindowController *windowController = [[self class] sharedLocalizationWindowController];
 	[windowController setConnectionActive:YES];
 	[windowController setConnectionMessageString:FRLocalizedString(@"Authorizing", nil)];
+	deviceTranslations = nil;
 
 	// send authorization message on initial connection
 	NSString *deviceIdentifier = DeviceGUIDString();
@@ -183,7 +241,10 @@ static NSString *DeviceNameString(void);
 	FRLocalizationWindowController *windowController = [[self class] sharedLocalizationWindowController];
 	[windowController setConnectionMessageString:FRLocalizedString(@"Connected", nil)];
 	
-	if ([message objectForKey:FRLocalizationResourcesMessage.messageID]) {
+	if ([message objectForKey:FRLocalizationManifestMessage.messageID]) {
+		[self requestResourcesForManifestMessage:message connection:connection];
+	}
+	else if ([message objectForKey:FRLocalizationResourcesMessage.messageID]) {
 		[self extractStringsFromResourcesMessage:message];
 	}
 }
@@ -194,42 +255,168 @@ static NSString *DeviceNameString(void);
 	FRLocalizationWindowController *windowController = [[self class] sharedLocalizationWindowController];
 	[windowController setConnectionActive:NO];
 	[windowController setConnectionMessageString:FRLocalizedString(@"Not Connected", nil)];
+	deviceTranslations = nil;
 }
 
 
-- (void)extractStringsFromResourcesMessage:(NSDictionary *)message {
-	NSFileManager *manager = [NSFileManager defaultManager];
+#pragma mark -
+#pragma mark syncing
+// ----------------------------------------------------------------------------------------------------
+// syncing
+// ----------------------------------------------------------------------------------------------------
+
+- (NSString *)storagePathForApplicationIdentifier:(NSString *)applicationIdentifier {
 	NSString *applicationSupport = [[NSBundle mainBundle] applicationSupportDirectory];
 	NSString *translationsDirectory = [applicationSupport stringByAppendingPathComponent:@"Applications"];
+	NSString *applicationPackageName = [applicationIdentifier stringByAppendingFormat:@".greenwichStringsArchive"];
+	return [translationsDirectory stringByAppendingPathComponent:applicationPackageName];
+}
+
+- (void)requestResourcesForManifestMessage:(NSDictionary *)message connection:(FRConnection *)connection {
+	NSString *applicationStorage = [self storagePathForApplicationIdentifier:
+									[message objectForKey:FRLocalizationManifestMessage.keys.applicationIdentifier]];
 	
+	NSMutableDictionary *translations = [NSMutableDictionary dictionary];
+	for (NSDictionary *resource in [message objectForKey:FRLocalizationManifestMessage.keys.translations]) {
+		NSString *resourcePath =
+			FRMessageResourcePath([resource objectForKey:FRLocalizationManifestMessage.keys.resource.bundleIdentifier],
+								  [resource objectForKey:FRLocalizationManifestMessage.keys.resource.language],
+								  [resource objectForKey:FRLocalizationManifestMessage.keys.resource.name]);
+		NSString *digest = [resource objectForKey:FRLocalizationManifestMessage.keys.resource.digest];
+		if (resourcePath && digest) { [translations setObject:digest forKey:resourcePath]; }
+	}
+	
+	// comparing against the stored files means reading all of them, so it happens with the rest of the
+	// storage work rather than here
+	dispatch_async(storageQueue, ^{
+		NSFileManager *manager = [NSFileManager defaultManager];
+		NSDictionary *digests = FRMessageResourceDigestsInDirectory(applicationStorage);
+		
+		// stored files with the same contents as on the device are kept, so only the ones that differ are
+		// requested. files the device no longer has are removed.
+		NSMutableArray *requested = [NSMutableArray array];
+		NSMutableSet *current = [NSMutableSet set];
+		NSMutableSet *partials = [NSMutableSet set];
+		for (NSDictionary *resource in [message objectForKey:FRLocalizationManifestMessage.keys.resources]) {
+			NSString *bundleID = [resource objectForKey:FRLocalizationManifestMessage.keys.resource.bundleIdentifier];
+			NSString *language = [resource objectForKey:FRLocalizationManifestMessage.keys.resource.language];
+			NSString *name = [resource objectForKey:FRLocalizationManifestMessage.keys.resource.name];
+			NSString *digest = [resource objectForKey:FRLocalizationManifestMessage.keys.resource.digest];
+			NSString *resourcePath = FRMessageResourcePath(bundleID, language, name);
+			if (!resourcePath) { continue; }
+			
+			[current addObject:resourcePath];
+			if (![[digests objectForKey:resourcePath] isEqualToString:digest]) {
+				NSMutableDictionary *request =
+					[NSMutableDictionary dictionaryWithObjectsAndKeys:
+					 bundleID, FRLocalizationRequestMessage.keys.resource.bundleIdentifier,
+					 language, FRLocalizationRequestMessage.keys.resource.language,
+					 name, FRLocalizationRequestMessage.keys.resource.name, nil];
+				
+				// a file that was cut off is asked for from where it stopped. partial files are named
+				// after the digest of the complete file, so they only continue the same contents.
+				NSString *partialPath = PartialPathForDigest(applicationStorage, digest);
+				NSData *partial = partialPath ?
+					[NSData dataWithContentsOfFile:partialPath options:NSDataReadingMappedIfSafe error:NULL] : nil;
+				if ([partial length]) {
+					[request setObject:[NSNumber numberWithUnsignedInteger:[partial length]]
+								forKey:FRLocalizationRequestMessage.keys.resource.offset];
+					[request setObject:FRMessageResourceDigest(partial)
+								forKey:FRLocalizationRequestMessage.keys.resource.digest];
+					[partials addObject:[partialPath lastPathComponent]];
+				}
+				[requested addObject:request];
+			}
+		}
+		for (NSString *resourcePath in digests) {
+			if (![current containsObject:resourcePath]) {
+				[manager removeItemAtPath:[applicationStorage stringByAppendingPathComponent:resourcePath] error:NULL];
+			}
+		}
+		NSString *partialDirectory = [applicationStorage stringByAppendingPathComponent:kPartialDirectoryName];
+		for (NSString *partialName in [manager contentsOfDirectoryAtPath:partialDirectory error:NULL]) {
+			if (![partials containsObject:partialName]) {
+				[manager removeItemAtPath:[partialDirectory stringByAppendingPathComponent:partialName] error:NULL];
+			}
+		}
+		
+		// the request is sent even if nothing is needed. the last response completes the sync.
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if ([client activeConnection] != connection) { return; }
+			deviceTranslations = translations;
+			requestedResourceCount = [requested count];
+			[connection sendMessage:
+			 [NSDictionary dictionaryWithObjectsAndKeys:
+			  FRLocalizationRequestMessage.messageID, FRLocalizationRequestMessage.messageID,
+			  requested, FRLocalizationRequestMessage.keys.resources, nil]];
+		});
+	});
+}
+
+- (void)extractStringsFromResourcesMessage:(NSDictionary *)message {
 	NSString *applicationName = [message objectForKey:FRLocalizationResourcesMessage.keys.applicationName];
 	NSString *applicationIdentifier = [message objectForKey:FRLocalizationResourcesMessage.keys.applicationIdentifier];
-	NSString *applicationPackageName = [applicationIdentifier stringByAppendingFormat:@".greenwichStringsArchive"];
-	NSString *applicationStorage = [translationsDirectory stringByAppendingPathComponent:applicationPackageName];
+	NSString *applicationStorage = [self storagePathForApplicationIdentifier:applicationIdentifier];
+	NSUInteger remaining = [[message objectForKey:FRLocalizationResourcesMessage.keys.remaining] unsignedIntegerValue];
 	
-	// clear old data
-	[manager removeItemAtPath:applicationStorage error:NULL];
-	
-	for (NSDictionary *resource in [message objectForKey:FRLocalizationResourcesMessage.keys.resources]) {
-		NSString *bundleID = [resource objectForKey:FRLocalizationResourcesMessage.keys.resource.bundleIdentifier];
-		NSString *language = [resource objectForKey:FRLocalizationResourcesMessage.keys.resource.language];
-		NSString *name = [resource objectForKey:FRLocalizationResourcesMessage.keys.resource.name];
-		NSData *data = [resource objectForKey:FRLocalizationResourcesMessage.keys.resource.data];
+	// files arrive one message at a time and are written in the background in the same order. the
+	// application only shows up once all of them are there.
+	dispatch_async(storageQueue, ^{
+		NSFileManager *manager = [NSFileManager defaultManager];
 		
-		NSString *bundleDirectory = [applicationStorage stringByAppendingPathComponent:bundleID];
-		NSString *lprojName = [NSString stringWithFormat:@"%@.lproj", language];
-		NSString *lprojDirectory = [bundleDirectory stringByAppendingPathComponent:lprojName];
-		NSString *stringsName = [NSString stringWithFormat:@"%@.strings", name];
-		NSString *stringsPath = [lprojDirectory stringByAppendingPathComponent:stringsName];
+		// the resources only hold what was requested after the manifest, so everything else stays
+		for (NSDictionary *resource in [message objectForKey:FRLocalizationResourcesMessage.keys.resources]) {
+			NSString *bundleID = [resource objectForKey:FRLocalizationResourcesMessage.keys.resource.bundleIdentifier];
+			NSString *language = [resource objectForKey:FRLocalizationResourcesMessage.keys.resource.language];
+			NSString *name = [resource objectForKey:FRLocalizationResourcesMessage.keys.resource.name];
+			NSData *data = [resource objectForKey:FRLocalizationResourcesMessage.keys.resource.data];
+			NSString *digest = [resource objectForKey:FRLocalizationResourcesMessage.keys.resource.digest];
+			NSNumber *offsetNumber = [resource objectForKey:FRLocalizationResourcesMessage.keys.resource.offset];
+			NSNumber *lengthNumber = [resource objectForKey:FRLocalizationResourcesMessage.keys.resource.length];
+			unsigned long long offset = [offsetNumber unsignedLongLongValue];
+			unsigned long long length = lengthNumber ? [lengthNumber unsignedLongLongValue] : [data length];
+			
+			NSString *stringsPath =
+				[applicationStorage stringByAppendingPathComponent:FRMessageResourcePath(bundleID, language, name)];
+			NSString *lprojDirectory = [stringsPath stringByDeletingLastPathComponent];
+			
+			// pieces of a longer file are collected next to the files until the last one is in. the
+			// complete file has to match its digest before it replaces the stored one.
+			NSString *partialPath = PartialPathForDigest(applicationStorage, digest);
+			if (!offset && length == [data length]) {
+				[manager createDirectoryAtPath:lprojDirectory
+				   withIntermediateDirectories:YES attributes:nil error:NULL];
+				[data writeToFile:stringsPath options:NSDataWritingAtomic error:NULL];
+			}
+			else if (partialPath && WritePartialResource(partialPath, data, offset)) {
+				if (offset + [data length] < length) { continue; }
+				NSData *contents = [NSData dataWithContentsOfFile:partialPath
+														  options:NSDataReadingMappedIfSafe error:NULL];
+				if ([contents length] == length && [FRMessageResourceDigest(contents) isEqualToString:digest]) {
+					[manager createDirectoryAtPath:lprojDirectory
+					   withIntermediateDirectories:YES attributes:nil error:NULL];
+					rename([partialPath fileSystemRepresentation], [stringsPath fileSystemRepresentation]);
+				}
+				[manager removeItemAtPath:partialPath error:NULL];
+			}
+			else if (partialPath) { [manager removeItemAtPath:partialPath error:NULL]; }
+		}
 		
-		[manager createDirectoryAtPath:lprojDirectory withIntermediateDirectories:YES attributes:nil error:NULL];
-		[data writeToFile:stringsPath options:0 error:NULL];
-	}
+		// write out the name and info to the Greenwich.details file
+		if (!remaining) {
+			NSString *detailsPath = [applicationStorage stringByAppendingPathComponent:@"Greenwich.details"];
+			NSDictionary *details =
+				[NSDictionary dictionaryWithObjectsAndKeys:applicationName, kApplicationNameKey, nil];
+			[details writeToFile:detailsPath atomically:YES];
+		}
+	});
 	
-	// write out the name and info to the Greenwich.details file
-	NSString *detailsPath = [applicationStorage stringByAppendingPathComponent:@"Greenwich.details"];
-	NSDictionary *details = [NSDictionary dictionaryWithObjectsAndKeys:applicationName, kApplicationNameKey, nil];
-	[details writeToFile:detailsPath atomically:YES];
+	if (remaining) {
+		NSUInteger received = (requestedResourceCount > remaining) ? requestedResourceCount - remaining : 0;
+		NSString *progress = [NSString stringWithFormat:FRLocalizedString(@"Receiving %lu of %lu", nil),
+							  (unsigned long)received, (unsigned long)requestedResourceCount];
+		[[[self class] sharedLocalizationWindowController] setConnectionMessageString:progress];
+	}
 }
 
 @end
@@ -283,6 +470,30 @@ static NSString *DeviceGUIDString(void) {
 	return address;
 }
 
+static NSString *PartialPathForDigest(NSString *applicationStorage, NSString *digest) {
+	// the digest comes from the device, so it can't be trusted to be a file name
+	NSCharacterSet *invalid = [[NSCharacterSet characterSetWithCharactersInString:@"0123456789abcdef"] invertedSet];
+	if (![digest length] || [digest rangeOfCharacterFromSet:invalid].location != NSNotFound) { return nil; }
+	return [[applicationStorage stringByAppendingPathComponent:kPartialDirectoryName]
+			stringByAppendingPathComponent:digest];
+}
+
+static BOOL WritePartialResource(NSString *path, NSData *data, unsigned long long offset) {
+	// pieces are only added right where the previous one ended. anything else means pieces went
+	// missing, and the file starts over on the next connection.
+	if (!offset) {
+		[[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent]
+								  withIntermediateDirectories:YES attributes:nil error:NULL];
+	}
+	int descriptor = open([path fileSystemRepresentation], O_WRONLY | O_CREAT | (offset ? 0 : O_TRUNC), 0644);
+	if (descriptor < 0) { return FALSE; }
+	struct stat info;
+	BOOL success = (fstat(descriptor, &info) == 0 && (unsigned long long)info.st_size == offset &&
+					pwrite(descriptor, [data bytes], [data length], (off_t)offset) == (ssize_t)[data length]);
+	close(descriptor);
+	return success;
+}
+
 static NSString *DeviceNameString(void) {
 	return(__bridge_transfer NSString *)SCDynamicStoreCopyComputerName(NULL, &(CFStringEncoding){0});
 }
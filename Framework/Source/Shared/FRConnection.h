@@ -21,13 +21,23 @@
 @protocol
 	FRConnectionDelegate;
 
+/*!
+ \brief		Connection between a device and a translator
+ \details	Messages are read and decoded on a shared input thread, so even very large messages never hold
+			up the run loop the connection was connected on. Only decoded messages come back to that run
+			loop, in the order they were received, and that's where the delegate is called.
+			
+			An open connection is kept alive until it's closed by either side.
+ */
 @interface FRConnection : NSObject {
-	CFReadStreamRef readStream;
-	NSMutableData *readBuffer;
-	BOOL readOpen;
+	struct FRConnectionReader *reader;
+	uint32_t readSession;
+	CFRunLoopRef runLoop;
 	CFWriteStreamRef writeStream;
-	NSMutableData *writeBuffer;
+	struct FRWriteQueue *writeQueue;
 	BOOL writeOpen;
+	BOOL writeQueueFull;
+	uint8_t compression;
 }
 
 - (id)initWithSocketHandle:(int)socketHandle;
@@ -35,10 +45,27 @@
 
 @property (assign, nonatomic) id <FRConnectionDelegate> delegate;
 
+/*!
+ \brief		Maximum message length
+ \details	Connections that send a longer message are closed before any of it is buffered. Defaults to
+			128 MB. Changes take effect the next time the connection is connected.
+ */
+@property (assign, nonatomic) NSUInteger maximumMessageLength;
+
 - (BOOL)connect;
 - (void)close;
 
-- (void)sendMessage:(NSDictionary *)message;
+/*!
+ \brief		Send a message
+ \details	Authentication, manifest and resources messages list the compression methods this side
+			accepts, and once the other side's list has been received, larger messages are sent compressed
+			with the best method on it.
+			
+			Queues the message and writes as much as the connection takes right away. Returns FALSE once
+			the queued messages reach the write high water mark; senders that have more to send should
+			then wait for connectionDrainedWriteQueue: (messages sent meanwhile are still queued).
+ */
+- (BOOL)sendMessage:(NSDictionary *)message;
 
 @end
 
@@ -46,4 +73,6 @@
 - (void)connectionFailed:(FRConnection *)connection;
 - (void)connectionTerminated:(FRConnection *)connection;
 - (void)connection:(FRConnection *)connection receivedMessage:(NSDictionary *)message;
+@optional
+- (void)connectionDrainedWriteQueue:(FRConnection *)connection;
 @end
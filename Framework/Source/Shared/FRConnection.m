@@ -15,8 +15,48 @@
 // COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
 // OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 // 
-
 #import "FRConnection.h"
+#import "FRConnection__.h"
+#import "FRMessages.h"
+#import "FRFrameBuffer.h"
+#import "FRMessageCompression.h"
+#import "FRWriteQueue.h"
+
+const NSUInteger FRConnectionDefaultMaximumMessageLength = 128 * 1024 * 1024;
+static const size_t kWriteHighWaterMark = 4 * 1024 * 1024;
+static const size_t kCoalescedWriteLength = 4 * 1024;
+
+/*!
+ \brief		Read side of a connection
+ \details	Everything the input thread needs to read and decode messages. It's only used on the input thread
+			and is freed there once the connection is closed, so reading never has to synchronize with the
+			connection itself.
+ */
+typedef struct FRConnectionReader {
+	CFReadStreamRef stream;
+	FRFrameBuffer *buffer;
+	size_t maximumMessageLength;
+	uint32_t session;
+	BOOL open;
+	BOOL finished;
+	CFRunLoopRef runLoop;	// where the connection's delegate is called
+	void *connection;		// retained until the reader is freed
+} FRConnectionReader;
+
+static CFRunLoopRef inputRunLoop = NULL;
+static dispatch_semaphore_t inputThreadStarted = NULL;
+
+static CFRunLoopRef FRConnectionInputRunLoop(void);
+static FRConnectionReader *FRConnectionReaderCreate(FRConnection *connection, CFReadStreamRef stream,
+													size_t maximumMessageLength, uint32_t session);
+static void FRConnectionReaderInvalidate(FRConnectionReader *reader);
+static BOOL FRConnectionReaderRead(FRConnectionReader *reader, NSMutableArray *messages);
+static NSDictionary *FRConnectionDecode(const uint8_t *payload, size_t length, size_t maximumMessageLength);
+static NSDictionary *FRConnectionDecodeVectors(const struct iovec *payload, int count, size_t length,
+											   size_t maximumMessageLength);
+static ssize_t FRConnectionWriteStream(void *context, const struct iovec *vectors, int count);
+static void FRConnectionReleaseData(void *data);
+static NSDictionary *FRConnectionMessageWithCompressionMethods(NSDictionary *message);
 
 void readStreamEventHandler(CFReadStreamRef stream, CFStreamEventType eventType, void *info);
 void writeStreamEventHandler(CFWriteStreamRef stream, CFStreamEventType eventType, void *info);
@@ -26,9 +66,10 @@ void writeStreamEventHandler(CFWriteStreamRef stream, CFStreamEventType eventTyp
 @property (assign, nonatomic) uint16_t port;
 @property (assign, nonatomic) int socket;
 
-- (void)handleReadStreamEvent:(CFStreamEventType)event;
++ (void)runInputThread:(id)object;
+- (void)handleMessages:(NSArray *)messages session:(uint32_t)session;
+- (void)handleEndOfReadingInSession:(uint32_t)session opened:(BOOL)opened;
 - (void)handleWriteStreamEvent:(CFStreamEventType)event;
-- (void)readFromStream;
 - (void)writeToStream;
 @end
 
@@ -38,14 +79,15 @@ void writeStreamEventHandler(CFWriteStreamRef stream, CFStreamEventType eventTyp
 @synthesize host;
 @synthesize port;
 @synthesize socket;
+@synthesize maximumMessageLength;
 
 - (id)init {
 	if ((self = [super init])) {
 		socket = -1;
 		port = -1;
 		host = nil;
-		readBuffer = [[NSMutableData alloc] init];
-		writeBuffer = [[NSMutableData alloc] init];
+		maximumMessageLength = FRConnectionDefaultMaximumMessageLength;
+		writeQueue = FRWriteQueueCreate(kWriteHighWaterMark);
 	}
 	return self;
 }
@@ -67,12 +109,14 @@ void writeStreamEventHandler(CFWriteStreamRef stream, CFStreamEventType eventTyp
 
 - (void)dealloc {
 	[self close];
+	if (writeQueue) { FRWriteQueueFree(writeQueue); }
 }
 
 - (BOOL)connect {
-	if (readStream && writeStream) { return FALSE; }
+	if (reader || writeStream) { return FALSE; }
 	
 	BOOL success = TRUE;
+	CFReadStreamRef readStream = NULL;
 	
 	// create read and write streams
 	if (self.socket != -1) {
@@ -85,6 +129,7 @@ void writeStreamEventHandler(CFWriteStreamRef stream, CFStreamEventType eventTyp
 	else { success = FALSE; }
 	
 	if (!readStream || !writeStream) {
+		if (readStream) { CFRelease(readStream); }
 		success = FALSE;
 	}
 	
@@ -93,18 +138,27 @@ void writeStreamEventHandler(CFWriteStreamRef stream, CFStreamEventType eventTyp
 		CFReadStreamSetProperty(readStream, kCFStreamPropertyShouldCloseNativeSocket, kCFBooleanTrue);
 		CFWriteStreamSetProperty(writeStream, kCFStreamPropertyShouldCloseNativeSocket, kCFBooleanTrue);
 		
+		// the reader takes over the read stream
+		runLoop = (CFRunLoopRef)CFRetain(CFRunLoopGetCurrent());
+		reader = FRConnectionReaderCreate(self, readStream, maximumMessageLength, ++readSession);
+		if (!reader) { success = FALSE; }
+	}
+	
+	if (success) {
 		CFOptionFlags events =
 			kCFStreamEventOpenCompleted | kCFStreamEventHasBytesAvailable | kCFStreamEventCanAcceptBytes |
 			kCFStreamEventEndEncountered | kCFStreamEventErrorOccurred;
-		CFStreamClientContext context = {0, (__bridge void *)self, NULL, NULL, NULL};
+		CFStreamClientContext readContext = {0, reader, NULL, NULL, NULL};
+		CFStreamClientContext writeContext = {0, (__bridge void *)self, NULL, NULL, NULL};
 
 		// set callback functions
-		CFReadStreamSetClient(readStream, events, readStreamEventHandler, &context);
-		CFWriteStreamSetClient(writeStream, events, writeStreamEventHandler, &context);
+		CFReadStreamSetClient(readStream, events, readStreamEventHandler, &readContext);
+		CFWriteStreamSetClient(writeStream, events, writeStreamEventHandler, &writeContext);
 		
-		// schedule with runloop
-		CFReadStreamScheduleWithRunLoop(readStream, CFRunLoopGetCurrent(), kCFRunLoopCommonModes);
-		CFWriteStreamScheduleWithRunLoop(writeStream, CFRunLoopGetCurrent(), kCFRunLoopCommonModes);
+		// schedule with runloop. reading and decoding happen on the input thread, so large messages never
+		// hold up this run loop, which only gets the decoded messages.
+		CFReadStreamScheduleWithRunLoop(readStream, FRConnectionInputRunLoop(), kCFRunLoopCommonModes);
+		CFWriteStreamScheduleWithRunLoop(writeStream, runLoop, kCFRunLoopCommonModes);
 	}
 	
 	if (success) {
@@ -122,96 +176,173 @@ void writeStreamEventHandler(CFWriteStreamRef stream, CFStreamEventType eventTyp
 }
 
 - (void)close {
-	if (readStream) {
-		CFReadStreamUnscheduleFromRunLoop(readStream, CFRunLoopGetCurrent(), kCFRunLoopCommonModes);
-		CFReadStreamClose(readStream);
-		CFRelease(readStream);
-		readStream = NULL;
+	if (reader) {
+		FRConnectionReaderInvalidate(reader);
+		reader = NULL;
 	}
 	if (writeStream) {
-		CFWriteStreamUnscheduleFromRunLoop(writeStream, CFRunLoopGetCurrent(), kCFRunLoopCommonModes);
+		if (runLoop) { CFWriteStreamUnscheduleFromRunLoop(writeStream, runLoop, kCFRunLoopCommonModes); }
 		CFWriteStreamClose(writeStream);
 		CFRelease(writeStream);
 		writeStream = NULL;
 	}
-	[readBuffer setData:[NSData data]];
-	[writeBuffer setData:[NSData data]];
-	readOpen = FALSE;
+	if (runLoop) {
+		CFRelease(runLoop);
+		runLoop = NULL;
+	}
+	if (writeQueue) { FRWriteQueueReset(writeQueue); }
+	
+	// messages the reader decoded before it was invalidated are dropped when they arrive
+	readSession++;
+	writeQueueFull = FALSE;
+	compression = FRMessageCompressionNone;
 	writeOpen = FALSE;
 	host = nil;
 	port = -1;
 	socket = -1;
 }
 
-- (void)sendMessage:(NSDictionary *)message {
-	NSData *rawPacket = [NSKeyedArchiver archivedDataWithRootObject:message];
-	int32_t packetLength = htonl([rawPacket length]);
-	[writeBuffer appendBytes:&packetLength length:sizeof(int32_t)];
-	[writeBuffer appendData:rawPacket];
+- (BOOL)sendMessage:(NSDictionary *)message {
+	return [self sendPacket:[self packetWithMessage:message] channel:FRConnectionChannelForMessage(message)];
+}
+
+- (uint8_t)compressionMethod {
+	return compression;
+}
+
+- (NSData *)packetWithMessage:(NSDictionary *)message {
+	NSData *rawPacket = FRMessageDataWithMessage(FRConnectionMessageWithCompressionMethods(message));
+	
+	// messages are only compressed with a method the other side has said it accepts
+	void *compressed = NULL;
+	size_t compressedLength = 0;
+	if (rawPacket &&
+		FRMessageCompress(compression, [rawPacket bytes], [rawPacket length], &compressed, &compressedLength) == 0 &&
+		compressed) {
+		rawPacket = [NSData dataWithBytesNoCopy:compressed length:compressedLength freeWhenDone:YES];
+	}
+	return rawPacket;
+}
+
+- (BOOL)sendPacket:(NSData *)rawPacket channel:(FRFrameChannel)channel {
+	// the queue holds on to the encoded message and writes it from where it is
+	if (!rawPacket || !writeQueue) { return FALSE; }
+	if (FRWriteQueuePush(writeQueue, channel, [rawPacket bytes], [rawPacket length],
+						 (__bridge_retained void *)rawPacket, FRConnectionReleaseData) != 0) { return FALSE; }
 	[self writeToStream];
+	
+	if (writeQueue && FRWriteQueueIsFull(writeQueue)) { writeQueueFull = TRUE; }
+	return !writeQueueFull;
 }
 
-- (void)handleReadStreamEvent:(CFStreamEventType)event {
-	if (event == kCFStreamEventOpenCompleted) { readOpen = YES; }
-	else if (event == kCFStreamEventHasBytesAvailable) { [self readFromStream]; }
-	else if (event == kCFStreamEventEndEncountered || event == kCFStreamEventErrorOccurred) {
-		if (readOpen && writeOpen) {
-			[self.delegate connectionTerminated:self];
-		}
-		else {
-			[self.delegate connectionFailed:self];
+- (NSDictionary *)decodePacket:(const uint8_t *)payload length:(size_t)length {
+	return FRConnectionDecode(payload, length, maximumMessageLength);
+}
+
+- (void)negotiateCompressionWithMessage:(NSDictionary *)message {
+	NSString *methods = [message objectForKey:FRAuthenticationMessage.keys.compression];
+	if (!methods) { methods = [message objectForKey:FRLocalizationResourcesMessage.keys.compression]; }
+	if (!methods) { methods = [message objectForKey:FRLocalizationManifestMessage.keys.compression]; }
+	if (methods) {
+		NSData *names = [methods dataUsingEncoding:NSUTF8StringEncoding];
+		compression = FRMessageCompressionNegotiate([names bytes], [names length]);
+	}
+}
+
+
+#pragma mark -
+#pragma mark reading
+// ----------------------------------------------------------------------------------------------------
+// reading
+// ----------------------------------------------------------------------------------------------------
+
++ (void)runInputThread:(id)object {
+	@autoreleasepool {
+		// the port keeps the run loop running while no streams are scheduled on it
+		[[NSRunLoop currentRunLoop] addPort:[NSMachPort port] forMode:NSDefaultRunLoopMode];
+		inputRunLoop = (CFRunLoopRef)CFRetain(CFRunLoopGetCurrent());
+		dispatch_semaphore_signal(inputThreadStarted);
+	}
+	while (TRUE) {
+		@autoreleasepool {
+			[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]];
 		}
-		[self close];
 	}
 }
 
-- (void)readFromStream {
+- (void)handleMessages:(NSArray *)messages session:(uint32_t)session {
+	for (NSDictionary *message in messages) {
+		// the delegate may close the connection, after which the remaining messages are dropped
+		if (session != readSession) { break; }
+		[self negotiateCompressionWithMessage:message];
+		[self.delegate connection:self receivedMessage:message];
+	}
+}
+
+- (void)handleEndOfReadingInSession:(uint32_t)session opened:(BOOL)opened {
+	if (session != readSession) { return; }
+	if (opened && writeOpen) {
+		[self.delegate connectionTerminated:self];
+	}
+	else {
+		[self.delegate connectionFailed:self];
+	}
+	[self close];
+}
+
+void readStreamEventHandler(CFReadStreamRef stream, CFStreamEventType eventType, void *info) {
+	FRConnectionReader *reader = info;
+	if (reader->finished) { return; }
+	
+	FRConnection *connection = (__bridge FRConnection *)reader->connection;
+	uint32_t session = reader->session;
 	BOOL success = TRUE;
 	
-	while(CFReadStreamHasBytesAvailable(readStream)) {
-		NSUInteger bufferSize = 1024;
-		NSUInteger currentLength = [readBuffer length];
-		[readBuffer increaseLengthBy:bufferSize];
-		char *buffer = ((char *)[readBuffer mutableBytes]) + currentLength;
-		
-		CFIndex len = CFReadStreamRead(readStream, (UInt8 *)buffer, bufferSize);
-		if (len <= 0) {
-			[self close];
-			[delegate connectionTerminated:self];
-			success = FALSE;
-			break;
+	if (eventType == kCFStreamEventOpenCompleted) { reader->open = TRUE; }
+	else if (eventType == kCFStreamEventHasBytesAvailable) {
+		// everything that was read is handed over in one go, in the order it arrived. anything that
+		// doesn't decode can't have come from a peer speaking the same protocol.
+		NSMutableArray *messages = [NSMutableArray array];
+		success = FRConnectionReaderRead(reader, messages);
+		if ([messages count]) {
+			CFRunLoopPerformBlock(reader->runLoop, kCFRunLoopCommonModes, ^{
+				[connection handleMessages:messages session:session];
+			});
 		}
-		else { [readBuffer setLength:currentLength + len]; }
+	}
+	else if (eventType == kCFStreamEventEndEncountered || eventType == kCFStreamEventErrorOccurred) {
+		success = FALSE;
 	}
 	
-	BOOL messagesToExtract = TRUE;
-	while (success && messagesToExtract) {
-		const char *buffer = [readBuffer bytes];
-		NSUInteger bufferLength = [readBuffer length];
-		NSUInteger headerSize = sizeof(int32_t);
-		if (bufferLength >= headerSize) {
-			int32_t messageSize = 0;
-			memcpy(&messageSize, buffer, headerSize);
-			messageSize = ntohl(messageSize);
-			buffer += headerSize;
-			bufferLength -= headerSize;
-			if (bufferLength >= (NSUInteger)messageSize) {
-				NSData *rawMessage = [NSData dataWithBytes:buffer length:bufferLength];
-				NSDictionary *message = [NSKeyedUnarchiver unarchiveObjectWithData:rawMessage];
-				[readBuffer replaceBytesInRange:NSMakeRange(0, headerSize+messageSize) withBytes:NULL length:0];
-				[self.delegate connection:self receivedMessage:message];
-			}
-			else { messagesToExtract = FALSE; }
-		}
-		else { messagesToExtract = FALSE; }
+	if (!success) {
+		BOOL opened = reader->open;
+		reader->finished = TRUE;
+		CFRunLoopPerformBlock(reader->runLoop, kCFRunLoopCommonModes, ^{
+			[connection handleEndOfReadingInSession:session opened:opened];
+		});
 	}
+	CFRunLoopWakeUp(reader->runLoop);
 }
 
+
+#pragma mark -
+#pragma mark writing
+// ----------------------------------------------------------------------------------------------------
+// writing
+// ----------------------------------------------------------------------------------------------------
+
 - (void)handleWriteStreamEvent:(CFStreamEventType)event {
-	if (event == kCFStreamEventOpenCompleted) { writeOpen = YES; }
+	if (event == kCFStreamEventOpenCompleted) {
+		writeOpen = YES;
+		CFDataRef handle = CFWriteStreamCopyProperty(writeStream, kCFStreamPropertySocketNativeHandle);
+		if (handle) {
+			FRWriteQueueSetSocketOptions(*(const CFSocketNativeHandle *)CFDataGetBytePtr(handle));
+			CFRelease(handle);
+		}
+	}
 	else if (event == kCFStreamEventCanAcceptBytes) { [self writeToStream]; }
 	else if (event == kCFStreamEventEndEncountered || event == kCFStreamEventErrorOccurred) {
-		if (readOpen && writeOpen) {
+		if (reader && writeOpen) {
 			[self.delegate connectionTerminated:self];
 		}
 		else {
@@ -222,25 +353,205 @@ void writeStreamEventHandler(CFWriteStreamRef stream, CFStreamEventType eventTyp
 }
 
 - (void)writeToStream {
-	if (!writeOpen || ![writeBuffer length]) { return; }
-	if (!CFWriteStreamCanAcceptBytes(writeStream) ) { return; }
+	if (!writeOpen || !writeQueue || !FRWriteQueueLength(writeQueue)) { return; }
 	
-	CFIndex writtenBytes = CFWriteStreamWrite(writeStream, [writeBuffer bytes], [writeBuffer length]);
-	if (writtenBytes == -1) {
+	if (FRWriteQueueFlush(writeQueue, FRConnectionWriteStream, writeStream) < 0) {
 		[self close];
 		[self.delegate connectionTerminated:self];
 	}
+	else if (writeQueueFull && FRWriteQueueIsDrained(writeQueue)) {
+		writeQueueFull = FALSE;
+		if ([(id)self.delegate respondsToSelector:@selector(connectionDrainedWriteQueue:)]) {
+			[self.delegate connectionDrainedWriteQueue:self];
+		}
+	}
+}
+
+void writeStreamEventHandler(CFWriteStreamRef stream, CFStreamEventType eventType, void *info) {
+	[(__bridge FRConnection *)info handleWriteStreamEvent:eventType];
+}
+
+static CFRunLoopRef FRConnectionInputRunLoop(void) {
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		inputThreadStarted = dispatch_semaphore_create(0);
+		[NSThread detachNewThreadSelector:@selector(runInputThread:) toTarget:[FRConnection class] withObject:nil];
+		dispatch_semaphore_wait(inputThreadStarted, DISPATCH_TIME_FOREVER);
+#if !OS_OBJECT_USE_OBJC
+		dispatch_release(inputThreadStarted);
+#endif
+		inputThreadStarted = NULL;
+	});
+	return inputRunLoop;
+}
+
+static FRConnectionReader *FRConnectionReaderCreate(FRConnection *connection, CFReadStreamRef stream,
+													size_t maximumMessageLength, uint32_t session) {
+	FRConnectionReader *reader = calloc(1, sizeof(FRConnectionReader));
+	if (reader) { reader->buffer = FRFrameBufferCreate(maximumMessageLength); }
+	if (!reader || !reader->buffer) {
+		free(reader);
+		CFRelease(stream);
+		return NULL;
+	}
+	reader->stream = stream;
+	reader->maximumMessageLength = maximumMessageLength;
+	reader->session = session;
+	reader->runLoop = (CFRunLoopRef)CFRetain(CFRunLoopGetCurrent());
+	reader->connection = (__bridge_retained void *)connection;
+	return reader;
+}
+
+static void FRConnectionReaderInvalidate(FRConnectionReader *reader) {
+	// the reader may be in the middle of an event on the input thread, so it's freed there. the connection
+	// is released back on its own run loop, where it's used.
+	CFRunLoopRef runLoop = FRConnectionInputRunLoop();
+	CFRunLoopPerformBlock(runLoop, kCFRunLoopCommonModes, ^{
+		CFReadStreamSetClient(reader->stream, kCFStreamEventNone, NULL, NULL);
+		CFReadStreamUnscheduleFromRunLoop(reader->stream, runLoop, kCFRunLoopCommonModes);
+		CFReadStreamClose(reader->stream);
+		CFRelease(reader->stream);
+		FRFrameBufferFree(reader->buffer);
+		
+		void *connection = reader->connection;
+		CFRunLoopRef connectionRunLoop = reader->runLoop;
+		CFRunLoopPerformBlock(connectionRunLoop, kCFRunLoopCommonModes, ^{ CFRelease(connection); });
+		CFRunLoopWakeUp(connectionRunLoop);
+		CFRelease(connectionRunLoop);
+		free(reader);
+	});
+	CFRunLoopWakeUp(runLoop);
+}
+
+static BOOL FRConnectionReaderRead(FRConnectionReader *reader, NSMutableArray *messages) {
+	// frames are taken out as soon as they're complete, so the buffer never holds more than the messages
+	// that are in progress and messages are decoded in place
+	while (CFReadStreamHasBytesAvailable(reader->stream)) {
+		size_t available = 0;
+		uint8_t *buffer = FRFrameBufferReserve(reader->buffer, &available);
+		CFIndex len = buffer ? CFReadStreamRead(reader->stream, buffer, (CFIndex)MIN(available, (size_t)LONG_MAX)) : -1;
+		if (len <= 0) { return FALSE; }
+		FRFrameBufferCommit(reader->buffer, (size_t)len);
+		
+		const struct iovec *payload = NULL;
+		int count = 0;
+		size_t length = 0;
+		FRFrameBufferResult result = FRFrameBufferIncomplete;
+		while ((result = FRFrameBufferNextMessage(reader->buffer, &payload, &count, &length)) ==
+			   FRFrameBufferComplete) {
+			NSDictionary *message = FRConnectionDecodeVectors(payload, count, length, reader->maximumMessageLength);
+			if (!message) { return FALSE; }
+			[messages addObject:message];
+		}
+		if (result < 0) { return FALSE; }
+	}
+	return TRUE;
+}
+
+static NSDictionary *FRConnectionDecode(const uint8_t *payload, size_t length, size_t maximumMessageLength) {
+	// the uncompressed length is checked against the maximum before anything is inflated. inflated
+	// messages are handed over whole, so their resources don't need copies of their data.
+	NSDictionary *message = nil;
+	if (FRMessageIsCompressed(payload, length)) {
+		void *uncompressed = NULL;
+		size_t uncompressedLength = 0;
+		if (FRMessageDecompress(payload, length, maximumMessageLength, &uncompressed, &uncompressedLength) == 0) {
+			message = FRMessageWithData([NSData dataWithBytesNoCopy:uncompressed length:uncompressedLength
+													   freeWhenDone:YES]);
+		}
+	}
+	else { message = FRMessageWithBytes(payload, length); }
+	return message;
+}
+
+static NSDictionary *FRConnectionDecodeVectors(const struct iovec *payload, int count, size_t length,
+											   size_t maximumMessageLength) {
+	// compressed messages are inflated straight from the chunks they were read in. only the rare long
+	// message that isn't compressed is put together first.
+	if (count == 1) { return FRConnectionDecode(payload[0].iov_base, length, maximumMessageLength); }
+	void *bytes = NULL;
+	size_t bytesLength = 0;
+	if (FRMessageIsCompressed(payload[0].iov_base, payload[0].iov_len)) {
+		if (FRMessageDecompressVectors(payload, count, maximumMessageLength, &bytes, &bytesLength) != 0) { return nil; }
+	}
 	else {
-		[writeBuffer replaceBytesInRange:NSMakeRange(0, writtenBytes) withBytes:NULL length:0];
+		bytes = malloc(length ? length : 1);
+		if (!bytes) { return nil; }
+		for (int index = 0; index < count; index++) {
+			memcpy((uint8_t *)bytes + bytesLength, payload[index].iov_base, payload[index].iov_len);
+			bytesLength += payload[index].iov_len;
+		}
 	}
+	return FRMessageWithData([NSData dataWithBytesNoCopy:bytes length:bytesLength freeWhenDone:YES]);
 }
 
-void readStreamEventHandler(CFReadStreamRef stream, CFStreamEventType eventType, void *info) {
-	[(__bridge FRConnection *)info handleReadStreamEvent:eventType];
+static ssize_t FRConnectionWriteStream(void *context, const struct iovec *vectors, int count) {
+	// write streams don't do gather writes, so the vectors are written in turn for as long as the
+	// stream takes them without blocking. with Nagle's algorithm off, each write can go out on its own,
+	// so headers and small payloads are copied together with what follows them and written at once.
+	CFWriteStreamRef stream = context;
+	uint8_t buffer[kCoalescedWriteLength];
+	ssize_t total = 0;
+	int index = 0;
+	size_t offset = 0;
+	while (index < count && CFWriteStreamCanAcceptBytes(stream)) {
+		const uint8_t *bytes = (const uint8_t *)vectors[index].iov_base + offset;
+		size_t length = vectors[index].iov_len - offset;
+		if (length < sizeof(buffer) && index + 1 < count) {
+			length = 0;
+			while (index < count && length < sizeof(buffer)) {
+				size_t piece = MIN(vectors[index].iov_len - offset, sizeof(buffer) - length);
+				memcpy(buffer + length, (const uint8_t *)vectors[index].iov_base + offset, piece);
+				length += piece;
+				offset += piece;
+				if (offset == vectors[index].iov_len) {
+					index++;
+					offset = 0;
+				}
+			}
+			bytes = buffer;
+		}
+		else {
+			index++;
+			offset = 0;
+		}
+		
+		CFIndex written = CFWriteStreamWrite(stream, bytes, (CFIndex)length);
+		if (written < 0) { return -1; }
+		total += written;
+		if ((size_t)written < length) { break; }
+	}
+	return total;
 }
 
-void writeStreamEventHandler(CFWriteStreamRef stream, CFStreamEventType eventType, void *info) {
-	[(__bridge FRConnection *)info handleWriteStreamEvent:eventType];
+static void FRConnectionReleaseData(void *data) {
+	CFRelease(data);
+}
+
+static NSDictionary *FRConnectionMessageWithCompressionMethods(NSDictionary *message) {
+	NSString *key = nil;
+	if ([message objectForKey:FRAuthenticationMessage.messageID]) {
+		key = FRAuthenticationMessage.keys.compression;
+	}
+	else if ([message objectForKey:FRLocalizationResourcesMessage.messageID]) {
+		key = FRLocalizationResourcesMessage.keys.compression;
+	}
+	else if ([message objectForKey:FRLocalizationManifestMessage.messageID]) {
+		key = FRLocalizationManifestMessage.keys.compression;
+	}
+	if (!key || [message objectForKey:key]) { return message; }
+	
+	NSMutableDictionary *result = [message mutableCopy];
+	[result setObject:[NSString stringWithUTF8String:FRMessageCompressionMethods] forKey:key];
+	return result;
+}
+
+FRFrameChannel FRConnectionChannelForMessage(NSDictionary *message) {
+	if ([message objectForKey:FRLocalizationResourcesMessage.messageID] ||
+		[message objectForKey:FRLocalizationChangesMessage.messageID]) {
+		return FRFrameChannelBulk;
+	}
+	return FRFrameChannelControl;
 }
 
 @end
@@ -0,0 +1,71 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#import "FRConnection.h"
+#import "FRFrameBuffer.h"
+
+/*!
+ \brief		Default maximum message length
+ \details	Default maximum message length
+ */
+extern const NSUInteger FRConnectionDefaultMaximumMessageLength;
+
+/*!
+ \brief		Channel for a message
+ \details	Messages that carry strings files go out on the bulk channel, so they can't hold up the others,
+			which go out on the control channel.
+ */
+FRFrameChannel FRConnectionChannelForMessage(NSDictionary *message);
+
+@interface FRConnection (FRConnectionInternal)
+
+/*!
+ \brief		Negotiated compression method
+ \details	The best method the other side has said it accepts (an FRMessageCompressionMethod).
+ */
+- (uint8_t)compressionMethod;
+
+/*!
+ \brief		Encode a message
+ \details	Returns the payload that sendMessage: would send for the message, compressed for this
+			connection. Connections with the same compression method send the same payload.
+ */
+- (NSData *)packetWithMessage:(NSDictionary *)message;
+
+/*!
+ \brief		Send an encoded message
+ \details	Works like sendMessage: for a payload made by packetWithMessage:, which is sent on the given
+			channel. Subclasses that write somewhere else override this.
+ */
+- (BOOL)sendPacket:(NSData *)packet channel:(FRFrameChannel)channel;
+
+/*!
+ \brief		Decode a received payload
+ \details	Uncompresses and decodes a payload. Returns nil if the payload isn't a valid message. Doesn't
+			change the connection, so it can be called from any thread.
+ */
+- (NSDictionary *)decodePacket:(const uint8_t *)payload length:(size_t)length;
+
+/*!
+ \brief		Pick up compression methods
+ \details	Uses the compression methods listed in a received message, if there are any. Must be called for
+			every decoded message before it's handed to the delegate.
+ */
+- (void)negotiateCompressionWithMessage:(NSDictionary *)message;
+
+@end
@@ -0,0 +1,203 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define FR_EVENT_KQUEUE 1
+#include <sys/event.h>
+#include <sys/time.h>
+#else
+#define FR_EVENT_KQUEUE 0
+#include <sys/epoll.h>
+#endif
+
+#import "FREventLoop.h"
+
+static const int kMaximumEvents = 64;
+
+typedef struct FREventSource {
+	FREventHandler handler;
+	void *info;
+	FREvents events;
+	uint32_t generation;	// changes whenever the descriptor is removed, so stale events can be ignored
+} FREventSource;
+
+struct FREventLoop {
+	int queue;
+	FREventSource *sources;	// indexed by descriptor
+	size_t capacity;
+};
+
+static int FREventLoopUpdate(FREventLoop *loop, int descriptor, FREvents previous, FREvents events);
+
+FREventLoop *FREventLoopCreate(void) {
+	FREventLoop *loop = calloc(1, sizeof(FREventLoop));
+	if (loop) {
+#if FR_EVENT_KQUEUE
+		loop->queue = kqueue();
+#else
+		loop->queue = epoll_create(kMaximumEvents);
+#endif
+		if (loop->queue < 0) {
+			free(loop);
+			loop = NULL;
+		}
+	}
+	return loop;
+}
+
+void FREventLoopFree(FREventLoop *loop) {
+	close(loop->queue);
+	free(loop->sources);
+	free(loop);
+}
+
+int FREventLoopDescriptor(const FREventLoop *loop) {
+	return loop->queue;
+}
+
+int FREventLoopAdd(FREventLoop *loop, int descriptor, FREvents events, FREventHandler handler, void *info) {
+	if (descriptor < 0 || !handler) { return EINVAL; }
+	if ((size_t)descriptor >= loop->capacity) {
+		size_t capacity = loop->capacity ? loop->capacity : 64;
+		while (capacity <= (size_t)descriptor) { capacity *= 2; }
+		FREventSource *sources = realloc(loop->sources, capacity * sizeof(FREventSource));
+		if (!sources) { return ENOMEM; }
+		memset(sources + loop->capacity, 0, (capacity - loop->capacity) * sizeof(FREventSource));
+		loop->sources = sources;
+		loop->capacity = capacity;
+	}
+	
+	FREventSource *source = &loop->sources[descriptor];
+	if (source->handler) { return EEXIST; }
+	
+#if !FR_EVENT_KQUEUE
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.data.fd = descriptor;
+	if (epoll_ctl(loop->queue, EPOLL_CTL_ADD, descriptor, &event) != 0) { return errno; }
+#endif
+	int error = FREventLoopUpdate(loop, descriptor, 0, events);
+	if (error) {
+#if !FR_EVENT_KQUEUE
+		epoll_ctl(loop->queue, EPOLL_CTL_DEL, descriptor, NULL);
+#endif
+		return error;
+	}
+	source->handler = handler;
+	source->info = info;
+	source->events = events;
+	return 0;
+}
+
+int FREventLoopModify(FREventLoop *loop, int descriptor, FREvents events) {
+	if (descriptor < 0 || (size_t)descriptor >= loop->capacity || !loop->sources[descriptor].handler) {
+		return ENOENT;
+	}
+	FREventSource *source = &loop->sources[descriptor];
+	if (source->events == events) { return 0; }
+	int error = FREventLoopUpdate(loop, descriptor, source->events, events);
+	if (!error) { source->events = events; }
+	return error;
+}
+
+void FREventLoopRemove(FREventLoop *loop, int descriptor) {
+	if (descriptor < 0 || (size_t)descriptor >= loop->capacity || !loop->sources[descriptor].handler) { return; }
+	FREventSource *source = &loop->sources[descriptor];
+	FREventLoopUpdate(loop, descriptor, source->events, 0);
+#if !FR_EVENT_KQUEUE
+	epoll_ctl(loop->queue, EPOLL_CTL_DEL, descriptor, NULL);
+#endif
+	source->handler = NULL;
+	source->info = NULL;
+	source->events = 0;
+	source->generation++;
+}
+
+int FREventLoopRun(FREventLoop *loop, int timeout) {
+	int count = 0;
+#if FR_EVENT_KQUEUE
+	struct kevent events[kMaximumEvents];
+	struct timespec interval = { timeout / 1000, (timeout % 1000) * 1000000L };
+	do { count = kevent(loop->queue, NULL, 0, events, kMaximumEvents, (timeout < 0) ? NULL : &interval); }
+	while (count < 0 && errno == EINTR);
+#else
+	struct epoll_event events[kMaximumEvents];
+	do { count = epoll_wait(loop->queue, events, kMaximumEvents, timeout); } while (count < 0 && errno == EINTR);
+#endif
+	if (count <= 0) { return count; }
+	
+	// handlers can remove any descriptor, and a descriptor that was removed may even have been reused by
+	// the time its event comes up. the generation at the start tells which events still apply.
+	uint32_t generations[kMaximumEvents];
+	for (int index = 0; index < count; index++) {
+#if FR_EVENT_KQUEUE
+		int descriptor = (int)events[index].ident;
+#else
+		int descriptor = events[index].data.fd;
+#endif
+		generations[index] = ((size_t)descriptor < loop->capacity) ? loop->sources[descriptor].generation : 0;
+	}
+	
+	for (int index = 0; index < count; index++) {
+#if FR_EVENT_KQUEUE
+		int descriptor = (int)events[index].ident;
+		FREvents ready = (events[index].filter == EVFILT_WRITE) ? FREventWrite : FREventRead;
+#else
+		int descriptor = events[index].data.fd;
+		FREvents ready = 0;
+		if (events[index].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) { ready |= FREventRead; }
+		if (events[index].events & (EPOLLOUT | EPOLLERR)) { ready |= FREventWrite; }
+#endif
+		if ((size_t)descriptor >= loop->capacity) { continue; }
+		FREventSource *source = &loop->sources[descriptor];
+		if (!source->handler || source->generation != generations[index]) { continue; }
+		ready &= source->events;
+		if (ready) { source->handler(loop, descriptor, ready, source->info); }
+	}
+	return count;
+}
+
+static int FREventLoopUpdate(FREventLoop *loop, int descriptor, FREvents previous, FREvents events) {
+#if FR_EVENT_KQUEUE
+	struct kevent changes[2];
+	int count = 0;
+	if ((previous ^ events) & FREventRead) {
+		EV_SET(&changes[count++], descriptor, EVFILT_READ, (events & FREventRead) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+	}
+	if ((previous ^ events) & FREventWrite) {
+		EV_SET(&changes[count++], descriptor, EVFILT_WRITE, (events & FREventWrite) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+	}
+	if (count && kevent(loop->queue, changes, count, NULL, 0, NULL) < 0) { return errno; }
+	return 0;
+#else
+	(void)previous;
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.data.fd = descriptor;
+	if (events & FREventRead) { event.events |= EPOLLIN; }
+	if (events & FREventWrite) { event.events |= EPOLLOUT; }
+	return (epoll_ctl(loop->queue, EPOLL_CTL_MOD, descriptor, &event) == 0) ? 0 : errno;
+#endif
+}
@@ -0,0 +1,89 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+
+#include <stddef.h>
+
+/*!
+ \brief		Event loop
+ \details	Waits for file descriptors to become readable or writable and calls their handlers. It uses
+			kqueue where that's available (Mac OS X, iOS and the BSDs) and epoll on Linux, so code built on
+			it runs the same everywhere.
+			
+			The loop doesn't own a thread. It's driven by calling FREventLoopRun, either in a loop of its own
+			or whenever the loop's descriptor is readable (which is how it's hooked up to a run loop). All
+			handlers are called from FREventLoopRun.
+ */
+typedef struct FREventLoop FREventLoop;
+
+enum {
+	FREventRead = 1 << 0,
+	FREventWrite = 1 << 1,
+};
+typedef int FREvents;
+
+/*!
+ \brief		Event handler
+ \details	Called with the events that are ready for the descriptor. Handlers may add, change and remove
+			any descriptors, including their own.
+ */
+typedef void (*FREventHandler)(FREventLoop *loop, int descriptor, FREvents events, void *info);
+
+/*!
+ \brief		Create an event loop
+ \details	Returns NULL if the kernel queue can't be created.
+ */
+FREventLoop *FREventLoopCreate(void);
+
+/*!
+ \brief		Free an event loop
+ \details	The descriptors that were added aren't closed.
+ */
+void FREventLoopFree(FREventLoop *loop);
+
+/*!
+ \brief		Loop descriptor
+ \details	A descriptor that's readable whenever FREventLoopRun has events to handle.
+ */
+int FREventLoopDescriptor(const FREventLoop *loop);
+
+/*!
+ \brief		Watch a descriptor
+ \details	Starts calling the handler for the given events. Returns 0 on success or an errno value.
+ */
+int FREventLoopAdd(FREventLoop *loop, int descriptor, FREvents events, FREventHandler handler, void *info);
+
+/*!
+ \brief		Change the events to watch for
+ \details	Change the events to watch for
+ */
+int FREventLoopModify(FREventLoop *loop, int descriptor, FREvents events);
+
+/*!
+ \brief		Stop watching a descriptor
+ \details	Must be called before the descriptor is closed. Events for the descriptor that are already
+			waiting aren't handled.
+ */
+void FREventLoopRemove(FREventLoop *loop, int descriptor);
+
+/*!
+ \brief		Handle events
+ \details	Waits up to the timeout (in milliseconds, or forever if negative) for events and handles
+			them. Returns the number of events handled or -1 with errno set.
+ */
+int FREventLoopRun(FREventLoop *loop, int timeout);
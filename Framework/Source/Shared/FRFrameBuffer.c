@@ -0,0 +1,301 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#import "FRFrameBuffer.h"
+
+const size_t FRFrameBufferHeaderLength = 5;
+const size_t FRFrameBufferMaximumChunkLength = 16 * 1024;
+static const size_t kInitialCapacity = 64 * 1024;
+static const size_t kMinimumReadLength = 16 * 1024;	// reads smaller than this move the unread bytes first
+static const size_t kInitialSliceCount = 16;
+
+// a chunk of a message that's split into several frames, left where it was read
+typedef struct FRFrameSlice {
+	size_t offset;
+	size_t length;
+} FRFrameSlice;
+
+// the chunks of a message that's split into several frames, in order
+typedef struct FRFrameAssembly {
+	FRFrameSlice *slices;
+	size_t count;
+	size_t capacity;
+	size_t length;
+} FRFrameAssembly;
+
+struct FRFrameBuffer {
+	uint8_t *bytes;
+	size_t capacity;
+	size_t start;	// first unread byte
+	size_t end;		// end of the read bytes
+	size_t maximumFrameLength;
+	FRFrameAssembly assemblies[FRFrameChannelCount];
+	struct iovec *vectors;	// the message handed out last
+	size_t vectorCapacity;
+	uint8_t *joined;		// the message handed out last by FRFrameBufferNextFrame, if it had to be joined
+	size_t joinedCapacity;
+};
+
+static int FRFrameBufferHeader(const FRFrameBuffer *buffer, size_t *length, uint8_t *flags);
+static void FRFrameBufferRewind(FRFrameBuffer *buffer);
+static void FRFrameBufferPack(FRFrameBuffer *buffer, uint8_t *bytes);
+static int FRFrameBufferReserveVectors(FRFrameBuffer *buffer, size_t count);
+static int FRFrameAssemblyAppend(FRFrameAssembly *assembly, size_t offset, size_t length);
+
+FRFrameBuffer *FRFrameBufferCreate(size_t maximumFrameLength) {
+	FRFrameBuffer *buffer = calloc(1, sizeof(FRFrameBuffer));
+	if (buffer) {
+		buffer->bytes = malloc(kInitialCapacity);
+		buffer->capacity = kInitialCapacity;
+		buffer->maximumFrameLength = maximumFrameLength;
+		if (!buffer->bytes) {
+			free(buffer);
+			buffer = NULL;
+		}
+	}
+	return buffer;
+}
+
+void FRFrameBufferFree(FRFrameBuffer *buffer) {
+	for (int channel = 0; channel < FRFrameChannelCount; channel++) { free(buffer->assemblies[channel].slices); }
+	free(buffer->vectors);
+	free(buffer->joined);
+	free(buffer->bytes);
+	free(buffer);
+}
+
+void FRFrameBufferReset(FRFrameBuffer *buffer) {
+	buffer->start = 0;
+	buffer->end = 0;
+	for (int channel = 0; channel < FRFrameChannelCount; channel++) {
+		buffer->assemblies[channel].count = 0;
+		buffer->assemblies[channel].length = 0;
+	}
+}
+
+void FRFrameBufferSetMaximumFrameLength(FRFrameBuffer *buffer, size_t maximumFrameLength) {
+	buffer->maximumFrameLength = maximumFrameLength;
+}
+
+uint8_t *FRFrameBufferReserve(FRFrameBuffer *buffer, size_t *length) {
+	// with the whole frame in view, it's read with as few reads as possible and never moved again
+	size_t unread = buffer->end - buffer->start;
+	size_t needed = kMinimumReadLength;
+	size_t payloadLength = 0;
+	uint8_t flags = 0;
+	if (FRFrameBufferHeader(buffer, &payloadLength, &flags)) {
+		FRFrameChannel channel = flags & FRFrameChannelMask;
+		size_t assembled = (channel < FRFrameChannelCount) ? buffer->assemblies[channel].length : 0;
+		if (payloadLength > buffer->maximumFrameLength - assembled) { return NULL; }
+		size_t frameLength = FRFrameBufferHeaderLength + payloadLength;
+		if (frameLength > unread && frameLength - unread > needed) { needed = frameLength - unread; }
+	}
+	
+	// chunks of unfinished messages and the unread bytes are packed together, which drops the headers and
+	// the messages taken in between. that's done in place when it frees at least as much as it moves, so
+	// every byte is moved a bounded number of times, and in a larger buffer otherwise.
+	if (buffer->capacity - buffer->end < needed) {
+		size_t occupied = unread;
+		for (int channel = 0; channel < FRFrameChannelCount; channel++) {
+			occupied += buffer->assemblies[channel].length;
+		}
+		size_t capacity = buffer->capacity;
+		while (capacity - occupied < needed || capacity - occupied < occupied) { capacity *= 2; }
+		uint8_t *bytes = (capacity == buffer->capacity) ? buffer->bytes : malloc(capacity);
+		if (!bytes) { return NULL; }
+		FRFrameBufferPack(buffer, bytes);
+		if (bytes != buffer->bytes) {
+			free(buffer->bytes);
+			buffer->bytes = bytes;
+			buffer->capacity = capacity;
+		}
+	}
+	
+	*length = buffer->capacity - buffer->end;
+	return buffer->bytes + buffer->end;
+}
+
+void FRFrameBufferCommit(FRFrameBuffer *buffer, size_t length) {
+	buffer->end += length;
+}
+
+FRFrameBufferResult FRFrameBufferNextMessage(FRFrameBuffer *buffer, const struct iovec **vectors, int *count,
+											 size_t *length) {
+	for (;;) {
+		size_t payloadLength = 0;
+		uint8_t flags = 0;
+		if (!FRFrameBufferHeader(buffer, &payloadLength, &flags)) { return FRFrameBufferIncomplete; }
+		
+		FRFrameChannel channel = flags & FRFrameChannelMask;
+		if (channel >= FRFrameChannelCount) { return FRFrameBufferInvalid; }
+		FRFrameAssembly *assembly = &buffer->assemblies[channel];
+		if (payloadLength > buffer->maximumFrameLength - assembly->length) { return FRFrameBufferTooLarge; }
+		if (buffer->end - buffer->start - FRFrameBufferHeaderLength < payloadLength) { return FRFrameBufferIncomplete; }
+		
+		size_t offset = buffer->start + FRFrameBufferHeaderLength;
+		buffer->start += FRFrameBufferHeaderLength + payloadLength;
+		
+		// a message in a single frame is handed out where it is
+		if (!(flags & FRFrameFlagMore) && !assembly->length) {
+			if (!FRFrameBufferReserveVectors(buffer, 1)) { return FRFrameBufferTooLarge; }
+			buffer->vectors[0].iov_base = buffer->bytes + offset;
+			buffer->vectors[0].iov_len = payloadLength;
+			*vectors = buffer->vectors;
+			*count = 1;
+			*length = payloadLength;
+			FRFrameBufferRewind(buffer);
+			return FRFrameBufferComplete;
+		}
+		
+		// longer messages stay where their chunks were read until the last chunk is in
+		if (!FRFrameAssemblyAppend(assembly, offset, payloadLength)) { return FRFrameBufferTooLarge; }
+		if (!(flags & FRFrameFlagMore)) {
+			if (!FRFrameBufferReserveVectors(buffer, assembly->count)) { return FRFrameBufferTooLarge; }
+			for (size_t index = 0; index < assembly->count; index++) {
+				buffer->vectors[index].iov_base = buffer->bytes + assembly->slices[index].offset;
+				buffer->vectors[index].iov_len = assembly->slices[index].length;
+			}
+			*vectors = buffer->vectors;
+			*count = (int)assembly->count;
+			*length = assembly->length;
+			assembly->count = 0; // the bytes stay until space is reserved again
+			assembly->length = 0;
+			FRFrameBufferRewind(buffer);
+			return FRFrameBufferComplete;
+		}
+		FRFrameBufferRewind(buffer);
+	}
+}
+
+FRFrameBufferResult FRFrameBufferNextFrame(FRFrameBuffer *buffer, const uint8_t **payload, size_t *length) {
+	const struct iovec *vectors = NULL;
+	int count = 0;
+	FRFrameBufferResult result = FRFrameBufferNextMessage(buffer, &vectors, &count, length);
+	if (result != FRFrameBufferComplete || count == 1) {
+		if (result == FRFrameBufferComplete) { *payload = vectors[0].iov_base; }
+		return result;
+	}
+	
+	// chunks that aren't next to each other are joined in a buffer of their own
+	if (buffer->joinedCapacity < *length) {
+		size_t capacity = buffer->joinedCapacity ? buffer->joinedCapacity : kInitialCapacity;
+		while (capacity < *length) { capacity *= 2; }
+		uint8_t *joined = realloc(buffer->joined, capacity);
+		if (!joined) { return FRFrameBufferTooLarge; }
+		buffer->joined = joined;
+		buffer->joinedCapacity = capacity;
+	}
+	size_t position = 0;
+	for (int index = 0; index < count; index++) {
+		memcpy(buffer->joined + position, vectors[index].iov_base, vectors[index].iov_len);
+		position += vectors[index].iov_len;
+	}
+	*payload = buffer->joined;
+	return FRFrameBufferComplete;
+}
+
+static int FRFrameBufferHeader(const FRFrameBuffer *buffer, size_t *length, uint8_t *flags) {
+	if (buffer->end - buffer->start < FRFrameBufferHeaderLength) { return 0; }
+	const uint8_t *header = buffer->bytes + buffer->start;
+	*length = ((size_t)header[0] << 24) | ((size_t)header[1] << 16) | ((size_t)header[2] << 8) | header[3];
+	*flags = header[4];
+	return 1;
+}
+
+static void FRFrameBufferRewind(FRFrameBuffer *buffer) {
+	// once everything has been taken, reading starts over at the beginning. messages handed out are still
+	// valid since nothing is written until space is reserved again.
+	if (buffer->start != buffer->end) { return; }
+	for (int channel = 0; channel < FRFrameChannelCount; channel++) {
+		if (buffer->assemblies[channel].count) { return; }
+	}
+	buffer->start = 0;
+	buffer->end = 0;
+}
+
+static void FRFrameBufferPack(FRFrameBuffer *buffer, uint8_t *bytes) {
+	// chunks are moved in the order they were read, so moving them within the buffer never overwrites a
+	// chunk that hasn't been moved yet. the unread bytes come after all of them.
+	size_t next[FRFrameChannelCount] = { 0 };
+	size_t position = 0;
+	for (;;) {
+		FRFrameSlice *slice = NULL;
+		int earliest = -1;
+		for (int channel = 0; channel < FRFrameChannelCount; channel++) {
+			FRFrameAssembly *assembly = &buffer->assemblies[channel];
+			if (next[channel] < assembly->count &&
+				(!slice || assembly->slices[next[channel]].offset < slice->offset)) {
+				slice = &assembly->slices[next[channel]];
+				earliest = channel;
+			}
+		}
+		if (!slice) { break; }
+		memmove(bytes + position, buffer->bytes + slice->offset, slice->length);
+		slice->offset = position;
+		position += slice->length;
+		next[earliest]++;
+	}
+	size_t unread = buffer->end - buffer->start;
+	memmove(bytes + position, buffer->bytes + buffer->start, unread);
+	buffer->start = position;
+	buffer->end = position + unread;
+	
+	// chunks of a message that ended up next to each other are handed out as one
+	for (int channel = 0; channel < FRFrameChannelCount; channel++) {
+		FRFrameAssembly *assembly = &buffer->assemblies[channel];
+		size_t count = 0;
+		for (size_t index = 0; index < assembly->count; index++) {
+			FRFrameSlice *slice = &assembly->slices[index];
+			FRFrameSlice *last = count ? &assembly->slices[count - 1] : NULL;
+			if (last && last->offset + last->length == slice->offset) { last->length += slice->length; }
+			else { assembly->slices[count++] = *slice; }
+		}
+		assembly->count = count;
+	}
+}
+
+static int FRFrameBufferReserveVectors(FRFrameBuffer *buffer, size_t count) {
+	if (count <= buffer->vectorCapacity) { return 1; }
+	size_t capacity = buffer->vectorCapacity ? buffer->vectorCapacity : kInitialSliceCount;
+	while (capacity < count) { capacity *= 2; }
+	struct iovec *vectors = realloc(buffer->vectors, capacity * sizeof(struct iovec));
+	if (!vectors) { return 0; }
+	buffer->vectors = vectors;
+	buffer->vectorCapacity = capacity;
+	return 1;
+}
+
+static int FRFrameAssemblyAppend(FRFrameAssembly *assembly, size_t offset, size_t length) {
+	// empty chunks don't need a slice, and the message only counts as started once it has bytes
+	if (!length) { return 1; }
+	if (assembly->count == assembly->capacity) {
+		size_t capacity = assembly->capacity ? assembly->capacity * 2 : kInitialSliceCount;
+		FRFrameSlice *slices = realloc(assembly->slices, capacity * sizeof(FRFrameSlice));
+		if (!slices) { return 0; }
+		assembly->slices = slices;
+		assembly->capacity = capacity;
+	}
+	assembly->slices[assembly->count].offset = offset;
+	assembly->slices[assembly->count].length = length;
+	assembly->count++;
+	assembly->length += length;
+	return 1;
+}
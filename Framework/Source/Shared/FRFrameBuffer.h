@@ -0,0 +1,137 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/*!
+ \brief		Message framing
+ \details	Collects bytes read from a connection and splits them into messages. Messages are sent as frames
+			on channels (see FRWriteQueue), and a message longer than a single frame is split into several
+			frames that can be interleaved with the frames of other channels. Each frame is a 32-bit big
+			endian payload length, a byte holding the channel and whether more frames of the message
+			follow, and the payload. Bytes are read straight into the buffer and messages are handed out
+			in place, so nothing is copied on the way to the decoder: the chunks of a longer message stay
+			where they were read and the message is handed out as a list of them.
+			
+			Unread bytes live between a read and a write cursor. Rather than wrapping around, the buffer
+			packs the chunks of unfinished messages and the unread bytes back at the start when it runs out
+			of space at the end, so every frame is contiguous. When that wouldn't free at least as much as
+			it moves, or a frame doesn't fit, the buffer grows geometrically.
+ */
+typedef struct FRFrameBuffer FRFrameBuffer;
+
+enum {
+	FRFrameBufferIncomplete = 0,	// more bytes are needed for the next message
+	FRFrameBufferComplete = 1,		// a message is ready
+	FRFrameBufferTooLarge = -1,		// the next message is longer than the maximum
+	FRFrameBufferInvalid = -2,		// a frame is on a channel that doesn't exist
+};
+typedef int FRFrameBufferResult;
+
+/*!
+ \brief		Channels
+ \details	Frames on lower channels are sent first, so short messages on the control channel never wait
+			for a long message on the bulk channel to be sent.
+ */
+enum {
+	FRFrameChannelControl = 0,		// authentication, requests and other short messages
+	FRFrameChannelBulk = 1,			// strings files
+	FRFrameChannelCount = 2,
+};
+typedef uint8_t FRFrameChannel;
+
+/*!
+ \brief		Frame header flags
+ \details	The header's last byte holds the channel in its lower bits.
+ */
+enum {
+	FRFrameFlagMore = 1 << 7,		// more frames of the message follow
+	FRFrameChannelMask = 0x7f,
+};
+
+/*!
+ \brief		Length of a frame header
+ \details	Length of a frame header
+ */
+extern const size_t FRFrameBufferHeaderLength;
+
+/*!
+ \brief		Longest frame payload
+ \details	Messages longer than this are split into several frames.
+ */
+extern const size_t FRFrameBufferMaximumChunkLength;
+
+/*!
+ \brief		Create a frame buffer
+ \details	Messages longer than the maximum frame length are rejected as soon as a frame header shows that
+			they will be. Returns NULL if memory couldn't be allocated.
+ */
+FRFrameBuffer *FRFrameBufferCreate(size_t maximumFrameLength);
+
+/*!
+ \brief		Free a frame buffer
+ \details	Free a frame buffer
+ */
+void FRFrameBufferFree(FRFrameBuffer *buffer);
+
+/*!
+ \brief		Discard everything
+ \details	Throws away all buffered bytes. The memory is kept for reuse.
+ */
+void FRFrameBufferReset(FRFrameBuffer *buffer);
+
+/*!
+ \brief		Maximum frame length
+ \details	Maximum frame length
+ */
+void FRFrameBufferSetMaximumFrameLength(FRFrameBuffer *buffer, size_t maximumFrameLength);
+
+/*!
+ \brief		Space to read into
+ \details	Returns where the next bytes should be read to and stores how many fit in length. When the
+			length of the frame in progress is known, there's room for all of it. Returns NULL if the
+			frame in progress is too large or memory couldn't be allocated. Reserving space invalidates
+			payloads handed out before.
+ */
+uint8_t *FRFrameBufferReserve(FRFrameBuffer *buffer, size_t *length);
+
+/*!
+ \brief		Add read bytes
+ \details	Marks length bytes at the reserved space as read.
+ */
+void FRFrameBufferCommit(FRFrameBuffer *buffer, size_t length);
+
+/*!
+ \brief		Take the next message
+ \details	When a complete message is buffered, stores the chunks it's made of, how many there are and its
+			length, and removes its frames from the buffer. A message that fits into a single frame is one
+			chunk. The chunks stay valid until space is reserved or the next message is taken.
+ */
+FRFrameBufferResult FRFrameBufferNextMessage(FRFrameBuffer *buffer, const struct iovec **vectors, int *count,
+											 size_t *length);
+
+/*!
+ \brief		Take the next message in one piece
+ \details	When a complete message is buffered, stores where it starts and its length and removes its
+			frames from the buffer. Works like FRFrameBufferNextMessage, but the chunks of a longer message
+			are copied into one piece. The message stays valid until space is reserved or the next message
+			is taken.
+ */
+FRFrameBufferResult FRFrameBufferNextFrame(FRFrameBuffer *buffer, const uint8_t **payload, size_t *length);
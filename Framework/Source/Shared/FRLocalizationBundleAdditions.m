@@ -15,11 +15,14 @@
 // OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 // 
 
+#import <objc/runtime.h>
+
 #import "FRLocalizationBundleAdditions.h"
 #import "FRLocalizationBundleAdditions__.h"
 #import "FRBundleAdditions.h"
 #import "FRRuntimeAdditions.h"
 #import "FRStrings.h"
+#import "FRStringsJournal.h"
 
 @interface NSBundle (FRLocalizationBundleAdditionsPrivate)
 + (BOOL)_mergeContentsOfStringsFile:(NSString *)mergeFromPath
@@ -27,6 +30,40 @@
 							  error:(NSError **)error;
 @end
 
+NSString * const FRTranslationsDidChangeNotification = @"FRTranslationsDidChangeNotification";
+NSString * const FRTranslationsBundleIdentifierKey = @"bundleIdentifier";
+NSString * const FRTranslationsTableKey = @"table";
+
+/*!
+ \brief		Translated tables of a bundle
+ \details	What lookups in a bundle need, worked out by the first one: the lproj directory with its
+			translations for the system language (nil if there's none), the tables read from it so far
+			(NSNull for ones that don't exist) and whether to pseudo localize. It never changes once it's
+			attached to the bundle, so lookups use it without a lock. Reading another table or invalidating
+			one attaches a new one.
+ */
+@interface FRTranslatedTables : NSObject {
+@public
+	NSString *directory;
+	NSDictionary *tables;
+	BOOL pseudoLocalize;
+}
+@end
+
+@implementation FRTranslatedTables
+@end
+
+// bundles with translated tables attached, in sets keyed by bundle identifier, so invalidating a table reaches
+// them. new tables are only attached while holding this.
+static NSMutableDictionary *gTranslatedBundles = nil;
+static char FRTranslatedTablesKey;
+
+static NSString *FRTranslationsLprojName(NSString *language);
+static NSString *FRSystemLprojName(void);
+static FRTranslatedTables *FRTranslatedTablesForBundle(NSBundle *bundle);
+static NSDictionary *FRTranslatedTable(NSBundle *bundle, FRTranslatedTables *translated, NSString *table);
+static FRTranslatedTables *FRTranslatedTablesWithTables(FRTranslatedTables *translated, NSDictionary *tables);
+static void FRInvalidateTranslatedTable(NSString *identifier, NSString *table);
 static BOOL FRShouldPseudoLocalize(void);
 static NSString *FRPseudoLocalizedString(NSString *string);
 
@@ -37,6 +74,7 @@ static NSString *(FRLocalizedStringLookup)(id self, SEL _cmd, NSString *key, NSS
 @implementation NSBundle (FRLocalizationBundleAdditions)
 
 + (void)load {
+	gTranslatedBundles = [[NSMutableDictionary alloc] init];
 	[self swizzle:@selector(localizedStringForKey:value:table:)
 			 with:(IMP)FRLocalizedStringLookup store:(IMPPointer)&SLocalizedStringLookup];
 }
@@ -49,42 +87,135 @@ static NSString *(FRLocalizedStringLookup)(id self, SEL _cmd, NSString *key, NSS
 // ----------------------------------------------------------------------------------------------------
 
 static NSString *FRLocalizedStringLookup(id self, SEL _cmd, NSString *key, NSString *value, NSString *table) {
-	NSBundle *bundle = self;
-	NSString *bundleID = [self bundleIdentifier];
-	BOOL shouldPseudoLocalize = FALSE;
+	// translated tables are read here rather than by the bundle, which never reads a table again once it has
+	// it. that way translations that change while the application is running can be reloaded. tables that
+	// haven't been translated yet, and strings that aren't in the translated table (anymore), come from the
+	// original bundle.
+	FRTranslatedTables *translated = FRTranslatedTablesForBundle(self);
+	NSString *result = nil;
+	if (translated->directory && key) {
+		NSDictionary *strings = FRTranslatedTable(self, translated, [table length] ? table : @"Localizable");
+		id translation = [strings objectForKey:key];
+		if ([translation isKindOfClass:[NSString class]]) { result = translation; }
+	}
 	
-	if (bundleID) {
-		// grab the translated bundle and ensure that it contains an lproj folder for the language the user has set in
-		// their system preferences. if it's not, we want to just fall back to the standard lookup. this allows fluent
-		// second language speakers to translate the app (and relaunch to see their changes with their system
-		// preferences are changed), but allows them to switch back to their native language without greenwhich always
-		// loading what they translated.
-		NSBundle *translated = [[self class] bundleForTranslationsWithIdentifier:bundleID];
+	if (!result) {
+		result = SLocalizedStringLookup(self, _cmd, key, value, table);
+	}
+	if (result && translated->pseudoLocalize) {
+		result = FRPseudoLocalizedString(result);
+	}
+	return result;
+}
+
+static NSString *FRTranslationsLprojName(NSString *language) {
+	return [language stringByAppendingPathExtension:@"lproj"];
+}
+
+static NSString *FRSystemLprojName(void) {
+	// the system language only changes for the application when it's relaunched
+	static NSString *lprojName = nil;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
 		NSArray *languages = [[NSUserDefaults standardUserDefaults] objectForKey:@"AppleLanguages"];
-		NSString *systemLanguage = ([languages count]) ? [languages objectAtIndex:0] : GREENWICH_DEFAULT_LANGUAGE;
-		NSString *lprojName = [NSString stringWithFormat:@"%@.lproj", systemLanguage];
-		NSString *lprojDirectory = [[translated bundlePath] stringByAppendingPathComponent:lprojName];
-		NSFileManager *manager = [NSFileManager defaultManager];
-		if (translated && [manager fileExistsAtPath:lprojDirectory]) {
-			bundle = translated;
-			shouldPseudoLocalize = FRShouldPseudoLocalize();
-		}
-		else {
-			// we should pseudo localize for anything that's a resource in the main bundle.
-			// items outside the main bundle are things like system frameworks, and it doesn't
-			// really make sense to pseudo localize those.
-			shouldPseudoLocalize = FRShouldPseudoLocalize() &&
-				[[self bundlePath] hasPrefix:[[NSBundle mainBundle] bundlePath]];
+		NSString *language = ([languages count]) ? [languages objectAtIndex:0] : GREENWICH_DEFAULT_LANGUAGE;
+		lprojName = FRTranslationsLprojName(language);
+	});
+	return lprojName;
+}
+
+static FRTranslatedTables *FRTranslatedTablesForBundle(NSBundle *bundle) {
+	FRTranslatedTables *translated = objc_getAssociatedObject(bundle, &FRTranslatedTablesKey);
+	if (translated) { return translated; }
+	
+	@synchronized(gTranslatedBundles) {
+		translated = objc_getAssociatedObject(bundle, &FRTranslatedTablesKey);
+		if (!translated) {
+			translated = [[FRTranslatedTables alloc] init];
+			translated->tables = [NSDictionary dictionary];
+			
+			NSString *bundleID = [bundle bundleIdentifier];
+			if (bundleID) {
+				// grab the translated bundle and ensure that it contains an lproj folder for the language the user
+				// has set in their system preferences. if it's not, we want to just fall back to the standard
+				// lookup. this allows fluent second language speakers to translate the app (and relaunch to see
+				// their changes with their system preferences are changed), but allows them to switch back to
+				// their native language without greenwhich always loading what they translated.
+				NSBundle *translations = [NSBundle bundleForTranslationsWithIdentifier:bundleID];
+				NSString *directory = [[translations bundlePath] stringByAppendingPathComponent:FRSystemLprojName()];
+				if (translations && [[NSFileManager defaultManager] fileExistsAtPath:directory]) {
+					translated->directory = directory;
+					translated->pseudoLocalize = FRShouldPseudoLocalize();
+				}
+				else {
+					// we should pseudo localize for anything that's a resource in the main bundle.
+					// items outside the main bundle are things like system frameworks, and it doesn't
+					// really make sense to pseudo localize those.
+					translated->pseudoLocalize = FRShouldPseudoLocalize() &&
+						[[bundle bundlePath] hasPrefix:[[NSBundle mainBundle] bundlePath]];
+				}
+				
+				NSMutableSet *bundles = [gTranslatedBundles objectForKey:bundleID];
+				if (!bundles) {
+					bundles = [NSMutableSet set];
+					[gTranslatedBundles setObject:bundles forKey:bundleID];
+				}
+				[bundles addObject:bundle];
+			}
+			objc_setAssociatedObject(bundle, &FRTranslatedTablesKey, translated, OBJC_ASSOCIATION_RETAIN);
 		}
 	}
-	
-	NSString *result = SLocalizedStringLookup(bundle, _cmd, key, value, table);
-	if (result && shouldPseudoLocalize) {
-		result = FRPseudoLocalizedString(result);
+	return translated;
+}
+
+static NSDictionary *FRTranslatedTable(NSBundle *bundle, FRTranslatedTables *translated, NSString *table) {
+	// tables that don't exist are remembered too, so they aren't looked for on every lookup
+	id strings = [translated->tables objectForKey:table];
+	if (!strings) {
+		@synchronized(gTranslatedBundles) {
+			// another lookup may have read the table or invalidated the tables in the meantime
+			translated = FRTranslatedTablesForBundle(bundle);
+			strings = [translated->tables objectForKey:table];
+			if (!strings && translated->directory) {
+				NSString *name = [table stringByAppendingPathExtension:@"strings"];
+				strings = [NSDictionary dictionaryWithContentsOfFile:
+						   [translated->directory stringByAppendingPathComponent:name]];
+				if (!strings) { strings = [NSNull null]; }
+				
+				NSMutableDictionary *tables = [translated->tables mutableCopy];
+				[tables setObject:strings forKey:table];
+				objc_setAssociatedObject(bundle, &FRTranslatedTablesKey,
+										 FRTranslatedTablesWithTables(translated, tables), OBJC_ASSOCIATION_RETAIN);
+			}
+		}
 	}
+	return [strings isKindOfClass:[NSDictionary class]] ? strings : nil;
+}
+
+static FRTranslatedTables *FRTranslatedTablesWithTables(FRTranslatedTables *translated, NSDictionary *tables) {
+	FRTranslatedTables *result = [[FRTranslatedTables alloc] init];
+	result->directory = translated->directory;
+	result->tables = tables;
+	result->pseudoLocalize = translated->pseudoLocalize;
 	return result;
 }
 
+static void FRInvalidateTranslatedTable(NSString *identifier, NSString *table) {
+	// bundles that didn't have translations for the language find out again whether they have them now
+	@synchronized(gTranslatedBundles) {
+		for (NSBundle *bundle in [gTranslatedBundles objectForKey:identifier]) {
+			FRTranslatedTables *translated = objc_getAssociatedObject(bundle, &FRTranslatedTablesKey);
+			FRTranslatedTables *updated = nil;
+			if (translated && translated->directory) {
+				NSMutableDictionary *tables = [translated->tables mutableCopy];
+				[tables removeObjectForKey:table];
+				updated = FRTranslatedTablesWithTables(translated, tables);
+			}
+			objc_setAssociatedObject(bundle, &FRTranslatedTablesKey, updated, OBJC_ASSOCIATION_RETAIN);
+		}
+	}
+}
+
 static BOOL FRShouldPseudoLocalize(void) {
 	static BOOL should = FALSE;
 	static BOOL checked = FALSE;
@@ -184,6 +315,23 @@ static NSString *FRPseudoLocalizedString(NSString *string) {
 																error:NULL];
 }
 
++ (void)invalidateTranslationsForIdentifier:(NSString *)identifier
+								   language:(NSString *)language
+									  table:(NSString *)table {
+	// lookups only use tables for the system language
+	if ([FRTranslationsLprojName(language) isEqualToString:FRSystemLprojName()]) {
+		FRInvalidateTranslatedTable(identifier, table);
+	}
+	
+	NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
+							  identifier, FRTranslationsBundleIdentifierKey,
+							  table, FRTranslationsTableKey, nil];
+	dispatch_async(dispatch_get_main_queue(), ^{
+		[[NSNotificationCenter defaultCenter] postNotificationName:FRTranslationsDidChangeNotification
+															object:nil userInfo:userInfo];
+	});
+}
+
 - (id)bundleUsingContentsForTranslationsWithIdentifier:(NSString *)bundleIdentifier
 						   updatingStringsForLanguages:(NSArray *)languages
 												 error:(NSError **)error {
@@ -303,7 +451,7 @@ static NSString *FRPseudoLocalizedString(NSString *string) {
 	}
 	
 	if (success) {
-		contentsTranslated = [[FRStrings alloc] initWithContentsOfFile:mergeIntoPath usedFormat:NULL error:error];
+		contentsTranslated = [FRStringsJournal stringsWithContentsOfFile:mergeIntoPath usedFormat:NULL error:error];
 		if (!contentsTranslated) { success = FALSE; }
 	}
 
@@ -328,7 +476,9 @@ static NSString *FRPseudoLocalizedString(NSString *string) {
 			[contentsUntranslated setComments:combinedComments forString:string];
 		}
 		
-		if (![contentsUntranslated writeToFile:mergeIntoPath format:format error:error]) {
+		// the merged contents include everything from the journal
+		if (![contentsUntranslated writeToFile:mergeIntoPath format:format error:error] ||
+			![[[FRStringsJournal alloc] initWithStringsFileAtPath:mergeIntoPath] discardWithError:error]) {
 			success = FALSE;
 		}
 	}
@@ -15,8 +15,34 @@
 // OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 // 
 
+/*!
+ \brief		Translations changed
+ \details	Posted on the main thread after a translated table was invalidated. The user info holds the
+			bundle identifier and the name of the table.
+ */
+extern NSString * const FRTranslationsDidChangeNotification;
+extern NSString * const FRTranslationsBundleIdentifierKey;
+extern NSString * const FRTranslationsTableKey;
+
 @interface NSBundle (FRLocalizationBundleAdditionsInternal)
 
+/*!
+ \brief		Get the translations storage path
+ \details	The directory that holds the user translations for all bundles, each in a directory named
+			after the bundle identifier.
+ */
++ (NSString *)translactionStoragePath;
+
+/*!
+ \brief		Invalidate a translated table
+ \details	Translated tables are only read once. After the strings file for a table in the translations
+			storage changes, this makes the next lookup read it again and posts a translations changed
+			notification so anything showing strings from the table can be updated.
+ */
++ (void)invalidateTranslationsForIdentifier:(NSString *)identifier
+								   language:(NSString *)language
+									  table:(NSString *)table;
+
 /*!
  \brief		Get the bundle contining user translations
  \details	This will create and merge strings files for the given langauges. It will create the bundle
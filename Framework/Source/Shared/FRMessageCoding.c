@@ -0,0 +1,367 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#import "FRMessageCoding.h"
+
+static const uint8_t kMagic = 0x47;
+static const uint8_t kVersion = 1;
+static const size_t kHeaderLength = 3;	// magic, version and type
+static const unsigned kKindBits = 2;
+static const size_t kMinimumResourceLength = 2;	// the tag and length of a resource without fields
+static const size_t kMaximumResourceCount = 1 << 20;
+
+// numbers are a single varint and every other field is length delimited, so fields of any of these
+// kinds can be skipped
+enum {
+	FRMessageFieldKindBytes = 0,
+	FRMessageFieldKindResource = 1,
+	FRMessageFieldKindVarint = 2,
+};
+
+/*!
+ \brief		Field description
+ \details	Where the value of a numbered field is stored. Resource fields can be repeated and are stored
+			in a list of resources in the message along with their count.
+ */
+typedef struct FRMessageField {
+	uint32_t number;
+	uint8_t kind;
+	size_t offset;
+	size_t countOffset;
+} FRMessageField;
+
+static const FRMessageField kAuthenticationFields[] = {
+	{ 1, FRMessageFieldKindBytes, offsetof(FRMessage, deviceName), 0 },
+	{ 2, FRMessageFieldKindBytes, offsetof(FRMessage, deviceIdentifier), 0 },
+	{ 3, FRMessageFieldKindBytes, offsetof(FRMessage, compression), 0 },
+};
+
+static const FRMessageField kLocalizationResourcesFields[] = {
+	{ 1, FRMessageFieldKindBytes, offsetof(FRMessage, applicationIdentifier), 0 },
+	{ 2, FRMessageFieldKindBytes, offsetof(FRMessage, applicationName), 0 },
+	{ 3, FRMessageFieldKindResource, offsetof(FRMessage, resources), offsetof(FRMessage, resourceCount) },
+	{ 4, FRMessageFieldKindBytes, offsetof(FRMessage, compression), 0 },
+	{ 5, FRMessageFieldKindVarint, offsetof(FRMessage, remaining), 0 },
+};
+
+static const FRMessageField kLocalizationManifestFields[] = {
+	{ 1, FRMessageFieldKindBytes, offsetof(FRMessage, applicationIdentifier), 0 },
+	{ 2, FRMessageFieldKindBytes, offsetof(FRMessage, applicationName), 0 },
+	{ 3, FRMessageFieldKindResource, offsetof(FRMessage, resources), offsetof(FRMessage, resourceCount) },
+	{ 4, FRMessageFieldKindBytes, offsetof(FRMessage, compression), 0 },
+	{ 5, FRMessageFieldKindResource, offsetof(FRMessage, translations), offsetof(FRMessage, translationCount) },
+};
+
+static const FRMessageField kLocalizationRequestFields[] = {
+	{ 3, FRMessageFieldKindResource, offsetof(FRMessage, resources), offsetof(FRMessage, resourceCount) },
+};
+
+static const FRMessageField kLocalizationChangesFields[] = {
+	{ 3, FRMessageFieldKindResource, offsetof(FRMessage, resources), offsetof(FRMessage, resourceCount) },
+};
+
+static const FRMessageField kLocalizationEditsFields[] = {
+	{ 3, FRMessageFieldKindResource, offsetof(FRMessage, resources), offsetof(FRMessage, resourceCount) },
+};
+
+static const FRMessageField kResourceFields[] = {
+	{ 1, FRMessageFieldKindBytes, offsetof(FRMessageResource, bundleIdentifier), 0 },
+	{ 2, FRMessageFieldKindBytes, offsetof(FRMessageResource, language), 0 },
+	{ 3, FRMessageFieldKindBytes, offsetof(FRMessageResource, name), 0 },
+	{ 4, FRMessageFieldKindBytes, offsetof(FRMessageResource, data), 0 },
+	{ 5, FRMessageFieldKindBytes, offsetof(FRMessageResource, digest), 0 },
+	{ 6, FRMessageFieldKindVarint, offsetof(FRMessageResource, offset), 0 },
+	{ 7, FRMessageFieldKindVarint, offsetof(FRMessageResource, length), 0 },
+};
+
+#define FRFieldValue(object, field, type) ((type *)((char *)(object) + (field)->offset))
+#define FRFieldCountValue(object, field) ((size_t *)((char *)(object) + (field)->countOffset))
+
+#define FRFieldCount(fields) (sizeof(fields) / sizeof(FRMessageField))
+
+static const FRMessageField *FRMessageSchema(FRMessageType type, size_t *count);
+static size_t FRMessageFieldsLength(const void *object, const FRMessage *message,
+									const FRMessageField *fields, size_t count);
+static uint8_t *FRMessageEncodeFields(const void *object, const FRMessage *message,
+									  const FRMessageField *fields, size_t count, uint8_t *buffer);
+static int FRMessageDecodeFields(const uint8_t *bytes, const uint8_t *end, void *object, FRMessage *message,
+								 const FRMessageField *fields, size_t count, int counting);
+static size_t FRVarintLength(uint64_t value);
+static uint8_t *FRVarintWrite(uint64_t value, uint8_t *buffer);
+static int FRVarintRead(const uint8_t **bytes, const uint8_t *end, uint64_t *value);
+
+
+#pragma mark -
+#pragma mark encoding
+// ----------------------------------------------------------------------------------------------------
+// encoding
+// ----------------------------------------------------------------------------------------------------
+
+size_t FRMessageEncodedLength(const FRMessage *message) {
+	size_t count = 0;
+	const FRMessageField *fields = FRMessageSchema(message->type, &count);
+	return kHeaderLength + FRMessageFieldsLength(message, message, fields, count);
+}
+
+size_t FRMessageEncode(const FRMessage *message, uint8_t *buffer) {
+	size_t count = 0;
+	const FRMessageField *fields = FRMessageSchema(message->type, &count);
+	buffer[0] = kMagic;
+	buffer[1] = kVersion;
+	buffer[2] = message->type;
+	uint8_t *end = FRMessageEncodeFields(message, message, fields, count, buffer + kHeaderLength);
+	return (size_t)(end - buffer);
+}
+
+static size_t FRMessageFieldsLength(const void *object, const FRMessage *message,
+									const FRMessageField *fields, size_t count) {
+	size_t length = 0;
+	for (size_t index = 0; index < count; index++) {
+		const FRMessageField *field = &fields[index];
+		size_t tagLength = FRVarintLength(((uint64_t)field->number << kKindBits) | field->kind);
+		if (field->kind == FRMessageFieldKindBytes) {
+			const FRMessageBytes *value = FRFieldValue(object, field, const FRMessageBytes);
+			if (!value->bytes) { continue; }
+			length += tagLength + FRVarintLength(value->length) + value->length;
+		}
+		else if (field->kind == FRMessageFieldKindVarint) {
+			const FRMessageNumber *value = FRFieldValue(object, field, const FRMessageNumber);
+			if (!value->present) { continue; }
+			length += tagLength + FRVarintLength(value->value);
+		}
+		else {
+			const FRMessageResource *resources = *FRFieldValue(message, field, FRMessageResource * const);
+			size_t resourceCount = *FRFieldCountValue(message, field);
+			for (size_t position = 0; position < resourceCount; position++) {
+				size_t resourceLength = FRMessageFieldsLength(&resources[position], NULL,
+															  kResourceFields, FRFieldCount(kResourceFields));
+				length += tagLength + FRVarintLength(resourceLength) + resourceLength;
+			}
+		}
+	}
+	return length;
+}
+
+static uint8_t *FRMessageEncodeFields(const void *object, const FRMessage *message,
+									  const FRMessageField *fields, size_t count, uint8_t *buffer) {
+	for (size_t index = 0; index < count; index++) {
+		const FRMessageField *field = &fields[index];
+		uint64_t tag = ((uint64_t)field->number << kKindBits) | field->kind;
+		if (field->kind == FRMessageFieldKindBytes) {
+			const FRMessageBytes *value = FRFieldValue(object, field, const FRMessageBytes);
+			if (!value->bytes) { continue; }
+			buffer = FRVarintWrite(tag, buffer);
+			buffer = FRVarintWrite(value->length, buffer);
+			memcpy(buffer, value->bytes, value->length);
+			buffer += value->length;
+		}
+		else if (field->kind == FRMessageFieldKindVarint) {
+			const FRMessageNumber *value = FRFieldValue(object, field, const FRMessageNumber);
+			if (!value->present) { continue; }
+			buffer = FRVarintWrite(tag, buffer);
+			buffer = FRVarintWrite(value->value, buffer);
+		}
+		else {
+			const FRMessageResource *resources = *FRFieldValue(message, field, FRMessageResource * const);
+			size_t resourceCount = *FRFieldCountValue(message, field);
+			for (size_t position = 0; position < resourceCount; position++) {
+				const FRMessageResource *resource = &resources[position];
+				buffer = FRVarintWrite(tag, buffer);
+				buffer = FRVarintWrite(FRMessageFieldsLength(resource, NULL, kResourceFields,
+															 FRFieldCount(kResourceFields)), buffer);
+				buffer = FRMessageEncodeFields(resource, NULL, kResourceFields, FRFieldCount(kResourceFields), buffer);
+			}
+		}
+	}
+	return buffer;
+}
+
+
+#pragma mark -
+#pragma mark decoding
+// ----------------------------------------------------------------------------------------------------
+// decoding
+// ----------------------------------------------------------------------------------------------------
+
+int FRMessageDecode(const void *bytes, size_t length, FRMessage *message) {
+	memset(message, 0, sizeof(FRMessage));
+	
+	const uint8_t *start = bytes;
+	if (length < kHeaderLength || start[0] != kMagic || start[1] != kVersion) { return 0; }
+	size_t count = 0;
+	const FRMessageField *fields = FRMessageSchema(start[2], &count);
+	if (!fields) { return 0; }
+	message->type = start[2];
+	
+	// the first pass checks everything and counts the resources, so each list fits in a single allocation
+	const uint8_t *end = start + length;
+	if (!FRMessageDecodeFields(start + kHeaderLength, end, message, message, fields, count, 1)) { return 0; }
+	int resourcesFound = 0;
+	for (size_t index = 0; index < count; index++) {
+		const FRMessageField *field = &fields[index];
+		if (field->kind != FRMessageFieldKindResource) { continue; }
+		size_t *resourceCount = FRFieldCountValue(message, field);
+		if (!*resourceCount) { continue; }
+		
+		// counting already stops at the maximum, and every resource takes up some of the input
+		if (*resourceCount > kMaximumResourceCount ||
+			*resourceCount > (length - kHeaderLength) / kMinimumResourceLength) {
+			FRMessageFreeDecoded(message);
+			return 0;
+		}
+		FRMessageResource **resources = FRFieldValue(message, field, FRMessageResource *);
+		*resources = calloc(*resourceCount, sizeof(FRMessageResource));
+		*resourceCount = 0;
+		resourcesFound = 1;
+		if (!*resources) {
+			FRMessageFreeDecoded(message);
+			return 0;
+		}
+	}
+	if (resourcesFound && !FRMessageDecodeFields(start + kHeaderLength, end, message, message, fields, count, 0)) {
+		FRMessageFreeDecoded(message);
+		return 0;
+	}
+	return 1;
+}
+
+void FRMessageFreeDecoded(FRMessage *message) {
+	free(message->resources);
+	free(message->translations);
+	message->resources = NULL;
+	message->resourceCount = 0;
+	message->translations = NULL;
+	message->translationCount = 0;
+}
+
+static int FRMessageDecodeFields(const uint8_t *bytes, const uint8_t *end, void *object, FRMessage *message,
+								 const FRMessageField *fields, size_t count, int counting) {
+	while (bytes < end) {
+		uint64_t tag = 0;
+		uint64_t length = 0;
+		uint64_t number = 0;
+		if (!FRVarintRead(&bytes, end, &tag)) { return 0; }
+		uint64_t kind = tag & ((1 << kKindBits) - 1);
+		if (kind == FRMessageFieldKindVarint) {
+			if (!FRVarintRead(&bytes, end, &number)) { return 0; }
+		}
+		else if (kind > FRMessageFieldKindVarint) { return 0; } // there's no telling how long it is
+		else if (!FRVarintRead(&bytes, end, &length) || length > (uint64_t)(end - bytes)) { return 0; }
+		
+		const FRMessageField *field = NULL;
+		for (size_t index = 0; index < count && !field; index++) {
+			if (fields[index].number == (tag >> kKindBits)) { field = &fields[index]; }
+		}
+		if (field && field->kind != kind) { return 0; }
+		
+		if (!field) { } // added in a later version, skip it
+		else if (field->kind == FRMessageFieldKindBytes) {
+			FRMessageBytes *value = FRFieldValue(object, field, FRMessageBytes);
+			value->bytes = bytes;
+			value->length = (size_t)length;
+		}
+		else if (field->kind == FRMessageFieldKindVarint) {
+			FRMessageNumber *value = FRFieldValue(object, field, FRMessageNumber);
+			value->value = number;
+			value->present = 1;
+		}
+		else if (!message) { return 0; } // resources can't be nested
+		else if (counting) {
+			FRMessageResource resource;
+			if (!FRMessageDecodeFields(bytes, bytes + length, &resource, NULL,
+									   kResourceFields, FRFieldCount(kResourceFields), 1)) { return 0; }
+			if (++(*FRFieldCountValue(message, field)) > kMaximumResourceCount) { return 0; }
+		}
+		else {
+			FRMessageResource *resources = *FRFieldValue(message, field, FRMessageResource *);
+			FRMessageResource *resource = &resources[(*FRFieldCountValue(message, field))++];
+			FRMessageDecodeFields(bytes, bytes + length, resource, NULL, kResourceFields,
+								  FRFieldCount(kResourceFields), 0);
+		}
+		bytes += length;
+	}
+	return 1;
+}
+
+
+#pragma mark -
+#pragma mark utilities
+// ----------------------------------------------------------------------------------------------------
+// utilities
+// ----------------------------------------------------------------------------------------------------
+
+static const FRMessageField *FRMessageSchema(FRMessageType type, size_t *count) {
+	switch (type) {
+		case FRMessageTypeAuthentication:
+			*count = FRFieldCount(kAuthenticationFields);
+			return kAuthenticationFields;
+		case FRMessageTypeLocalizationResources:
+			*count = FRFieldCount(kLocalizationResourcesFields);
+			return kLocalizationResourcesFields;
+		case FRMessageTypeLocalizationChanges:
+			*count = FRFieldCount(kLocalizationChangesFields);
+			return kLocalizationChangesFields;
+		case FRMessageTypeLocalizationManifest:
+			*count = FRFieldCount(kLocalizationManifestFields);
+			return kLocalizationManifestFields;
+		case FRMessageTypeLocalizationRequest:
+			*count = FRFieldCount(kLocalizationRequestFields);
+			return kLocalizationRequestFields;
+		case FRMessageTypeLocalizationEdits:
+			*count = FRFieldCount(kLocalizationEditsFields);
+			return kLocalizationEditsFields;
+	}
+	*count = 0;
+	return NULL;
+}
+
+static size_t FRVarintLength(uint64_t value) {
+	size_t length = 1;
+	while (value >= 0x80) {
+		value >>= 7;
+		length++;
+	}
+	return length;
+}
+
+static uint8_t *FRVarintWrite(uint64_t value, uint8_t *buffer) {
+	while (value >= 0x80) {
+		*buffer++ = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	*buffer++ = (uint8_t)value;
+	return buffer;
+}
+
+static int FRVarintRead(const uint8_t **bytes, const uint8_t *end, uint64_t *value) {
+	uint64_t result = 0;
+	for (unsigned shift = 0; shift < 64; shift += 7) {
+		if (*bytes == end) { return 0; }
+		uint8_t byte = *(*bytes)++;
+		if (shift == 63 && byte > 1) { return 0; } // more than 64 bits
+		result |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			*value = result;
+			return 1;
+		}
+	}
+	return 0;
+}
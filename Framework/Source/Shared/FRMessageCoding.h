@@ -0,0 +1,128 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ \brief		Message wire format
+ \details	Messages are encoded as a short header followed by tagged fields. The header is a magic byte,
+			the format version and the message type. Each field starts with a varint tag holding the field
+			number and its kind. Numbers follow as a single varint, and everything else as a varint length
+			and that many bytes (UTF-8 for strings, raw bytes for blobs, and fields of their own for nested
+			resources). Fields with numbers a decoder doesn't know about are skipped, so fields can be
+			added without changing the version.
+			
+			The fields of each message are the keys defined in FRMessages.h. Nothing here depends on
+			Foundation, so the format can be read and written anywhere.
+ */
+enum {
+	FRMessageTypeAuthentication = 1,
+	FRMessageTypeLocalizationResources = 2,
+	FRMessageTypeLocalizationChanges = 3,
+	FRMessageTypeLocalizationManifest = 4,
+	FRMessageTypeLocalizationRequest = 5,
+	FRMessageTypeLocalizationEdits = 6,
+};
+typedef uint8_t FRMessageType;
+
+/*!
+ \brief		A string or blob
+ \details	Bytes are NULL for fields that aren't present. Decoded fields point into the encoded message.
+ */
+typedef struct FRMessageBytes {
+	const void *bytes;
+	size_t length;
+} FRMessageBytes;
+
+/*!
+ \brief		A number
+ \details	Present is 0 for fields that aren't present.
+ */
+typedef struct FRMessageNumber {
+	uint64_t value;
+	int present;
+} FRMessageNumber;
+
+/*!
+ \brief		A strings file in a message
+ \details	Resources messages can hold just part of a file, in which case the offset and the full length
+			of the file say which part.
+ */
+typedef struct FRMessageResource {
+	FRMessageBytes bundleIdentifier;
+	FRMessageBytes language;
+	FRMessageBytes name;
+	FRMessageBytes data;
+	FRMessageBytes digest;
+	FRMessageNumber offset;
+	FRMessageNumber length;
+} FRMessageResource;
+
+/*!
+ \brief		A message
+ \details	Only the fields of the message's type are encoded: the device name and identifier for
+			authentication, and the application identifier, application name and resources for
+			resources messages (along with the number of resources messages that follow). Manifest
+			messages hold the application identifier, name and resources plus a second list of resources
+			for translations, and changes, edits and request messages only hold resources. Authentication, resources
+			and manifest messages also carry the compression methods the sender accepts (see
+			FRMessageCompression.h).
+ */
+typedef struct FRMessage {
+	FRMessageType type;
+	FRMessageBytes deviceName;
+	FRMessageBytes deviceIdentifier;
+	FRMessageBytes applicationIdentifier;
+	FRMessageBytes applicationName;
+	FRMessageBytes compression;
+	FRMessageNumber remaining;
+	FRMessageResource *resources;
+	size_t resourceCount;
+	FRMessageResource *translations;
+	size_t translationCount;
+} FRMessage;
+
+/*!
+ \brief		Encoded length
+ \details	The number of bytes needed to encode the message.
+ */
+size_t FRMessageEncodedLength(const FRMessage *message);
+
+/*!
+ \brief		Encode a message
+ \details	Writes the message to the buffer, which must hold at least FRMessageEncodedLength bytes.
+			Returns the number of bytes written.
+ */
+size_t FRMessageEncode(const FRMessage *message, uint8_t *buffer);
+
+/*!
+ \brief		Decode a message
+ \details	Decodes the message in the bytes without copying any strings or blobs. Returns 1 on success
+			and 0 if the bytes aren't a complete message in a known version (everything is checked, so
+			the bytes can come from anywhere, and a message can't hold more than about a million
+			resources). After a successful decode, the bytes must stay valid for
+			as long as the message is used, and the message must be freed with FRMessageFreeDecoded.
+ */
+int FRMessageDecode(const void *bytes, size_t length, FRMessage *message);
+
+/*!
+ \brief		Free a decoded message
+ \details	Frees what was allocated while decoding (not the strings and blobs themselves).
+ */
+void FRMessageFreeDecoded(FRMessage *message);
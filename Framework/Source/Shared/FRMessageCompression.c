@@ -0,0 +1,254 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#import "FRMessageCompression.h"
+
+const char * const FRMessageCompressionMethods = "deflate-strings deflate";
+const size_t FRMessageCompressionThreshold = 1024;
+static const uint8_t kMagic = 0x5a;
+static const int kWindowBits = -15;					// raw deflate, the header carries everything else
+
+/*!
+ \brief		Dictionary snippets
+ \details	Text that shows up over and over in strings files from genstrings and ibtool. Deflate finds
+			matches closer to the end of the dictionary with fewer bits, so the most common text is last.
+ */
+static const char * const kDictionarySnippets[] = {
+	"Class = \"NSTableColumn\"; headerCell.title = \"", "Class = \"NSBox\"; title = \"",
+	"Class = \"NSWindow\"; title = \"", "Class = \"NSButtonCell\"; title = \"",
+	"Class = \"NSTextFieldCell\"; title = \"", "Class = \"NSMenuItem\"; title = \"",
+	"Class = \"UINavigationItem\"; title = \"", "Class = \"UIBarButtonItem\"; title = \"",
+	"Class = \"UITextField\"; placeholder = \"", "Class = \"UIButton\"; normalTitle = \"",
+	"Class = \"UILabel\"; text = \"", "; ObjectID = \"", ".headerCell.title\" = \"", ".placeholder\" = \"",
+	".normalTitle\" = \"", ".title\" = \"", ".text\" = \"", "/* No comment provided by engineer. */\n\"",
+	"\";\n\n/* ", "\" = \"",
+};
+
+static pthread_once_t dictionaryOnce = PTHREAD_ONCE_INIT;
+static uint8_t *dictionary = NULL;
+static size_t dictionaryLength = 0;
+
+static void FRMessageCompressionBuildDictionary(void);
+static int FRMessageCompressionPrime(z_stream *stream, FRMessageCompressionMethod method, int inflating);
+static size_t FRMessageCompressionWriteVarint(uint8_t *buffer, uint64_t value);
+static int FRMessageCompressionReadVarint(const uint8_t **cursor, const uint8_t *end, uint64_t *value);
+
+FRMessageCompressionMethod FRMessageCompressionNegotiate(const void *names, size_t length) {
+	static const struct { const char *name; FRMessageCompressionMethod method; } methods[] = {
+		{ "deflate-strings", FRMessageCompressionDeflateStrings },
+		{ "deflate", FRMessageCompressionDeflate },
+	};
+	
+	for (size_t index = 0; index < sizeof(methods) / sizeof(methods[0]); index++) {
+		size_t nameLength = strlen(methods[index].name);
+		const char *cursor = names;
+		const char *end = cursor + length;
+		while (cursor < end) {
+			const char *separator = memchr(cursor, ' ', end - cursor);
+			if (!separator) { separator = end; }
+			if ((size_t)(separator - cursor) == nameLength && memcmp(cursor, methods[index].name, nameLength) == 0) {
+				return methods[index].method;
+			}
+			cursor = separator + 1;
+		}
+	}
+	return FRMessageCompressionNone;
+}
+
+int FRMessageCompress(FRMessageCompressionMethod method, const void *bytes, size_t length,
+					  void **result, size_t *resultLength) {
+	*result = NULL;
+	*resultLength = 0;
+	if (method == FRMessageCompressionNone || length < FRMessageCompressionThreshold || (uint64_t)length > UINT32_MAX) {
+		return 0;
+	}
+	
+	z_stream stream;
+	memset(&stream, 0, sizeof(z_stream));
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, kWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return ENOMEM;
+	}
+	int error = FRMessageCompressionPrime(&stream, method, 0);
+	
+	// there's only any point in sending it compressed when it's shorter, so the output never needs to
+	// be longer than the input
+	uint8_t *buffer = error ? NULL : malloc(length);
+	if (!error && !buffer) { error = ENOMEM; }
+	if (!error) {
+		size_t headerLength = 0;
+		buffer[headerLength++] = kMagic;
+		buffer[headerLength++] = method;
+		headerLength += FRMessageCompressionWriteVarint(buffer + headerLength, length);
+		
+		stream.next_in = (Bytef *)bytes;
+		stream.avail_in = (uInt)length;
+		stream.next_out = buffer + headerLength;
+		stream.avail_out = (uInt)(length - headerLength);
+		int status = deflate(&stream, Z_FINISH);
+		if (status == Z_STREAM_END) {
+			*result = buffer;
+			*resultLength = headerLength + stream.total_out;
+			buffer = NULL;
+		}
+		else if (status != Z_OK && status != Z_BUF_ERROR) { error = EINVAL; } // otherwise it ran out of space
+	}
+	
+	free(buffer);
+	deflateEnd(&stream);
+	return error;
+}
+
+int FRMessageIsCompressed(const void *bytes, size_t length) {
+	return (length > 0 && ((const uint8_t *)bytes)[0] == kMagic);
+}
+
+int FRMessageDecompress(const void *bytes, size_t length, size_t maximumLength, void **result, size_t *resultLength) {
+	struct iovec vector = { (void *)bytes, length };
+	return FRMessageDecompressVectors(&vector, 1, maximumLength, result, resultLength);
+}
+
+int FRMessageDecompressVectors(const struct iovec *vectors, int count, size_t maximumLength,
+							   void **result, size_t *resultLength) {
+	*result = NULL;
+	*resultLength = 0;
+	
+	// the header is read from a copy of its first bytes, wherever the chunks are split
+	uint8_t header[2 + 10];
+	size_t headerLength = 0;
+	for (int index = 0; index < count && headerLength < sizeof(header); index++) {
+		size_t length = vectors[index].iov_len;
+		if (length > sizeof(header) - headerLength) { length = sizeof(header) - headerLength; }
+		memcpy(header + headerLength, vectors[index].iov_base, length);
+		headerLength += length;
+	}
+	const uint8_t *cursor = header;
+	const uint8_t *end = header + headerLength;
+	uint64_t uncompressedLength = 0;
+	if (headerLength < 2 || cursor[0] != kMagic) { return EINVAL; }
+	FRMessageCompressionMethod method = cursor[1];
+	if (method != FRMessageCompressionDeflate && method != FRMessageCompressionDeflateStrings) { return EINVAL; }
+	cursor += 2;
+	if (!FRMessageCompressionReadVarint(&cursor, end, &uncompressedLength)) { return EINVAL; }
+	if (uncompressedLength > maximumLength || uncompressedLength > UINT32_MAX) { return EFBIG; }
+	
+	z_stream stream;
+	memset(&stream, 0, sizeof(z_stream));
+	if (inflateInit2(&stream, kWindowBits) != Z_OK) { return ENOMEM; }
+	int error = FRMessageCompressionPrime(&stream, method, 1);
+	
+	// the output is exactly as long as the header says, so anything that doesn't fill it or doesn't
+	// fit in it is damaged. every chunk is inflated from where it is.
+	uint8_t *buffer = error ? NULL : malloc(uncompressedLength ? (size_t)uncompressedLength : 1);
+	if (!error && !buffer) { error = ENOMEM; }
+	if (!error) {
+		stream.next_out = buffer;
+		stream.avail_out = (uInt)uncompressedLength;
+		size_t skip = (size_t)(cursor - header);
+		int status = Z_OK;
+		int index = 0;
+		for (; index < count && status == Z_OK; index++) {
+			size_t length = vectors[index].iov_len;
+			size_t offset = (skip < length) ? skip : length;
+			skip -= offset;
+			if (length - offset > UINT32_MAX) {
+				status = Z_DATA_ERROR;
+				break;
+			}
+			stream.next_in = (Bytef *)vectors[index].iov_base + offset;
+			stream.avail_in = (uInt)(length - offset);
+			while (stream.avail_in && status == Z_OK) { status = inflate(&stream, Z_NO_FLUSH); }
+		}
+		int trailing = (stream.avail_in != 0);
+		for (; index < count; index++) { trailing = trailing || vectors[index].iov_len; }
+		if (status == Z_STREAM_END && stream.total_out == uncompressedLength && !trailing) {
+			*result = buffer;
+			*resultLength = (size_t)uncompressedLength;
+			buffer = NULL;
+		}
+		else { error = EINVAL; }
+	}
+	
+	free(buffer);
+	inflateEnd(&stream);
+	return error;
+}
+
+static void FRMessageCompressionBuildDictionary(void) {
+	// strings files are usually UTF-16, but the snippets are in UTF-8 as well. UTF-16 comes last since
+	// it's more common.
+	size_t count = sizeof(kDictionarySnippets) / sizeof(kDictionarySnippets[0]);
+	size_t length = 0;
+	for (size_t index = 0; index < count; index++) { length += strlen(kDictionarySnippets[index]) * 3; }
+	
+	uint8_t *buffer = malloc(length);
+	if (!buffer) { return; }
+	size_t position = 0;
+	for (size_t index = 0; index < count; index++) {
+		size_t snippetLength = strlen(kDictionarySnippets[index]);
+		memcpy(buffer + position, kDictionarySnippets[index], snippetLength);
+		position += snippetLength;
+	}
+	for (size_t index = 0; index < count; index++) {
+		for (const char *snippet = kDictionarySnippets[index]; *snippet; snippet++) {
+			buffer[position++] = (uint8_t)*snippet;
+			buffer[position++] = 0;
+		}
+	}
+	dictionary = buffer;
+	dictionaryLength = position;
+}
+
+static int FRMessageCompressionPrime(z_stream *stream, FRMessageCompressionMethod method, int inflating) {
+	if (method != FRMessageCompressionDeflateStrings) { return 0; }
+	pthread_once(&dictionaryOnce, FRMessageCompressionBuildDictionary);
+	if (!dictionary) { return ENOMEM; }
+	int status = inflating ?
+		inflateSetDictionary(stream, dictionary, (uInt)dictionaryLength) :
+		deflateSetDictionary(stream, dictionary, (uInt)dictionaryLength);
+	return (status == Z_OK) ? 0 : EINVAL;
+}
+
+static size_t FRMessageCompressionWriteVarint(uint8_t *buffer, uint64_t value) {
+	size_t length = 0;
+	while (value >= 0x80) {
+		buffer[length++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	buffer[length++] = (uint8_t)value;
+	return length;
+}
+
+static int FRMessageCompressionReadVarint(const uint8_t **cursor, const uint8_t *end, uint64_t *value) {
+	uint64_t result = 0;
+	for (unsigned shift = 0; shift < 64 && *cursor < end; shift += 7) {
+		uint8_t byte = *(*cursor)++;
+		result |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			*value = result;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,88 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/*!
+ \brief		Message compression
+ \details	Encoded messages can be sent compressed. A compressed message starts with its own magic byte
+			(so it can't be mistaken for a plain one), the method and the uncompressed length, followed by
+			the compressed message.
+			
+			Each side lists the methods it can decompress in its first message, and the other side then
+			compresses with the best method on that list. Until then, or if nothing matches, messages are
+			sent as they are. Small messages aren't compressed either.
+ */
+enum {
+	FRMessageCompressionNone = 0,
+	FRMessageCompressionDeflate = 1,
+	FRMessageCompressionDeflateStrings = 2,	// deflate primed with a dictionary of common strings file contents
+};
+typedef uint8_t FRMessageCompressionMethod;
+
+/*!
+ \brief		Supported methods
+ \details	The names of all methods that can be decompressed, best first and separated by spaces.
+ */
+extern const char * const FRMessageCompressionMethods;
+
+/*!
+ \brief		Messages that are compressed
+ \details	Messages shorter than this are always sent as they are.
+ */
+extern const size_t FRMessageCompressionThreshold;
+
+/*!
+ \brief		Pick a method
+ \details	Returns the best method that's in both the given list of names (as sent by the other side) and
+			the supported methods.
+ */
+FRMessageCompressionMethod FRMessageCompressionNegotiate(const void *names, size_t length);
+
+/*!
+ \brief		Compress a message
+ \details	Compresses an encoded message with the given method into a buffer that the caller must free.
+			When compressing isn't worth it (the message is short or doesn't get shorter), the result is
+			NULL. Returns 0 on success or an errno value.
+ */
+int FRMessageCompress(FRMessageCompressionMethod method, const void *bytes, size_t length,
+					  void **result, size_t *resultLength);
+
+/*!
+ \brief		Check for a compressed message
+ \details	Check for a compressed message
+ */
+int FRMessageIsCompressed(const void *bytes, size_t length);
+
+/*!
+ \brief		Decompress a message
+ \details	Decompresses a compressed message into a buffer that the caller must free. Messages that would
+			be longer than the maximum length aren't decompressed at all. Returns 0 on success or an errno
+			value (EINVAL for anything that isn't a valid compressed message).
+ */
+int FRMessageDecompress(const void *bytes, size_t length, size_t maximumLength, void **result, size_t *resultLength);
+
+/*!
+ \brief		Decompress a message in chunks
+ \details	Works like FRMessageDecompress for a message that's split into chunks (see
+			FRFrameBufferNextMessage), which are inflated from where they are.
+ */
+int FRMessageDecompressVectors(const struct iovec *vectors, int count, size_t maximumLength,
+							   void **result, size_t *resultLength);
@@ -20,36 +20,95 @@
 /*!
  \brief		Authentication message
  \details	Sent from the Mac app to the iOS server to authenticate. After authentication,
-			the iOS app will continue by sending a localization resources message.
+			the iOS app will continue by sending a localization manifest message.
  */
 extern const struct FRAuthenticationMessage {
 	safe NSString *messageID;
 	struct {
 		safe NSString *deviceName;
 		safe NSString *deviceIdentifier;
+		safe NSString *compression;
 	} keys;
 } FRAuthenticationMessage;
 
 /*!
  \brief		Resources message
- \details	Sent from the iOS server back to the Mac app and includes information on all localizable
-			strings files.
+ \details	Sent from the iOS server back to the Mac app in response to a request message and includes
+			the strings files that were requested. The files are streamed with one resources message per
+			file, and each message holds the number of files still to come (an NSNumber) in remaining.
+			The last one, which has no files if none were requested, has a remaining count of 0.
+			
+			Longer files are sent in pieces, one per message, each holding the offset of its data in the
+			file and the length of the whole file (NSNumbers) along with the file's digest. A file
+			counts as still to come until its last piece. Pieces let a transfer that's cut off pick up
+			where it stopped: a request message can ask for a file from an offset on.
  */
 extern const struct FRLocalizationResourcesMessage {
 	safe NSString *messageID;
 	struct {
 		safe NSString *applicationIdentifier;
 		safe NSString *applicationName;
+		safe NSString *compression;
+		safe NSString *remaining;
 		safe NSString *resources;
 		struct {
 			safe NSString *bundleIdentifier;
 			safe NSString *language;
 			safe NSString *name;
 			safe NSString *data;
+			safe NSString *digest;
+			safe NSString *offset;
+			safe NSString *length;
 		} resource;
 	} keys;
 } FRLocalizationResourcesMessage;
 
+/*!
+ \brief		Manifest message
+ \details	Sent from the iOS server after authentication instead of all of the resources. Lists every
+			localizable strings file with the digest of its contents, along with the translations the
+			device already has. The Mac app then asks for the files it doesn't have with a request
+			message, and only sends changes the device doesn't have yet.
+ */
+extern const struct FRLocalizationManifestMessage {
+	safe NSString *messageID;
+	struct {
+		safe NSString *applicationIdentifier;
+		safe NSString *applicationName;
+		safe NSString *compression;
+		safe NSString *resources;
+		safe NSString *translations;
+		struct {
+			safe NSString *bundleIdentifier;
+			safe NSString *language;
+			safe NSString *name;
+			safe NSString *digest;
+		} resource;
+	} keys;
+} FRLocalizationManifestMessage;
+
+/*!
+ \brief		Request message
+ \details	Sent from the Mac app in response to a manifest message. Lists the strings files that the iOS
+			server should send in a resources message (which may be none at all). When the Mac app already
+			has the start of a file from a transfer that was cut off, the resource holds how much it has
+			(an NSNumber) in offset and the digest of what it has. The file is then sent from the offset
+			on, unless the digest doesn't match the start of the file.
+ */
+extern const struct FRLocalizationRequestMessage {
+	safe NSString *messageID;
+	struct {
+		safe NSString *resources;
+		struct {
+			safe NSString *bundleIdentifier;
+			safe NSString *language;
+			safe NSString *name;
+			safe NSString *digest;
+			safe NSString *offset;
+		} resource;
+	} keys;
+} FRLocalizationRequestMessage;
+
 /*!
  \brief		Changes message
  \details	Sent from the Mac client app back to the iOS server indicating the localizations
@@ -68,4 +127,65 @@ extern const struct FRLocalizationChangesMessage {
 	} keys;
 } FRLocalizationChangesMessage;
 
+/*!
+ \brief		Edits message
+ \details	Sent from the Mac app to the iOS server as the user edits a strings file, so the changes show
+			up on the device right away. Each resource only holds the entries that changed, as a property
+			list dictionary from the entries' strings to their translations in data. Entries that aren't in
+			the device's copy of the file are ignored.
+ */
+extern const struct FRLocalizationEditsMessage {
+	safe NSString *messageID;
+	struct {
+		safe NSString *resources;
+		struct {
+			safe NSString *bundleIdentifier;
+			safe NSString *language;
+			safe NSString *name;
+			safe NSString *data;
+		} resource;
+	} keys;
+} FRLocalizationEditsMessage;
+
 #undef safe
+
+/*!
+ \brief		Encode a message
+ \details	Encodes one of the messages above in the binary format described in FRMessageCoding.h. Returns
+			nil if the message isn't one of them.
+ */
+NSData *FRMessageDataWithMessage(NSDictionary *message);
+
+/*!
+ \brief		Decode a message
+ \details	Decodes a message encoded with FRMessageDataWithMessage into a dictionary with the same keys.
+			Returns nil if the bytes aren't a valid message.
+ */
+NSDictionary *FRMessageWithBytes(const void *bytes, NSUInteger length);
+
+/*!
+ \brief		Decode a message in data
+ \details	Like FRMessageWithBytes, but the data of the resources is used in place instead of being
+			copied, which keeps the message data around for as long as any of it is used.
+ */
+NSDictionary *FRMessageWithData(NSData *data);
+
+/*!
+ \brief		Resource path
+ \details	The path of a strings file relative to the directory that translations are stored in, which
+			is the same on both sides: bundle identifier, lproj folder and strings file.
+ */
+NSString *FRMessageResourcePath(NSString *bundleIdentifier, NSString *language, NSString *name);
+
+/*!
+ \brief		Resource digest
+ \details	The digest used in manifest messages, a hex SHA-1 of the file contents.
+ */
+NSString *FRMessageResourceDigest(NSData *data);
+
+/*!
+ \brief		Resource digests in a directory
+ \details	Digests of all strings files in a directory laid out like FRMessageResourcePath describes,
+			keyed by their resource paths.
+ */
+NSDictionary *FRMessageResourceDigestsInDirectory(NSString *directory);
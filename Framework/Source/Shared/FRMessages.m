@@ -15,13 +15,44 @@
 // OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 // 
 
+#include <CommonCrypto/CommonDigest.h>
+
 #import "FRMessages.h"
+#import "FRMessageCoding.h"
+
+/*!
+ \brief		Part of a message
+ \details	The data of a resource in a decoded message. Rather than copying the data, it keeps the whole
+			message it was decoded from.
+ */
+@interface FRMessageDataSlice : NSData {
+	NSData *message;
+	const void *sliceBytes;
+	NSUInteger sliceLength;
+}
+- (id)initWithMessage:(NSData *)message bytes:(const void *)bytes length:(NSUInteger)length;
+@end
+
+static NSDictionary *FRMessageDecodeDictionary(const void *bytes, NSUInteger length, NSData *owner);
+static FRMessageBytes FRMessageBytesWithObject(id object);
+static FRMessageNumber FRMessageNumberWithObject(id object);
+static void FRMessageSetString(NSMutableDictionary *dictionary, NSString *key, FRMessageBytes value);
+static void FRMessageSetNumber(NSMutableDictionary *dictionary, NSString *key, FRMessageNumber value);
+static BOOL FRMessageEncodeResources(NSArray *resources, NSString *bundleIdentifierKey, NSString *languageKey,
+									 NSString *nameKey, NSString *dataKey, NSString *digestKey,
+									 NSString *offsetKey, NSString *lengthKey,
+									 FRMessageResource **list, size_t *count);
+static NSArray *FRMessageDecodeResources(const FRMessageResource *list, size_t count, NSData *owner,
+										 NSString *bundleIdentifierKey, NSString *languageKey, NSString *nameKey,
+										 NSString *dataKey, NSString *digestKey, NSString *offsetKey,
+										 NSString *lengthKey);
 
 const struct FRAuthenticationMessage FRAuthenticationMessage = {
 	.messageID = @"FRAuthenticationMessageID",
 	.keys = {
 		.deviceName = @"deviceName",
 		.deviceIdentifier = @"deviceIdentifier",
+		.compression = @"compression",
 	}
 };
 
@@ -30,12 +61,48 @@ const struct FRLocalizationResourcesMessage FRLocalizationResourcesMessage = {
 	.keys = {
 		.applicationIdentifier = @"applicationIdentifier",
 		.applicationName = @"applicationName",
+		.compression = @"compression",
+		.remaining = @"remaining",
 		.resources = @"resources",
 		.resource = {
 			.bundleIdentifier = @"bundleIdentifier",
 			.language = @"language",
 			.name = @"name",
 			.data = @"data",
+			.digest = @"digest",
+			.offset = @"offset",
+			.length = @"length",
+		},
+	},
+};
+
+const struct FRLocalizationManifestMessage FRLocalizationManifestMessage = {
+	.messageID = @"FRLocalizationManifestMessageID",
+	.keys = {
+		.applicationIdentifier = @"applicationIdentifier",
+		.applicationName = @"applicationName",
+		.compression = @"compression",
+		.resources = @"resources",
+		.translations = @"translations",
+		.resource = {
+			.bundleIdentifier = @"bundleIdentifier",
+			.language = @"language",
+			.name = @"name",
+			.digest = @"digest",
+		},
+	},
+};
+
+const struct FRLocalizationRequestMessage FRLocalizationRequestMessage = {
+	.messageID = @"FRLocalizationRequestMessageID",
+	.keys = {
+		.resources = @"resources",
+		.resource = {
+			.bundleIdentifier = @"bundleIdentifier",
+			.language = @"language",
+			.name = @"name",
+			.digest = @"digest",
+			.offset = @"offset",
 		},
 	},
 };
@@ -52,3 +119,336 @@ const struct FRLocalizationChangesMessage FRLocalizationChangesMessage = {
 		},
 	},
 };
+
+const struct FRLocalizationEditsMessage FRLocalizationEditsMessage = {
+	.messageID = @"FRLocalizationEditsMessageID",
+	.keys = {
+		.resources = @"resources",
+		.resource = {
+			.bundleIdentifier = @"bundleIdentifier",
+			.language = @"language",
+			.name = @"name",
+			.data = @"data",
+		},
+	},
+};
+
+NSData *FRMessageDataWithMessage(NSDictionary *message) {
+	FRMessage contents;
+	memset(&contents, 0, sizeof(FRMessage));
+	
+	BOOL success = TRUE;
+	if ([message objectForKey:FRAuthenticationMessage.messageID]) {
+		contents.type = FRMessageTypeAuthentication;
+		contents.deviceName =
+			FRMessageBytesWithObject([message objectForKey:FRAuthenticationMessage.keys.deviceName]);
+		contents.deviceIdentifier =
+			FRMessageBytesWithObject([message objectForKey:FRAuthenticationMessage.keys.deviceIdentifier]);
+		contents.compression =
+			FRMessageBytesWithObject([message objectForKey:FRAuthenticationMessage.keys.compression]);
+	}
+	else if ([message objectForKey:FRLocalizationResourcesMessage.messageID]) {
+		contents.type = FRMessageTypeLocalizationResources;
+		contents.applicationIdentifier = FRMessageBytesWithObject
+			([message objectForKey:FRLocalizationResourcesMessage.keys.applicationIdentifier]);
+		contents.applicationName = FRMessageBytesWithObject
+			([message objectForKey:FRLocalizationResourcesMessage.keys.applicationName]);
+		contents.compression = FRMessageBytesWithObject
+			([message objectForKey:FRLocalizationResourcesMessage.keys.compression]);
+		contents.remaining = FRMessageNumberWithObject
+			([message objectForKey:FRLocalizationResourcesMessage.keys.remaining]);
+		success = FRMessageEncodeResources([message objectForKey:FRLocalizationResourcesMessage.keys.resources],
+										   FRLocalizationResourcesMessage.keys.resource.bundleIdentifier,
+										   FRLocalizationResourcesMessage.keys.resource.language,
+										   FRLocalizationResourcesMessage.keys.resource.name,
+										   FRLocalizationResourcesMessage.keys.resource.data,
+										   FRLocalizationResourcesMessage.keys.resource.digest,
+										   FRLocalizationResourcesMessage.keys.resource.offset,
+										   FRLocalizationResourcesMessage.keys.resource.length,
+										   &contents.resources, &contents.resourceCount);
+	}
+	else if ([message objectForKey:FRLocalizationManifestMessage.messageID]) {
+		contents.type = FRMessageTypeLocalizationManifest;
+		contents.applicationIdentifier = FRMessageBytesWithObject
+			([message objectForKey:FRLocalizationManifestMessage.keys.applicationIdentifier]);
+		contents.applicationName = FRMessageBytesWithObject
+			([message objectForKey:FRLocalizationManifestMessage.keys.applicationName]);
+		contents.compression = FRMessageBytesWithObject
+			([message objectForKey:FRLocalizationManifestMessage.keys.compression]);
+		success = (FRMessageEncodeResources([message objectForKey:FRLocalizationManifestMessage.keys.resources],
+											FRLocalizationManifestMessage.keys.resource.bundleIdentifier,
+											FRLocalizationManifestMessage.keys.resource.language,
+											FRLocalizationManifestMessage.keys.resource.name, nil,
+											FRLocalizationManifestMessage.keys.resource.digest, nil, nil,
+											&contents.resources, &contents.resourceCount) &&
+				   FRMessageEncodeResources([message objectForKey:FRLocalizationManifestMessage.keys.translations],
+											FRLocalizationManifestMessage.keys.resource.bundleIdentifier,
+											FRLocalizationManifestMessage.keys.resource.language,
+											FRLocalizationManifestMessage.keys.resource.name, nil,
+											FRLocalizationManifestMessage.keys.resource.digest, nil, nil,
+											&contents.translations, &contents.translationCount));
+	}
+	else if ([message objectForKey:FRLocalizationRequestMessage.messageID]) {
+		contents.type = FRMessageTypeLocalizationRequest;
+		success = FRMessageEncodeResources([message objectForKey:FRLocalizationRequestMessage.keys.resources],
+										   FRLocalizationRequestMessage.keys.resource.bundleIdentifier,
+										   FRLocalizationRequestMessage.keys.resource.language,
+										   FRLocalizationRequestMessage.keys.resource.name, nil,
+										   FRLocalizationRequestMessage.keys.resource.digest,
+										   FRLocalizationRequestMessage.keys.resource.offset, nil,
+										   &contents.resources, &contents.resourceCount);
+	}
+	else if ([message objectForKey:FRLocalizationChangesMessage.messageID]) {
+		contents.type = FRMessageTypeLocalizationChanges;
+		success = FRMessageEncodeResources([message objectForKey:FRLocalizationChangesMessage.keys.resources],
+										   FRLocalizationChangesMessage.keys.resource.bundleIdentifier,
+										   FRLocalizationChangesMessage.keys.resource.language,
+										   FRLocalizationChangesMessage.keys.resource.name,
+										   FRLocalizationChangesMessage.keys.resource.data, nil, nil, nil,
+										   &contents.resources, &contents.resourceCount);
+	}
+	else if ([message objectForKey:FRLocalizationEditsMessage.messageID]) {
+		contents.type = FRMessageTypeLocalizationEdits;
+		success = FRMessageEncodeResources([message objectForKey:FRLocalizationEditsMessage.keys.resources],
+										   FRLocalizationEditsMessage.keys.resource.bundleIdentifier,
+										   FRLocalizationEditsMessage.keys.resource.language,
+										   FRLocalizationEditsMessage.keys.resource.name,
+										   FRLocalizationEditsMessage.keys.resource.data, nil, nil, nil,
+										   &contents.resources, &contents.resourceCount);
+	}
+	else { success = FALSE; }
+	
+	// the strings and data are copied straight into the encoded message
+	NSMutableData *data = nil;
+	if (success) {
+		data = [NSMutableData dataWithLength:FRMessageEncodedLength(&contents)];
+		FRMessageEncode(&contents, [data mutableBytes]);
+	}
+	free(contents.resources);
+	free(contents.translations);
+	return data;
+}
+
+NSDictionary *FRMessageWithBytes(const void *bytes, NSUInteger length) {
+	return FRMessageDecodeDictionary(bytes, length, nil);
+}
+
+NSDictionary *FRMessageWithData(NSData *data) {
+	return FRMessageDecodeDictionary([data bytes], [data length], data);
+}
+
+static NSDictionary *FRMessageDecodeDictionary(const void *bytes, NSUInteger length, NSData *owner) {
+	FRMessage contents;
+	if (!FRMessageDecode(bytes, length, &contents)) { return nil; }
+	
+	NSMutableDictionary *message = [NSMutableDictionary dictionary];
+	if (contents.type == FRMessageTypeAuthentication) {
+		[message setObject:FRAuthenticationMessage.messageID forKey:FRAuthenticationMessage.messageID];
+		FRMessageSetString(message, FRAuthenticationMessage.keys.deviceName, contents.deviceName);
+		FRMessageSetString(message, FRAuthenticationMessage.keys.deviceIdentifier, contents.deviceIdentifier);
+		FRMessageSetString(message, FRAuthenticationMessage.keys.compression, contents.compression);
+	}
+	else if (contents.type == FRMessageTypeLocalizationResources) {
+		[message setObject:FRLocalizationResourcesMessage.messageID forKey:FRLocalizationResourcesMessage.messageID];
+		FRMessageSetString(message, FRLocalizationResourcesMessage.keys.applicationIdentifier,
+						   contents.applicationIdentifier);
+		FRMessageSetString(message, FRLocalizationResourcesMessage.keys.applicationName, contents.applicationName);
+		FRMessageSetString(message, FRLocalizationResourcesMessage.keys.compression, contents.compression);
+		FRMessageSetNumber(message, FRLocalizationResourcesMessage.keys.remaining, contents.remaining);
+		[message setObject:FRMessageDecodeResources(contents.resources, contents.resourceCount, owner,
+													FRLocalizationResourcesMessage.keys.resource.bundleIdentifier,
+													FRLocalizationResourcesMessage.keys.resource.language,
+													FRLocalizationResourcesMessage.keys.resource.name,
+													FRLocalizationResourcesMessage.keys.resource.data,
+													FRLocalizationResourcesMessage.keys.resource.digest,
+													FRLocalizationResourcesMessage.keys.resource.offset,
+													FRLocalizationResourcesMessage.keys.resource.length)
+					forKey:FRLocalizationResourcesMessage.keys.resources];
+	}
+	else if (contents.type == FRMessageTypeLocalizationManifest) {
+		[message setObject:FRLocalizationManifestMessage.messageID forKey:FRLocalizationManifestMessage.messageID];
+		FRMessageSetString(message, FRLocalizationManifestMessage.keys.applicationIdentifier,
+						   contents.applicationIdentifier);
+		FRMessageSetString(message, FRLocalizationManifestMessage.keys.applicationName, contents.applicationName);
+		FRMessageSetString(message, FRLocalizationManifestMessage.keys.compression, contents.compression);
+		[message setObject:FRMessageDecodeResources(contents.resources, contents.resourceCount, owner,
+													FRLocalizationManifestMessage.keys.resource.bundleIdentifier,
+													FRLocalizationManifestMessage.keys.resource.language,
+													FRLocalizationManifestMessage.keys.resource.name, nil,
+													FRLocalizationManifestMessage.keys.resource.digest, nil, nil)
+					forKey:FRLocalizationManifestMessage.keys.resources];
+		[message setObject:FRMessageDecodeResources(contents.translations, contents.translationCount, owner,
+													FRLocalizationManifestMessage.keys.resource.bundleIdentifier,
+													FRLocalizationManifestMessage.keys.resource.language,
+													FRLocalizationManifestMessage.keys.resource.name, nil,
+													FRLocalizationManifestMessage.keys.resource.digest, nil, nil)
+					forKey:FRLocalizationManifestMessage.keys.translations];
+	}
+	else if (contents.type == FRMessageTypeLocalizationRequest) {
+		[message setObject:FRLocalizationRequestMessage.messageID forKey:FRLocalizationRequestMessage.messageID];
+		[message setObject:FRMessageDecodeResources(contents.resources, contents.resourceCount, owner,
+													FRLocalizationRequestMessage.keys.resource.bundleIdentifier,
+													FRLocalizationRequestMessage.keys.resource.language,
+													FRLocalizationRequestMessage.keys.resource.name, nil,
+													FRLocalizationRequestMessage.keys.resource.digest,
+													FRLocalizationRequestMessage.keys.resource.offset, nil)
+					forKey:FRLocalizationRequestMessage.keys.resources];
+	}
+	else if (contents.type == FRMessageTypeLocalizationChanges) {
+		[message setObject:FRLocalizationChangesMessage.messageID forKey:FRLocalizationChangesMessage.messageID];
+		[message setObject:FRMessageDecodeResources(contents.resources, contents.resourceCount, owner,
+													FRLocalizationChangesMessage.keys.resource.bundleIdentifier,
+													FRLocalizationChangesMessage.keys.resource.language,
+													FRLocalizationChangesMessage.keys.resource.name,
+													FRLocalizationChangesMessage.keys.resource.data, nil, nil, nil)
+					forKey:FRLocalizationChangesMessage.keys.resources];
+	}
+	else if (contents.type == FRMessageTypeLocalizationEdits) {
+		[message setObject:FRLocalizationEditsMessage.messageID forKey:FRLocalizationEditsMessage.messageID];
+		[message setObject:FRMessageDecodeResources(contents.resources, contents.resourceCount, owner,
+													FRLocalizationEditsMessage.keys.resource.bundleIdentifier,
+													FRLocalizationEditsMessage.keys.resource.language,
+													FRLocalizationEditsMessage.keys.resource.name,
+													FRLocalizationEditsMessage.keys.resource.data, nil, nil, nil)
+					forKey:FRLocalizationEditsMessage.keys.resources];
+	}
+	FRMessageFreeDecoded(&contents);
+	
+	return message;
+}
+
+NSString *FRMessageResourcePath(NSString *bundleIdentifier, NSString *language, NSString *name) {
+	NSString *lprojName = [NSString stringWithFormat:@"%@.lproj", language];
+	NSString *stringsName = [NSString stringWithFormat:@"%@.strings", name];
+	return [[bundleIdentifier stringByAppendingPathComponent:lprojName] stringByAppendingPathComponent:stringsName];
+}
+
+NSString *FRMessageResourceDigest(NSData *data) {
+	unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+	CC_SHA1([data bytes], (CC_LONG)[data length], digest);
+	NSMutableString *result = [NSMutableString stringWithCapacity:sizeof(digest) * 2];
+	for (size_t index = 0; index < sizeof(digest); index++) { [result appendFormat:@"%02x", digest[index]]; }
+	return result;
+}
+
+NSDictionary *FRMessageResourceDigestsInDirectory(NSString *directory) {
+	NSMutableDictionary *digests = [NSMutableDictionary dictionary];
+	NSDirectoryEnumerator *enumerator = [[NSFileManager defaultManager] enumeratorAtPath:directory];
+	for (NSString *path in enumerator) {
+		NSArray *components = [path pathComponents];
+		if ([components count] != 3 ||
+			![[[components objectAtIndex:1] pathExtension] isEqualToString:@"lproj"] ||
+			![[path pathExtension] isEqualToString:@"strings"]) { continue; }
+		
+		NSData *data = [NSData dataWithContentsOfFile:[directory stringByAppendingPathComponent:path]
+											  options:NSDataReadingMappedIfSafe error:NULL];
+		if (data) { [digests setObject:FRMessageResourceDigest(data) forKey:path]; }
+	}
+	return digests;
+}
+
+static FRMessageBytes FRMessageBytesWithObject(id object) {
+	// empty data may not have any bytes, but it still needs to be sent
+	static const char empty = 0;
+	FRMessageBytes result = { NULL, 0 };
+	if ([object isKindOfClass:[NSString class]]) {
+		result.bytes = [object UTF8String];
+		result.length = strlen(result.bytes);
+	}
+	else if ([object isKindOfClass:[NSData class]]) {
+		result.length = [object length];
+		result.bytes = result.length ? [object bytes] : &empty;
+	}
+	return result;
+}
+
+static FRMessageNumber FRMessageNumberWithObject(id object) {
+	FRMessageNumber result = { 0, 0 };
+	if ([object isKindOfClass:[NSNumber class]]) {
+		result.value = [object unsignedLongLongValue];
+		result.present = 1;
+	}
+	return result;
+}
+
+static void FRMessageSetString(NSMutableDictionary *dictionary, NSString *key, FRMessageBytes value) {
+	if (!value.bytes) { return; }
+	NSString *string = [[NSString alloc] initWithBytes:value.bytes length:value.length encoding:NSUTF8StringEncoding];
+	if (string) { [dictionary setObject:string forKey:key]; }
+}
+
+static void FRMessageSetNumber(NSMutableDictionary *dictionary, NSString *key, FRMessageNumber value) {
+	if (!value.present) { return; }
+	[dictionary setObject:[NSNumber numberWithUnsignedLongLong:value.value] forKey:key];
+}
+
+static BOOL FRMessageEncodeResources(NSArray *resources, NSString *bundleIdentifierKey, NSString *languageKey,
+									 NSString *nameKey, NSString *dataKey, NSString *digestKey,
+									 NSString *offsetKey, NSString *lengthKey,
+									 FRMessageResource **list, size_t *count) {
+	NSUInteger resourceCount = [resources count];
+	*list = calloc(resourceCount ? resourceCount : 1, sizeof(FRMessageResource));
+	if (!*list) { return FALSE; }
+	*count = resourceCount;
+	
+	for (NSUInteger index = 0; index < resourceCount; index++) {
+		NSDictionary *resource = [resources objectAtIndex:index];
+		FRMessageResource *contents = &(*list)[index];
+		contents->bundleIdentifier = FRMessageBytesWithObject([resource objectForKey:bundleIdentifierKey]);
+		contents->language = FRMessageBytesWithObject([resource objectForKey:languageKey]);
+		contents->name = FRMessageBytesWithObject([resource objectForKey:nameKey]);
+		if (dataKey) { contents->data = FRMessageBytesWithObject([resource objectForKey:dataKey]); }
+		if (digestKey) { contents->digest = FRMessageBytesWithObject([resource objectForKey:digestKey]); }
+		if (offsetKey) { contents->offset = FRMessageNumberWithObject([resource objectForKey:offsetKey]); }
+		if (lengthKey) { contents->length = FRMessageNumberWithObject([resource objectForKey:lengthKey]); }
+	}
+	return TRUE;
+}
+
+static NSArray *FRMessageDecodeResources(const FRMessageResource *list, size_t count, NSData *owner,
+										 NSString *bundleIdentifierKey, NSString *languageKey, NSString *nameKey,
+										 NSString *dataKey, NSString *digestKey, NSString *offsetKey,
+										 NSString *lengthKey) {
+	NSMutableArray *resources = [NSMutableArray arrayWithCapacity:count];
+	for (size_t index = 0; index < count; index++) {
+		const FRMessageResource *contents = &list[index];
+		NSMutableDictionary *resource = [NSMutableDictionary dictionaryWithCapacity:4];
+		FRMessageSetString(resource, bundleIdentifierKey, contents->bundleIdentifier);
+		FRMessageSetString(resource, languageKey, contents->language);
+		FRMessageSetString(resource, nameKey, contents->name);
+		if (dataKey && contents->data.bytes) {
+			// data in a message that's kept around is used in place, otherwise it has to be copied
+			NSData *data = owner ?
+				[[FRMessageDataSlice alloc] initWithMessage:owner bytes:contents->data.bytes
+													 length:contents->data.length] :
+				[NSData dataWithBytes:contents->data.bytes length:contents->data.length];
+			[resource setObject:data forKey:dataKey];
+		}
+		if (digestKey) { FRMessageSetString(resource, digestKey, contents->digest); }
+		if (offsetKey) { FRMessageSetNumber(resource, offsetKey, contents->offset); }
+		if (lengthKey) { FRMessageSetNumber(resource, lengthKey, contents->length); }
+		[resources addObject:resource];
+	}
+	return resources;
+}
+
+@implementation FRMessageDataSlice
+
+- (id)initWithMessage:(NSData *)messageData bytes:(const void *)bytes length:(NSUInteger)length {
+	if ((self = [super init])) {
+		message = messageData;
+		sliceBytes = bytes;
+		sliceLength = length;
+	}
+	return self;
+}
+
+- (const void *)bytes {
+	return sliceBytes;
+}
+
+- (NSUInteger)length {
+	return sliceLength;
+}
+
+@end
@@ -0,0 +1,270 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#import "FRServer.h"
+#import "FRFrameBuffer.h"
+
+static const size_t kWriteHighWaterMark = 4 * 1024 * 1024;
+static const int kReadsPerEvent = 16; // keeps a busy client from starving the others
+
+struct FRServerClient {
+	FRServer *server;
+	FRServerClient *previous;
+	FRServerClient *next;
+	int descriptor;
+	FRFrameBuffer *buffer;
+	FRWriteQueue *queue;
+	void *info;
+	unsigned busy;		// nesting of event handling for the client, which keeps it from being freed
+	int full;
+	int closed;
+};
+
+struct FRServer {
+	FREventLoop *loop;
+	int listener;
+	size_t maximumPayloadLength;
+	FRServerCallbacks callbacks;
+	FRServerClient *clients;
+	size_t count;
+};
+
+static void FRServerAccept(FREventLoop *loop, int descriptor, FREvents events, void *info);
+static void FRServerHandleClient(FREventLoop *loop, int descriptor, FREvents events, void *info);
+static void FRServerRead(FRServerClient *client);
+static void FRServerWrite(FRServerClient *client);
+static void FRServerClientFree(FRServerClient *client);
+static int FRServerSetNonBlocking(int descriptor);
+static ssize_t FRServerWriteSocket(void *context, const struct iovec *vectors, int count);
+
+FRServer *FRServerCreate(FREventLoop *loop, int listener, size_t maximumPayloadLength,
+						 const FRServerCallbacks *callbacks) {
+	FRServer *server = calloc(1, sizeof(FRServer));
+	if (!server) { return NULL; }
+	server->loop = loop;
+	server->listener = listener;
+	server->maximumPayloadLength = maximumPayloadLength;
+	server->callbacks = *callbacks;
+	
+	int error = FRServerSetNonBlocking(listener);
+	if (!error) { error = FREventLoopAdd(loop, listener, FREventRead, FRServerAccept, server); }
+	if (error) {
+		free(server);
+		errno = error;
+		return NULL;
+	}
+	return server;
+}
+
+void FRServerFree(FRServer *server) {
+	while (server->clients) { FRServerClose(server->clients); }
+	FREventLoopRemove(server->loop, server->listener);
+	close(server->listener);
+	free(server);
+}
+
+size_t FRServerClientCount(const FRServer *server) {
+	return server->count;
+}
+
+void *FRServerClientGetInfo(const FRServerClient *client) {
+	return client->info;
+}
+
+void FRServerClientSetInfo(FRServerClient *client, void *info) {
+	client->info = info;
+}
+
+int FRServerSend(FRServerClient *client, FRFrameChannel channel, const void *payload, size_t length,
+				 void *owner, FRWriteQueueRelease release) {
+	if (client->closed) {
+		if (release) { release(owner); }
+		return ENOTCONN;
+	}
+	int error = FRWriteQueuePush(client->queue, channel, payload, length, owner, release);
+	if (error) { return error; }
+	
+	// writing right away saves a trip through the loop. it may close the client, but the client is only
+	// freed here if nothing else is handling it.
+	client->busy++;
+	FRServerWrite(client);
+	if (!client->closed && FRWriteQueueIsFull(client->queue)) { client->full = 1; }
+	client->busy--;
+	if (client->closed && !client->busy) {
+		FRServerClientFree(client);
+		return ENOTCONN;
+	}
+	return 0;
+}
+
+int FRServerClientIsFull(const FRServerClient *client) {
+	return client->full;
+}
+
+void FRServerClose(FRServerClient *client) {
+	if (client->closed) { return; }
+	FRServer *server = client->server;
+	client->closed = 1;
+	FREventLoopRemove(server->loop, client->descriptor);
+	close(client->descriptor);
+	client->descriptor = -1;
+	
+	if (client->previous) { client->previous->next = client->next; }
+	else { server->clients = client->next; }
+	if (client->next) { client->next->previous = client->previous; }
+	server->count--;
+	
+	client->busy++;
+	server->callbacks.closed(server, client, server->callbacks.info);
+	client->busy--;
+	if (!client->busy) { FRServerClientFree(client); }
+}
+
+static void FRServerAccept(FREventLoop *loop, int descriptor, FREvents events, void *info) {
+	(void)events;
+	FRServer *server = info;
+	for (;;) {
+		int socket = accept(descriptor, NULL, NULL);
+		if (socket < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) { continue; }
+			break; // nothing left to accept (or out of descriptors, in which case the loop will call again)
+		}
+		
+		FRServerClient *client = calloc(1, sizeof(FRServerClient));
+		if (client) {
+			client->server = server;
+			client->descriptor = socket;
+			client->buffer = FRFrameBufferCreate(server->maximumPayloadLength);
+			client->queue = FRWriteQueueCreate(kWriteHighWaterMark);
+		}
+		if (!client || !client->buffer || !client->queue || FRServerSetNonBlocking(socket) != 0 ||
+			FREventLoopAdd(loop, socket, FREventRead, FRServerHandleClient, client) != 0) {
+			if (client) { FRServerClientFree(client); }
+			close(socket);
+			continue;
+		}
+#ifdef SO_NOSIGPIPE
+		setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &(int){1}, sizeof(int));
+#endif
+		FRWriteQueueSetSocketOptions(socket);
+		
+		client->next = server->clients;
+		if (client->next) { client->next->previous = client; }
+		server->clients = client;
+		server->count++;
+		
+		client->busy++;
+		server->callbacks.accepted(server, client, server->callbacks.info);
+		client->busy--;
+		if (client->closed && !client->busy) { FRServerClientFree(client); }
+	}
+}
+
+static void FRServerHandleClient(FREventLoop *loop, int descriptor, FREvents events, void *info) {
+	FRServerClient *client = info;
+	client->busy++;
+	if (events & FREventWrite) { FRServerWrite(client); }
+	if ((events & FREventRead) && !client->closed) { FRServerRead(client); }
+	client->busy--;
+	if (client->closed && !client->busy) { FRServerClientFree(client); }
+}
+
+static void FRServerRead(FRServerClient *client) {
+	FRServer *server = client->server;
+	for (int reads = 0; reads < kReadsPerEvent && !client->closed; reads++) {
+		size_t available = 0;
+		uint8_t *buffer = FRFrameBufferReserve(client->buffer, &available);
+		if (!buffer) {
+			FRServerClose(client);
+			break;
+		}
+		
+		ssize_t length = read(client->descriptor, buffer, available);
+		if (length < 0 && errno == EINTR) { continue; }
+		if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+		if (length <= 0) {
+			FRServerClose(client);
+			break;
+		}
+		FRFrameBufferCommit(client->buffer, (size_t)length);
+		
+		const struct iovec *payload = NULL;
+		int count = 0;
+		size_t payloadLength = 0;
+		FRFrameBufferResult result = FRFrameBufferIncomplete;
+		while (!client->closed &&
+			   (result = FRFrameBufferNextMessage(client->buffer, &payload, &count, &payloadLength)) ==
+			   FRFrameBufferComplete) {
+			server->callbacks.received(server, client, payload, count, payloadLength, server->callbacks.info);
+		}
+		if (result < 0) { FRServerClose(client); }
+	}
+}
+
+static void FRServerWrite(FRServerClient *client) {
+	FRServer *server = client->server;
+	if (client->closed) { return; }
+	if (FRWriteQueueFlush(client->queue, FRServerWriteSocket, &client->descriptor) < 0) {
+		FRServerClose(client);
+		return;
+	}
+	
+	// the loop only needs to watch for writability while there's something left to write
+	FREvents events = FREventRead | (FRWriteQueueLength(client->queue) ? FREventWrite : 0);
+	if (FREventLoopModify(server->loop, client->descriptor, events) != 0) {
+		FRServerClose(client);
+		return;
+	}
+	
+	if (client->full && FRWriteQueueIsDrained(client->queue)) {
+		client->full = 0;
+		if (server->callbacks.drained) { server->callbacks.drained(server, client, server->callbacks.info); }
+	}
+}
+
+static void FRServerClientFree(FRServerClient *client) {
+	if (client->buffer) { FRFrameBufferFree(client->buffer); }
+	if (client->queue) { FRWriteQueueFree(client->queue); }
+	free(client);
+}
+
+static int FRServerSetNonBlocking(int descriptor) {
+	int flags = fcntl(descriptor, F_GETFL, 0);
+	if (flags < 0 || fcntl(descriptor, F_SETFL, flags | O_NONBLOCK) < 0) { return errno; }
+	return 0;
+}
+
+static ssize_t FRServerWriteSocket(void *context, const struct iovec *vectors, int count) {
+	// sendmsg can be told not to raise SIGPIPE where there's no SO_NOSIGPIPE, so a client going away
+	// never takes the whole process with it
+#ifdef MSG_NOSIGNAL
+	struct msghdr message = { .msg_iov = (struct iovec *)vectors, .msg_iovlen = count };
+	ssize_t written = -1;
+	do { written = sendmsg(*(int *)context, &message, MSG_NOSIGNAL); } while (written < 0 && errno == EINTR);
+	if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { written = 0; }
+	return written;
+#else
+	return FRWriteQueueWriteSocket(context, vectors, count);
+#endif
+}
@@ -0,0 +1,99 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#import "FREventLoop.h"
+#import "FRWriteQueue.h"
+
+/*!
+ \brief		Multi-client server
+ \details	Accepts connections on a listening socket and serves all of them from an event loop. Each
+			client has its own frame buffer and write queue, so clients read, write and apply backpressure
+			independently of each other. Payloads are framed the same way FRConnection frames them.
+			
+			All callbacks are called from FREventLoopRun.
+ */
+typedef struct FRServer FRServer;
+
+/*!
+ \brief		A connected client
+ \details	Clients stay valid until their closed callback returns.
+ */
+typedef struct FRServerClient FRServerClient;
+
+typedef struct FRServerCallbacks {
+	void *info;
+	void (*accepted)(FRServer *server, FRServerClient *client, void *info);
+	void (*received)(FRServer *server, FRServerClient *client, const struct iovec *payload, int count, size_t length,
+					 void *info);
+	void (*drained)(FRServer *server, FRServerClient *client, void *info);		// may be NULL
+	void (*closed)(FRServer *server, FRServerClient *client, void *info);
+} FRServerCallbacks;
+
+/*!
+ \brief		Create a server
+ \details	Starts accepting connections on the listening socket, which the server takes over. Payloads in
+			received callbacks are handed over as the chunks they were read in (see FRFrameBufferNextMessage)
+			and are only valid until the callback returns, and clients that send longer payloads than the
+			maximum are closed. Returns NULL with errno set on failure.
+ */
+FRServer *FRServerCreate(FREventLoop *loop, int listener, size_t maximumPayloadLength,
+						 const FRServerCallbacks *callbacks);
+
+/*!
+ \brief		Free a server
+ \details	Closes every client (calling its closed callback) and the listening socket. Must not be called
+			from a callback.
+ */
+void FRServerFree(FRServer *server);
+
+/*!
+ \brief		Number of connected clients
+ \details	Number of connected clients
+ */
+size_t FRServerClientCount(const FRServer *server);
+
+/*!
+ \brief		Client info
+ \details	A pointer kept for the client. It's NULL until it's set.
+ */
+void *FRServerClientGetInfo(const FRServerClient *client);
+void FRServerClientSetInfo(FRServerClient *client, void *info);
+
+/*!
+ \brief		Send a payload
+ \details	Queues the payload on the channel (see FRWriteQueuePush for how it's owned and how channels are
+			ordered) and writes as much as the client takes right away. Returns 0 on success or an errno value.
+ */
+int FRServerSend(FRServerClient *client, FRFrameChannel channel, const void *payload, size_t length,
+				 void *owner, FRWriteQueueRelease release);
+
+/*!
+ \brief		Whether the client's queue is full
+ \details	Once it is, senders should hold off until the drained callback.
+ */
+int FRServerClientIsFull(const FRServerClient *client);
+
+/*!
+ \brief		Close a client
+ \details	Closes the connection and calls the closed callback right away. Safe to call from any callback,
+			including for the client the callback is about.
+ */
+void FRServerClose(FRServerClient *client);
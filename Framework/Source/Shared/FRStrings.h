@@ -23,9 +23,12 @@ enum {
 };
 typedef NSUInteger FRStringsFormat;
 
-@interface FRStrings : NSObject <NSFastEnumeration> {
+struct FRTranslationStatusMap;
+
+@interface FRStrings : NSObject <NSFastEnumeration, NSCopying> {
 	NSMutableDictionary *strings;
 	NSMutableArray *order;
+	NSMutableSet *changes;
 }
 
 /*!
@@ -40,6 +43,24 @@ typedef NSUInteger FRStringsFormat;
  */
 - (id)initWithData:(NSData *)data usedFormat:(FRStringsFormat *)format error:(NSError **)error;
 
+/*!
+ \brief		Create a new strings file in batches
+ \details	Reads the data like initWithData:usedFormat:error:, but calls the handler on the calling thread
+			each time another batch of strings has been read, with the range of the strings in the batch.
+			The first batch holds firstLength strings and the others batchLength (the last one can hold
+			fewer). The strings read so far can be used from the handler, for instance to get their quoted
+			contents. Reading stops and nil is returned when the handler returns FALSE.
+ */
+- (id)initWithData:(NSData *)data usedFormat:(FRStringsFormat *)format
+  firstBatchLength:(NSUInteger)firstLength batchLength:(NSUInteger)batchLength
+		   handler:(BOOL (^)(FRStrings *strings, NSRange range))handler error:(NSError **)error;
+
+/*!
+ \brief		Create a new strings file
+ \details	Create with the contents of a string
+ */
+- (id)initWithString:(NSString *)string usedFormat:(FRStringsFormat *)format error:(NSError **)error;
+
 /*!
  \brief		Write the strings file
  \details	Write the stings file in the given format
@@ -54,6 +75,15 @@ typedef NSUInteger FRStringsFormat;
  */
 - (id)contentsInFormat:(FRStringsFormat)format;
 
+/*!
+ \brief		Get the quoted contents of some of the strings
+ \details	Gets the contents of the strings in the given range in FRStringsFormatQuoted, as they would
+			appear in the full contents. When locations is not NULL, it receives the location in the
+			result where each of the strings begins (including its comments), or NSNotFound if the
+			string was left out because it has no translation.
+ */
+- (NSString *)quotedContentsOfStringsInRange:(NSRange)range entryLocations:(NSUInteger *)locations;
+
 /*!
  \brief		Enumerate the strings
  \details	Enumerate the strings (in order if possible)
@@ -96,4 +126,25 @@ typedef NSUInteger FRStringsFormat;
  */
 - (void)setTranslation:(NSString *)translation forString:(NSString *)string;
 
+/*!
+ \brief		Translation status of the strings
+ \details	Classifies each string (in the order they're enumerated) as translated, untranslated or equal
+			using the rules in FRTranslationStatus.h. The caller is responsible for freeing the result
+			with FRTranslationStatusMapFree. Returns NULL if memory couldn't be allocated.
+ */
+- (struct FRTranslationStatusMap *)createTranslationStatusMap;
+
+/*!
+ \brief		Changed strings
+ \details	The strings whose translation or comments were changed through one of the setters since
+			changes were last cleared. Setting a value equal to the current one is not a change.
+ */
+- (NSSet *)changedStrings;
+
+/*!
+ \brief		Clear changes
+ \details	Clear changes
+ */
+- (void)clearChanges;
+
 @end
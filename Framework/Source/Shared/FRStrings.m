@@ -16,13 +16,18 @@
 // 
 
 #import "FRStrings.h"
+#import "FRStringsTokenizer.h"
+#import "FRTranslationStatus.h"
 
 static NSString * const kCommentsKey = @"comments";
 static NSString * const kTranslationKey = @"translation";
 
+static const FRStringsChar *FRStringsGetCharacters(NSString *string, NSMutableData *buffer, NSUInteger offset);
+static BOOL FRStringsMayBePropertyList(NSData *data);
+
 @interface FRStrings ()
 - (void)setupWithPropertyList:(NSDictionary *)plist;
-- (void)setupWithQuotedString:(NSString *)string;
+- (BOOL)setupWithQuotedString:(NSString *)string progress:(BOOL (^)(BOOL finished))progress;
 @end
 
 @implementation FRStrings
@@ -31,21 +36,57 @@ static NSString * const kTranslationKey = @"translation";
 	if ((self = [super init])) {
 		strings = [[NSMutableDictionary alloc] init];
 		order = [[NSMutableArray alloc] init];
+		changes = [[NSMutableSet alloc] init];
 	}
 	return self;
 }
 
+- (id)copyWithZone:(NSZone *)zone {
+	FRStrings *copy = [[[self class] allocWithZone:zone] init];
+	for (NSString *string in order) {
+		[copy->strings setObject:[[strings objectForKey:string] mutableCopy] forKey:string];
+	}
+	[copy->order setArray:order];
+	[copy->changes setSet:changes];
+	return copy;
+}
+
 - (id)initWithContentsOfFile:(NSString *)path usedFormat:(FRStringsFormat *)outFormat error:(NSError **)error {
 	NSData *data = [NSData dataWithContentsOfFile:path options:0 error:error];
 	return data ? [self initWithData:data usedFormat:outFormat error:error] : nil;
 }
 
 - (id)initWithData:(NSData *)data usedFormat:(FRStringsFormat *)outFormat error:(NSError **)error {
+	return [self initWithData:data usedFormat:outFormat firstBatchLength:0 batchLength:0 handler:nil error:error];
+}
+
+- (id)initWithData:(NSData *)data usedFormat:(FRStringsFormat *)outFormat
+  firstBatchLength:(NSUInteger)firstLength batchLength:(NSUInteger)batchLength
+		   handler:(BOOL (^)(FRStrings *strings, NSRange range))handler error:(NSError **)error {
 	FRStringsFormat format = 0;
 	BOOL created = FALSE;
+	BOOL cancelled = FALSE;
 	
 	if ((self = [self init])) {
-		if (!created) {
+		// batches are handed out whenever enough strings have been read since the last one
+		__block NSUInteger reported = 0;
+		__block NSUInteger nextLength = MAX(firstLength, 1);
+		NSMutableArray *readOrder = order;
+		FRStrings *reading = self;
+		BOOL (^progress)(BOOL) = !handler ? nil : ^BOOL(BOOL finished) {
+			NSUInteger count = [readOrder count];
+			while (count > reported && (finished || count - reported >= nextLength)) {
+				NSRange range = NSMakeRange(reported, MIN(nextLength, count - reported));
+				reported = NSMaxRange(range);
+				nextLength = MAX(batchLength, 1);
+				if (!handler(reading, range)) { return FALSE; }
+			}
+			return TRUE;
+		};
+		
+		// quoted files are read as they're tokenized. checking for them first means they aren't also read
+		// as an old style property list just to find out that they're not some other kind.
+		if (!created && FRStringsMayBePropertyList(data)) {
 			NSDictionary *plist = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable
 																			 format:&format error:error];
 			if (plist && format != NSPropertyListOpenStepFormat) {
@@ -65,17 +106,18 @@ static NSString * const kTranslationKey = @"translation";
 												encoding:NSUTF16StringEncoding];
 			}
 			if (string) {
-				[self setupWithQuotedString:string];
+				cancelled = ![self setupWithQuotedString:string progress:progress];
 				format = FRStringsFormatQuoted;
 				created = TRUE;
 			}
 		}
-
+		
+		if (created && progress && !cancelled) { cancelled = !progress(TRUE); }
 	}
 	
 	if (outFormat) { *outFormat = format; }
 	
-	return created ? self : nil;
+	return (created && !cancelled) ? self : nil;
 }
 
 - (id)initWithString:(NSString *)string usedFormat:(FRStringsFormat *)outFormat error:(NSError **)error {
@@ -96,7 +138,7 @@ static NSString * const kTranslationKey = @"translation";
 		
 		if (!created) {
 			if (string) {
-				[self setupWithQuotedString:string];
+				[self setupWithQuotedString:string progress:nil];
 				format = FRStringsFormatQuoted;
 				created = TRUE;
 			}
@@ -119,48 +161,46 @@ static NSString * const kTranslationKey = @"translation";
 	}
 }
 
-- (void)setupWithQuotedString:(NSString *)quotedString {
-	NSCharacterSet *breaksCharacterSet = [NSCharacterSet characterSetWithCharactersInString:@"\r\n"];
-	NSArray *lines = [quotedString componentsSeparatedByCharactersInSet:breaksCharacterSet];
-
+- (BOOL)setupWithQuotedString:(NSString *)quotedString progress:(BOOL (^)(BOOL finished))progress {
+	NSUInteger length = [quotedString length];
+	NSMutableData *buffer = nil;
+	const unichar *chars = CFStringGetCharactersPtr((__bridge CFStringRef)quotedString);
+	if (!chars) {
+		buffer = [NSMutableData dataWithLength:length * sizeof(unichar)];
+		[quotedString getCharacters:[buffer mutableBytes] range:NSMakeRange(0, length)];
+		chars = [buffer bytes];
+	}
+	
 	NSMutableArray *comments = [NSMutableArray array];
-	static NSString * const kCommentPrefix = @"/*";
-	static NSString * const kCommentSuffix = @"*/";
-
-	for (__strong NSString *line in lines) {
-		if ([line hasSuffix:@";"]) {
-			line = [line substringWithRange:NSMakeRange(0, [line length]-1)];
-		}
-		NSArray *components = [line componentsSeparatedByString:@"\" = \""];
-		if ([components count] == 2) {
-			NSString *string = [components objectAtIndex:0];
-			NSString *translation = [components objectAtIndex:1];
-			if ([string hasPrefix:@"\""]) {
-				string = [string substringWithRange:NSMakeRange(1, [string length]-1)];
-				string = [string stringByReplacingOccurrencesOfString:@"\\\"" withString:@"\""];
-			}
-			if ([translation hasSuffix:@"\""]) {
-				translation = [translation substringWithRange:NSMakeRange(0, [translation length]-1)];
-				translation = [translation stringByReplacingOccurrencesOfString:@"\\\"" withString:@"\""];
-			}
+	FRStringsLexState state = FRStringsLexStateInitial;
+	FRStringsLine line = {};
+	
+	for (NSUInteger location = 0; location < length; location += line.length) {
+		const unichar *lineChars = chars + location;
+		state = FRStringsTokenizeLine(lineChars, length - location, state, &line);
+		if (line.kind == FRStringsLineEntry) {
+			NSString *string = [NSString stringWithCharacters:lineChars + line.keyLocation length:line.keyLength];
+			NSString *translation = [NSString stringWithCharacters:lineChars + line.valueLocation
+															length:line.valueLength];
+			string = [string stringByReplacingOccurrencesOfString:@"\\\"" withString:@"\""];
+			translation = [translation stringByReplacingOccurrencesOfString:@"\\\"" withString:@"\""];
 			NSMutableDictionary *object = [NSMutableDictionary dictionary];
 			if (translation) { [object setObject:translation forKey:kTranslationKey]; }
 			if (comments) { [object setObject:comments forKey:kCommentsKey]; }
 			[strings setObject:object forKey:string];
 			[order addObject:string];
 			comments = [NSMutableArray array];
+			if (progress && !progress(FALSE)) { return FALSE; }
 		}
-		else if ([line hasPrefix:kCommentPrefix] && [line hasSuffix:kCommentSuffix]) {
-			NSRange range = {};
-			range.location = [kCommentPrefix length];
-			range.length = [line length]-[kCommentPrefix length]-[kCommentSuffix length];
-			NSString *substring = [line substringWithRange:range];
+		else if (line.kind == FRStringsLineComment) {
+			NSString *substring = [NSString stringWithCharacters:lineChars + line.keyLocation length:line.keyLength];
 			[comments addObject:
 			 [substring stringByTrimmingCharactersInSet:
 			  [NSCharacterSet whitespaceCharacterSet]]];
 		}
-		else { comments = [NSMutableArray array]; }
+		else if (line.kind != FRStringsLineBlank) { comments = [NSMutableArray array]; }
 	}
+	return TRUE;
 }
 
 - (BOOL)writeToFile:(NSString *)path format:(FRStringsFormat)format error:(NSError **)error {
@@ -186,23 +226,29 @@ static NSString * const kTranslationKey = @"translation";
 		return plist;
 	}
 	else if (format == FRStringsFormatQuoted) {
-		NSMutableString *result = [NSMutableString string];
-		for (NSString *string in self) {
-			NSArray *comments = [self commentsForString:string];
-			NSString *translation = [self translationForString:string];
-			
-			if (translation) {
-				for (NSString *comment in comments) {
-					[result appendFormat:@"/* %@ */\n", comment];
-				}
-				NSString *escapedString = [string stringByReplacingOccurrencesOfString:@"\"" withString:@"\\\""];
-				NSString *escapedTranslation = [translation stringByReplacingOccurrencesOfString:@"\"" withString:@"\\\""];
-				[result appendFormat:@"\"%@\" = \"%@\";\n\n", escapedString, escapedTranslation];
+		return [self quotedContentsOfStringsInRange:NSMakeRange(0, [order count]) entryLocations:NULL];
+	}
+	else { return nil; }
+}
+
+- (NSString *)quotedContentsOfStringsInRange:(NSRange)range entryLocations:(NSUInteger *)locations {
+	NSMutableString *result = [NSMutableString string];
+	for (NSUInteger index = range.location; index < NSMaxRange(range); index++) {
+		NSString *string = [order objectAtIndex:index];
+		NSArray *comments = [self commentsForString:string];
+		NSString *translation = [self translationForString:string];
+		
+		if (locations) { locations[index - range.location] = translation ? [result length] : NSNotFound; }
+		if (translation) {
+			for (NSString *comment in comments) {
+				[result appendFormat:@"/* %@ */\n", comment];
 			}
+			NSString *escapedString = [string stringByReplacingOccurrencesOfString:@"\"" withString:@"\\\""];
+			NSString *escapedTranslation = [translation stringByReplacingOccurrencesOfString:@"\"" withString:@"\\\""];
+			[result appendFormat:@"\"%@\" = \"%@\";\n\n", escapedString, escapedTranslation];
 		}
-		return result;
 	}
-	else { return nil; }
+	return result;
 }
 
 - (NSUInteger)count {
@@ -218,7 +264,12 @@ static NSString * const kTranslationKey = @"translation";
 }
 
 - (void)setComments:(NSArray *)comments forString:(NSString *)string {
-	[[strings objectForKey:string] setObject:comments forKey:kCommentsKey];
+	NSMutableDictionary *object = [strings objectForKey:string];
+	NSArray *current = [object objectForKey:kCommentsKey];
+	if (object && !(current == comments || [current isEqualToArray:comments])) {
+		[object setObject:comments forKey:kCommentsKey];
+		[changes addObject:string];
+	}
 }
 
 - (NSString *)translationForString:(NSString *)string {
@@ -226,7 +277,50 @@ static NSString * const kTranslationKey = @"translation";
 }
 
 - (void)setTranslation:(NSString *)translation forString:(NSString *)string {
-	[[strings objectForKey:string] setObject:translation forKey:kTranslationKey];
+	NSMutableDictionary *object = [strings objectForKey:string];
+	NSString *current = [object objectForKey:kTranslationKey];
+	if (object && !(current == translation || [current isEqualToString:translation])) {
+		[object setObject:translation forKey:kTranslationKey];
+		[changes addObject:string];
+	}
+}
+
+- (struct FRTranslationStatusMap *)createTranslationStatusMap {
+	NSUInteger count = [order count];
+	FRTranslationStatusMap *map = FRTranslationStatusMapCreate(count);
+	NSMutableData *buffer = [NSMutableData data];
+	
+	for (NSUInteger index = 0; map && index < count; index++) {
+		NSString *string = [order objectAtIndex:index];
+		NSDictionary *object = [strings objectForKey:string];
+		NSString *translation = [object objectForKey:kTranslationKey];
+		NSString *lastComment = [[object objectForKey:kCommentsKey] lastObject];
+		NSUInteger keyLength = [string length];
+		NSUInteger valueLength = [translation length];
+		NSUInteger commentLength = [lastComment length];
+		NSUInteger needed = MAX(keyLength + valueLength, commentLength) * sizeof(FRStringsChar);
+		if ([buffer length] < needed) { [buffer setLength:needed]; }
+		
+		// the marker only matters when the key and value are the same, so the comment is checked last
+		const FRStringsChar *key = FRStringsGetCharacters(string, buffer, 0);
+		const FRStringsChar *value = FRStringsGetCharacters(translation, buffer, keyLength);
+		FRTranslationStatus status = FRTranslationStatusClassify(key, keyLength, value, valueLength, 0);
+		if (status == FRTranslationStatusUntranslated && commentLength) {
+			const FRStringsChar *comment = FRStringsGetCharacters(lastComment, buffer, 0);
+			if (FRTranslationStatusContainsMarker(comment, commentLength)) { status = FRTranslationStatusEqual; }
+		}
+		FRTranslationStatusMapSet(map, index, status);
+	}
+	
+	return map;
+}
+
+- (NSSet *)changedStrings {
+	return [changes copy];
+}
+
+- (void)clearChanges {
+	[changes removeAllObjects];
 }
 
 - (NSEnumerator *)stringsEnumerator {
@@ -238,3 +332,25 @@ static NSString * const kTranslationKey = @"translation";
 }
 
 @end
+
+static BOOL FRStringsMayBePropertyList(NSData *data) {
+	// quoted files start with a comment or an entry, after any byte order mark (the zeros are for UTF-16)
+	const unsigned char *bytes = [data bytes];
+	NSUInteger length = MIN([data length], 64);
+	for (NSUInteger index = 0; index < length; index++) {
+		unsigned char byte = bytes[index];
+		if (byte == '/' || byte == '"') { return FALSE; }
+		if (!(byte == 0 || byte == 0xEF || byte == 0xBB || byte == 0xBF || byte == 0xFE || byte == 0xFF ||
+			  byte == ' ' || byte == '\t' || byte == '\r' || byte == '\n')) { return TRUE; }
+	}
+	return TRUE;
+}
+
+static const FRStringsChar *FRStringsGetCharacters(NSString *string, NSMutableData *buffer, NSUInteger offset) {
+	const FRStringsChar *chars = string ? CFStringGetCharactersPtr((__bridge CFStringRef)string) : NULL;
+	if (!chars) { // the buffer has to be large enough already, growing it would move previous results
+		chars = (FRStringsChar *)[buffer mutableBytes] + offset;
+		[string getCharacters:(unichar *)chars range:NSMakeRange(0, [string length])];
+	}
+	return chars;
+}
@@ -0,0 +1,95 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#import <Foundation/Foundation.h>
+#import "FRStrings.h"
+
+/*!
+ \brief		Edit journal for a strings file
+ \details	Changes to individual entries are appended to a journal that sits next to the strings file
+			rather than rewriting the whole file for every change. Reading the strings file through the
+			journal gives the current contents, and compacting the journal writes those contents back to
+			the strings file and removes the journal. Records are checksummed, so a record that was only
+			partially written (if the application quit while appending) is ignored.
+ */
+@interface FRStringsJournal : NSObject {
+	NSString *path;
+	NSString *journalPath;
+	NSUInteger recordCount;
+}
+
+/*!
+ \brief		Journal path for a strings file
+ \details	Journal path for a strings file
+ */
++ (NSString *)journalPathForStringsFileAtPath:(NSString *)path;
+
+/*!
+ \brief		Read a strings file
+ \details	Reads the strings file at the given path and applies any changes recorded in its journal.
+ */
++ (FRStrings *)stringsWithContentsOfFile:(NSString *)path usedFormat:(FRStringsFormat *)format error:(NSError **)error;
+
+/*!
+ \brief		Create a journal
+ \details	Create a journal for the strings file at the given path. The journal file is not created
+			until changes are appended.
+ */
+- (id)initWithStringsFileAtPath:(NSString *)path;
+
+/*!
+ \brief		Append changes
+ \details	Appends a record for each of the changed strings (see -[FRStrings changedStrings]) with the
+			current translation and comments of the string. The records are flushed to disk before
+			returning. The journal keeps count of its records while appending, so checking the record
+			count afterwards doesn't read the journal again.
+ */
+- (BOOL)appendChanges:(NSSet *)changes inStrings:(FRStrings *)strings error:(NSError **)error;
+
+/*!
+ \brief		Apply the journal
+ \details	Applies the changes recorded in the journal to the given strings, in the order they were
+			recorded. Records for strings that no longer exist are ignored.
+ */
+- (BOOL)applyToStrings:(FRStrings *)strings error:(NSError **)error;
+
+/*!
+ \brief		Compact the journal
+ \details	Writes the strings file with all changes from the journal applied and removes the journal. Does
+			nothing when there is no journal.
+ */
+- (BOOL)compactWithError:(NSError **)error;
+
+/*!
+ \brief		Discard the journal
+ \details	Removes the journal without applying it. Used when the strings file was rewritten with contents
+			that already include the changes.
+ */
+- (BOOL)discardWithError:(NSError **)error;
+
+/*!
+ \brief		Number of records
+ \details	The number of complete records currently in the journal. The journal is only read for this
+			when there hasn't been an append, compaction or discard to keep the count current.
+ */
+- (NSUInteger)recordCount;
+
+@property (readonly) NSString *path;
+@property (readonly) NSString *journalPath;
+
+@end
@@ -0,0 +1,254 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#import "FRStringsJournal.h"
+
+/*
+ * journal layout:
+ *
+ *  magic     4 bytes   'FRJ1'
+ *  records   each one is:
+ *              length    4 bytes   big endian length of the payload
+ *              checksum  4 bytes   big endian FNV-1a hash of the payload
+ *              payload   binary property list with the string, translation and comments
+ *
+ * records are only ever appended. anything following the last record with a valid length and
+ * checksum was interrupted while being written and gets dropped by the next append.
+ */
+
+static const char kJournalMagic[4] = { 'F', 'R', 'J', '1' };
+static const NSUInteger kRecordHeaderLength = 8;
+static NSString * const kStringKey = @"string";
+static NSString * const kCommentsKey = @"comments";
+static NSString * const kTranslationKey = @"translation";
+
+static uint32_t FRJournalChecksum(const uint8_t *bytes, NSUInteger length);
+static NSUInteger FRJournalScan(NSData *data, NSUInteger *count, void (^block)(NSDictionary *record));
+static NSError *FRJournalPOSIXError(void);
+
+@implementation FRStringsJournal
+
+@synthesize path;
+@synthesize journalPath;
+
++ (NSString *)journalPathForStringsFileAtPath:(NSString *)path {
+	return [path stringByAppendingPathExtension:@"journal"];
+}
+
++ (FRStrings *)stringsWithContentsOfFile:(NSString *)path usedFormat:(FRStringsFormat *)format error:(NSError **)error {
+	FRStringsJournal *journal = [[self alloc] initWithStringsFileAtPath:path];
+	FRStrings *strings = [[FRStrings alloc] initWithContentsOfFile:path usedFormat:format error:error];
+	if (strings && ![journal applyToStrings:strings error:error]) { strings = nil; }
+	[strings clearChanges];
+	return strings;
+}
+
+- (id)init {
+	[self doesNotRecognizeSelector:_cmd];
+	return nil;
+}
+
+- (id)initWithStringsFileAtPath:(NSString *)aPath {
+	if ((self = [super init])) {
+		path = [aPath copy];
+		journalPath = [[[self class] journalPathForStringsFileAtPath:path] copy];
+		recordCount = NSNotFound;
+	}
+	return self;
+}
+
+- (BOOL)appendChanges:(NSSet *)changes inStrings:(FRStrings *)strings error:(NSError **)error {
+	error = error ? error : &(NSError * __autoreleasing){ nil };
+	
+	// build all records up front so they go out with a single write
+	NSMutableData *records = [NSMutableData data];
+	NSUInteger appendedCount = 0;
+	for (NSString *string in changes) {
+		NSString *translation = [strings translationForString:string];
+		NSArray *comments = [strings commentsForString:string];
+		if (!translation) { continue; }
+		
+		NSMutableDictionary *record = [NSMutableDictionary dictionary];
+		[record setObject:string forKey:kStringKey];
+		[record setObject:translation forKey:kTranslationKey];
+		if (comments) { [record setObject:comments forKey:kCommentsKey]; }
+		
+		NSData *payload = [NSPropertyListSerialization dataWithPropertyList:record
+																	 format:NSPropertyListBinaryFormat_v1_0
+																	options:0 error:error];
+		if (!payload) { return FALSE; }
+		
+		uint32_t header[2] = {
+			htonl((uint32_t)[payload length]),
+			htonl(FRJournalChecksum([payload bytes], [payload length])),
+		};
+		[records appendBytes:header length:sizeof(header)];
+		[records appendData:payload];
+		appendedCount++;
+	}
+	
+	if (![records length]) { return TRUE; }
+	
+	NSData *existing = [NSData dataWithContentsOfFile:journalPath options:NSDataReadingMappedIfSafe error:NULL];
+	NSUInteger existingCount = 0;
+	NSUInteger validLength = FRJournalScan(existing, &existingCount, nil);
+	if (!validLength) {
+		[records replaceBytesInRange:NSMakeRange(0, 0) withBytes:kJournalMagic length:sizeof(kJournalMagic)];
+	}
+	
+	BOOL success = TRUE;
+	int fd = open([journalPath fileSystemRepresentation], O_WRONLY | O_CREAT, 0644);
+	if (fd < 0) { success = FALSE; }
+	if (success) { success = (ftruncate(fd, validLength) == 0 && lseek(fd, validLength, SEEK_SET) >= 0); }
+	
+	const uint8_t *bytes = [records bytes];
+	NSUInteger remaining = [records length];
+	while (success && remaining) {
+		ssize_t written = write(fd, bytes, remaining);
+		if (written < 0 && errno == EINTR) { continue; }
+		if (written < 0) { success = FALSE; break; }
+		bytes += written;
+		remaining -= written;
+	}
+	
+	if (success) { success = (fsync(fd) == 0); }
+	if (!success) { *error = FRJournalPOSIXError(); }
+	if (fd >= 0) { close(fd); }
+	
+	// the scan above already counted what was in the journal (without decoding any records), so the
+	// count stays current. after a failure it's unknown how much made it to disk.
+	recordCount = success ? existingCount + appendedCount : NSNotFound;
+	
+	return success;
+}
+
+- (BOOL)applyToStrings:(FRStrings *)strings error:(NSError **)error {
+	NSData *data = [NSData dataWithContentsOfFile:journalPath options:NSDataReadingMappedIfSafe error:NULL];
+	FRJournalScan(data, NULL, ^(NSDictionary *record) {
+		NSString *string = [record objectForKey:kStringKey];
+		NSString *translation = [record objectForKey:kTranslationKey];
+		NSArray *comments = [record objectForKey:kCommentsKey];
+		if (translation) { [strings setTranslation:translation forString:string]; }
+		if (comments) { [strings setComments:comments forString:string]; }
+	});
+	return TRUE;
+}
+
+- (BOOL)compactWithError:(NSError **)error {
+	if (![[NSFileManager defaultManager] fileExistsAtPath:journalPath]) { return TRUE; }
+	
+	BOOL success = TRUE;
+	FRStringsFormat format = 0;
+	FRStrings *strings = nil;
+	
+	if (success) {
+		strings = [[FRStrings alloc] initWithContentsOfFile:path usedFormat:&format error:error];
+		if (!strings) { success = FALSE; }
+	}
+	
+	if (success) {
+		success = [self applyToStrings:strings error:error];
+	}
+	
+	// the strings file is replaced atomically before the journal is removed. if anything goes wrong
+	// in between, the journal just gets applied again, which doesn't change anything.
+	if (success && [[strings changedStrings] count]) {
+		success = [strings writeToFile:path format:format error:error];
+	}
+	
+	if (success) {
+		success = [self discardWithError:error];
+	}
+	
+	return success;
+}
+
+- (BOOL)discardWithError:(NSError **)error {
+	if (unlink([journalPath fileSystemRepresentation]) != 0 && errno != ENOENT) {
+		if (error) { *error = FRJournalPOSIXError(); }
+		return FALSE;
+	}
+	recordCount = 0;
+	return TRUE;
+}
+
+- (NSUInteger)recordCount {
+	if (recordCount == NSNotFound) {
+		NSData *data = [NSData dataWithContentsOfFile:journalPath options:NSDataReadingMappedIfSafe error:NULL];
+		recordCount = 0;
+		FRJournalScan(data, &recordCount, nil);
+	}
+	return recordCount;
+}
+
+@end
+
+static uint32_t FRJournalChecksum(const uint8_t *bytes, NSUInteger length) {
+	uint32_t hash = 2166136261u;
+	for (NSUInteger i = 0; i < length; i++) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static NSUInteger FRJournalScan(NSData *data, NSUInteger *count, void (^block)(NSDictionary *record)) {
+	const uint8_t *bytes = [data bytes];
+	NSUInteger length = [data length];
+	NSUInteger location = sizeof(kJournalMagic);
+	NSUInteger records = 0;
+	
+	if (length < sizeof(kJournalMagic) || memcmp(bytes, kJournalMagic, sizeof(kJournalMagic)) != 0) {
+		return 0;
+	}
+	
+	while (length - location >= kRecordHeaderLength) {
+		uint32_t header[2];
+		memcpy(header, bytes + location, sizeof(header));
+		uint32_t payloadLength = ntohl(header[0]);
+		uint32_t checksum = ntohl(header[1]);
+		const uint8_t *payload = bytes + location + kRecordHeaderLength;
+		
+		if (payloadLength > length - location - kRecordHeaderLength) { break; }
+		if (FRJournalChecksum(payload, payloadLength) != checksum) { break; }
+		
+		if (block) {
+			NSData *recordData = [NSData dataWithBytesNoCopy:(void *)payload length:payloadLength freeWhenDone:NO];
+			NSDictionary *record = [NSPropertyListSerialization propertyListWithData:recordData
+																			 options:NSPropertyListImmutable
+																			  format:NULL error:NULL];
+			if (![record isKindOfClass:[NSDictionary class]] ||
+				![[record objectForKey:kStringKey] isKindOfClass:[NSString class]]) { break; }
+			block(record);
+		}
+		
+		location += kRecordHeaderLength + payloadLength;
+		records++;
+	}
+	
+	if (count) { *count = records; }
+	return location;
+}
+
+static NSError *FRJournalPOSIXError(void) {
+	return [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+}
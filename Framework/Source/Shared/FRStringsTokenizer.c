@@ -0,0 +1,298 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <stdlib.h>
+#include <string.h>
+
+#import "FRStringsTokenizer.h"
+#import "FRTranslationStatus.h"
+
+static const size_t kInitialBufferCapacity = 16 * 1024;
+
+struct FRStringsLexer {
+	FRStringsLine *lines;
+	size_t count;
+	size_t capacity;
+	uint32_t generation;
+	FRStringsChar *buffer;
+	size_t bufferCapacity;
+	size_t bufferLocation;
+	size_t bufferLength;
+};
+
+static int FRStringsTokenizeEntry(const FRStringsChar *chars, size_t length, FRStringsLine *line);
+static int FRStringsLinesReserve(FRStringsLine **lines, size_t *capacity, size_t needed);
+static const FRStringsChar *FRStringsLexerRead(FRStringsLexer *lexer, FRStringsCharacterProvider provider, void *info,
+											   size_t location, size_t length, size_t *available);
+
+
+#pragma mark -
+#pragma mark tokenizing
+// ----------------------------------------------------------------------------------------------------
+// tokenizing
+// ----------------------------------------------------------------------------------------------------
+
+FRStringsLexState FRStringsTokenizeLine(const FRStringsChar *chars, size_t length, FRStringsLexState state,
+										FRStringsLine *line) {
+	FRStringsLexState next = FRStringsLexStateInitial;
+	size_t end = 0;
+	while (end < length && chars[end] != '\n') { end++; }
+	
+	size_t content = end;
+	if (content && chars[content - 1] == '\r') { content--; }
+	
+	line->length = (uint32_t)((end < length) ? end + 1 : end);
+	line->contentLength = (uint32_t)content;
+	line->keyLocation = 0;
+	line->keyLength = 0;
+	line->valueLocation = 0;
+	line->valueLength = 0;
+	line->generation = 0;
+	line->flags = 0;
+	line->state = state;
+	
+	if (content == 0) {
+		// blank lines don't separate comments from the entry that follows them
+		line->kind = FRStringsLineBlank;
+		next = state;
+	}
+	else if (content >= 4 && // needs at least: /**/
+			 chars[0] == '/' && chars[1] == '*' && chars[content - 2] == '*' && chars[content - 1] == '/') {
+		line->kind = FRStringsLineComment;
+		line->keyLocation = 2;
+		line->keyLength = (uint32_t)(content - 4);
+		next = FRStringsLexStateComment;
+		if (FRTranslationStatusContainsMarker(chars + line->keyLocation, line->keyLength)) {
+			line->flags |= FRStringsLineFlagMarker;
+			next |= FRStringsLexStateMarker;
+		}
+	}
+	else if (FRStringsTokenizeEntry(chars, content, line)) {
+		line->kind = FRStringsLineEntry;
+		FRTranslationStatus status =
+			FRTranslationStatusClassify(chars + line->keyLocation, line->keyLength,
+										chars + line->valueLocation, line->valueLength,
+										(state & FRStringsLexStateMarker) != 0);
+		if (status != FRTranslationStatusUntranslated) {
+			line->flags |= FRStringsLineFlagTranslated;
+		}
+	}
+	else {
+		line->kind = FRStringsLineUnknown;
+	}
+	
+	return next;
+}
+
+static int FRStringsTokenizeEntry(const FRStringsChar *chars, size_t length, FRStringsLine *line) {
+	int terminated = (length && chars[length - 1] == ';');
+	size_t end = terminated ? length - 1 : length;
+	
+	// needs at least: "" = ""
+	if (end < 7 || chars[0] != '"' || chars[end - 1] != '"') { return 0; }
+	
+	// find the first unescaped quote that is followed by the separator. the value needs to
+	// start before the closing quote.
+	for (size_t i = 1; i + 5 < end; i++) {
+		if (chars[i] == '\\') { i++; }
+		else if (chars[i] == '"' &&
+				 chars[i + 1] == ' ' && chars[i + 2] == '=' && chars[i + 3] == ' ' && chars[i + 4] == '"') {
+			line->keyLocation = 1;
+			line->keyLength = (uint32_t)(i - 1);
+			line->valueLocation = (uint32_t)(i + 5);
+			line->valueLength = (uint32_t)(end - 1 - (i + 5));
+			if (terminated) { line->flags |= FRStringsLineFlagTerminated; }
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+#pragma mark -
+#pragma mark incremental lexing
+// ----------------------------------------------------------------------------------------------------
+// incremental lexing
+// ----------------------------------------------------------------------------------------------------
+
+FRStringsLexer *FRStringsLexerCreate(void) {
+	FRStringsLexer *lexer = calloc(1, sizeof(FRStringsLexer));
+	if (lexer && FRStringsLinesReserve(&lexer->lines, &lexer->capacity, 64)) {
+		// an empty document still has a single empty line
+		memset(&lexer->lines[0], 0, sizeof(FRStringsLine));
+		lexer->lines[0].kind = FRStringsLineBlank;
+		lexer->count = 1;
+	}
+	else {
+		FRStringsLexerFree(lexer);
+		lexer = NULL;
+	}
+	return lexer;
+}
+
+void FRStringsLexerFree(FRStringsLexer *lexer) {
+	if (lexer) {
+		free(lexer->lines);
+		free(lexer->buffer);
+		free(lexer);
+	}
+}
+
+uint32_t FRStringsLexerGeneration(const FRStringsLexer *lexer) {
+	return lexer->generation;
+}
+
+size_t FRStringsLexerLineCount(const FRStringsLexer *lexer) {
+	return lexer->count;
+}
+
+const FRStringsLine *FRStringsLexerLineAtIndex(const FRStringsLexer *lexer, size_t index) {
+	return (index < lexer->count) ? &lexer->lines[index] : NULL;
+}
+
+size_t FRStringsLexerLineIndexForLocation(const FRStringsLexer *lexer, size_t location) {
+	size_t low = 0;
+	size_t high = lexer->count;
+	while (high - low > 1) {
+		size_t middle = low + (high - low) / 2;
+		if (lexer->lines[middle].location <= location) { low = middle; }
+		else { high = middle; }
+	}
+	return low;
+}
+
+size_t FRStringsLexerEdit(FRStringsLexer *lexer, FRStringsCharacterProvider provider, void *info, size_t length,
+						  size_t location, size_t oldLength, size_t newLength, size_t *outCount) {
+	
+	size_t first = FRStringsLexerLineIndexForLocation(lexer, location);
+	size_t last = FRStringsLexerLineIndexForLocation(lexer, location + oldLength);
+	size_t retained = last + 1;
+	size_t editEnd = location + newLength;
+	size_t position = lexer->lines[first].location;
+	FRStringsLexState state = lexer->lines[first].state;
+	
+	// lines after the edit keep their tokens, but move to their new locations
+	for (size_t i = retained; i < lexer->count; i++) {
+		lexer->lines[i].location = lexer->lines[i].location + newLength - oldLength;
+	}
+	
+	// the document changed, so nothing that was read before is still valid
+	lexer->bufferLength = 0;
+	lexer->generation++;
+	
+	FRStringsLine *scratch = NULL;
+	size_t scratchCount = 0;
+	size_t scratchCapacity = 0;
+	
+	for (;;) {
+		// once past the edit, stop as soon as a retained line starts where we are with the same state
+		if (position >= editEnd && retained < lexer->count &&
+			lexer->lines[retained].location == position && lexer->lines[retained].state == state) {
+			break;
+		}
+		
+		size_t available = 0;
+		const FRStringsChar *chars = FRStringsLexerRead(lexer, provider, info, position, length, &available);
+		if (!FRStringsLinesReserve(&scratch, &scratchCapacity, scratchCount + 1)) { break; }
+		
+		FRStringsLine *line = &scratch[scratchCount++];
+		line->location = position;
+		state = FRStringsTokenizeLine(chars, available, state, line);
+		line->generation = lexer->generation;
+		position += line->length;
+		
+		// drop any retained lines that the newly tokenized line now covers
+		while (retained < lexer->count && lexer->lines[retained].location < position) { retained++; }
+		
+		// the last line is the only one not ending in a line break
+		if (line->length == 0 || chars[line->length - 1] != '\n') {
+			retained = lexer->count;
+			break;
+		}
+	}
+	
+	// splice the newly tokenized lines in place of the ones they replace
+	size_t removed = retained - first;
+	size_t count = lexer->count - removed + scratchCount;
+	if (FRStringsLinesReserve(&lexer->lines, &lexer->capacity, count)) {
+		memmove(&lexer->lines[first + scratchCount], &lexer->lines[retained],
+				(lexer->count - retained) * sizeof(FRStringsLine));
+		memcpy(&lexer->lines[first], scratch, scratchCount * sizeof(FRStringsLine));
+		lexer->count = count;
+	}
+	else { scratchCount = 0; }
+	free(scratch);
+	
+	if (outCount) { *outCount = scratchCount; }
+	return first;
+}
+
+static int FRStringsLinesReserve(FRStringsLine **lines, size_t *capacity, size_t needed) {
+	if (needed <= *capacity) { return 1; }
+	size_t grown = *capacity ? *capacity : 16;
+	while (grown < needed) { grown *= 2; }
+	FRStringsLine *reallocated = realloc(*lines, grown * sizeof(FRStringsLine));
+	if (!reallocated) { return 0; }
+	*lines = reallocated;
+	*capacity = grown;
+	return 1;
+}
+
+static const FRStringsChar *FRStringsLexerRead(FRStringsLexer *lexer, FRStringsCharacterProvider provider, void *info,
+											   size_t location, size_t length, size_t *available) {
+	
+	// reuse what is already buffered as long as it contains the whole line
+	if (location >= lexer->bufferLocation && location < lexer->bufferLocation + lexer->bufferLength) {
+		size_t offset = location - lexer->bufferLocation;
+		size_t remaining = lexer->bufferLength - offset;
+		const FRStringsChar *chars = lexer->buffer + offset;
+		int complete = (lexer->bufferLocation + lexer->bufferLength == length);
+		for (size_t i = 0; !complete && i < remaining; i++) {
+			if (chars[i] == '\n') { complete = 1; }
+		}
+		if (complete) {
+			*available = remaining;
+			return chars;
+		}
+	}
+	
+	// fill the buffer from the location until it contains a line break or the end of the document
+	size_t capacity = lexer->bufferCapacity ? lexer->bufferCapacity : kInitialBufferCapacity;
+	for (;;) {
+		if (capacity > lexer->bufferCapacity) {
+			FRStringsChar *reallocated = realloc(lexer->buffer, capacity * sizeof(FRStringsChar));
+			if (!reallocated) { break; }
+			lexer->buffer = reallocated;
+			lexer->bufferCapacity = capacity;
+		}
+		size_t fill = length - location;
+		if (fill > lexer->bufferCapacity) { fill = lexer->bufferCapacity; }
+		if (fill) { provider(info, location, fill, lexer->buffer); }
+		lexer->bufferLocation = location;
+		lexer->bufferLength = fill;
+		
+		int found = (location + fill == length);
+		for (size_t i = 0; !found && i < fill; i++) {
+			if (lexer->buffer[i] == '\n') { found = 1; }
+		}
+		if (found) { break; }
+		capacity *= 2;
+	}
+	
+	*available = lexer->bufferLength;
+	return lexer->buffer;
+}
@@ -0,0 +1,144 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ \brief		Characters used by the tokenizer
+ \details	Characters are UTF-16 code units so that the tokenizer can work directly on the contents of
+			an NSString without any conversion.
+ */
+typedef uint16_t FRStringsChar;
+
+enum {
+	FRStringsLineBlank,
+	FRStringsLineComment,
+	FRStringsLineEntry,
+	FRStringsLineUnknown,
+};
+typedef uint8_t FRStringsLineKind;
+
+enum {
+	FRStringsLineFlagMarker = 1 << 0,		// comment contains ==, so the following entry is considered translated
+	FRStringsLineFlagTranslated = 1 << 1,	// entry translation differs from its key or is marked as translated
+	FRStringsLineFlagTerminated = 1 << 2,	// entry ends with a semicolon
+};
+typedef uint8_t FRStringsLineFlags;
+
+/*!
+ \brief		Lexer state
+ \details	The state carried from the end of one line to the start of the next one. Two lines with the
+			same contents and the same incoming state always lex to the same token.
+ */
+enum {
+	FRStringsLexStateInitial = 0,
+	FRStringsLexStateComment = 1 << 0,		// the previous line was a comment (blank lines in between are skipped)
+	FRStringsLexStateMarker = 1 << 1,		// the previous comment contained ==
+};
+typedef uint8_t FRStringsLexState;
+
+/*!
+ \brief		A single tokenized line
+ \details	All locations are relative to the start of the line. For comments, the key range holds the
+			comment body (without the comment delimiters). For entries, the key and value ranges exclude
+			the surrounding quotes and are still escaped.
+ */
+typedef struct FRStringsLine {
+	size_t location;
+	uint32_t length;			// length including the line break
+	uint32_t contentLength;		// length excluding the line break
+	uint32_t keyLocation;
+	uint32_t keyLength;
+	uint32_t valueLocation;
+	uint32_t valueLength;
+	uint32_t generation;		// lexer generation in which the line was last tokenized
+	FRStringsLineKind kind;
+	FRStringsLineFlags flags;
+	FRStringsLexState state;	// state at the start of the line
+} FRStringsLine;
+
+/*!
+ \brief		Tokenize a line
+ \details	Tokenizes the line that starts at the given characters. The length is the length of all
+			remaining characters; the line ends at the first line feed (which is included in the line) or
+			at the end of the characters. Returns the state for the start of the next line.
+ */
+FRStringsLexState FRStringsTokenizeLine(const FRStringsChar *chars, size_t length, FRStringsLexState state,
+										FRStringsLine *line);
+
+/*!
+ \brief		Incremental lexer
+ \details	Caches tokenized lines for a document so that edits only need to tokenize the lines that
+			changed. Lines that follow an edit are only tokenized again when the state flowing into them
+			changed.
+ */
+typedef struct FRStringsLexer FRStringsLexer;
+
+/*!
+ \brief		Character provider
+ \details	Called by the lexer to copy the characters in a range of the document into a buffer.
+ */
+typedef void (*FRStringsCharacterProvider)(void *info, size_t location, size_t length, FRStringsChar *buffer);
+
+/*!
+ \brief		Create a lexer
+ \details	The lexer starts out describing an empty document.
+ */
+FRStringsLexer *FRStringsLexerCreate(void);
+
+/*!
+ \brief		Free a lexer
+ \details	Free a lexer
+ */
+void FRStringsLexerFree(FRStringsLexer *lexer);
+
+/*!
+ \brief		Update the lexer for an edit
+ \details	The edit replaced oldLength characters at location with newLength characters, leaving the
+			document with a total of length characters. Tokenizes the lines affected by the edit and
+			returns the index of the first changed line. The number of changed lines is returned through
+			count.
+ */
+size_t FRStringsLexerEdit(FRStringsLexer *lexer, FRStringsCharacterProvider provider, void *info, size_t length,
+						  size_t location, size_t oldLength, size_t newLength, size_t *count);
+
+/*!
+ \brief		Current generation
+ \details	The generation increases with every edit. Lines tokenized during an edit are stamped with the
+			generation of that edit, so comparing against a previously recorded generation tells which
+			lines changed since then.
+ */
+uint32_t FRStringsLexerGeneration(const FRStringsLexer *lexer);
+
+/*!
+ \brief		Number of lines
+ \details	Number of lines
+ */
+size_t FRStringsLexerLineCount(const FRStringsLexer *lexer);
+
+/*!
+ \brief		Line at index
+ \details	The returned line is owned by the lexer and is only valid until the next edit.
+ */
+const FRStringsLine *FRStringsLexerLineAtIndex(const FRStringsLexer *lexer, size_t index);
+
+/*!
+ \brief		Line index for a location
+ \details	Line index for a location
+ */
+size_t FRStringsLexerLineIndexForLocation(const FRStringsLexer *lexer, size_t location);
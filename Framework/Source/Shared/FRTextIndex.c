@@ -0,0 +1,339 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#import "FRTextIndex.h"
+
+// items are indexed as if they started with this character so that prefix queries can be answered
+// from the index as well. it's a noncharacter, so it can't appear in well formed text.
+static const FRStringsChar kStartCharacter = 0xFFFF;
+static const size_t kGramLength = 3;
+
+typedef struct FRTextIndexStoredItem {
+	size_t location;
+	uint32_t length;
+	uint32_t entry;
+	FRTextIndexField field;
+} FRTextIndexStoredItem;
+
+typedef struct FRTextIndexPosting {
+	uint64_t gram;
+	uint32_t item;
+} FRTextIndexPosting;
+
+struct FRTextIndexSegment {
+	uint32_t document;
+	FRTextIndexStoredItem *items;
+	size_t itemCount;
+	FRStringsChar *text;
+	FRTextIndexPosting *postings;
+	size_t postingCount;
+};
+
+struct FRTextIndex {
+	FRTextIndexSegment **segments;		// sorted by document
+	size_t count;
+	size_t capacity;
+};
+
+static uint64_t FRTextIndexGram(FRStringsChar a, FRStringsChar b, FRStringsChar c);
+static int FRTextIndexComparePostings(const void *a, const void *b);
+static size_t FRTextIndexQueryGrams(const FRStringsChar *query, size_t length, FRTextIndexMatchMode mode,
+									uint64_t *grams);
+static size_t FRTextIndexSegmentFind(const FRTextIndex *index, uint32_t document, int *found);
+static size_t FRTextIndexSegmentSearch(const FRTextIndexSegment *segment, const FRStringsChar *query, size_t length,
+									   FRTextIndexMatchMode mode, const uint64_t *grams, size_t gramCount,
+									   FRTextIndexMatch *matches, size_t capacity);
+static int FRTextIndexItemMatches(const FRTextIndexSegment *segment, const FRTextIndexStoredItem *item,
+								  const FRStringsChar *query, size_t length, FRTextIndexMatchMode mode);
+
+
+#pragma mark -
+#pragma mark segments
+// ----------------------------------------------------------------------------------------------------
+// segments
+// ----------------------------------------------------------------------------------------------------
+
+FRTextIndexSegment *FRTextIndexSegmentCreate(uint32_t document, const FRTextIndexItem *items, size_t count) {
+	FRTextIndexSegment *segment = calloc(1, sizeof(FRTextIndexSegment));
+	size_t textLength = 0;
+	size_t gramCount = 0;
+	
+	for (size_t index = 0; index < count; index++) {
+		textLength += items[index].length;
+		gramCount += (items[index].length + 1 >= kGramLength) ? items[index].length + 1 - (kGramLength - 1) : 0;
+	}
+	
+	if (segment) {
+		segment->document = document;
+		segment->items = malloc((count ? count : 1) * sizeof(FRTextIndexStoredItem));
+		segment->text = malloc((textLength ? textLength : 1) * sizeof(FRStringsChar));
+		segment->postings = malloc((gramCount ? gramCount : 1) * sizeof(FRTextIndexPosting));
+		if (!segment->items || !segment->text || !segment->postings) {
+			FRTextIndexSegmentFree(segment);
+			segment = NULL;
+		}
+	}
+	
+	if (segment) {
+		size_t location = 0;
+		size_t postingCount = 0;
+		for (size_t index = 0; index < count; index++) {
+			const FRTextIndexItem *item = &items[index];
+			FRTextIndexStoredItem *stored = &segment->items[index];
+			stored->location = location;
+			stored->length = (uint32_t)item->length;
+			stored->entry = item->entry;
+			stored->field = item->field;
+			memcpy(segment->text + location, item->chars, item->length * sizeof(FRStringsChar));
+			location += item->length;
+			
+			// the first gram includes the start character, the rest are plain trigrams of the text
+			const FRStringsChar *chars = item->chars;
+			if (item->length >= kGramLength - 1) {
+				segment->postings[postingCount++] =
+					(FRTextIndexPosting){ FRTextIndexGram(kStartCharacter, chars[0], chars[1]), (uint32_t)index };
+			}
+			for (size_t offset = 0; offset + kGramLength <= item->length; offset++) {
+				segment->postings[postingCount++] =
+					(FRTextIndexPosting){ FRTextIndexGram(chars[offset], chars[offset + 1], chars[offset + 2]),
+										  (uint32_t)index };
+			}
+		}
+		segment->itemCount = count;
+		
+		// sort by gram and then item, dropping grams that occur more than once in the same item
+		qsort(segment->postings, postingCount, sizeof(FRTextIndexPosting), FRTextIndexComparePostings);
+		size_t unique = 0;
+		for (size_t index = 0; index < postingCount; index++) {
+			if (!unique ||
+				segment->postings[unique - 1].gram != segment->postings[index].gram ||
+				segment->postings[unique - 1].item != segment->postings[index].item) {
+				segment->postings[unique++] = segment->postings[index];
+			}
+		}
+		segment->postingCount = unique;
+	}
+	
+	return segment;
+}
+
+void FRTextIndexSegmentFree(FRTextIndexSegment *segment) {
+	if (segment) {
+		free(segment->items);
+		free(segment->text);
+		free(segment->postings);
+		free(segment);
+	}
+}
+
+
+#pragma mark -
+#pragma mark index
+// ----------------------------------------------------------------------------------------------------
+// index
+// ----------------------------------------------------------------------------------------------------
+
+FRTextIndex *FRTextIndexCreate(void) {
+	return calloc(1, sizeof(FRTextIndex));
+}
+
+void FRTextIndexFree(FRTextIndex *index) {
+	if (index) {
+		for (size_t position = 0; position < index->count; position++) {
+			FRTextIndexSegmentFree(index->segments[position]);
+		}
+		free(index->segments);
+		free(index);
+	}
+}
+
+int FRTextIndexAddSegment(FRTextIndex *index, FRTextIndexSegment *segment) {
+	int found = 0;
+	size_t position = FRTextIndexSegmentFind(index, segment->document, &found);
+	
+	if (found) {
+		FRTextIndexSegmentFree(index->segments[position]);
+		index->segments[position] = segment;
+		return 1;
+	}
+	
+	if (index->count == index->capacity) {
+		size_t capacity = index->capacity ? index->capacity * 2 : 16;
+		FRTextIndexSegment **segments = realloc(index->segments, capacity * sizeof(FRTextIndexSegment *));
+		if (!segments) {
+			FRTextIndexSegmentFree(segment);
+			return 0;
+		}
+		index->segments = segments;
+		index->capacity = capacity;
+	}
+	
+	memmove(index->segments + position + 1, index->segments + position,
+			(index->count - position) * sizeof(FRTextIndexSegment *));
+	index->segments[position] = segment;
+	index->count++;
+	return 1;
+}
+
+void FRTextIndexRemoveDocument(FRTextIndex *index, uint32_t document) {
+	int found = 0;
+	size_t position = FRTextIndexSegmentFind(index, document, &found);
+	if (found) {
+		FRTextIndexSegmentFree(index->segments[position]);
+		memmove(index->segments + position, index->segments + position + 1,
+				(index->count - position - 1) * sizeof(FRTextIndexSegment *));
+		index->count--;
+	}
+}
+
+size_t FRTextIndexDocumentCount(const FRTextIndex *index) {
+	return index->count;
+}
+
+size_t FRTextIndexSearch(const FRTextIndex *index, const FRStringsChar *query, size_t length,
+						 FRTextIndexMatchMode mode, FRTextIndexMatch *matches, size_t capacity) {
+	if (!length || !capacity) { return 0; }
+	
+	uint64_t *grams = malloc((length + 1) * sizeof(uint64_t));
+	if (!grams) { return 0; }
+	
+	size_t gramCount = FRTextIndexQueryGrams(query, length, mode, grams);
+	size_t count = 0;
+	for (size_t position = 0; position < index->count && count < capacity; position++) {
+		count += FRTextIndexSegmentSearch(index->segments[position], query, length, mode, grams, gramCount,
+										  matches + count, capacity - count);
+	}
+	
+	free(grams);
+	return count;
+}
+
+
+#pragma mark -
+#pragma mark helpers
+// ----------------------------------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------------------------------
+
+static uint64_t FRTextIndexGram(FRStringsChar a, FRStringsChar b, FRStringsChar c) {
+	return ((uint64_t)a << 32) | ((uint64_t)b << 16) | (uint64_t)c;
+}
+
+static int FRTextIndexComparePostings(const void *a, const void *b) {
+	const FRTextIndexPosting *lhs = a;
+	const FRTextIndexPosting *rhs = b;
+	if (lhs->gram != rhs->gram) { return (lhs->gram < rhs->gram) ? -1 : 1; }
+	if (lhs->item != rhs->item) { return (lhs->item < rhs->item) ? -1 : 1; }
+	return 0;
+}
+
+static size_t FRTextIndexQueryGrams(const FRStringsChar *query, size_t length, FRTextIndexMatchMode mode,
+									uint64_t *grams) {
+	size_t count = 0;
+	if (mode == FRTextIndexMatchPrefix && length >= kGramLength - 1) {
+		grams[count++] = FRTextIndexGram(kStartCharacter, query[0], query[1]);
+	}
+	for (size_t offset = 0; offset + kGramLength <= length; offset++) {
+		grams[count++] = FRTextIndexGram(query[offset], query[offset + 1], query[offset + 2]);
+	}
+	return count;
+}
+
+static size_t FRTextIndexSegmentFind(const FRTextIndex *index, uint32_t document, int *found) {
+	size_t low = 0;
+	size_t high = index->count;
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		uint32_t current = index->segments[middle]->document;
+		if (current == document) { *found = 1; return middle; }
+		else if (current < document) { low = middle + 1; }
+		else { high = middle; }
+	}
+	*found = 0;
+	return low;
+}
+
+static size_t FRTextIndexPostingsLowerBound(const FRTextIndexSegment *segment, uint64_t gram) {
+	size_t low = 0;
+	size_t high = segment->postingCount;
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		if (segment->postings[middle].gram < gram) { low = middle + 1; }
+		else { high = middle; }
+	}
+	return low;
+}
+
+static size_t FRTextIndexSegmentSearch(const FRTextIndexSegment *segment, const FRStringsChar *query, size_t length,
+									   FRTextIndexMatchMode mode, const uint64_t *grams, size_t gramCount,
+									   FRTextIndexMatch *matches, size_t capacity) {
+	size_t count = 0;
+	
+	// queries that are too short to have any grams just check every item
+	if (!gramCount) {
+		for (size_t index = 0; index < segment->itemCount && count < capacity; index++) {
+			const FRTextIndexStoredItem *item = &segment->items[index];
+			if (FRTextIndexItemMatches(segment, item, query, length, mode)) {
+				matches[count++] = (FRTextIndexMatch){ segment->document, item->entry, item->field };
+			}
+		}
+		return count;
+	}
+	
+	// every match has to contain all of the grams, so only the items listed for the rarest gram need
+	// to be checked
+	size_t start = 0;
+	size_t end = 0;
+	for (size_t index = 0; index < gramCount; index++) {
+		size_t lower = FRTextIndexPostingsLowerBound(segment, grams[index]);
+		size_t upper = lower;
+		while (upper < segment->postingCount && segment->postings[upper].gram == grams[index]) { upper++; }
+		if (upper == lower) { return 0; }
+		if (index == 0 || upper - lower < end - start) {
+			start = lower;
+			end = upper;
+		}
+	}
+	
+	for (size_t position = start; position < end && count < capacity; position++) {
+		const FRTextIndexStoredItem *item = &segment->items[segment->postings[position].item];
+		if (FRTextIndexItemMatches(segment, item, query, length, mode)) {
+			matches[count++] = (FRTextIndexMatch){ segment->document, item->entry, item->field };
+		}
+	}
+	
+	return count;
+}
+
+static int FRTextIndexItemMatches(const FRTextIndexSegment *segment, const FRTextIndexStoredItem *item,
+								  const FRStringsChar *query, size_t length, FRTextIndexMatchMode mode) {
+	const FRStringsChar *text = segment->text + item->location;
+	if (length > item->length) { return 0; }
+	if (mode == FRTextIndexMatchPrefix) {
+		return memcmp(text, query, length * sizeof(FRStringsChar)) == 0;
+	}
+	for (size_t offset = 0; offset + length <= item->length; offset++) {
+		if (text[offset] == query[0] && memcmp(text + offset, query, length * sizeof(FRStringsChar)) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,137 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FRStringsTokenizer.h"
+
+/*!
+ \brief		Indexed fields
+ \details	The part of a strings file entry that an indexed item came from.
+ */
+enum {
+	FRTextIndexFieldKey,
+	FRTextIndexFieldTranslation,
+	FRTextIndexFieldComment,
+};
+typedef uint8_t FRTextIndexField;
+
+/*!
+ \brief		Match modes
+ \details	Substring matches find the query anywhere in an item, prefix matches only at its start.
+ */
+enum {
+	FRTextIndexMatchSubstring,
+	FRTextIndexMatchPrefix,
+};
+typedef uint8_t FRTextIndexMatchMode;
+
+/*!
+ \brief		An item to index
+ \details	The characters are copied when a segment is created. Matching compares characters exactly, so
+			callers that want case insensitive searches should fold both the items and the queries.
+ */
+typedef struct FRTextIndexItem {
+	const FRStringsChar *chars;
+	size_t length;
+	uint32_t entry;				// caller defined, usually the index of the entry in its file
+	FRTextIndexField field;
+} FRTextIndexItem;
+
+/*!
+ \brief		A search match
+ \details	A search match
+ */
+typedef struct FRTextIndexMatch {
+	uint32_t document;
+	uint32_t entry;
+	FRTextIndexField field;
+} FRTextIndexMatch;
+
+/*!
+ \brief		Index segment
+ \details	The indexed items of a single document (usually one strings file) along with a sorted trigram
+			posting list for them. Segments are independent of each other and of the index, so they can be
+			created concurrently and then added to the index. Updating a document just means creating a
+			new segment for it.
+ */
+typedef struct FRTextIndexSegment FRTextIndexSegment;
+
+/*!
+ \brief		Text index
+ \details	An n-gram (trigram) inverted index over a set of segments. Queries first narrow down the
+			candidates using the trigrams of the query and then verify each candidate, so results are
+			exact. The index is not synchronized; searching is safe from multiple threads as long as
+			nothing modifies the index at the same time.
+ */
+typedef struct FRTextIndex FRTextIndex;
+
+/*!
+ \brief		Create a segment
+ \details	Create a segment for a document from the given items. Returns NULL if memory couldn't be
+			allocated.
+ */
+FRTextIndexSegment *FRTextIndexSegmentCreate(uint32_t document, const FRTextIndexItem *items, size_t count);
+
+/*!
+ \brief		Free a segment
+ \details	Only needed for segments that were never added to an index.
+ */
+void FRTextIndexSegmentFree(FRTextIndexSegment *segment);
+
+/*!
+ \brief		Create an index
+ \details	The index starts out empty.
+ */
+FRTextIndex *FRTextIndexCreate(void);
+
+/*!
+ \brief		Free an index
+ \details	Frees the index along with all of its segments.
+ */
+void FRTextIndexFree(FRTextIndex *index);
+
+/*!
+ \brief		Add a segment
+ \details	The index takes ownership of the segment, replacing (and freeing) any segment that was already
+			in the index for the same document. Returns 0 if memory couldn't be allocated, in which case
+			the segment is freed.
+ */
+int FRTextIndexAddSegment(FRTextIndex *index, FRTextIndexSegment *segment);
+
+/*!
+ \brief		Remove a document
+ \details	Remove a document
+ */
+void FRTextIndexRemoveDocument(FRTextIndex *index, uint32_t document);
+
+/*!
+ \brief		Number of documents
+ \details	Number of documents
+ */
+size_t FRTextIndexDocumentCount(const FRTextIndex *index);
+
+/*!
+ \brief		Search the index
+ \details	Finds the items that contain the query (or start with it, depending on the mode). Up to
+			capacity matches are stored in matches, ordered by document and then by the order the items
+			were given in. Returns the number of matches stored. An empty query matches nothing.
+ */
+size_t FRTextIndexSearch(const FRTextIndex *index, const FRStringsChar *query, size_t length,
+						 FRTextIndexMatchMode mode, FRTextIndexMatch *matches, size_t capacity);
@@ -0,0 +1,738 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#import "FRTranslationMemory.h"
+
+// strings are indexed as if they were surrounded by these characters so that every character is part
+// of three grams, even at the ends. both are noncharacters, so they can't appear in well formed text.
+static const FRStringsChar kStartCharacter = 0xFFFE;
+static const FRStringsChar kEndCharacter = 0xFFFF;
+static const uint64_t kOccupiedGram = (uint64_t)1 << 63;
+static const size_t kWordBits = 64;
+static const uint32_t kCommonGramCount = 1024;		// grams in fewer entries than this are always counted
+static const size_t kCommonGramRatio = 16;			// grams in more than 1/16 of the entries are common
+static const size_t kSuggestionDistanceRatio = 4;	// suggestions can be up to a quarter of the query's length away
+static const uint32_t kSuggestionDistanceLimit = 4;	// but never more than this many edits
+enum { kHistogramBuckets = 16 };					// characters are counted in this many buckets
+
+typedef struct FRTranslationMemoryEntry {
+	size_t sourceLocation;
+	size_t translationLocation;
+	uint32_t sourceLength;
+	uint32_t translationLength;
+	uint32_t language;
+	uint8_t removed;
+} FRTranslationMemoryEntry;
+
+typedef struct FRTranslationMemoryHistogram {
+	uint8_t counts[kHistogramBuckets];		// clamped character counts, by character modulo the bucket count
+} FRTranslationMemoryHistogram;
+
+typedef struct FRTranslationMemoryPostings {
+	uint32_t *entries;
+	uint32_t count;
+	uint32_t capacity;
+} FRTranslationMemoryPostings;
+
+typedef struct FRTranslationMemoryPartition {
+	uint32_t language;
+	uint64_t *grams;						// open addressed hash table, kOccupiedGram marks used slots
+	FRTranslationMemoryPostings *postings;	// parallel to grams
+	size_t gramCount;
+	size_t gramCapacity;
+	uint32_t *members;						// every entry in the partition, for queries without grams
+	size_t memberCount;
+	size_t memberCapacity;
+} FRTranslationMemoryPartition;
+
+struct FRTranslationMemory {
+	FRTranslationMemoryEntry *entries;
+	size_t count;
+	size_t capacity;
+	size_t removedCount;
+	uint16_t *lengths;						// source lengths (clamped) apart from the entries to check them quickly
+	size_t lengthsCapacity;
+	FRTranslationMemoryHistogram *histograms;	// source histograms, also apart from the entries
+	size_t histogramsCapacity;
+	FRStringsChar *text;
+	size_t textLength;
+	size_t textCapacity;
+	FRTranslationMemoryPartition *partitions;
+	size_t partitionCount;
+};
+
+/*!
+ \brief		Pattern for the bit-parallel edit distance
+ \details	Match masks for each character of a pattern of up to 64 characters. ASCII characters are
+			looked up directly, everything else is searched for in a short list.
+ */
+typedef struct FRTranslationMemoryPattern {
+	uint64_t ascii[128];
+	FRStringsChar others[64];
+	uint64_t otherMasks[64];
+	size_t otherCount;
+	size_t length;
+} FRTranslationMemoryPattern;
+
+typedef struct FRTranslationMemorySearchState {
+	const FRTranslationMemory *memory;
+	const FRStringsChar *query;
+	size_t length;
+	uint32_t maximum;						// lowered to the worst match once there are enough matches
+	int usePattern;
+	FRTranslationMemoryPattern pattern;
+	FRTranslationMemoryHistogram histogram;
+	FRTranslationMemoryMatch *matches;		// max heap of the best matches so far
+	size_t count;
+	size_t capacity;
+} FRTranslationMemorySearchState;
+
+static size_t FRTranslationMemoryGrams(const FRStringsChar *chars, size_t length, uint64_t *grams);
+static int FRTranslationMemoryReserve(void **buffer, size_t *capacity, size_t needed, size_t size);
+static FRTranslationMemoryPartition *FRTranslationMemoryPartitionForLanguage(const FRTranslationMemory *memory,
+																			  uint32_t language);
+static FRTranslationMemoryPostings *FRTranslationMemoryPostingsForGram(const FRTranslationMemoryPartition *partition,
+																		uint64_t gram);
+static int FRTranslationMemoryPartitionAdd(FRTranslationMemoryPartition *partition, uint32_t entry,
+										   const uint64_t *grams, size_t count);
+static void FRTranslationMemoryHistogramInit(FRTranslationMemoryHistogram *histogram, const FRStringsChar *chars,
+											 size_t length);
+static uint32_t FRTranslationMemoryHistogramDistance(const FRTranslationMemoryHistogram *a,
+													 const FRTranslationMemoryHistogram *b);
+static void FRTranslationMemoryPatternInit(FRTranslationMemoryPattern *pattern, const FRStringsChar *chars,
+										   size_t length);
+static uint32_t FRTranslationMemoryPatternDistance(const FRTranslationMemoryPattern *pattern,
+												   const FRStringsChar *text, size_t length, uint32_t maximum);
+static void FRTranslationMemoryCheckCandidate(FRTranslationMemorySearchState *state, uint32_t entry);
+static uint32_t FRTranslationMemoryBandedDistance(const FRStringsChar *a, size_t aLength,
+												  const FRStringsChar *b, size_t bLength, uint32_t maximum);
+static int FRTranslationMemoryComparePostings(const void *a, const void *b);
+static int FRTranslationMemoryCompareMatches(const void *a, const void *b);
+static int FRTranslationMemoryCompareGrams(const void *a, const void *b);
+
+
+#pragma mark -
+#pragma mark memory
+// ----------------------------------------------------------------------------------------------------
+// memory
+// ----------------------------------------------------------------------------------------------------
+
+FRTranslationMemory *FRTranslationMemoryCreate(void) {
+	return calloc(1, sizeof(FRTranslationMemory));
+}
+
+void FRTranslationMemoryFree(FRTranslationMemory *memory) {
+	if (memory) {
+		for (size_t position = 0; position < memory->partitionCount; position++) {
+			FRTranslationMemoryPartition *partition = &memory->partitions[position];
+			for (size_t slot = 0; slot < partition->gramCapacity; slot++) {
+				free(partition->postings[slot].entries);
+			}
+			free(partition->grams);
+			free(partition->postings);
+			free(partition->members);
+		}
+		free(memory->partitions);
+		free(memory->entries);
+		free(memory->lengths);
+		free(memory->histograms);
+		free(memory->text);
+		free(memory);
+	}
+}
+
+uint32_t FRTranslationMemoryAdd(FRTranslationMemory *memory, uint32_t language,
+								const FRStringsChar *source, size_t sourceLength,
+								const FRStringsChar *translation, size_t translationLength) {
+	FRTranslationMemoryPartition *partition = FRTranslationMemoryPartitionForLanguage(memory, language);
+	if (!partition) {
+		FRTranslationMemoryPartition *partitions =
+			realloc(memory->partitions, (memory->partitionCount + 1) * sizeof(FRTranslationMemoryPartition));
+		if (!partitions) { return UINT32_MAX; }
+		memory->partitions = partitions;
+		partition = &memory->partitions[memory->partitionCount++];
+		memset(partition, 0, sizeof(FRTranslationMemoryPartition));
+		partition->language = language;
+	}
+	
+	if (memory->count >= UINT32_MAX - 1 || sourceLength > UINT32_MAX || translationLength > UINT32_MAX ||
+		!FRTranslationMemoryReserve((void **)&memory->entries, &memory->capacity, memory->count + 1,
+									sizeof(FRTranslationMemoryEntry)) ||
+		!FRTranslationMemoryReserve((void **)&memory->lengths, &memory->lengthsCapacity, memory->count + 1,
+									sizeof(uint16_t)) ||
+		!FRTranslationMemoryReserve((void **)&memory->histograms, &memory->histogramsCapacity, memory->count + 1,
+									sizeof(FRTranslationMemoryHistogram)) ||
+		!FRTranslationMemoryReserve((void **)&memory->text, &memory->textCapacity,
+									memory->textLength + sourceLength + translationLength, sizeof(FRStringsChar))) {
+		return UINT32_MAX;
+	}
+	
+	uint64_t *grams = malloc((sourceLength ? sourceLength : 1) * sizeof(uint64_t));
+	if (!grams) { return UINT32_MAX; }
+	size_t gramCount = FRTranslationMemoryGrams(source, sourceLength, grams);
+	
+	uint32_t entry = (uint32_t)memory->count;
+	if (!FRTranslationMemoryPartitionAdd(partition, entry, grams, gramCount)) {
+		free(grams);
+		return UINT32_MAX;
+	}
+	free(grams);
+	
+	FRTranslationMemoryEntry *stored = &memory->entries[memory->count++];
+	stored->sourceLocation = memory->textLength;
+	stored->sourceLength = (uint32_t)sourceLength;
+	memcpy(memory->text + memory->textLength, source, sourceLength * sizeof(FRStringsChar));
+	memory->textLength += sourceLength;
+	stored->translationLocation = memory->textLength;
+	stored->translationLength = (uint32_t)translationLength;
+	memcpy(memory->text + memory->textLength, translation, translationLength * sizeof(FRStringsChar));
+	memory->textLength += translationLength;
+	stored->language = language;
+	stored->removed = 0;
+	memory->lengths[entry] = (sourceLength < UINT16_MAX) ? (uint16_t)sourceLength : UINT16_MAX;
+	FRTranslationMemoryHistogramInit(&memory->histograms[entry], source, sourceLength);
+	
+	return entry;
+}
+
+void FRTranslationMemoryRemove(FRTranslationMemory *memory, uint32_t entry) {
+	if (entry < memory->count && !memory->entries[entry].removed) {
+		memory->entries[entry].removed = 1;
+		memory->removedCount++;
+	}
+}
+
+int FRTranslationMemoryNeedsCompaction(const FRTranslationMemory *memory) {
+	return memory->removedCount && memory->removedCount * 2 >= memory->count;
+}
+
+int FRTranslationMemoryCompact(FRTranslationMemory *memory, uint32_t *entries) {
+	// the remaining entries are added to a new memory in their current order, which packs the text and
+	// drops the removed entries from every posting list. the memory only changes once that has worked.
+	FRTranslationMemory *compacted = FRTranslationMemoryCreate();
+	if (!compacted) { return 0; }
+	for (size_t entry = 0; entry < memory->count; entry++) {
+		const FRTranslationMemoryEntry *stored = &memory->entries[entry];
+		uint32_t moved = UINT32_MAX;
+		if (!stored->removed) {
+			moved = FRTranslationMemoryAdd(compacted, stored->language,
+										   memory->text + stored->sourceLocation, stored->sourceLength,
+										   memory->text + stored->translationLocation, stored->translationLength);
+			if (moved == UINT32_MAX) {
+				FRTranslationMemoryFree(compacted);
+				return 0;
+			}
+		}
+		if (entries) { entries[entry] = moved; }
+	}
+	
+	FRTranslationMemory replaced = *memory;
+	*memory = *compacted;
+	*compacted = replaced;
+	FRTranslationMemoryFree(compacted);
+	return 1;
+}
+
+size_t FRTranslationMemoryCount(const FRTranslationMemory *memory) {
+	return memory->count;
+}
+
+const FRStringsChar *FRTranslationMemorySource(const FRTranslationMemory *memory, uint32_t entry, size_t *length) {
+	*length = memory->entries[entry].sourceLength;
+	return memory->text + memory->entries[entry].sourceLocation;
+}
+
+const FRStringsChar *FRTranslationMemoryTranslation(const FRTranslationMemory *memory, uint32_t entry,
+													 size_t *length) {
+	*length = memory->entries[entry].translationLength;
+	return memory->text + memory->entries[entry].translationLocation;
+}
+
+size_t FRTranslationMemorySearch(const FRTranslationMemory *memory, uint32_t language,
+								 const FRStringsChar *query, size_t length, uint32_t maximumDistance,
+								 FRTranslationMemoryMatch *matches, size_t capacity) {
+	const FRTranslationMemoryPartition *partition = FRTranslationMemoryPartitionForLanguage(memory, language);
+	if (!partition || !capacity) { return 0; }
+	
+	FRTranslationMemorySearchState state = {
+		.memory = memory,
+		.query = query,
+		.length = length,
+		.maximum = maximumDistance,
+		.usePattern = (length <= kWordBits),
+		.matches = matches,
+		.capacity = capacity,
+	};
+	uint64_t *grams = malloc((length ? length : 1) * sizeof(uint64_t));
+	const FRTranslationMemoryPostings **lists = malloc((length ? length : 1) * sizeof(FRTranslationMemoryPostings *));
+	uint8_t *shared = calloc(memory->count ? memory->count : 1, sizeof(uint8_t));
+	uint32_t *candidates = NULL;
+	uint32_t *ordered = NULL;
+	size_t candidateCount = 0;
+	size_t candidateCapacity = 0;
+	size_t buckets[UINT8_MAX + 2] = {};
+	int success = (grams && lists && shared);
+	size_t gramCount = 0;
+	size_t listCount = 0;
+	size_t counted = 0;
+	
+	if (success) {
+		if (state.usePattern) { FRTranslationMemoryPatternInit(&state.pattern, query, length); }
+		FRTranslationMemoryHistogramInit(&state.histogram, query, length);
+		
+		// grams that no entry has are kept out of the lists, rarest grams first
+		gramCount = FRTranslationMemoryGrams(query, length, grams);
+		for (size_t index = 0; index < gramCount; index++) {
+			const FRTranslationMemoryPostings *postings = FRTranslationMemoryPostingsForGram(partition, grams[index]);
+			if (postings) { lists[listCount++] = postings; }
+		}
+		qsort(lists, listCount, sizeof(FRTranslationMemoryPostings *), FRTranslationMemoryComparePostings);
+		
+		// any string within k edits of the query has all but at most 3k of the query's grams. grams that
+		// no entry has are already known to be missing, and the grams that most entries have cost the
+		// most to count while saying the least, so those are left out as long as a match still has to
+		// share at least one of the grams that are counted.
+		size_t missing = gramCount - listCount;
+		size_t required = 3 * (size_t)maximumDistance + 1;
+		counted = listCount;
+		while (counted > 0 && counted - 1 + missing >= required &&
+			   lists[counted - 1]->count >= kCommonGramCount &&
+			   lists[counted - 1]->count * kCommonGramRatio >= partition->memberCount) {
+			counted--;
+		}
+		
+		// entries whose length alone puts them too far away aren't counted, which keeps them out of the
+		// candidates without having to look at the entries themselves
+		for (size_t list = 0; list < counted; list++) {
+			for (uint32_t position = 0; position < lists[list]->count; position++) {
+				uint32_t entry = lists[list]->entries[position];
+				size_t entryLength = memory->lengths[entry];
+				if (entryLength != UINT16_MAX &&
+					(entryLength + maximumDistance < length || entryLength > length + maximumDistance)) { continue; }
+				if (shared[entry] < UINT8_MAX) { shared[entry]++; }
+			}
+		}
+		counted += missing;
+		
+		// the entries with enough grams in common are collected in order, which reads their histograms
+		// front to back. the characters they have over the query (or the other way around) rule out most
+		// of them without reading their text.
+		int64_t needed = (int64_t)counted - 3 * (int64_t)maximumDistance;
+		for (uint32_t entry = 0; entry < memory->count; entry++) {
+			if (!shared[entry] || (shared[entry] < UINT8_MAX && shared[entry] < needed)) { continue; }
+			if (FRTranslationMemoryHistogramDistance(&memory->histograms[entry], &state.histogram) > maximumDistance) {
+				continue;
+			}
+			if (!FRTranslationMemoryReserve((void **)&candidates, &candidateCapacity, candidateCount + 1,
+											sizeof(uint32_t))) { success = 0; break; }
+			candidates[candidateCount++] = entry;
+		}
+	}
+	
+	if (success) {
+		ordered = malloc((candidateCount ? candidateCount : 1) * sizeof(uint32_t));
+		success = (ordered != NULL);
+	}
+	
+	if (success) {
+		// check the entries with the most grams in common first. once there are enough matches to fill
+		// the results, k drops to the worst of them, which raises the number of grams an entry needs.
+		for (size_t position = 0; position < candidateCount; position++) { buckets[shared[candidates[position]]]++; }
+		for (size_t count = UINT8_MAX, offset = 0; count > 0; count--) {
+			size_t size = buckets[count];
+			buckets[count] = offset;
+			offset += size;
+		}
+		for (size_t position = 0; position < candidateCount; position++) {
+			ordered[buckets[shared[candidates[position]]]++] = candidates[position];
+		}
+		
+		for (size_t position = 0; position < candidateCount; position++) {
+			uint32_t entry = ordered[position];
+			int64_t needed = (int64_t)counted - 3 * (int64_t)state.maximum;
+			if (shared[entry] < UINT8_MAX && shared[entry] < needed) { break; }
+			FRTranslationMemoryCheckCandidate(&state, entry);
+		}
+		
+		// entries without any counted grams are only close enough for very short queries
+		if ((int64_t)counted - 3 * (int64_t)state.maximum <= 0) {
+			for (size_t position = 0; position < partition->memberCount; position++) {
+				if (!shared[partition->members[position]]) {
+					FRTranslationMemoryCheckCandidate(&state, partition->members[position]);
+				}
+			}
+		}
+	}
+	
+	qsort(matches, state.count, sizeof(FRTranslationMemoryMatch), FRTranslationMemoryCompareMatches);
+	
+	free(grams);
+	free(lists);
+	free(shared);
+	free(candidates);
+	free(ordered);
+	return state.count;
+}
+
+uint32_t FRTranslationMemorySuggestionDistance(size_t length) {
+	size_t distance = length / kSuggestionDistanceRatio;
+	return (distance < kSuggestionDistanceLimit) ? (uint32_t)distance : kSuggestionDistanceLimit;
+}
+
+uint32_t FRTranslationMemoryDistance(const FRStringsChar *a, size_t aLength, const FRStringsChar *b, size_t bLength,
+									 uint32_t maximumDistance) {
+	if (aLength > bLength) {
+		const FRStringsChar *swap = a; a = b; b = swap;
+		size_t swapLength = aLength; aLength = bLength; bLength = swapLength;
+	}
+	if (bLength - aLength > maximumDistance) { return maximumDistance + 1; }
+	if (aLength <= kWordBits) {
+		FRTranslationMemoryPattern pattern;
+		FRTranslationMemoryPatternInit(&pattern, a, aLength);
+		return FRTranslationMemoryPatternDistance(&pattern, b, bLength, maximumDistance);
+	}
+	return FRTranslationMemoryBandedDistance(a, aLength, b, bLength, maximumDistance);
+}
+
+
+static void FRTranslationMemoryCheckCandidate(FRTranslationMemorySearchState *state, uint32_t entry) {
+	const FRTranslationMemoryEntry *stored = &state->memory->entries[entry];
+	size_t difference = (stored->sourceLength > state->length) ?
+		stored->sourceLength - state->length : state->length - stored->sourceLength;
+	if (stored->removed || difference > state->maximum) { return; }
+	
+	const FRStringsChar *source = state->memory->text + stored->sourceLocation;
+	uint32_t distance = state->usePattern ?
+		FRTranslationMemoryPatternDistance(&state->pattern, source, stored->sourceLength, state->maximum) :
+		FRTranslationMemoryBandedDistance(state->query, state->length, source, stored->sourceLength,
+										  state->maximum);
+	if (distance > state->maximum) { return; }
+	
+	FRTranslationMemoryMatch match = { entry, distance };
+	FRTranslationMemoryMatch *heap = state->matches;
+	size_t position = 0;
+	if (state->count < state->capacity) {
+		// sift up
+		position = state->count++;
+		while (position && FRTranslationMemoryCompareMatches(&heap[(position - 1) / 2], &match) < 0) {
+			heap[position] = heap[(position - 1) / 2];
+			position = (position - 1) / 2;
+		}
+		heap[position] = match;
+	}
+	else if (FRTranslationMemoryCompareMatches(&match, &heap[0]) < 0) {
+		// replace the worst match and sift down
+		for (;;) {
+			size_t child = position * 2 + 1;
+			if (child >= state->count) { break; }
+			if (child + 1 < state->count && FRTranslationMemoryCompareMatches(&heap[child + 1], &heap[child]) > 0) {
+				child++;
+			}
+			if (FRTranslationMemoryCompareMatches(&heap[child], &match) <= 0) { break; }
+			heap[position] = heap[child];
+			position = child;
+		}
+		heap[position] = match;
+	}
+	
+	if (state->count == state->capacity) {
+		state->maximum = heap[0].distance;
+	}
+}
+
+
+#pragma mark -
+#pragma mark partitions
+// ----------------------------------------------------------------------------------------------------
+// partitions
+// ----------------------------------------------------------------------------------------------------
+
+static FRTranslationMemoryPartition *FRTranslationMemoryPartitionForLanguage(const FRTranslationMemory *memory,
+																			  uint32_t language) {
+	for (size_t position = 0; position < memory->partitionCount; position++) {
+		if (memory->partitions[position].language == language) { return &memory->partitions[position]; }
+	}
+	return NULL;
+}
+
+static size_t FRTranslationMemorySlot(uint64_t gram, size_t capacity) {
+	uint64_t hash = gram * 0x9E3779B97F4A7C15ull;
+	return (size_t)(hash >> 32) & (capacity - 1);
+}
+
+static FRTranslationMemoryPostings *FRTranslationMemoryPostingsForGram(const FRTranslationMemoryPartition *partition,
+																		uint64_t gram) {
+	if (!partition->gramCapacity) { return NULL; }
+	size_t slot = FRTranslationMemorySlot(gram, partition->gramCapacity);
+	while (partition->grams[slot]) {
+		if (partition->grams[slot] == (gram | kOccupiedGram)) { return &partition->postings[slot]; }
+		slot = (slot + 1) & (partition->gramCapacity - 1);
+	}
+	return NULL;
+}
+
+static int FRTranslationMemoryPartitionGrow(FRTranslationMemoryPartition *partition) {
+	size_t capacity = partition->gramCapacity ? partition->gramCapacity * 2 : 1024;
+	uint64_t *grams = calloc(capacity, sizeof(uint64_t));
+	FRTranslationMemoryPostings *postings = calloc(capacity, sizeof(FRTranslationMemoryPostings));
+	if (!grams || !postings) {
+		free(grams);
+		free(postings);
+		return 0;
+	}
+	
+	for (size_t slot = 0; slot < partition->gramCapacity; slot++) {
+		if (partition->grams[slot]) {
+			size_t moved = FRTranslationMemorySlot(partition->grams[slot] & ~kOccupiedGram, capacity);
+			while (grams[moved]) { moved = (moved + 1) & (capacity - 1); }
+			grams[moved] = partition->grams[slot];
+			postings[moved] = partition->postings[slot];
+		}
+	}
+	
+	free(partition->grams);
+	free(partition->postings);
+	partition->grams = grams;
+	partition->postings = postings;
+	partition->gramCapacity = capacity;
+	return 1;
+}
+
+static int FRTranslationMemoryPartitionAdd(FRTranslationMemoryPartition *partition, uint32_t entry,
+										   const uint64_t *grams, size_t count) {
+	if (!FRTranslationMemoryReserve((void **)&partition->members, &partition->memberCapacity,
+									partition->memberCount + 1, sizeof(uint32_t))) { return 0; }
+	
+	for (size_t index = 0; index < count; index++) {
+		if ((partition->gramCount + 1) * 4 > partition->gramCapacity * 3) {
+			if (!FRTranslationMemoryPartitionGrow(partition)) { return 0; }
+		}
+		
+		size_t slot = FRTranslationMemorySlot(grams[index], partition->gramCapacity);
+		while (partition->grams[slot] && partition->grams[slot] != (grams[index] | kOccupiedGram)) {
+			slot = (slot + 1) & (partition->gramCapacity - 1);
+		}
+		if (!partition->grams[slot]) {
+			partition->grams[slot] = grams[index] | kOccupiedGram;
+			partition->gramCount++;
+		}
+		
+		// entries are added in increasing order, so posting lists stay sorted
+		FRTranslationMemoryPostings *postings = &partition->postings[slot];
+		size_t postingsCapacity = postings->capacity;
+		if (!FRTranslationMemoryReserve((void **)&postings->entries, &postingsCapacity, postings->count + 1,
+										sizeof(uint32_t))) { return 0; }
+		postings->capacity = (uint32_t)postingsCapacity;
+		postings->entries[postings->count++] = entry;
+	}
+	
+	partition->members[partition->memberCount++] = entry;
+	return 1;
+}
+
+
+#pragma mark -
+#pragma mark edit distance
+// ----------------------------------------------------------------------------------------------------
+// edit distance
+// ----------------------------------------------------------------------------------------------------
+
+static void FRTranslationMemoryHistogramInit(FRTranslationMemoryHistogram *histogram, const FRStringsChar *chars,
+											 size_t length) {
+	memset(histogram, 0, sizeof(FRTranslationMemoryHistogram));
+	for (size_t index = 0; index < length; index++) {
+		uint8_t *count = &histogram->counts[chars[index] % kHistogramBuckets];
+		if (*count < UINT8_MAX) { (*count)++; }
+	}
+}
+
+static uint32_t FRTranslationMemoryHistogramDistance(const FRTranslationMemoryHistogram *a,
+													 const FRTranslationMemoryHistogram *b) {
+	// an edit adds at most one character to a bucket and takes at most one away from another one (and
+	// clamping the counts can only make them closer), so the characters either string has over the other
+	// are a lower bound of the edit distance. the loop is simple enough to be vectorized.
+	uint32_t more = 0;
+	uint32_t fewer = 0;
+	for (size_t bucket = 0; bucket < kHistogramBuckets; bucket++) {
+		uint8_t lhs = a->counts[bucket];
+		uint8_t rhs = b->counts[bucket];
+		more += (lhs > rhs) ? lhs - rhs : 0;
+		fewer += (rhs > lhs) ? rhs - lhs : 0;
+	}
+	return (more > fewer) ? more : fewer;
+}
+
+static void FRTranslationMemoryPatternInit(FRTranslationMemoryPattern *pattern, const FRStringsChar *chars,
+										   size_t length) {
+	memset(pattern->ascii, 0, sizeof(pattern->ascii));
+	pattern->otherCount = 0;
+	pattern->length = length;
+	for (size_t index = 0; index < length; index++) {
+		uint64_t bit = (uint64_t)1 << index;
+		if (chars[index] < 128) {
+			pattern->ascii[chars[index]] |= bit;
+		}
+		else {
+			size_t other = 0;
+			while (other < pattern->otherCount && pattern->others[other] != chars[index]) { other++; }
+			if (other == pattern->otherCount) {
+				pattern->others[pattern->otherCount] = chars[index];
+				pattern->otherMasks[pattern->otherCount++] = 0;
+			}
+			pattern->otherMasks[other] |= bit;
+		}
+	}
+}
+
+static uint64_t FRTranslationMemoryPatternMask(const FRTranslationMemoryPattern *pattern, FRStringsChar c) {
+	if (c < 128) { return pattern->ascii[c]; }
+	for (size_t other = 0; other < pattern->otherCount; other++) {
+		if (pattern->others[other] == c) { return pattern->otherMasks[other]; }
+	}
+	return 0;
+}
+
+static uint32_t FRTranslationMemoryPatternDistance(const FRTranslationMemoryPattern *pattern,
+												   const FRStringsChar *text, size_t length, uint32_t maximum) {
+	// Myers' bit-parallel algorithm (in Hyyrö's formulation for global distance) computes a whole
+	// column of the dynamic programming matrix at once using the bits of a word. score tracks the
+	// last row, which can drop by at most one for each remaining character of the text.
+	size_t m = pattern->length;
+	if (!m) { return (uint32_t)((length <= maximum) ? length : maximum + 1); }
+	
+	uint64_t mask = (m == kWordBits) ? ~(uint64_t)0 : (((uint64_t)1 << m) - 1);
+	uint64_t last = (uint64_t)1 << (m - 1);
+	uint64_t pv = mask;
+	uint64_t mv = 0;
+	size_t score = m;
+	
+	for (size_t index = 0; index < length; index++) {
+		uint64_t eq = FRTranslationMemoryPatternMask(pattern, text[index]);
+		uint64_t xv = eq | mv;
+		uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+		uint64_t ph = mv | ~(xh | pv);
+		uint64_t mh = pv & xh;
+		if (ph & last) { score++; }
+		else if (mh & last) { score--; }
+		ph = (ph << 1) | 1;
+		mh = mh << 1;
+		pv = (mh | ~(xv | ph)) & mask;
+		mv = ph & xv & mask;
+		
+		if (score > maximum + (length - index - 1)) { return maximum + 1; }
+	}
+	
+	return (uint32_t)((score <= maximum) ? score : maximum + 1);
+}
+
+static uint32_t FRTranslationMemoryBandedDistance(const FRStringsChar *a, size_t aLength,
+												  const FRStringsChar *b, size_t bLength, uint32_t maximum) {
+	// only cells within maximum of the diagonal can lead to a distance within maximum, so everything
+	// else is treated as being over the limit
+	uint32_t limit = maximum + 1;
+	uint32_t *row = malloc((bLength + 2) * sizeof(uint32_t));
+	uint32_t distance = limit;
+	if (!row) { return limit; }
+	
+	for (size_t column = 0; column <= bLength; column++) {
+		row[column] = (column <= maximum) ? (uint32_t)column : limit;
+	}
+	
+	for (size_t line = 1; line <= aLength; line++) {
+		size_t first = (line > maximum) ? line - maximum : 1;
+		size_t end = (line + maximum < bLength) ? line + maximum : bLength;
+		uint32_t diagonal = row[first - 1];
+		row[first - 1] = (first == 1 && line <= maximum) ? (uint32_t)line : limit;
+		uint32_t best = row[first - 1];
+		
+		for (size_t column = first; column <= end; column++) {
+			uint32_t above = row[column];
+			uint32_t value = diagonal + (a[line - 1] != b[column - 1]);
+			if (above + 1 < value) { value = above + 1; }
+			if (row[column - 1] + 1 < value) { value = row[column - 1] + 1; }
+			if (value > limit) { value = limit; }
+			diagonal = above;
+			row[column] = value;
+			if (value < best) { best = value; }
+		}
+		if (end < bLength) { row[end + 1] = limit; }
+		if (best >= limit) { free(row); return limit; }
+	}
+	
+	distance = row[bLength];
+	free(row);
+	return (distance <= maximum) ? distance : limit;
+}
+
+
+#pragma mark -
+#pragma mark helpers
+// ----------------------------------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------------------------------
+
+static size_t FRTranslationMemoryGrams(const FRStringsChar *chars, size_t length, uint64_t *grams) {
+	for (size_t index = 0; index < length; index++) {
+		uint64_t a = index ? chars[index - 1] : kStartCharacter;
+		uint64_t b = chars[index];
+		uint64_t c = (index + 1 < length) ? chars[index + 1] : kEndCharacter;
+		grams[index] = (a << 32) | (b << 16) | c;
+	}
+	
+	// only distinct grams count
+	qsort(grams, length, sizeof(uint64_t), FRTranslationMemoryCompareGrams);
+	size_t unique = 0;
+	for (size_t index = 0; index < length; index++) {
+		if (!unique || grams[unique - 1] != grams[index]) { grams[unique++] = grams[index]; }
+	}
+	return unique;
+}
+
+static int FRTranslationMemoryReserve(void **buffer, size_t *capacity, size_t needed, size_t size) {
+	if (needed <= *capacity) { return 1; }
+	size_t grown = *capacity ? *capacity : 16;
+	while (grown < needed) { grown *= 2; }
+	void *reallocated = realloc(*buffer, grown * size);
+	if (!reallocated) { return 0; }
+	*buffer = reallocated;
+	*capacity = grown;
+	return 1;
+}
+
+static int FRTranslationMemoryComparePostings(const void *a, const void *b) {
+	const FRTranslationMemoryPostings *lhs = *(const FRTranslationMemoryPostings * const *)a;
+	const FRTranslationMemoryPostings *rhs = *(const FRTranslationMemoryPostings * const *)b;
+	return (lhs->count < rhs->count) ? -1 : (lhs->count > rhs->count) ? 1 : 0;
+}
+
+static int FRTranslationMemoryCompareMatches(const void *a, const void *b) {
+	const FRTranslationMemoryMatch *lhs = a;
+	const FRTranslationMemoryMatch *rhs = b;
+	if (lhs->distance != rhs->distance) { return (lhs->distance < rhs->distance) ? -1 : 1; }
+	if (lhs->entry != rhs->entry) { return (lhs->entry < rhs->entry) ? -1 : 1; }
+	return 0;
+}
+
+static int FRTranslationMemoryCompareGrams(const void *a, const void *b) {
+	uint64_t lhs = *(const uint64_t *)a;
+	uint64_t rhs = *(const uint64_t *)b;
+	return (lhs < rhs) ? -1 : (lhs > rhs) ? 1 : 0;
+}
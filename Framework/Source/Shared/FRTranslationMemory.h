@@ -0,0 +1,134 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FRStringsTokenizer.h"
+
+/*!
+ \brief		Translation memory
+ \details	Stores pairs of source strings and their translations, partitioned by language, and finds the
+			pairs whose source is closest to a query by edit distance. Candidates are found with a trigram
+			index (any string within edit distance k of the query shares all but at most 3k of its
+			trigrams), skipping entries whose length alone differs by more than k or whose character counts
+			differ by more than k, and then ranked with a bit-parallel bounded edit distance.
+			
+			The memory is not synchronized; searching is safe from multiple threads as long as nothing
+			modifies the memory at the same time.
+ */
+typedef struct FRTranslationMemory FRTranslationMemory;
+
+/*!
+ \brief		A search result
+ \details	A search result
+ */
+typedef struct FRTranslationMemoryMatch {
+	uint32_t entry;
+	uint32_t distance;
+} FRTranslationMemoryMatch;
+
+/*!
+ \brief		Create a translation memory
+ \details	The memory starts out empty.
+ */
+FRTranslationMemory *FRTranslationMemoryCreate(void);
+
+/*!
+ \brief		Free a translation memory
+ \details	Free a translation memory
+ */
+void FRTranslationMemoryFree(FRTranslationMemory *memory);
+
+/*!
+ \brief		Add a pair
+ \details	Adds a source string and its translation for a language (an identifier chosen by the caller).
+			The characters are copied. Returns the identifier of the new entry (entries are numbered in the
+			order they're added, starting at zero), or UINT32_MAX if memory couldn't be allocated.
+ */
+uint32_t FRTranslationMemoryAdd(FRTranslationMemory *memory, uint32_t language,
+								const FRStringsChar *source, size_t sourceLength,
+								const FRStringsChar *translation, size_t translationLength);
+
+/*!
+ \brief		Remove a pair
+ \details	The entry is no longer returned from searches. Its identifier is not reused until the memory is
+			compacted, and its characters are kept until then as well.
+ */
+void FRTranslationMemoryRemove(FRTranslationMemory *memory, uint32_t entry);
+
+/*!
+ \brief		Whether the memory should be compacted
+ \details	True once at least half of the entries have been removed.
+ */
+int FRTranslationMemoryNeedsCompaction(const FRTranslationMemory *memory);
+
+/*!
+ \brief		Compact the memory
+ \details	Drops the removed entries and their characters and renumbers the remaining entries, which keep
+			their order. If entries isn't NULL, it has to have room for the count of entries before
+			compacting, and the new identifier of each entry (or UINT32_MAX for removed ones) is stored at
+			its old one. Returns zero and leaves the memory as it was if memory couldn't be allocated.
+ */
+int FRTranslationMemoryCompact(FRTranslationMemory *memory, uint32_t *entries);
+
+/*!
+ \brief		Number of entries
+ \details	Number of entries that have been added, including removed ones that haven't been compacted away.
+ */
+size_t FRTranslationMemoryCount(const FRTranslationMemory *memory);
+
+/*!
+ \brief		Source of an entry
+ \details	Returns the source characters of an entry and stores their count in length.
+ */
+const FRStringsChar *FRTranslationMemorySource(const FRTranslationMemory *memory, uint32_t entry, size_t *length);
+
+/*!
+ \brief		Translation of an entry
+ \details	Returns the translation characters of an entry and stores their count in length.
+ */
+const FRStringsChar *FRTranslationMemoryTranslation(const FRTranslationMemory *memory, uint32_t entry,
+													 size_t *length);
+
+/*!
+ \brief		Find the closest entries
+ \details	Finds entries for the language whose source is within maximumDistance edits (insertions,
+			deletions and substitutions) of the query. Up to capacity matches are stored in matches,
+			closest first (ties are ordered by entry). Returns the number of matches stored.
+ */
+size_t FRTranslationMemorySearch(const FRTranslationMemory *memory, uint32_t language,
+								 const FRStringsChar *query, size_t length, uint32_t maximumDistance,
+								 FRTranslationMemoryMatch *matches, size_t capacity);
+
+/*!
+ \brief		Suggestion distance
+ \details	The largest edit distance at which an entry is still worth suggesting for a query of the given
+			length: a quarter of the length, but no more than four edits. That covers a typo or two and
+			small changes like a plural or punctuation in strings of any length. Allowing more edits in long
+			strings makes their searches weed out far fewer entries, which doesn't fit the query budget.
+ */
+uint32_t FRTranslationMemorySuggestionDistance(size_t length);
+
+/*!
+ \brief		Edit distance
+ \details	The edit distance between two strings if it's at most maximumDistance, otherwise some value
+			greater than maximumDistance.
+ */
+uint32_t FRTranslationMemoryDistance(const FRStringsChar *a, size_t aLength, const FRStringsChar *b, size_t bLength,
+									 uint32_t maximumDistance);
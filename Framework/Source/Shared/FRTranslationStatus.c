@@ -0,0 +1,168 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#import "FRTranslationStatus.h"
+
+static const size_t kWordBits = 64;
+
+struct FRTranslationStatusMap {
+	size_t count;
+	uint64_t *translated;
+	uint64_t *equal;
+};
+
+
+#pragma mark -
+#pragma mark classifying
+// ----------------------------------------------------------------------------------------------------
+// classifying
+// ----------------------------------------------------------------------------------------------------
+
+int FRTranslationStatusCharsEqual(const FRStringsChar *a, const FRStringsChar *b, size_t length) {
+	size_t index = 0;
+	
+#if defined(__SSE2__)
+	for (; index + 8 <= length; index += 8) {
+		__m128i left = _mm_loadu_si128((const __m128i *)(a + index));
+		__m128i right = _mm_loadu_si128((const __m128i *)(b + index));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(left, right)) != 0xFFFF) { return 0; }
+	}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	for (; index + 8 <= length; index += 8) {
+		uint8x8_t same = vmovn_u16(vceqq_u16(vld1q_u16(a + index), vld1q_u16(b + index)));
+		if (vget_lane_u64(vreinterpret_u64_u8(same), 0) != UINT64_MAX) { return 0; }
+	}
+#endif
+	
+	// word at a time for what's left (or everything without vector registers)
+	for (; index + 4 <= length; index += 4) {
+		uint64_t left, right;
+		memcpy(&left, a + index, sizeof(left));
+		memcpy(&right, b + index, sizeof(right));
+		if (left != right) { return 0; }
+	}
+	for (; index < length; index++) {
+		if (a[index] != b[index]) { return 0; }
+	}
+	return 1;
+}
+
+int FRTranslationStatusContainsMarker(const FRStringsChar *chars, size_t length) {
+	size_t index = 0;
+	
+#if defined(__SSE2__)
+	__m128i marker = _mm_set1_epi16('=');
+	for (; index + 9 <= length; index += 8) {
+		__m128i current = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(chars + index)), marker);
+		__m128i next = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(chars + index + 1)), marker);
+		if (_mm_movemask_epi8(_mm_and_si128(current, next))) { return 1; }
+	}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	uint16x8_t marker = vdupq_n_u16('=');
+	for (; index + 9 <= length; index += 8) {
+		uint16x8_t current = vceqq_u16(vld1q_u16(chars + index), marker);
+		uint16x8_t next = vceqq_u16(vld1q_u16(chars + index + 1), marker);
+		uint8x8_t found = vmovn_u16(vandq_u16(current, next));
+		if (vget_lane_u64(vreinterpret_u64_u8(found), 0)) { return 1; }
+	}
+#endif
+	
+	for (; index + 1 < length; index++) {
+		if (chars[index] == '=' && chars[index + 1] == '=') { return 1; }
+	}
+	return 0;
+}
+
+FRTranslationStatus FRTranslationStatusClassify(const FRStringsChar *key, size_t keyLength,
+												const FRStringsChar *value, size_t valueLength, int marked) {
+	if (keyLength != valueLength || !FRTranslationStatusCharsEqual(key, value, keyLength)) {
+		return FRTranslationStatusTranslated;
+	}
+	return marked ? FRTranslationStatusEqual : FRTranslationStatusUntranslated;
+}
+
+
+#pragma mark -
+#pragma mark bitmaps
+// ----------------------------------------------------------------------------------------------------
+// bitmaps
+// ----------------------------------------------------------------------------------------------------
+
+FRTranslationStatusMap *FRTranslationStatusMapCreate(size_t count) {
+	size_t words = (count + kWordBits - 1) / kWordBits;
+	FRTranslationStatusMap *map = calloc(1, sizeof(FRTranslationStatusMap));
+	if (map) {
+		map->count = count;
+		map->translated = calloc(words ? words : 1, sizeof(uint64_t));
+		map->equal = calloc(words ? words : 1, sizeof(uint64_t));
+		if (!map->translated || !map->equal) {
+			FRTranslationStatusMapFree(map);
+			map = NULL;
+		}
+	}
+	return map;
+}
+
+void FRTranslationStatusMapFree(FRTranslationStatusMap *map) {
+	if (map) {
+		free(map->translated);
+		free(map->equal);
+		free(map);
+	}
+}
+
+void FRTranslationStatusMapSet(FRTranslationStatusMap *map, size_t index, FRTranslationStatus status) {
+	uint64_t bit = (uint64_t)1 << (index % kWordBits);
+	size_t word = index / kWordBits;
+	map->translated[word] &= ~bit;
+	map->equal[word] &= ~bit;
+	if (status == FRTranslationStatusTranslated) { map->translated[word] |= bit; }
+	else if (status == FRTranslationStatusEqual) { map->equal[word] |= bit; }
+}
+
+FRTranslationStatus FRTranslationStatusMapGet(const FRTranslationStatusMap *map, size_t index) {
+	uint64_t bit = (uint64_t)1 << (index % kWordBits);
+	size_t word = index / kWordBits;
+	if (map->translated[word] & bit) { return FRTranslationStatusTranslated; }
+	if (map->equal[word] & bit) { return FRTranslationStatusEqual; }
+	return FRTranslationStatusUntranslated;
+}
+
+size_t FRTranslationStatusMapCount(const FRTranslationStatusMap *map, FRTranslationStatus status) {
+	size_t words = (map->count + kWordBits - 1) / kWordBits;
+	size_t translated = 0;
+	size_t equal = 0;
+	for (size_t word = 0; word < words; word++) {
+		translated += __builtin_popcountll(map->translated[word]);
+		equal += __builtin_popcountll(map->equal[word]);
+	}
+	
+	switch (status) {
+		case FRTranslationStatusTranslated: return translated;
+		case FRTranslationStatusEqual: return equal;
+		default: return map->count - translated - equal;
+	}
+}
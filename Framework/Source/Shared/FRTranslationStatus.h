@@ -0,0 +1,93 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FRStringsTokenizer.h"
+
+/*!
+ \brief		Translation status of an entry
+ \details	An entry is translated when its value differs from its key. When the value is the same as the
+			key, the entry is untranslated unless the comment before it contains ==, which marks it as
+			meant to be equal.
+ */
+enum {
+	FRTranslationStatusUntranslated,
+	FRTranslationStatusTranslated,
+	FRTranslationStatusEqual,
+};
+typedef uint8_t FRTranslationStatus;
+
+/*!
+ \brief		Compare characters
+ \details	Returns 1 if the two runs of characters are the same. Compares a whole vector register at a
+			time where the platform has them.
+ */
+int FRTranslationStatusCharsEqual(const FRStringsChar *a, const FRStringsChar *b, size_t length);
+
+/*!
+ \brief		Check for the equal marker
+ \details	Returns 1 if the characters (usually the body of a comment) contain ==.
+ */
+int FRTranslationStatusContainsMarker(const FRStringsChar *chars, size_t length);
+
+/*!
+ \brief		Classify an entry
+ \details	Classify an entry from its key, its value and whether the comment before it contains the equal
+			marker.
+ */
+FRTranslationStatus FRTranslationStatusClassify(const FRStringsChar *key, size_t keyLength,
+												const FRStringsChar *value, size_t valueLength, int marked);
+
+/*!
+ \brief		Status bitmap
+ \details	Holds the status of a number of entries as one bit per entry for translated entries and one for
+			equal entries, so counting entries of a status is a matter of counting bits.
+ */
+typedef struct FRTranslationStatusMap FRTranslationStatusMap;
+
+/*!
+ \brief		Create a status bitmap
+ \details	All entries start out untranslated.
+ */
+FRTranslationStatusMap *FRTranslationStatusMapCreate(size_t count);
+
+/*!
+ \brief		Free a status bitmap
+ \details	Free a status bitmap
+ */
+void FRTranslationStatusMapFree(FRTranslationStatusMap *map);
+
+/*!
+ \brief		Set the status of an entry
+ \details	Set the status of an entry
+ */
+void FRTranslationStatusMapSet(FRTranslationStatusMap *map, size_t index, FRTranslationStatus status);
+
+/*!
+ \brief		Status of an entry
+ \details	Status of an entry
+ */
+FRTranslationStatus FRTranslationStatusMapGet(const FRTranslationStatusMap *map, size_t index);
+
+/*!
+ \brief		Number of entries with a status
+ \details	Number of entries with a status
+ */
+size_t FRTranslationStatusMapCount(const FRTranslationStatusMap *map, FRTranslationStatus status);
@@ -0,0 +1,304 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#import "FRWriteQueue.h"
+#import "FRFrameBuffer.h"
+
+static const size_t kInitialCapacity = 16;
+static const int kNotSentLowWaterMark = 32 * 1024;
+enum { kMaximumVectors = 64 }; // two for each chunk, well below IOV_MAX everywhere
+enum { kMaximumChunks = kMaximumVectors / 2 - 1 }; // chunks started in one write, next to a partly written one
+
+typedef struct FRWriteQueueMessage {
+	const uint8_t *payload;
+	size_t length;
+	size_t offset;		// bytes of the payload that have been put in chunks
+	void *owner;
+	FRWriteQueueRelease release;
+} FRWriteQueueMessage;
+
+// messages are kept in a ring for each channel so that taking them off the front never moves the others
+typedef struct FRWriteQueueRing {
+	FRWriteQueueMessage *messages;
+	size_t capacity;
+	size_t first;
+	size_t count;
+} FRWriteQueueRing;
+
+typedef struct FRWriteQueueChunk {
+	uint8_t header[5];
+	const uint8_t *payload;
+	size_t length;
+	size_t written;		// bytes of the header and payload that have been written
+	void *owner;		// set when this is the last chunk of its message
+	FRWriteQueueRelease release;
+} FRWriteQueueChunk;
+
+struct FRWriteQueue {
+	FRWriteQueueRing rings[FRFrameChannelCount];
+	FRWriteQueueChunk partial;	// a chunk that's only been written in part, it has to be finished first
+	int hasPartial;
+	size_t length;
+	size_t highWaterMark;
+};
+
+static void FRWriteQueueChunkFinish(FRWriteQueueChunk *chunk);
+static void FRWriteQueuePop(FRWriteQueueRing *ring, int release);
+
+FRWriteQueue *FRWriteQueueCreate(size_t highWaterMark) {
+	FRWriteQueue *queue = calloc(1, sizeof(FRWriteQueue));
+	if (queue) {
+		queue->highWaterMark = highWaterMark;
+		for (int channel = 0; channel < FRFrameChannelCount; channel++) {
+			FRWriteQueueRing *ring = &queue->rings[channel];
+			ring->messages = malloc(kInitialCapacity * sizeof(FRWriteQueueMessage));
+			ring->capacity = kInitialCapacity;
+			if (!ring->messages) {
+				FRWriteQueueFree(queue);
+				queue = NULL;
+				break;
+			}
+		}
+	}
+	return queue;
+}
+
+void FRWriteQueueFree(FRWriteQueue *queue) {
+	FRWriteQueueReset(queue);
+	for (int channel = 0; channel < FRFrameChannelCount; channel++) { free(queue->rings[channel].messages); }
+	free(queue);
+}
+
+void FRWriteQueueReset(FRWriteQueue *queue) {
+	if (queue->hasPartial) { FRWriteQueueChunkFinish(&queue->partial); }
+	queue->hasPartial = 0;
+	for (int channel = 0; channel < FRFrameChannelCount; channel++) {
+		FRWriteQueueRing *ring = &queue->rings[channel];
+		while (ring->count) { FRWriteQueuePop(ring, 1); }
+		ring->first = 0;
+	}
+	queue->length = 0;
+}
+
+int FRWriteQueuePush(FRWriteQueue *queue, FRFrameChannel channel, const void *payload, size_t length,
+					  void *owner, FRWriteQueueRelease release) {
+	int error = 0;
+	FRWriteQueueRing *ring = (channel < FRFrameChannelCount) ? &queue->rings[channel] : NULL;
+	if (!ring || (uint64_t)length > UINT32_MAX) { error = EINVAL; }
+	else if (ring->count == ring->capacity) {
+		// unwrap the messages into the larger ring
+		size_t capacity = ring->capacity * 2;
+		FRWriteQueueMessage *messages = malloc(capacity * sizeof(FRWriteQueueMessage));
+		if (messages) {
+			size_t tail = ring->capacity - ring->first;
+			if (tail > ring->count) { tail = ring->count; }
+			memcpy(messages, ring->messages + ring->first, tail * sizeof(FRWriteQueueMessage));
+			memcpy(messages + tail, ring->messages, (ring->count - tail) * sizeof(FRWriteQueueMessage));
+			free(ring->messages);
+			ring->messages = messages;
+			ring->capacity = capacity;
+			ring->first = 0;
+		}
+		else { error = ENOMEM; }
+	}
+	if (error != 0) {
+		if (release) { release(owner); }
+		return error;
+	}
+	
+	FRWriteQueueMessage *message = &ring->messages[(ring->first + ring->count) % ring->capacity];
+	message->payload = payload;
+	message->length = length;
+	message->offset = 0;
+	message->owner = owner;
+	message->release = release;
+	ring->count++;
+	
+	size_t chunks = (length + FRFrameBufferMaximumChunkLength - 1) / FRFrameBufferMaximumChunkLength;
+	queue->length += length + (chunks ? chunks : 1) * FRFrameBufferHeaderLength;
+	return 0;
+}
+
+ssize_t FRWriteQueueFlush(FRWriteQueue *queue, FRWriteQueueWriter writer, void *context) {
+	ssize_t total = 0;
+	while (queue->hasPartial || queue->length) {
+		struct iovec vectors[kMaximumVectors];
+		int count = 0;
+		size_t requested = 0;
+		
+		// a chunk that's been started has to be finished before any other chunk can follow it
+		if (queue->hasPartial) {
+			FRWriteQueueChunk *chunk = &queue->partial;
+			size_t skip = chunk->written;
+			if (skip < FRFrameBufferHeaderLength) {
+				vectors[count].iov_base = chunk->header + skip;
+				vectors[count].iov_len = FRFrameBufferHeaderLength - skip;
+				count++;
+				skip = 0;
+			}
+			else { skip -= FRFrameBufferHeaderLength; }
+			vectors[count].iov_base = (void *)(chunk->payload + skip);
+			vectors[count].iov_len = chunk->length - skip;
+			count++;
+			requested += FRFrameBufferHeaderLength + chunk->length - chunk->written;
+		}
+		
+		// plan the next chunks. the lowest channel with anything waiting always goes first, so a
+		// message on the control channel only ever waits for the chunk that's being written.
+		FRWriteQueueChunk planned[kMaximumChunks];
+		FRFrameChannel plannedChannels[kMaximumChunks];
+		size_t indexes[FRFrameChannelCount] = { 0 };
+		size_t offsets[FRFrameChannelCount];
+		for (int channel = 0; channel < FRFrameChannelCount; channel++) {
+			const FRWriteQueueRing *ring = &queue->rings[channel];
+			offsets[channel] = ring->count ? ring->messages[ring->first].offset : 0;
+		}
+		int plannedCount = 0;
+		while (plannedCount < kMaximumChunks) {
+			int channel = 0;
+			while (channel < FRFrameChannelCount && indexes[channel] == queue->rings[channel].count) { channel++; }
+			if (channel == FRFrameChannelCount) { break; }
+			
+			const FRWriteQueueRing *ring = &queue->rings[channel];
+			const FRWriteQueueMessage *message = &ring->messages[(ring->first + indexes[channel]) % ring->capacity];
+			size_t length = message->length - offsets[channel];
+			if (length > FRFrameBufferMaximumChunkLength) { length = FRFrameBufferMaximumChunkLength; }
+			int more = (offsets[channel] + length < message->length);
+			
+			FRWriteQueueChunk *chunk = &planned[plannedCount];
+			chunk->header[0] = (uint8_t)(length >> 24);
+			chunk->header[1] = (uint8_t)(length >> 16);
+			chunk->header[2] = (uint8_t)(length >> 8);
+			chunk->header[3] = (uint8_t)length;
+			chunk->header[4] = (uint8_t)channel | (more ? FRFrameFlagMore : 0);
+			chunk->payload = message->payload + offsets[channel];
+			chunk->length = length;
+			chunk->written = 0;
+			chunk->owner = more ? NULL : message->owner;
+			chunk->release = more ? NULL : message->release;
+			plannedChannels[plannedCount] = (FRFrameChannel)channel;
+			plannedCount++;
+			
+			vectors[count].iov_base = chunk->header;
+			vectors[count].iov_len = FRFrameBufferHeaderLength;
+			vectors[count + 1].iov_base = (void *)chunk->payload;
+			vectors[count + 1].iov_len = length;
+			count += 2;
+			requested += FRFrameBufferHeaderLength + length;
+			
+			if (more) { offsets[channel] += length; }
+			else {
+				indexes[channel]++;
+				offsets[channel] = 0;
+			}
+		}
+		
+		ssize_t written = writer(context, vectors, count);
+		if (written < 0) { return -1; }
+		total += written;
+		queue->length -= (size_t)written;
+		
+		// release what's been written completely and keep track of a chunk that's been started
+		size_t remaining = (size_t)written;
+		if (queue->hasPartial) {
+			FRWriteQueueChunk *chunk = &queue->partial;
+			size_t left = FRFrameBufferHeaderLength + chunk->length - chunk->written;
+			if (remaining < left) {
+				chunk->written += remaining;
+				remaining = 0;
+			}
+			else {
+				remaining -= left;
+				queue->hasPartial = 0;
+				FRWriteQueueChunkFinish(chunk);
+			}
+		}
+		for (int index = 0; index < plannedCount && remaining; index++) {
+			FRWriteQueueChunk *chunk = &planned[index];
+			FRWriteQueueRing *ring = &queue->rings[plannedChannels[index]];
+			FRWriteQueueMessage *message = &ring->messages[ring->first];
+			size_t chunkLength = FRFrameBufferHeaderLength + chunk->length;
+			
+			message->offset += chunk->length;
+			int last = (message->offset == message->length);
+			if (remaining >= chunkLength) {
+				remaining -= chunkLength;
+				if (last) { FRWriteQueuePop(ring, 1); }
+			}
+			else {
+				// the message must stay around until its last chunk has been written
+				chunk->written = remaining;
+				remaining = 0;
+				queue->partial = *chunk;
+				queue->hasPartial = 1;
+				if (last) { FRWriteQueuePop(ring, 0); }
+			}
+		}
+		
+		if ((size_t)written < requested || !count) { break; }
+	}
+	return total;
+}
+
+size_t FRWriteQueueLength(const FRWriteQueue *queue) {
+	return queue->length;
+}
+
+int FRWriteQueueIsFull(const FRWriteQueue *queue) {
+	return (queue->length >= queue->highWaterMark);
+}
+
+int FRWriteQueueIsDrained(const FRWriteQueue *queue) {
+	return (queue->length < queue->highWaterMark / 2);
+}
+
+ssize_t FRWriteQueueWriteSocket(void *context, const struct iovec *vectors, int count) {
+	ssize_t written = -1;
+	do { written = writev(*(int *)context, vectors, count); } while (written < 0 && errno == EINTR);
+	if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { written = 0; }
+	return written;
+}
+
+int FRWriteQueueSetSocketOptions(int descriptor) {
+	if (setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int)) != 0) { return errno; }
+#ifdef TCP_NOTSENT_LOWAT
+	if (setsockopt(descriptor, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &kNotSentLowWaterMark, sizeof(int)) != 0) {
+		return errno;
+	}
+#endif
+	return 0;
+}
+
+static void FRWriteQueueChunkFinish(FRWriteQueueChunk *chunk) {
+	if (chunk->release) { chunk->release(chunk->owner); }
+}
+
+static void FRWriteQueuePop(FRWriteQueueRing *ring, int release) {
+	FRWriteQueueMessage *message = &ring->messages[ring->first];
+	if (release && message->release) { message->release(message->owner); }
+	ring->first = (ring->first + 1) % ring->capacity;
+	ring->count--;
+}
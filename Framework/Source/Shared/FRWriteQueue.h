@@ -0,0 +1,122 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#import "FRFrameBuffer.h"
+
+/*!
+ \brief		Outgoing message queue
+ \details	Holds messages waiting to be written to a connection. The queue only references the payload of
+			each message (it's released once the message has been written) and writes it in chunks of
+			frames FRFrameBuffer reads, with gather writes straight from the payload, so payloads are never
+			copied or moved, no matter how much is queued.
+			
+			Each message goes out on a channel. Chunks of the lowest channel with anything waiting are
+			always written first, so a message on the control channel only waits for the chunk that's
+			currently being written, not for all of the bulk data queued ahead of it. Messages on the same
+			channel are written in order.
+			
+			The queue counts the bytes waiting to be written. Once they reach the high water mark, the queue
+			is full; senders should hold off until it has drained (below half of the mark).
+ */
+typedef struct FRWriteQueue FRWriteQueue;
+
+/*!
+ \brief		Payload release
+ \details	Called with the owner of a payload once the payload is no longer needed.
+ */
+typedef void (*FRWriteQueueRelease)(void *owner);
+
+/*!
+ \brief		Writer
+ \details	Writes as much of the vectors as possible without blocking and returns the number of bytes
+			written. Returns 0 if nothing can be written right now and -1 on errors.
+ */
+typedef ssize_t (*FRWriteQueueWriter)(void *context, const struct iovec *vectors, int count);
+
+/*!
+ \brief		Create a queue
+ \details	Returns NULL if memory couldn't be allocated.
+ */
+FRWriteQueue *FRWriteQueueCreate(size_t highWaterMark);
+
+/*!
+ \brief		Free a queue
+ \details	Releases the payloads of all messages that haven't been written.
+ */
+void FRWriteQueueFree(FRWriteQueue *queue);
+
+/*!
+ \brief		Remove all messages
+ \details	Releases the payloads of all messages that haven't been written.
+ */
+void FRWriteQueueReset(FRWriteQueue *queue);
+
+/*!
+ \brief		Add a message
+ \details	Queues the payload as a message on the channel. The payload must stay unchanged until it's
+			released (release may be NULL if it never needs to be). Returns 0 on success or an errno value,
+			in which case the payload is released right away.
+ */
+int FRWriteQueuePush(FRWriteQueue *queue, FRFrameChannel channel, const void *payload, size_t length,
+					  void *owner, FRWriteQueueRelease release);
+
+/*!
+ \brief		Write queued messages
+ \details	Writes chunks until everything has been written, the writer can't take more, or it fails.
+			Returns the number of bytes written or -1 if the writer failed.
+ */
+ssize_t FRWriteQueueFlush(FRWriteQueue *queue, FRWriteQueueWriter writer, void *context);
+
+/*!
+ \brief		Bytes waiting
+ \details	Bytes waiting
+ */
+size_t FRWriteQueueLength(const FRWriteQueue *queue);
+
+/*!
+ \brief		Whether the queue is full
+ \details	True once the bytes waiting reach the high water mark.
+ */
+int FRWriteQueueIsFull(const FRWriteQueue *queue);
+
+/*!
+ \brief		Whether the queue has drained
+ \details	True while the bytes waiting are below half of the high water mark.
+ */
+int FRWriteQueueIsDrained(const FRWriteQueue *queue);
+
+/*!
+ \brief		Socket writer
+ \details	A writer that uses writev on the non-blocking socket pointed to by the context.
+ */
+ssize_t FRWriteQueueWriteSocket(void *context, const struct iovec *vectors, int count);
+
+/*!
+ \brief		Socket options
+ \details	Sets up a connected TCP socket for writing from a queue. Nagle's algorithm is turned off, since
+			the queue already writes as much as it can at once and holding back what's left (like a control
+			message sent on its own) only delays it. Where it's supported, little unsent data is left to the
+			kernel, because chunks can only be put in order by channel while they're in the queue. Returns 0
+			on success or the errno value of the first failure.
+ */
+int FRWriteQueueSetSocketOptions(int descriptor);
@@ -21,6 +21,9 @@
 @interface FRLocalizationManager : NSObject {
 	FRNetworkServer *server;
 	NSString *generatedAuthorizationCode;
+	NSDictionary *bundleResources;
+	NSDictionary *bundleResourceFiles;
+	dispatch_queue_t workQueue;
 }
 
 + (id)defaultLocalizationManager;
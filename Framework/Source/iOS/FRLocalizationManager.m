@@ -21,20 +21,26 @@
 #import "FRNetworkServer__.h"
 #import "FRBundleAdditions.h"
 #import "FRMessages.h"
+#import "FRStrings.h"
 #import "FRLocalizationBundleAdditions__.h"
 
 static NSString * const kAuthorizedDevicesKey = @"FRTranslatorAuthorizedDevices";
 static const char kConfirmationKey;
 static const char kCancelationKey;
-static const char kAuthorizedKey;
+static NSString * const kResourceFileKey = @"file";
+static NSString * const kResourceContentsKey = @"contents";
+static NSString * const kResourceOffsetKey = @"offset";
+static NSString * const kResourceReceivedDigestKey = @"receivedDigest";
+static const NSUInteger kResourcePieceLength = 256 * 1024;
 
 @interface FRLocalizationManager () <FRNetworkServerDelegate>
-- (NSDictionary *)localizationResourcesMessage;
+- (void)loadBundleResources;
+- (NSDictionary *)localizationManifestMessage;
+- (NSArray *)resourceFilesForRequest:(NSDictionary *)message;
+- (void)sendPendingResourcesToConnection:(FRNetworkServerConnection *)connection;
 - (void)extractUpdatedStringsFromResourcesMessage:(NSDictionary *)message;
-@end
-
-@interface FRConnection (FRAuthorizationAdditions)
-@property (nonatomic, assign, getter=isAuthorized) BOOL authorized;
+- (void)applyEditsFromMessage:(NSDictionary *)message;
+- (void)notifyConnectionsOfChangesFromConnection:(FRNetworkServerConnection *)connection;
 @end
 
 @implementation FRLocalizationManager
@@ -55,39 +61,43 @@ static const char kAuthorizedKey;
 	if ((self = [super init])) {
 		server = [[FRNetworkServer alloc] init];
 		server.delegate = self;
+		
+		// messages are handled in the background, but still one after the other in the order they arrived
+		workQueue = dispatch_queue_create("com.fadingred.Greenwich.work", DISPATCH_QUEUE_SERIAL);
 	}
 	return self;
 }
 
+- (void)dealloc {
+#if !OS_OBJECT_USE_OBJC
+	dispatch_release(workQueue);
+#endif
+}
+
 - (void)networkServer:(FRNetworkServer *)server
 	  receivedMessage:(NSDictionary *)message
-	   fromConnection:(FRConnection *)connection {
+	   fromConnection:(FRNetworkServerConnection *)connection {
 	
 	BOOL isAuthorized = [connection isAuthorized];
 	if (isAuthorized) {
 		if ([message objectForKey:FRLocalizationChangesMessage.messageID]) {
-			dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+			dispatch_async(workQueue, ^{
 				[self extractUpdatedStringsFromResourcesMessage:message];
+				[self notifyConnectionsOfChangesFromConnection:connection];
+			});
+		}
+		else if ([message objectForKey:FRLocalizationEditsMessage.messageID]) {
+			dispatch_async(workQueue, ^{
+				[self applyEditsFromMessage:message];
+				[self notifyConnectionsOfChangesFromConnection:connection];
+			});
+		}
+		else if ([message objectForKey:FRLocalizationRequestMessage.messageID]) {
+			dispatch_async(workQueue, ^{
+				NSArray *files = [self resourceFilesForRequest:message];
 				dispatch_async(dispatch_get_main_queue(), ^{
-					NSString *title = FRLocalizedString(@"New Localizations", nil);
-					NSString *details =
-						FRLocalizedString(@"You have added new localizations to the application. To see these "
-										  @"localization, you will need to terminate the application and then start it "
-										  @"again.", nil);
-					UIAlertView *alert = [[UIAlertView alloc] initWithTitle:title message:details delegate:self
-														  cancelButtonTitle:FRLocalizedString(@"Cancel", nil)
-														  otherButtonTitles:FRLocalizedString(@"Terminate", nil), nil];
-					void (^complete)(void) = ^{
-						UIApplication *application = [UIApplication sharedApplication];
-						id <UIApplicationDelegate> delegate = [application delegate];
-						if ([delegate respondsToSelector:@selector(applicationWillTerminate:)]) {
-							[delegate applicationWillTerminate:application];
-						}
-						exit(0);
-					};
-					objc_setAssociatedObject(alert, &kConfirmationKey, complete, OBJC_ASSOCIATION_COPY_NONATOMIC);
-					
-					[alert show];
+					[connection setPendingResources:[files mutableCopy]];
+					[self sendPendingResourcesToConnection:connection];
 				});
 			});
 		}
@@ -98,10 +108,10 @@ static const char kAuthorizedKey;
 		NSString *deviceIdentifier = [message objectForKey:FRAuthenticationMessage.keys.deviceIdentifier];
 		
 		void (^performActionsForValidAuthentication)(void) = ^{
-			// on initial authorization, send all strings to the client
+			// on initial authorization, send the manifest so the client can ask for the strings it needs
 			[connection setAuthorized:YES];
-			dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-				NSDictionary *response = [self localizationResourcesMessage];
+			dispatch_async(workQueue, ^{
+				NSDictionary *response = [self localizationManifestMessage];
 				dispatch_async(dispatch_get_main_queue(), ^{
 					[connection sendMessage:response];
 				});
@@ -143,6 +153,14 @@ static const char kAuthorizedKey;
 	}
 }
 
+- (void)networkServer:(FRNetworkServer *)server drainedConnection:(FRNetworkServerConnection *)connection {
+	[self sendPendingResourcesToConnection:connection];
+}
+
+- (void)networkServer:(FRNetworkServer *)server didCloseConnection:(FRNetworkServerConnection *)connection {
+	[connection setPendingResources:nil];
+}
+
 - (void)alertView:(UIAlertView *)alertView clickedButtonAtIndex:(NSInteger)buttonIndex {
 	void (^block)(void) = nil;
 	if (buttonIndex == [alertView cancelButtonIndex]) {
@@ -153,7 +171,12 @@ static const char kAuthorizedKey;
 	if (block) { block(); }
 }
 
-- (NSDictionary *)localizationResourcesMessage {
+- (void)loadBundleResources {
+	// the bundle never changes while the application is running, so it only needs to be read once
+	@synchronized(self) {
+		if (bundleResources) { return; }
+	}
+	
 	NSMutableArray *languages = [NSMutableArray array];
 	NSArray *lprojPaths = [[NSBundle mainBundle] pathsForResourcesOfType:@"lproj" inDirectory:nil];
 	for (NSString *path in lprojPaths) {
@@ -161,7 +184,8 @@ static const char kAuthorizedKey;
 		 [[path lastPathComponent] stringByDeletingPathExtension]];
 	}
 	
-	NSMutableArray *resources = [NSMutableArray array];
+	NSMutableDictionary *resources = [NSMutableDictionary dictionary];
+	NSMutableDictionary *files = [NSMutableDictionary dictionary];
 	NSFileManager *manager = [NSFileManager defaultManager];
 	
 	// TODO: could ignore certain contained bundles here by enumerating contained bundles and skipping
@@ -187,29 +211,166 @@ static const char kAuthorizedKey;
 			if ([languages containsObject:directoryName] && [fileExtension isEqualToString:@"strings"]) {
 				NSString *name = [[path lastPathComponent] stringByDeletingPathExtension];
 				NSString *filePath = [bundlePath stringByAppendingPathComponent:path];
-				NSData *data = [NSData dataWithContentsOfFile:filePath options:0 error:NULL];
-				[resources addObject:
+				NSData *data = [NSData dataWithContentsOfFile:filePath options:NSDataReadingMappedIfSafe error:NULL];
+				NSString *resourcePath = FRMessageResourcePath(bundleIdentifier, directoryName, name);
+				if (!data || !resourcePath) { continue; }
+				[resources setObject:
 				 [NSDictionary dictionaryWithObjectsAndKeys:
-				  bundleIdentifier, FRLocalizationResourcesMessage.keys.resource.bundleIdentifier,
-				  directoryName, FRLocalizationResourcesMessage.keys.resource.language,
-				  name, FRLocalizationResourcesMessage.keys.resource.name,
-				  data, FRLocalizationResourcesMessage.keys.resource.data, nil]];
-				
+				  bundleIdentifier, FRLocalizationManifestMessage.keys.resource.bundleIdentifier,
+				  directoryName, FRLocalizationManifestMessage.keys.resource.language,
+				  name, FRLocalizationManifestMessage.keys.resource.name,
+				  FRMessageResourceDigest(data), FRLocalizationManifestMessage.keys.resource.digest, nil]
+							  forKey:resourcePath];
+				[files setObject:filePath forKey:resourcePath];
 			}
 		}
 	}
+	
+	@synchronized(self) {
+		bundleResources = resources;
+		bundleResourceFiles = files;
+	}
+}
 
+- (NSDictionary *)localizationManifestMessage {
+	[self loadBundleResources];
+	NSArray *resources = nil;
+	@synchronized(self) {
+		resources = [bundleResources allValues];
+	}
+	
+	// translations that were sent earlier don't need to be sent again
+	NSMutableArray *translations = [NSMutableArray array];
+	NSDictionary *digests = FRMessageResourceDigestsInDirectory([NSBundle translactionStoragePath]);
+	for (NSString *path in digests) {
+		NSArray *components = [path pathComponents];
+		NSString *language = [[components objectAtIndex:1] stringByDeletingPathExtension];
+		NSString *name = [[components objectAtIndex:2] stringByDeletingPathExtension];
+		[translations addObject:
+		 [NSDictionary dictionaryWithObjectsAndKeys:
+		  [components objectAtIndex:0], FRLocalizationManifestMessage.keys.resource.bundleIdentifier,
+		  language, FRLocalizationManifestMessage.keys.resource.language,
+		  name, FRLocalizationManifestMessage.keys.resource.name,
+		  [digests objectForKey:path], FRLocalizationManifestMessage.keys.resource.digest, nil]];
+	}
+	
 	return [NSDictionary dictionaryWithObjectsAndKeys:
-			FRLocalizationResourcesMessage.messageID, FRLocalizationResourcesMessage.messageID,
-			resources, FRLocalizationResourcesMessage.keys.resources, 
-			[[NSBundle mainBundle] name], FRLocalizationResourcesMessage.keys.applicationName,
-			[[NSBundle mainBundle] bundleIdentifier], FRLocalizationResourcesMessage.keys.applicationIdentifier, nil];
+			FRLocalizationManifestMessage.messageID, FRLocalizationManifestMessage.messageID,
+			resources, FRLocalizationManifestMessage.keys.resources,
+			translations, FRLocalizationManifestMessage.keys.translations,
+			[[NSBundle mainBundle] name], FRLocalizationManifestMessage.keys.applicationName,
+			[[NSBundle mainBundle] bundleIdentifier], FRLocalizationManifestMessage.keys.applicationIdentifier, nil];
+}
+
+- (NSArray *)resourceFilesForRequest:(NSDictionary *)message {
+	[self loadBundleResources];
+	NSDictionary *files = nil;
+	NSDictionary *manifest = nil;
+	@synchronized(self) {
+		files = bundleResourceFiles;
+		manifest = bundleResources;
+	}
+	
+	// only files from the manifest can be requested
+	NSMutableArray *resources = [NSMutableArray array];
+	for (NSDictionary *resource in [message objectForKey:FRLocalizationRequestMessage.keys.resources]) {
+		NSString *bundleID = [resource objectForKey:FRLocalizationRequestMessage.keys.resource.bundleIdentifier];
+		NSString *language = [resource objectForKey:FRLocalizationRequestMessage.keys.resource.language];
+		NSString *name = [resource objectForKey:FRLocalizationRequestMessage.keys.resource.name];
+		NSString *resourcePath = FRMessageResourcePath(bundleID, language, name);
+		NSString *filePath = [files objectForKey:resourcePath];
+		NSString *digest =
+			[[manifest objectForKey:resourcePath] objectForKey:FRLocalizationManifestMessage.keys.resource.digest];
+		if (!filePath || !digest) { continue; }
+		
+		// what the translator already has is only checked once the file is read
+		NSMutableDictionary *pending =
+			[NSMutableDictionary dictionaryWithObjectsAndKeys:
+			 bundleID, FRLocalizationResourcesMessage.keys.resource.bundleIdentifier,
+			 language, FRLocalizationResourcesMessage.keys.resource.language,
+			 name, FRLocalizationResourcesMessage.keys.resource.name,
+			 digest, FRLocalizationResourcesMessage.keys.resource.digest,
+			 filePath, kResourceFileKey, nil];
+		NSNumber *offset = [resource objectForKey:FRLocalizationRequestMessage.keys.resource.offset];
+		NSString *received = [resource objectForKey:FRLocalizationRequestMessage.keys.resource.digest];
+		if (offset && received) {
+			[pending setObject:offset forKey:kResourceOffsetKey];
+			[pending setObject:received forKey:kResourceReceivedDigestKey];
+		}
+		[resources addObject:pending];
+	}
+	return resources;
+}
+
+- (void)sendPendingResourcesToConnection:(FRNetworkServerConnection *)connection {
+	// every file goes in its own messages, and files are only read while the connection is taking
+	// messages. once it stops, sending picks up again when it has drained.
+	NSMutableArray *pendingResources = nil;
+	while ((pendingResources = [connection pendingResources])) {
+		NSUInteger remaining = [pendingResources count];
+		NSArray *resources = [NSArray array];
+		if (remaining) {
+			NSMutableDictionary *pending = [pendingResources objectAtIndex:0];
+			NSData *data = [pending objectForKey:kResourceContentsKey];
+			if (!data) {
+				data = [NSData dataWithContentsOfFile:[pending objectForKey:kResourceFileKey]
+											  options:NSDataReadingMappedIfSafe error:NULL];
+				if (data) { [pending setObject:data forKey:kResourceContentsKey]; }
+				
+				// a transfer that was cut off only continues if the translator has the same start of the file
+				unsigned long long offset = [[pending objectForKey:kResourceOffsetKey] unsignedLongLongValue];
+				NSString *received = [pending objectForKey:kResourceReceivedDigestKey];
+				if (offset > [data length] || ![received isEqualToString:
+					FRMessageResourceDigest([data subdataWithRange:NSMakeRange(0, (NSUInteger)offset)])]) {
+					[pending removeObjectForKey:kResourceOffsetKey];
+				}
+			}
+			
+			NSUInteger offset = [[pending objectForKey:kResourceOffsetKey] unsignedIntegerValue];
+			NSUInteger length = MIN([data length] - offset, kResourcePieceLength);
+			if (!data || offset + length == [data length]) {
+				[pendingResources removeObjectAtIndex:0];
+				remaining--;
+			}
+			else { [pending setObject:[NSNumber numberWithUnsignedInteger:offset + length] forKey:kResourceOffsetKey]; }
+			
+			if (!data && remaining) { continue; }
+			if (data) {
+				resources =
+					[NSArray arrayWithObject:
+					 [NSDictionary dictionaryWithObjectsAndKeys:
+					  [pending objectForKey:FRLocalizationResourcesMessage.keys.resource.bundleIdentifier],
+					  FRLocalizationResourcesMessage.keys.resource.bundleIdentifier,
+					  [pending objectForKey:FRLocalizationResourcesMessage.keys.resource.language],
+					  FRLocalizationResourcesMessage.keys.resource.language,
+					  [pending objectForKey:FRLocalizationResourcesMessage.keys.resource.name],
+					  FRLocalizationResourcesMessage.keys.resource.name,
+					  [pending objectForKey:FRLocalizationResourcesMessage.keys.resource.digest],
+					  FRLocalizationResourcesMessage.keys.resource.digest,
+					  [NSNumber numberWithUnsignedInteger:offset],
+					  FRLocalizationResourcesMessage.keys.resource.offset,
+					  [NSNumber numberWithUnsignedInteger:[data length]],
+					  FRLocalizationResourcesMessage.keys.resource.length,
+					  [data subdataWithRange:NSMakeRange(offset, length)],
+					  FRLocalizationResourcesMessage.keys.resource.data, nil]];
+			}
+		}
+		if (!remaining) { [connection setPendingResources:nil]; }
+		
+		NSDictionary *message =
+			[NSDictionary dictionaryWithObjectsAndKeys:
+			 FRLocalizationResourcesMessage.messageID, FRLocalizationResourcesMessage.messageID,
+			 resources, FRLocalizationResourcesMessage.keys.resources,
+			 [NSNumber numberWithUnsignedInteger:remaining], FRLocalizationResourcesMessage.keys.remaining,
+			 [[NSBundle mainBundle] name], FRLocalizationResourcesMessage.keys.applicationName,
+			 [[NSBundle mainBundle] bundleIdentifier], FRLocalizationResourcesMessage.keys.applicationIdentifier, nil];
+		if (![connection sendMessage:message]) { break; }
+	}
 }
 
 - (void)extractUpdatedStringsFromResourcesMessage:(NSDictionary *)message {
 	NSFileManager *manager = [NSFileManager defaultManager];
-	NSString *applicationSupport = [[NSBundle mainBundle] applicationSupportDirectory];
-	NSString *translationsDirectory = [applicationSupport stringByAppendingPathComponent:@"Translations"];
+	NSString *translationsDirectory = [NSBundle translactionStoragePath];
 	
 	for (NSDictionary *resource in [message objectForKey:FRLocalizationChangesMessage.keys.resources]) {
 		NSString *bundleID = [resource objectForKey:FRLocalizationChangesMessage.keys.resource.bundleIdentifier];
@@ -217,22 +378,75 @@ static const char kAuthorizedKey;
 		NSString *name = [resource objectForKey:FRLocalizationChangesMessage.keys.resource.name];
 		NSData *data = [resource objectForKey:FRLocalizationChangesMessage.keys.resource.data];
 		
-		NSString *bundleDirectory = [translationsDirectory stringByAppendingPathComponent:bundleID];
-		NSString *lprojName = [NSString stringWithFormat:@"%@.lproj", language];
-		NSString *lprojDirectory = [bundleDirectory stringByAppendingPathComponent:lprojName];
-		NSString *stringsName = [NSString stringWithFormat:@"%@.strings", name];
-		NSString *stringsPath = [lprojDirectory stringByAppendingPathComponent:stringsName];
+		NSString *stringsPath =
+			[translationsDirectory stringByAppendingPathComponent:FRMessageResourcePath(bundleID, language, name)];
+		NSString *lprojDirectory = [stringsPath stringByDeletingLastPathComponent];
 		
 		[manager createDirectoryAtPath:lprojDirectory withIntermediateDirectories:YES attributes:nil error:NULL];
-		[data writeToFile:stringsPath options:0 error:NULL];
+		if ([data writeToFile:stringsPath options:0 error:NULL]) {
+			[NSBundle invalidateTranslationsForIdentifier:bundleID language:language table:name];
+		}
 	}
 }
 
-@end
+- (void)applyEditsFromMessage:(NSDictionary *)message {
+	[self loadBundleResources];
+	NSDictionary *files = nil;
+	@synchronized(self) {
+		files = bundleResourceFiles;
+	}
+	
+	NSFileManager *manager = [NSFileManager defaultManager];
+	NSString *translationsDirectory = [NSBundle translactionStoragePath];
+	
+	for (NSDictionary *resource in [message objectForKey:FRLocalizationEditsMessage.keys.resources]) {
+		NSString *bundleID = [resource objectForKey:FRLocalizationEditsMessage.keys.resource.bundleIdentifier];
+		NSString *language = [resource objectForKey:FRLocalizationEditsMessage.keys.resource.language];
+		NSString *name = [resource objectForKey:FRLocalizationEditsMessage.keys.resource.name];
+		NSData *data = [resource objectForKey:FRLocalizationEditsMessage.keys.resource.data];
+		NSDictionary *edits =
+			data ? [NSPropertyListSerialization propertyListWithData:data options:0 format:NULL error:NULL] : nil;
+		NSString *resourcePath = FRMessageResourcePath(bundleID, language, name);
+		if (![edits isKindOfClass:[NSDictionary class]] || !resourcePath) { continue; }
+		
+		// a file that hasn't been sent to the device yet starts out as the one the application has for the
+		// language (or the default language), the same way it does in the translator
+		NSString *stringsPath = [translationsDirectory stringByAppendingPathComponent:resourcePath];
+		NSString *sourcePath = stringsPath;
+		if (![manager fileExistsAtPath:stringsPath]) {
+			sourcePath = [files objectForKey:resourcePath];
+			if (!sourcePath) {
+				sourcePath = [files objectForKey:FRMessageResourcePath(bundleID, GREENWICH_DEFAULT_LANGUAGE, name)];
+			}
+		}
+		
+		FRStringsFormat format = 0;
+		FRStrings *strings =
+			sourcePath ? [[FRStrings alloc] initWithContentsOfFile:sourcePath usedFormat:&format error:NULL] : nil;
+		for (NSString *string in edits) {
+			NSString *translation = [edits objectForKey:string];
+			if ([translation isKindOfClass:[NSString class]]) { [strings setTranslation:translation forString:string]; }
+		}
+		if (![[strings changedStrings] count]) { continue; }
+		
+		[manager createDirectoryAtPath:[stringsPath stringByDeletingLastPathComponent]
+		   withIntermediateDirectories:YES attributes:nil error:NULL];
+		if ([strings writeToFile:stringsPath format:format error:NULL]) {
+			[NSBundle invalidateTranslationsForIdentifier:bundleID language:language table:name];
+		}
+	}
+}
 
-@implementation FRConnection (FRAuthorizationAdditions)
-- (BOOL)isAuthorized { return [objc_getAssociatedObject(self, &kAuthorizedKey) boolValue]; }
-- (void)setAuthorized:(BOOL)flag {
-	objc_setAssociatedObject(self, &kAuthorizedKey, [NSNumber numberWithBool:flag], OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+- (void)notifyConnectionsOfChangesFromConnection:(FRNetworkServerConnection *)connection {
+	// every other translator gets the new manifest, so it knows which translations the device has now
+	NSDictionary *message = [self localizationManifestMessage];
+	dispatch_async(dispatch_get_main_queue(), ^{
+		NSMutableArray *connections = [NSMutableArray array];
+		for (FRNetworkServerConnection *other in [server connections]) {
+			if (other != connection && [other isAuthorized]) { [connections addObject:other]; }
+		}
+		[server broadcastMessage:message toConnections:connections];
+	});
 }
+
 @end
@@ -19,11 +19,45 @@
 #import <sys/socket.h>
 
 #import "FRNetworkServer__.h"
+#import "FRConnection__.h"
+#import "FREventLoop.h"
+#import "FRServer.h"
 
-static void callback(CFSocketRef socket, CFSocketCallBackType type, CFDataRef address, const void *data, void *info);
+static const size_t kWriteHighWaterMark = 4 * 1024 * 1024;
+
+static CFRunLoopRef ioRunLoop = NULL;
+static dispatch_semaphore_t ioThreadStarted = NULL;
+
+/*!
+ \brief		A packet queued for a connection
+ \details	Keeps the packet and the connection it was sent on until the server is done writing it.
+ */
+typedef struct FRNetworkServerPacket {
+	CFDataRef data;
+	void *connection;	// retained until the packet is released
+} FRNetworkServerPacket;
+
+static CFRunLoopRef FRNetworkServerIORunLoop(void);
+static void FRNetworkServerPerform(void (^block)(void));
+static void FRNetworkServerLoopCallBack(CFFileDescriptorRef descriptor, CFOptionFlags flags, void *info);
+static void FRNetworkServerAccepted(FRServer *server, FRServerClient *client, void *info);
+static void FRNetworkServerReceived(FRServer *server, FRServerClient *client,
+									const struct iovec *payload, int count, size_t length, void *info);
+static void FRNetworkServerClosed(FRServer *server, FRServerClient *client, void *info);
+static void FRNetworkServerReleasePacket(void *info);
+
+@interface FRNetworkServerConnection ()
+- (id)initWithClient:(FRServerClient *)client;
+- (void)receivePacket:(const struct iovec *)payload count:(int)count length:(size_t)length;
+- (void)clientClosed;
+- (void)releasedPacketOfLength:(size_t)length;
+@end
 
 @interface FRNetworkServer ()
++ (void)runIOThread:(id)object;
 - (BOOL)setupServer;
+- (void)acceptClient:(FRServerClient *)client;
+- (void)closeClient:(FRServerClient *)client;
 @end
 
 @implementation FRNetworkServer
@@ -31,27 +65,53 @@ static void callback(CFSocketRef socket, CFSocketCallBackType type, CFDataRef ad
 
 - (id)init {
 	if ((self = [super init])) {
+		connections = [[NSMutableSet alloc] init];
 		[self performSelector:@selector(setupServer) withObject:nil afterDelay:0];
 	}
 	return self;
 }
 
+- (void)dealloc {
+	[service stop];
+	
+	// the server and its loop belong to the I/O thread, so they're freed there. clients closed on the way
+	// aren't reported, since there's nobody left to report them to.
+	stopping = TRUE;
+	if (loop) {
+		CFFileDescriptorRef descriptor = loopDescriptor;
+		FRServer *aServer = server;
+		FREventLoop *aLoop = loop;
+		dispatch_semaphore_t stopped = dispatch_semaphore_create(0);
+		FRNetworkServerPerform(^{
+			if (descriptor) {
+				CFFileDescriptorInvalidate(descriptor);
+				CFRelease(descriptor);
+			}
+			if (aServer) { FRServerFree(aServer); }
+			FREventLoopFree(aLoop);
+			dispatch_semaphore_signal(stopped);
+		});
+		dispatch_semaphore_wait(stopped, DISPATCH_TIME_FOREVER);
+#if !OS_OBJECT_USE_OBJC
+		dispatch_release(stopped);
+#endif
+	}
+}
+
 - (BOOL)setupServer {
 	BOOL success = TRUE;
 	uint16_t port = 0;
-	CFSocketRef socket = NULL;
+	int listener = -1;
 
-	// create socket object
+	// create socket
 	if (success) {
-		CFSocketContext context = {0, (__bridge void *)self, NULL, NULL, NULL};
-		socket = CFSocketCreate(kCFAllocatorDefault, PF_INET, SOCK_STREAM, IPPROTO_TCP, kCFSocketAcceptCallBack,
-								(CFSocketCallBack)&callback, &context);
-		if (!socket) { success = FALSE; }
+		listener = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listener < 0) { success = FALSE; }
 	}
 
 	// setup listening socket
 	if (success) {
-		setsockopt(CFSocketGetNative(socket), SOL_SOCKET, SO_REUSEADDR, (void *)&(int){0}, sizeof(int));
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (void *)&(int){0}, sizeof(int));
 		
 		struct sockaddr_in address = {
 			.sin_len = sizeof(struct sockaddr_in),
@@ -60,26 +120,50 @@ static void callback(CFSocketRef socket, CFSocketCallBackType type, CFDataRef ad
 			.sin_addr.s_addr = htonl(INADDR_ANY),
 		};
 		
-		NSData *data = [NSData dataWithBytes:&address length:sizeof(address)];
-		if (CFSocketSetAddress(socket, (__bridge CFDataRef)data) != kCFSocketSuccess) {
+		if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+			listen(listener, SOMAXCONN) != 0) {
 			success = FALSE;
 		}
 	}
 	
 	// get assigned port
 	if (success) {
-		NSData *data =  (__bridge_transfer NSData *)CFSocketCopyAddress(socket);
 		struct sockaddr_in address;
-		memcpy(&address, [data bytes], [data length]);
-		port = ntohs(address.sin_port);
+		socklen_t length = sizeof(address);
+		if (getsockname(listener, (struct sockaddr *)&address, &length) == 0) { port = ntohs(address.sin_port); }
+		else { success = FALSE; }
+	}
+	
+	// create the event loop that serves all connections. the server takes over the listening socket.
+	if (success) {
+		FRServerCallbacks callbacks = {
+			.info = (__bridge void *)self,
+			.accepted = FRNetworkServerAccepted,
+			.received = FRNetworkServerReceived,
+			.drained = NULL,
+			.closed = FRNetworkServerClosed,
+		};
+		loop = FREventLoopCreate();
+		server = loop ? FRServerCreate(loop, listener, FRConnectionDefaultMaximumMessageLength, &callbacks) : NULL;
+		if (server) { listener = -1; }
+		else { success = FALSE; }
 	}
 	
-	// schedule with run loop
+	// schedule with the I/O thread's run loop. the loop's descriptor is readable whenever it has events to
+	// handle, and from here on the server and its loop are only used on that thread.
 	if (success) {
-		CFRunLoopRef currentRunLoop = CFRunLoopGetCurrent();
-		CFRunLoopSourceRef runLoopSource = CFSocketCreateRunLoopSource(kCFAllocatorDefault, socket, 0);
-		CFRunLoopAddSource(currentRunLoop, runLoopSource, kCFRunLoopCommonModes);
-		CFRelease(runLoopSource);
+		CFFileDescriptorContext context = {0, (__bridge void *)self, NULL, NULL, NULL};
+		loopDescriptor = CFFileDescriptorCreate(kCFAllocatorDefault, FREventLoopDescriptor(loop), FALSE,
+												FRNetworkServerLoopCallBack, &context);
+		CFRunLoopSourceRef runLoopSource =
+			loopDescriptor ? CFFileDescriptorCreateRunLoopSource(kCFAllocatorDefault, loopDescriptor, 0) : NULL;
+		if (runLoopSource) {
+			CFFileDescriptorEnableCallBacks(loopDescriptor, kCFFileDescriptorReadCallBack);
+			CFRunLoopAddSource(FRNetworkServerIORunLoop(), runLoopSource, kCFRunLoopCommonModes);
+			CFRunLoopWakeUp(FRNetworkServerIORunLoop());
+			CFRelease(runLoopSource);
+		}
+		else { success = FALSE; }
 	}
 
 	// setup service
@@ -96,33 +180,118 @@ static void callback(CFSocketRef socket, CFSocketCallBackType type, CFDataRef ad
 	}
 	
 	// cleanup
-	if (socket != NULL) {
-		CFRelease(socket);
-		socket = NULL;
+	if (listener >= 0) {
+		close(listener);
+		listener = -1;
 	}
 
 	return success;
 }
 
-static void callback(CFSocketRef socket, CFSocketCallBackType type, CFDataRef address, const void *data, void *info) {
-	if (type != kCFSocketAcceptCallBack) { return; }
-	
-	FRNetworkServer *server = (__bridge FRNetworkServer *)info;
-	int sock = *(CFSocketNativeHandle *)data;
-	
-	if (!server->connection) {
-		server->connection = nil;
-		server->connection = [[FRConnection alloc] initWithSocketHandle:sock];
-		server->connection.delegate = server;
-		
-		if (server->connection) { [server->connection connect]; }
-		else { close(sock); }
-		
-		if ([server.delegate respondsToSelector:@selector(networkServer:didCreateConnection:)]) {
-			[server.delegate networkServer:server didCreateConnection:server->connection];
+
+#pragma mark -
+#pragma mark connections
+// ----------------------------------------------------------------------------------------------------
+// connections
+// ----------------------------------------------------------------------------------------------------
+
+- (NSArray *)connections {
+	return [connections allObjects];
+}
+
+- (void)broadcastMessage:(NSDictionary *)message toConnections:(NSArray *)targets {
+	// a payload only depends on the message and how it's compressed, so the queues of all connections
+	// that compress the same way can share it
+	NSMutableDictionary *packets = [NSMutableDictionary dictionary];
+	FRFrameChannel channel = FRConnectionChannelForMessage(message);
+	for (FRConnection *connection in targets) {
+		NSNumber *method = [NSNumber numberWithUnsignedChar:[connection compressionMethod]];
+		NSData *packet = [packets objectForKey:method];
+		if (!packet) {
+			packet = [connection packetWithMessage:message];
+			if (!packet) { continue; }
+			[packets setObject:packet forKey:method];
 		}
+		[connection sendPacket:packet channel:channel];
 	}
-	else { close(sock); }
+}
+
+- (void)acceptClient:(FRServerClient *)client {
+	// called on the I/O thread. the client holds a reference to the connection until it's closed.
+	FRNetworkServerConnection *connection = [[FRNetworkServerConnection alloc] initWithClient:client];
+	connection.delegate = self;
+	FRServerClientSetInfo(client, (__bridge_retained void *)connection);
+	dispatch_async(dispatch_get_main_queue(), ^{
+		[connections addObject:connection];
+		if ([self.delegate respondsToSelector:@selector(networkServer:didCreateConnection:)]) {
+			[self.delegate networkServer:self didCreateConnection:connection];
+		}
+	});
+}
+
+- (void)closeClient:(FRServerClient *)client {
+	// called on the I/O thread. the connection reports the close once the messages it received before it
+	// are delivered.
+	void *info = FRServerClientGetInfo(client);
+	if (!info) { return; }
+	FRServerClientSetInfo(client, NULL);
+	FRNetworkServerConnection *connection = (__bridge_transfer FRNetworkServerConnection *)info;
+	if (stopping) { connection.delegate = nil; }
+	[connection clientClosed];
+}
+
++ (void)runIOThread:(id)object {
+	@autoreleasepool {
+		// the port keeps the run loop running while no server is scheduled on it
+		[[NSRunLoop currentRunLoop] addPort:[NSMachPort port] forMode:NSDefaultRunLoopMode];
+		ioRunLoop = (CFRunLoopRef)CFRetain(CFRunLoopGetCurrent());
+		dispatch_semaphore_signal(ioThreadStarted);
+	}
+	while (TRUE) {
+		@autoreleasepool {
+			[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]];
+		}
+	}
+}
+
+static CFRunLoopRef FRNetworkServerIORunLoop(void) {
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		ioThreadStarted = dispatch_semaphore_create(0);
+		[NSThread detachNewThreadSelector:@selector(runIOThread:) toTarget:[FRNetworkServer class] withObject:nil];
+		dispatch_semaphore_wait(ioThreadStarted, DISPATCH_TIME_FOREVER);
+#if !OS_OBJECT_USE_OBJC
+		dispatch_release(ioThreadStarted);
+#endif
+		ioThreadStarted = NULL;
+	});
+	return ioRunLoop;
+}
+
+static void FRNetworkServerPerform(void (^block)(void)) {
+	CFRunLoopRef runLoop = FRNetworkServerIORunLoop();
+	CFRunLoopPerformBlock(runLoop, kCFRunLoopCommonModes, block);
+	CFRunLoopWakeUp(runLoop);
+}
+
+static void FRNetworkServerLoopCallBack(CFFileDescriptorRef descriptor, CFOptionFlags flags, void *info) {
+	FRNetworkServer *networkServer = (__bridge FRNetworkServer *)info;
+	FREventLoopRun(networkServer->loop, 0);
+	CFFileDescriptorEnableCallBacks(descriptor, kCFFileDescriptorReadCallBack);
+}
+
+static void FRNetworkServerAccepted(FRServer *server, FRServerClient *client, void *info) {
+	[(__bridge FRNetworkServer *)info acceptClient:client];
+}
+
+static void FRNetworkServerReceived(FRServer *server, FRServerClient *client,
+									const struct iovec *payload, int count, size_t length, void *info) {
+	[(__bridge FRNetworkServerConnection *)FRServerClientGetInfo(client) receivePacket:payload count:count
+																				length:length];
+}
+
+static void FRNetworkServerClosed(FRServer *server, FRServerClient *client, void *info) {
+	[(__bridge FRNetworkServer *)info closeClient:client];
 }
 
 #pragma mark -
@@ -133,23 +302,30 @@ static void callback(CFSocketRef socket, CFSocketCallBackType type, CFDataRef ad
 
 - (void)connectionFailed:(FRConnection *)aConnection {
 	if ([self.delegate respondsToSelector:@selector(networkServer:didCloseConnection:)]) {
-		[self.delegate networkServer:self didCloseConnection:aConnection];
+		[self.delegate networkServer:self didCloseConnection:(FRNetworkServerConnection *)aConnection];
 	}
-	connection = nil;
 }
 
 - (void)connectionTerminated:(FRConnection *)aConnection {
+	// the set holds the only other reference to the connection, so it's kept until the delegate is done
+	// with it
 	if ([self.delegate respondsToSelector:@selector(networkServer:didCloseConnection:)]) {
-		[self.delegate networkServer:self didCloseConnection:aConnection];
+		[self.delegate networkServer:self didCloseConnection:(FRNetworkServerConnection *)aConnection];
 	}
-	connection = nil;
+	[connections removeObject:aConnection];
 }
 
 - (void)connection:(FRConnection *)aConnection receivedMessage:(NSDictionary *)message {
 	if ([self.delegate respondsToSelector:@selector(networkServer:receivedMessage:fromConnection:)]) {
 		[self.delegate networkServer:self
 					 receivedMessage:message
-					  fromConnection:aConnection];
+					  fromConnection:(FRNetworkServerConnection *)aConnection];
+	}
+}
+
+- (void)connectionDrainedWriteQueue:(FRConnection *)aConnection {
+	if ([self.delegate respondsToSelector:@selector(networkServer:drainedConnection:)]) {
+		[self.delegate networkServer:self drainedConnection:(FRNetworkServerConnection *)aConnection];
 	}
 }
 
@@ -168,3 +344,110 @@ static void callback(CFSocketRef socket, CFSocketCallBackType type, CFDataRef ad
 }
 
 @end
+
+
+@implementation FRNetworkServerConnection
+@synthesize authorized;
+@synthesize pendingResources;
+
+- (id)initWithClient:(FRServerClient *)aClient {
+	if ((self = [super init])) {
+		client = aClient;
+		writeOpen = TRUE;
+		decodeQueue = dispatch_queue_create("com.fadingred.Greenwich.decode", DISPATCH_QUEUE_SERIAL);
+	}
+	return self;
+}
+
+#if !OS_OBJECT_USE_OBJC
+- (void)dealloc {
+	dispatch_release(decodeQueue);
+}
+#endif
+
+- (BOOL)connect {
+	return writeOpen;
+}
+
+- (void)close {
+	// messages that are still being decoded are dropped, and the delegate hears about the close once the
+	// I/O thread has closed the client
+	writeOpen = FALSE;
+	FRNetworkServerPerform(^{
+		if (client) { FRServerClose(client); }
+	});
+}
+
+- (BOOL)sendPacket:(NSData *)packet channel:(FRFrameChannel)channel {
+	// the client is only used on the I/O thread, so the packet is queued there. bytes that haven't been
+	// written yet are counted here, which lets callers hold off right away.
+	if (!packet || !writeOpen) { return FALSE; }
+	FRNetworkServerPacket *queued = malloc(sizeof(FRNetworkServerPacket));
+	if (!queued) { return FALSE; }
+	queued->data = (__bridge_retained CFDataRef)packet;
+	queued->connection = (__bridge_retained void *)self;
+	size_t length = [packet length];
+	if (__sync_add_and_fetch(&queuedLength, length) >= kWriteHighWaterMark) { writeQueueFull = TRUE; }
+	FRNetworkServerPerform(^{
+		if (!client) {
+			FRNetworkServerReleasePacket(queued);
+			return;
+		}
+		FRServerSend(client, channel, CFDataGetBytePtr(queued->data), length, queued, FRNetworkServerReleasePacket);
+	});
+	return !writeQueueFull;
+}
+
+- (void)releasedPacketOfLength:(size_t)length {
+	// called on the I/O thread. the delegate hears about it once the bytes waiting drop below half of the
+	// high water mark, if it was told to hold off.
+	size_t remaining = __sync_sub_and_fetch(&queuedLength, length);
+	size_t lowWaterMark = kWriteHighWaterMark / 2;
+	if (remaining >= lowWaterMark || remaining + length < lowWaterMark) { return; }
+	dispatch_async(dispatch_get_main_queue(), ^{
+		if (!writeOpen || !writeQueueFull || queuedLength >= lowWaterMark) { return; }
+		writeQueueFull = FALSE;
+		[self.delegate connectionDrainedWriteQueue:self];
+	});
+}
+
+- (void)receivePacket:(const struct iovec *)payload count:(int)count length:(size_t)length {
+	// called on the I/O thread. the payload is only valid during the call, so the queue gets a copy, which
+	// is also where the chunks of a longer message are put together.
+	NSMutableData *packet = [NSMutableData dataWithCapacity:length];
+	for (int index = 0; index < count; index++) {
+		[packet appendBytes:payload[index].iov_base length:payload[index].iov_len];
+	}
+	dispatch_async(decodeQueue, ^{
+		NSDictionary *message = [self decodePacket:[packet bytes] length:[packet length]];
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if (!writeOpen) { return; }
+			if (message) {
+				[self negotiateCompressionWithMessage:message];
+				[self.delegate connection:self receivedMessage:message];
+			}
+			else { [self close]; }
+		});
+	});
+}
+
+- (void)clientClosed {
+	// called on the I/O thread. messages that were received before the client closed are still delivered.
+	client = NULL;
+	dispatch_async(decodeQueue, ^{
+		dispatch_async(dispatch_get_main_queue(), ^{
+			writeOpen = FALSE;
+			[self.delegate connectionTerminated:self];
+		});
+	});
+}
+
+@end
+
+static void FRNetworkServerReleasePacket(void *info) {
+	FRNetworkServerPacket *queued = info;
+	FRNetworkServerConnection *connection = (__bridge_transfer FRNetworkServerConnection *)queued->connection;
+	[connection releasedPacketOfLength:(size_t)CFDataGetLength(queued->data)];
+	CFRelease(queued->data);
+	free(queued);
+}
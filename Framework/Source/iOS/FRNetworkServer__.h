@@ -19,39 +19,102 @@
 
 @protocol
 	FRNetworkServerDelegate;
+@class
+	FRNetworkServerConnection;
 
+/*!
+ \brief		Server for translator connections
+ \details	Accepts any number of connections at once and serves all of them from a single event loop that
+			runs on a thread of its own, so reading and writing never wait for the main thread. Only decoded
+			messages and connection events come back to the main thread, which is where the delegate is
+			called and where connections are used. Every connection is independent: it has its own queue of
+			outgoing messages, and any state kept for it (like whether it's authorized) is tied to the
+			connection.
+ */
 @interface FRNetworkServer : NSObject <NSNetServiceDelegate, FRConnectionDelegate> {
 	NSNetService *service;
-	FRConnection *connection;
+	struct FREventLoop *loop;
+	struct FRServer *server;
+	CFFileDescriptorRef loopDescriptor;
+	NSMutableSet *connections;
+	BOOL stopping;
 }
 
 @property (assign, nonatomic) id <FRNetworkServerDelegate> delegate;
 
+/*!
+ \brief		Open connections
+ \details	Open connections
+ */
+@property (readonly, nonatomic) NSArray *connections;
+
+/*!
+ \brief		Send a message to several connections
+ \details	The message is only encoded once for all connections that compress messages the same way.
+ */
+- (void)broadcastMessage:(NSDictionary *)message toConnections:(NSArray *)connections;
+
+@end
+
+/*!
+ \brief		A connection served by the network server
+ \details	Messages go through the server's event loop rather than through streams of the connection's own.
+			Received messages are decoded in the background, one at a time, and handed to the delegate on
+			the main thread in the order they arrived.
+ */
+@interface FRNetworkServerConnection : FRConnection {
+	struct FRServerClient *client;
+	dispatch_queue_t decodeQueue;
+	volatile size_t queuedLength;
+	BOOL authorized;
+	NSMutableArray *pendingResources;
+}
+
+/*!
+ \brief		Whether the translator has authenticated
+ \details	Starts out FALSE for every new connection.
+ */
+@property (nonatomic, assign, getter=isAuthorized) BOOL authorized;
+
+/*!
+ \brief		Resources waiting to be sent
+ \details	Resources requested by the translator that are sent as the connection's write queue drains.
+ */
+@property (nonatomic, strong) NSMutableArray *pendingResources;
+
 @end
 
 @protocol FRNetworkServerDelegate <NSObject>
 @optional;
 
 /*!
- \brief		
- \details	
+ \brief		Connection accepted
+ \details	Sent on the main thread once for every connection, before any message is received from it.
  */
 - (void)networkServer:(FRNetworkServer *)server
-  didCreateConnection:(FRConnection *)connection;
+  didCreateConnection:(FRNetworkServerConnection *)connection;
 
 /*!
- \brief		
- \details
+ \brief		Message received
+ \details	Sent on the main thread for every message, in the order the connection received them.
  */
 - (void)networkServer:(FRNetworkServer *)server
 	  receivedMessage:(NSDictionary *)message
-	   fromConnection:(FRConnection *)connection;
+	   fromConnection:(FRNetworkServerConnection *)connection;
+
+/*!
+ \brief		Connection closed
+ \details	Sent once for every connection, whether it was closed by the other side or with close.
+ */
+- (void)networkServer:(FRNetworkServer *)server
+   didCloseConnection:(FRNetworkServerConnection *)connection;
 
 /*!
- \brief		
- \details	
+ \brief		Connection can take more messages
+ \details	Sent once a connection that stopped taking messages (see -[FRConnection sendMessage:]) has
+			written enough of its queued messages.
  */
 - (void)networkServer:(FRNetworkServer *)server
-   didCloseConnection:(FRConnection *)connection;
+	drainedConnection:(FRNetworkServerConnection *)connection;
 
 @end
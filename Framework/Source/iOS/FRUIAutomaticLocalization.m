@@ -21,11 +21,14 @@
 #import "FRUIAutomaticLocalization.h"
 #import "FRRuntimeAdditions.h"
 #import "FRLocalizationBundleAdditions.h"
+#import "FRLocalizationBundleAdditions__.h"
 #import "FRBundleAdditions.h"
 
 static int FRAutomaticLocalizationBundleKey;
 static int FRAutomaticLocalizationTableKey;
+static int FRAutomaticLocalizationSourcesKey;
 static int FRProxyOriginalClassKey;
+static NSString * const kButtonTitleKey = @"normalTitle";
 
 // we're making the assumption that all nibs are created on the main thread,
 // so these variables don't need to be thread local or thread safe at all.
@@ -42,6 +45,13 @@ static Class gWebViewClass = nil;
 - (void)localizePlaceholder:(id)object;
 - (void)localizePrompt:(id)object;
 - (NSString *)localizedStringFor:(NSString *)string;
+- (NSString *)localizedStringFor:(NSString *)string object:(id)object key:(id)key;
+- (NSBundle *)localizationBundle;
++ (void)translationsDidChange:(NSNotification *)notification;
++ (void)relocalizeObject:(id)object
+			  identifier:(NSString *)identifier
+				   table:(NSString *)table
+				 visited:(NSMutableSet *)visited;
 - (void)prepareForLocalizationWithNibName:(NSString *)nibName directory:(NSString *)directory bundle:(NSBundle *)bundle;
 @end
 
@@ -121,6 +131,9 @@ static NSArray *(FRInstantiateNib)(id self, SEL _cmd, id owner, NSDictionary *op
 	[self swizzle:@selector(initWithCoder:) with:(IMP)FRInitNibWithCodder store:(IMPPointer)&SInitNibWithCodder];
 	[self swizzle:@selector(instantiateWithOwner:options:)
 			 with:(IMP)FRInstantiateNib store:(IMPPointer)&SInstantiateNib];
+	
+	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(translationsDidChange:)
+												 name:FRTranslationsDidChangeNotification object:nil];
 }
 
 static void *FRAlloc(id self, SEL _cmd, NSZone *zone) {
@@ -190,7 +203,8 @@ static id FRInitNibWithCodder(id self, SEL _cmd, NSCoder *coder) {
 					// normal state title in interface builder
 					NSString *title = [object titleForState:UIControlStateNormal];
 					if (title) {
-						[object setTitle:[self localizedStringFor:title] forState:UIControlStateNormal];
+						[object setTitle:[self localizedStringFor:title object:object key:kButtonTitleKey]
+								forState:UIControlStateNormal];
 					}
 					[localizeSubviews removeAllObjects];
 				}
@@ -225,7 +239,8 @@ static id FRInitNibWithCodder(id self, SEL _cmd, NSCoder *coder) {
 					for (NSUInteger i = 0; i < [object numberOfSegments]; i++) {
 						NSString *title = [object titleForSegmentAtIndex:i];
 						if (title) {
-							[object setTitle:[self localizedStringFor:title] forSegmentAtIndex:i];
+							NSNumber *key = [NSNumber numberWithUnsignedInteger:i];
+							[object setTitle:[self localizedStringFor:title object:object key:key] forSegmentAtIndex:i];
 						}
 					}
 					[localizeSubviews removeAllObjects];
@@ -377,7 +392,7 @@ static id FRInitNibWithCodder(id self, SEL _cmd, NSCoder *coder) {
 - (void)localize ## upSignature:(id)object { \
 	if ([object lowSignature]) { \
 		[object set ## upSignature: \
-		[self localizedStringFor:[object lowSignature]]]; \
+		[self localizedStringFor:[object lowSignature] object:object key:@#lowSignature]]; \
 	} \
 }
 
@@ -388,27 +403,137 @@ FRDefineLocalization(prompt, Prompt);
 
 - (NSString *)localizedStringFor:(NSString *)string {
 	if (string && [string length]) {
-		NSBundle *bundle = objc_getAssociatedObject(self, &FRAutomaticLocalizationBundleKey);
 		NSString *table = objc_getAssociatedObject(self, &FRAutomaticLocalizationTableKey);
+		return [[self localizationBundle] localizedStringForKey:string value:string table:table];
+	} else {
+		return string;
+	}
+}
+
+- (NSString *)localizedStringFor:(NSString *)string object:(id)object key:(id)key {
+	if (string && [string length]) {
+		NSBundle *bundle = [self localizationBundle];
+		NSString *table = objc_getAssociatedObject(self, &FRAutomaticLocalizationTableKey);
+		NSString *localized = [bundle localizedStringForKey:string value:string table:table];
 		
-		// since the bundle isn't the real bundle, we need to keep moving up through the
-		// path to try to find the identifier.
-		NSString *directory = [bundle bundlePath];
-		while (([[directory pathComponents] count] > 1)) {
-			NSBundle *check = [NSBundle bundleWithPath:directory];
-			directory = [directory stringByDeletingLastPathComponent];
-			if ([check bundleIdentifier]) {
-				bundle = check;
-				break;
-			}
+		// the original string is kept with the object, so it can be localized again when translations
+		// change while the application is running
+		NSMutableDictionary *sources = objc_getAssociatedObject(object, &FRAutomaticLocalizationSourcesKey);
+		if (!sources) {
+			sources = [NSMutableDictionary dictionary];
+			objc_setAssociatedObject(object, &FRAutomaticLocalizationSourcesKey, sources, OBJC_ASSOCIATION_RETAIN);
 		}
+		[sources setObject:[NSArray arrayWithObjects:string, localized, nil] forKey:key];
+		objc_setAssociatedObject(object, &FRAutomaticLocalizationBundleKey, bundle, OBJC_ASSOCIATION_RETAIN);
+		objc_setAssociatedObject(object, &FRAutomaticLocalizationTableKey, table, OBJC_ASSOCIATION_COPY);
 		
-		return [bundle localizedStringForKey:string value:string table:table];
+		return localized;
 	} else {
 		return string;
 	}
 }
 
+- (NSBundle *)localizationBundle {
+	NSBundle *bundle = objc_getAssociatedObject(self, &FRAutomaticLocalizationBundleKey);
+	
+	// since the bundle isn't the real bundle, we need to keep moving up through the
+	// path to try to find the identifier.
+	NSString *directory = [bundle bundlePath];
+	while (([[directory pathComponents] count] > 1)) {
+		NSBundle *check = [NSBundle bundleWithPath:directory];
+		directory = [directory stringByDeletingLastPathComponent];
+		if ([check bundleIdentifier]) {
+			bundle = check;
+			break;
+		}
+	}
+	
+	return bundle;
+}
+
++ (void)translationsDidChange:(NSNotification *)notification {
+	NSString *identifier = [[notification userInfo] objectForKey:FRTranslationsBundleIdentifierKey];
+	NSString *table = [[notification userInfo] objectForKey:FRTranslationsTableKey];
+	NSMutableSet *visited = [NSMutableSet set];
+	for (UIWindow *window in [[UIApplication sharedApplication] windows]) {
+		[self relocalizeObject:[window rootViewController] identifier:identifier table:table visited:visited];
+		[self relocalizeObject:window identifier:identifier table:table visited:visited];
+	}
+}
+
++ (void)relocalizeObject:(id)object
+			  identifier:(NSString *)identifier
+				   table:(NSString *)table
+				 visited:(NSMutableSet *)visited {
+	if ([object isKindOfClass:[NSArray class]]) {
+		for (id item in object) { [self relocalizeObject:item identifier:identifier table:table visited:visited]; }
+		return;
+	}
+	if (!object || [visited containsObject:object]) { return; }
+	[visited addObject:object];
+	
+	NSMutableDictionary *sources = objc_getAssociatedObject(object, &FRAutomaticLocalizationSourcesKey);
+	NSBundle *bundle = objc_getAssociatedObject(object, &FRAutomaticLocalizationBundleKey);
+	NSString *objectTable = objc_getAssociatedObject(object, &FRAutomaticLocalizationTableKey);
+	if (sources && [[bundle bundleIdentifier] isEqualToString:identifier] && [objectTable isEqualToString:table]) {
+		for (id key in [sources allKeys]) {
+			NSString *source = [[sources objectForKey:key] objectAtIndex:0];
+			NSString *previous = [[sources objectForKey:key] objectAtIndex:1];
+			NSString *localized = [bundle localizedStringForKey:source value:source table:table];
+			
+			// strings that the application has changed since they were localized are left alone
+			id current = nil;
+			if ([key isKindOfClass:[NSNumber class]]) {
+				if ([key unsignedIntegerValue] < [object numberOfSegments]) {
+					current = [object titleForSegmentAtIndex:[key unsignedIntegerValue]];
+				}
+			}
+			else if ([key isEqualToString:kButtonTitleKey]) { current = [object titleForState:UIControlStateNormal]; }
+			else { current = [object valueForKey:key]; }
+			if (![current isEqual:previous] || [localized isEqualToString:previous]) { continue; }
+			
+			if ([key isKindOfClass:[NSNumber class]]) {
+				[object setTitle:localized forSegmentAtIndex:[key unsignedIntegerValue]];
+			}
+			else if ([key isEqualToString:kButtonTitleKey]) {
+				[object setTitle:localized forState:UIControlStateNormal];
+			}
+			else { [object setValue:localized forKey:key]; }
+			[sources setObject:[NSArray arrayWithObjects:source, localized, nil] forKey:key];
+		}
+	}
+	
+	// only what's showing (or could show again without being loaded) is updated. bar items aren't views,
+	// so they're reached through their bars and navigation items.
+	if ([object isKindOfClass:[UIView class]]) {
+		[self relocalizeObject:[object subviews] identifier:identifier table:table visited:visited];
+		if ([object isKindOfClass:[UINavigationBar class]] ||
+			[object isKindOfClass:[UIToolbar class]] ||
+			[object isKindOfClass:[UITabBar class]]) {
+			[self relocalizeObject:[object items] identifier:identifier table:table visited:visited];
+		}
+	}
+	else if ([object isKindOfClass:[UINavigationItem class]]) {
+		[self relocalizeObject:[object titleView] identifier:identifier table:table visited:visited];
+		[self relocalizeObject:[object backBarButtonItem] identifier:identifier table:table visited:visited];
+		[self relocalizeObject:[object leftBarButtonItems] identifier:identifier table:table visited:visited];
+		[self relocalizeObject:[object rightBarButtonItems] identifier:identifier table:table visited:visited];
+	}
+	else if ([object isKindOfClass:[UIBarButtonItem class]]) {
+		[self relocalizeObject:[object customView] identifier:identifier table:table visited:visited];
+	}
+	else if ([object isKindOfClass:[UIViewController class]]) {
+		if ([object isViewLoaded]) {
+			[self relocalizeObject:[object view] identifier:identifier table:table visited:visited];
+		}
+		[self relocalizeObject:[object navigationItem] identifier:identifier table:table visited:visited];
+		[self relocalizeObject:[object tabBarItem] identifier:identifier table:table visited:visited];
+		[self relocalizeObject:[object toolbarItems] identifier:identifier table:table visited:visited];
+		[self relocalizeObject:[object childViewControllers] identifier:identifier table:table visited:visited];
+		[self relocalizeObject:[object presentedViewController] identifier:identifier table:table visited:visited];
+	}
+}
+
 static NSArray *FRInstantiateNib(id self, SEL _cmd, id owner, NSDictionary *options) {
 	NSString *currentTableKey = nil;
 	NSBundle *currentBundleKey = nil;
@@ -0,0 +1,138 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <string.h>
+#include <unistd.h>
+#include <bzlib.h>
+
+#import "parallel_bzip2.h"
+#import "FRTests.h"
+
+// compresses a project's worth of strings files the way archives used to be written (a single bzip2 stream) and
+// with the parallel compressor at different thread counts. every output is decompressed again and compared.
+typedef struct FRTestOutput {
+	char *bytes;
+	size_t length;
+	size_t capacity;
+} FRTestOutput;
+
+static int FRTestWrite(void *context, const void *buffer, size_t length) {
+	FRTestOutput *output = context;
+	if (output->length + length > output->capacity) {
+		output->capacity = (output->length + length) * 2;
+		output->bytes = realloc(output->bytes, output->capacity);
+		FRTestAssert(output->bytes != NULL, "allocate");
+	}
+	memcpy(output->bytes + output->length, buffer, length);
+	output->length += length;
+	return 0;
+}
+
+static void FRTestSingleStream(const char *input, size_t length, FRTestOutput *output) {
+	bz_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	FRTestAssert(BZ2_bzCompressInit(&stream, 9, 0, 0) == BZ_OK, "initialize bzip2");
+	stream.next_in = (char *)input;
+	stream.avail_in = (unsigned int)length;
+	int result = BZ_RUN_OK;
+	while (result != BZ_STREAM_END) {
+		char buffer[64 * 1024];
+		stream.next_out = buffer;
+		stream.avail_out = sizeof(buffer);
+		result = BZ2_bzCompress(&stream, BZ_FINISH);
+		FRTestAssert(result == BZ_FINISH_OK || result == BZ_STREAM_END, "compress: %d", result);
+		FRTestWrite(output, buffer, sizeof(buffer) - stream.avail_out);
+	}
+	BZ2_bzCompressEnd(&stream);
+}
+
+static void FRTestParallel(const char *input, size_t length, int threads, FRTestOutput *output) {
+	parallel_bzip2 *compressor = parallel_bzip2_create(FRTestWrite, output, threads);
+	FRTestAssert(compressor != NULL, "create compressor");
+	// written in pieces the size archiving writes tar data in
+	for (size_t location = 0; location < length; location += 10240) {
+		size_t amount = (length - location < 10240) ? length - location : 10240;
+		FRTestAssert(parallel_bzip2_write(compressor, input + location, amount) == 0, "write");
+	}
+	FRTestAssert(parallel_bzip2_finish(compressor) == 0, "finish");
+}
+
+// the parallel output is a series of streams, which is decompressed one stream after another like bzip2 does
+static void FRTestVerify(const FRTestOutput *output, const char *input, size_t length) {
+	char *decompressed = malloc(length + 1);
+	FRTestAssert(decompressed != NULL, "allocate");
+	size_t location = 0, produced = 0;
+	while (location < output->length) {
+		bz_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		FRTestAssert(BZ2_bzDecompressInit(&stream, 0, 0) == BZ_OK, "initialize bzip2");
+		stream.next_in = output->bytes + location;
+		stream.avail_in = (unsigned int)(output->length - location);
+		stream.next_out = decompressed + produced;
+		stream.avail_out = (unsigned int)(length + 1 - produced);
+		FRTestAssert(BZ2_bzDecompress(&stream) == BZ_STREAM_END, "stream at %zu doesn't end", location);
+		location = output->length - stream.avail_in;
+		produced = (size_t)(stream.next_out - decompressed);
+		BZ2_bzDecompressEnd(&stream);
+	}
+	FRTestAssert(produced == length && memcmp(decompressed, input, length) == 0, "decompressed data differs");
+	free(decompressed);
+}
+
+int main(int argc, char **argv) {
+	double scale = FRTestScale(argc, argv);
+	size_t length = (size_t)(32 * 1024 * 1024 * scale);
+	if (length < 1024 * 1024) { length = 1024 * 1024; }
+	
+	// strings files with some less compressible data mixed in, like the images that get packaged with them
+	uint32_t random = 13;
+	char *input = malloc(length + 128);
+	FRTestAssert(input != NULL, "allocate");
+	size_t filled = 0;
+	for (size_t entry = 0; filled < length; entry++) {
+		if (entry % 200 == 0) {
+			for (size_t count = 0; count < 2048 && filled < length; count++) {
+				input[filled++] = (char)FRTestRandom(&random);
+			}
+			continue;
+		}
+		filled += snprintf(input + filled, 128, "/* Label for item %u */\n\"Item %zu\" = \"Element %u\";\n\n",
+						   FRTestRandom(&random) % 1000, entry, FRTestRandom(&random) % 100000);
+	}
+	
+	long processors = sysconf(_SC_NPROCESSORS_ONLN);
+	int counts[] = { 0, 1, 2, 4, (int)(processors > 0 ? processors : 1) };
+	size_t configurations = sizeof(counts) / sizeof(*counts) - (counts[4] <= 4);
+	printf("bzip2: %.1f MB on %ld processors\n", length / 1048576.0, processors);
+	
+	for (size_t configuration = 0; configuration < configurations; configuration++) {
+		FRTestOutput output = { NULL, 0, 0 };
+		double start = FRTestTime();
+		if (counts[configuration] == 0) { FRTestSingleStream(input, length, &output); }
+		else { FRTestParallel(input, length, counts[configuration], &output); }
+		double elapsed = FRTestTime() - start;
+		FRTestVerify(&output, input, length);
+		
+		if (counts[configuration] == 0) { printf("  single stream:      "); }
+		else { printf("  parallel %2d threads:", counts[configuration]); }
+		printf(" %6.2f MB/s, %5.1f%% of the input\n", length / 1048576.0 / elapsed, 100.0 * output.length / length);
+		free(output.bytes);
+	}
+	
+	free(input);
+	return 0;
+}
@@ -0,0 +1,154 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <errno.h>
+#include <string.h>
+
+#import "archiving.h"
+#import "FRTests.h"
+
+// reads archives with and without an index from memory and checks every file against what was archived
+enum { kItemCount = 120 };
+
+typedef struct {
+	char *bytes;
+	size_t length;
+	size_t capacity;
+} FRTestBuffer;
+
+static char gPaths[kItemCount][64];
+static char *gContents[kItemCount];
+static size_t gLengths[kItemCount];
+static archiving_item gItems[kItemCount];
+
+static int FRTestOutput(void *context, const void *buffer, size_t length) {
+	FRTestBuffer *output = context;
+	if (output->length + length > output->capacity) {
+		output->capacity = (output->length + length) * 2;
+		output->bytes = realloc(output->bytes, output->capacity);
+		FRTestAssert(output->bytes != NULL, "grow output to %zu", output->capacity);
+	}
+	memcpy(output->bytes + output->length, buffer, length);
+	output->length += length;
+	return 0;
+}
+
+static void FRTestMakeItems(void) {
+	// mostly small files with a few that span several streams, in no particular order
+	uint32_t state = 2463534242u;
+	for (size_t index = 0; index < kItemCount; index++) {
+		size_t length = FRTestRandom(&state) % 4000;
+		if (index % 40 == 7) { length = 1000000 + FRTestRandom(&state) % 200000; }
+		if (index % 50 == 3) { length = 0; }
+		gContents[index] = malloc(length ? length : 1);
+		for (size_t position = 0; position < length; position++) {
+			// compressible, but not so much that a large file fits in one stream
+			gContents[index][position] = (char)('a' + FRTestRandom(&state) % ((position % 7) ? 4 : 26));
+		}
+		gLengths[index] = length;
+		snprintf(gPaths[index], sizeof(gPaths[index]), "package/%s/%03zu.strings",
+				 (index % 3) ? "en.lproj" : "de.lproj", (index * 37) % kItemCount);
+		archiving_item item = { .archive_path = gPaths[index], .data = gContents[index], .length = length };
+		gItems[index] = item;
+	}
+}
+
+static void FRTestReadsEveryItem(archiving_reader *reader, const char *kind) {
+	FRTestAssert(archiving_reader_count(reader) == kItemCount, "%s: %zu files",
+				 kind, archiving_reader_count(reader));
+	for (size_t index = 1; index < kItemCount; index++) {
+		FRTestAssert(strcmp(archiving_reader_path(reader, index - 1), archiving_reader_path(reader, index)) < 0,
+					 "%s: sorted at %zu", kind, index);
+	}
+	
+	// read in an order that jumps between streams
+	for (size_t step = 0; step < kItemCount; step++) {
+		size_t index = (step * 53) % kItemCount;
+		void *buffer = NULL;
+		size_t length = 0;
+		int error = archiving_reader_read(reader, gPaths[index], &buffer, &length);
+		FRTestAssert(error == 0, "%s: read %s: %s", kind, gPaths[index], strerror(error));
+		FRTestAssert(length == gLengths[index] && memcmp(buffer, gContents[index], length) == 0,
+					 "%s: contents of %s", kind, gPaths[index]);
+		free(buffer);
+	}
+	
+	void *buffer = NULL;
+	size_t length = 0;
+	FRTestAssert(archiving_reader_read(reader, "package/missing.strings", &buffer, &length) == ENOENT,
+				 "%s: missing file", kind);
+	FRTestAssert(archiving_reader_read(reader, "package/.index", &buffer, &length) == ENOENT,
+				 "%s: the index isn't a file", kind);
+}
+
+static void FRTestReadsIndexedArchives(void) {
+	FRTestBuffer archive = { NULL, 0, 0 };
+	int error = archive_create_indexed_tar_items(gItems, kItemCount, "package/.index", FRTestOutput, &archive);
+	FRTestAssert(error == 0, "create indexed archive: %s", strerror(error));
+	
+	archiving_reader *reader = NULL;
+	error = archiving_reader_create(archive.bytes, archive.length, ".index", &reader);
+	FRTestAssert(error == 0, "open indexed archive: %s", strerror(error));
+	FRTestReadsEveryItem(reader, "indexed");
+	archiving_reader_free(reader);
+	
+	// an index with another name is just a file, so the archive is read without it
+	error = archiving_reader_create(archive.bytes, archive.length, "index", &reader);
+	FRTestAssert(error == 0, "open with another index name: %s", strerror(error));
+	FRTestAssert(archiving_reader_count(reader) == kItemCount + 1, "index read as a file");
+	archiving_reader_free(reader);
+	
+	// a damaged end takes the index with it, and reading without it finds the damage too
+	error = archiving_reader_create(archive.bytes, archive.length - 40, ".index", &reader);
+	FRTestAssert(error != 0, "open truncated indexed archive");
+	
+	free(archive.bytes);
+}
+
+static void FRTestReadsArchivesWithoutIndex(void) {
+	archiving_compression compressions[] = { archiving_compression_bzip2, archiving_compression_parallel_bzip2 };
+	const char *kinds[] = { "single stream", "parallel" };
+	for (size_t kind = 0; kind < 2; kind++) {
+		FRTestBuffer archive = { NULL, 0, 0 };
+		int error = archive_create_tar_items(gItems, kItemCount, compressions[kind], FRTestOutput, &archive);
+		FRTestAssert(error == 0, "%s: create archive: %s", kinds[kind], strerror(error));
+		
+		archiving_reader *reader = NULL;
+		error = archiving_reader_create(archive.bytes, archive.length, ".index", &reader);
+		FRTestAssert(error == 0, "%s: open archive: %s", kinds[kind], strerror(error));
+		FRTestReadsEveryItem(reader, kinds[kind]);
+		archiving_reader_free(reader);
+		
+		error = archiving_reader_create(archive.bytes, archive.length / 2, ".index", &reader);
+		FRTestAssert(error != 0, "%s: open truncated archive", kinds[kind]);
+		free(archive.bytes);
+	}
+	
+	// not an archive at all
+	archiving_reader *reader = NULL;
+	FRTestAssert(archiving_reader_create("BZh91AY&SY", 10, ".index", &reader) != 0, "open garbage");
+}
+
+int main(int argc, char **argv) {
+	FRTestMakeItems();
+	FRTestReadsIndexedArchives();
+	FRTestReadsArchivesWithoutIndex();
+	
+	for (size_t index = 0; index < kItemCount; index++) { free(gContents[index]); }
+	printf("archiving reader: ok\n");
+	return 0;
+}
@@ -0,0 +1,239 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <archive.h>
+#include <archive_entry.h>
+
+#import "archiving.h"
+#import "FRTests.h"
+
+// extracts archives written with libarchive directly (so they can hold entries the archiver would never write)
+// into a scratch directory and checks that nothing ends up outside of the directory it's extracted to
+typedef struct FRTestEntry {
+	const char *path;
+	char type;					// f for files, d for directories, l for links
+	const char *contents;		// the data of a file or the target of a link
+} FRTestEntry;
+
+static char gRoot[64];
+
+// paths are only valid until the next few calls, so ones that are kept around are copied
+static const char *FRTestPath(const char *relative) {
+	static char path[4][256];
+	static int next = 0;
+	char *result = path[next++ % 4];
+	snprintf(result, sizeof(path[0]), "%s/%s", gRoot, relative);
+	return result;
+}
+
+static void FRTestWriteArchive(const char *path, const FRTestEntry *entries, size_t count) {
+	struct archive *a = archive_write_new();
+	FRTestAssert(a != NULL, "create archive");
+	archive_write_set_compression_bzip2(a);
+	archive_write_set_format_pax_restricted(a);
+	FRTestAssert(archive_write_open_filename(a, path) == ARCHIVE_OK, "open %s", path);
+	for (size_t index = 0; index < count; index++) {
+		struct archive_entry *entry = archive_entry_new();
+		size_t length = (entries[index].type == 'f') ? strlen(entries[index].contents) : 0;
+		archive_entry_set_pathname(entry, entries[index].path);
+		archive_entry_set_perm(entry, 0644);
+		archive_entry_set_size(entry, length);
+		if (entries[index].type == 'd') { archive_entry_set_filetype(entry, AE_IFDIR); }
+		if (entries[index].type == 'f') { archive_entry_set_filetype(entry, AE_IFREG); }
+		if (entries[index].type == 'l') {
+			archive_entry_set_filetype(entry, AE_IFLNK);
+			archive_entry_set_symlink(entry, entries[index].contents);
+		}
+		FRTestAssert(archive_write_header(a, entry) == ARCHIVE_OK, "write %s", entries[index].path);
+		if (length) { archive_write_data(a, entries[index].contents, length); }
+		archive_entry_free(entry);
+	}
+	archive_write_close(a);
+	archive_write_finish(a);
+}
+
+static int FRTestExtract(const FRTestEntry *entries, size_t count, const char *destination) {
+	const char *archive = FRTestPath("archive.tbz");
+	FRTestWriteArchive(archive, entries, count);
+	mkdir(destination, 0755);
+	int fd = open(archive, O_RDONLY);
+	FRTestAssert(fd >= 0, "open %s", archive);
+	int error = archive_extract_tar_bzip2(fd, destination);
+	close(fd);
+	unlink(archive);
+	return error;
+}
+
+static int FRTestRemoveItem(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+	return remove(path);
+}
+
+static void FRTestRemove(const char *path) {
+	nftw(path, FRTestRemoveItem, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static int FRTestExists(const char *path) {
+	struct stat st;
+	return lstat(path, &st) == 0;
+}
+
+static void FRTestContents(const char *path, const char *expected) {
+	char buffer[256] = {};
+	int fd = open(path, O_RDONLY);
+	FRTestAssert(fd >= 0, "open %s", path);
+	FRTestAssert(read(fd, buffer, sizeof(buffer) - 1) >= 0, "read %s", path);
+	close(fd);
+	FRTestAssert(strcmp(buffer, expected) == 0, "%s has '%s', expected '%s'", path, buffer, expected);
+}
+
+static void FRTestExtractsNormalArchives(void) {
+	FRTestEntry entries[] = {
+		{ "./top.txt", 'f', "top" },
+		{ "a/", 'd', NULL },
+		{ "a/b.txt", 'f', "b" },
+		{ "a/link", 'l', "b.txt" },
+		{ "a/up", 'l', "../top.txt" },
+		{ "a/deep/c.txt", 'f', "c" },
+		{ "a/deep/up", 'l', "./../../a/b.txt" },
+		{ "self", 'l', "." },
+	};
+	char destination[256];
+	strcpy(destination, FRTestPath("normal"));
+	int error = FRTestExtract(entries, sizeof(entries) / sizeof(*entries), destination);
+	FRTestAssert(error == 0, "extract: %s", strerror(error));
+	
+	FRTestContents(FRTestPath("normal/top.txt"), "top");
+	FRTestContents(FRTestPath("normal/a/link"), "b");
+	FRTestContents(FRTestPath("normal/a/up"), "top");
+	FRTestContents(FRTestPath("normal/a/deep/c.txt"), "c");
+	FRTestContents(FRTestPath("normal/a/deep/up"), "b");
+	FRTestContents(FRTestPath("normal/self/a/b.txt"), "b");
+	
+	// extracting again replaces everything
+	error = FRTestExtract(entries, sizeof(entries) / sizeof(*entries), destination);
+	FRTestAssert(error == 0, "extract again: %s", strerror(error));
+	FRTestContents(FRTestPath("normal/a/up"), "top");
+	FRTestRemove(destination);
+}
+
+// each archive has to fail with the expected error without touching anything outside of the destination
+static void FRTestRejects(const char *name, const FRTestEntry *entries, size_t count, int expected) {
+	char destination[256];
+	strcpy(destination, FRTestPath("evil"));
+	mkdir(FRTestPath("outside"), 0755);
+	int error = FRTestExtract(entries, count, destination);
+	FRTestAssert(error == expected, "%s: got %d (%s), expected %d", name, error, strerror(error), expected);
+	FRTestAssert(!FRTestExists(FRTestPath("escaped.txt")), "%s: wrote escaped.txt", name);
+	FRTestAssert(!FRTestExists(FRTestPath("outside/escaped.txt")), "%s: wrote outside/escaped.txt", name);
+	FRTestRemove(destination);
+}
+
+#define FRTestRejectsArchive(expected, ...) do { \
+	FRTestEntry entries[] = { __VA_ARGS__ }; \
+	FRTestRejects(#__VA_ARGS__, entries, sizeof(entries) / sizeof(*entries), expected); \
+} while (0)
+
+static void FRTestRejectsEscapingArchives(void) {
+	// paths outside of the destination
+	FRTestRejectsArchive(EINVAL, { "../escaped.txt", 'f', "x" });
+	FRTestRejectsArchive(EINVAL, { "a/../../escaped.txt", 'f', "x" });
+	FRTestRejectsArchive(EINVAL, { "./../escaped.txt", 'f', "x" });
+	
+	// links pointing outside of the destination, directly or through other links
+	FRTestRejectsArchive(EINVAL, { "link", 'l', "/tmp" });
+	FRTestRejectsArchive(EINVAL, { "link", 'l', "" });
+	FRTestRejectsArchive(EINVAL, { "link", 'l', ".." });
+	FRTestRejectsArchive(EINVAL, { "link", 'l', "../outside" });
+	FRTestRejectsArchive(EINVAL, { "a/b/link", 'l', "../../../outside" });
+	FRTestRejectsArchive(EINVAL, { "a/link", 'l', "b/../../.." });
+	FRTestRejectsArchive(EINVAL, { "self", 'l', "." }, { "a/up", 'l', "../self/.." });
+	
+	// writing through links, even ones that point inside
+	FRTestRejectsArchive(EINVAL, { "self", 'l', "." }, { "self/escaped.txt", 'f', "x" });
+	FRTestRejectsArchive(EINVAL, { "a/", 'd', NULL }, { "b", 'l', "a" }, { "b/c/escaped.txt", 'f', "x" });
+	FRTestRejectsArchive(EEXIST, { "a", 'l', "b" }, { "a/", 'd', NULL });
+	
+	// links that were already there
+	mkdir(FRTestPath("evil"), 0755);
+	FRTestAssert(symlink(FRTestPath("outside"), FRTestPath("evil/out")) == 0, "create link");
+	FRTestRejectsArchive(EINVAL, { "out/escaped.txt", 'f', "x" });
+	
+	// files that are in the way of directories
+	FRTestRejectsArchive(ENOTDIR, { "file", 'f', "x" }, { "file/escaped.txt", 'f', "x" });
+}
+
+// the paths in a package manifest come from whoever made the package, so the ones a hostile manifest could
+// list to get at files outside of the directory it's applied to have to be turned down
+static void FRTestChecksPaths(void) {
+	char directory[256];
+	strcpy(directory, FRTestPath("checked"));
+	mkdir(directory, 0755);
+	mkdir(FRTestPath("checked/en.lproj"), 0755);
+	mkdir(FRTestPath("outside"), 0755);
+	FRTestAssert(symlink(FRTestPath("outside"), FRTestPath("checked/out")) == 0, "create link");
+	FRTestAssert(symlink("en.lproj", FRTestPath("checked/fr.lproj")) == 0, "create link");
+	FRTestAssert(symlink("../outside/escaped.txt", FRTestPath("checked/en.lproj/link.strings")) == 0,
+				 "create link");
+	
+	const char *valid[] = {
+		"Localizable.strings", "en.lproj/Localizable.strings", "de.lproj/Localizable.strings",
+		"App/en.lproj/Main.strings", "..strings", ".hidden",
+	};
+	for (size_t index = 0; index < sizeof(valid) / sizeof(*valid); index++) {
+		int error = archive_check_path(directory, valid[index]);
+		FRTestAssert(error == 0, "check %s: %s", valid[index], strerror(error));
+	}
+	
+	const char *hostile[] = {
+		"", "/etc/passwd", "../escaped.txt", "en.lproj/../../escaped.txt", "..", ".", "./Localizable.strings",
+		"en.lproj/./Localizable.strings", "en.lproj//Localizable.strings", "en.lproj/", "out/escaped.txt",
+		"fr.lproj/Localizable.strings", "en.lproj/link.strings", "out",
+	};
+	for (size_t index = 0; index < sizeof(hostile) / sizeof(*hostile); index++) {
+		int error = archive_check_path(directory, hostile[index]);
+		FRTestAssert(error == EINVAL, "check %s: got %d, expected %d", hostile[index], error, EINVAL);
+	}
+	
+	// files in the way of directories are an error, but not a link
+	int fd = open(FRTestPath("checked/file"), O_WRONLY | O_CREAT, 0644);
+	FRTestAssert(fd >= 0, "create file");
+	close(fd);
+	int error = archive_check_path(directory, "file/Localizable.strings");
+	FRTestAssert(error == ENOTDIR, "check file/Localizable.strings: got %d, expected %d", error, ENOTDIR);
+	
+	FRTestRemove(directory);
+	FRTestRemove(FRTestPath("outside"));
+}
+
+int main(int argc, char **argv) {
+	snprintf(gRoot, sizeof(gRoot), "/tmp/greenwich-tests.XXXXXX");
+	FRTestAssert(mkdtemp(gRoot) != NULL, "create scratch directory");
+	
+	FRTestExtractsNormalArchives();
+	FRTestRejectsEscapingArchives();
+	FRTestChecksPaths();
+	
+	FRTestRemove(gRoot);
+	printf("archiving: ok\n");
+	return 0;
+}
@@ -0,0 +1,190 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <errno.h>
+#include <pthread.h>
+
+#import "FRFrameBuffer.h"
+#import "FRTests.h"
+
+// sends a session's worth of messages over a loopback connection and reads them with a frame buffer the way a
+// connection does: mostly short control messages, interleaved with strings files that take many frames on the
+// bulk channel. every message is checked in the chunks it comes out in.
+typedef struct FRTestTraffic {
+	int socket;
+	size_t controlCount;
+	size_t bulkCount;
+	size_t bytes;
+} FRTestTraffic;
+
+static void FRTestWriteAll(int socket, const uint8_t *bytes, size_t length) {
+	while (length) {
+		ssize_t written = write(socket, bytes, length);
+		if (written < 0 && errno == EINTR) { continue; }
+		FRTestAssert(written > 0, "write: %s", strerror(errno));
+		bytes += written;
+		length -= (size_t)written;
+	}
+}
+
+static size_t FRTestFrame(uint8_t *frame, FRFrameChannel channel, uint32_t index, size_t offset,
+						  size_t chunkLength, size_t messageLength) {
+	// the first bytes of a message hold its index and length, the rest is the low byte of the index
+	int more = (offset + chunkLength < messageLength);
+	frame[0] = (uint8_t)(chunkLength >> 24);
+	frame[1] = (uint8_t)(chunkLength >> 16);
+	frame[2] = (uint8_t)(chunkLength >> 8);
+	frame[3] = (uint8_t)chunkLength;
+	frame[4] = channel | (more ? FRFrameFlagMore : 0);
+	uint8_t *payload = frame + FRFrameBufferHeaderLength;
+	memset(payload, (uint8_t)index, chunkLength);
+	uint8_t header[8] = { (uint8_t)(index >> 24), (uint8_t)(index >> 16), (uint8_t)(index >> 8), (uint8_t)index,
+		(uint8_t)(messageLength >> 24), (uint8_t)(messageLength >> 16), (uint8_t)(messageLength >> 8),
+		(uint8_t)messageLength };
+	for (size_t position = offset; position < 8 && position < offset + chunkLength; position++) {
+		payload[position - offset] = header[position];
+	}
+	return FRFrameBufferHeaderLength + chunkLength;
+}
+
+static void *FRTestWriter(void *context) {
+	FRTestTraffic *traffic = context;
+	size_t capacity = 256 * 1024;
+	uint8_t *output = malloc(capacity);
+	FRTestAssert(output != NULL, "allocate");
+	size_t filled = 0;
+	
+	uint32_t random = 11;
+	uint32_t control = 0;
+	uint32_t bulk = 0;
+	size_t bulkLength = 0;
+	size_t bulkOffset = 0;
+	while (control < traffic->controlCount || bulk < traffic->bulkCount) {
+		if (filled + FRFrameBufferHeaderLength + FRFrameBufferMaximumChunkLength > capacity) {
+			FRTestWriteAll(traffic->socket, output, filled);
+			filled = 0;
+		}
+		
+		// a frame of the strings file in progress, then maybe a control message in between
+		if (bulk < traffic->bulkCount) {
+			if (!bulkLength) { bulkLength = 20 * 1024 + FRTestRandom(&random) % (300 * 1024); }
+			size_t chunk = bulkLength - bulkOffset;
+			if (chunk > FRFrameBufferMaximumChunkLength) { chunk = FRFrameBufferMaximumChunkLength; }
+			filled += FRTestFrame(output + filled, FRFrameChannelBulk, bulk, bulkOffset, chunk, bulkLength);
+			bulkOffset += chunk;
+			if (bulkOffset == bulkLength) {
+				bulk++;
+				bulkLength = 0;
+				bulkOffset = 0;
+			}
+		}
+		if (control < traffic->controlCount &&
+			(bulk == traffic->bulkCount || FRTestRandom(&random) % 4 == 0)) {
+			size_t length = 16 + FRTestRandom(&random) % 500;
+			filled += FRTestFrame(output + filled, FRFrameChannelControl, control++, 0, length, length);
+		}
+	}
+	FRTestWriteAll(traffic->socket, output, filled);
+	shutdown(traffic->socket, SHUT_WR);
+	free(output);
+	return NULL;
+}
+
+static uint8_t FRTestByte(const struct iovec *vectors, int count, size_t position) {
+	for (int index = 0; index < count; index++) {
+		if (position < vectors[index].iov_len) { return ((const uint8_t *)vectors[index].iov_base)[position]; }
+		position -= vectors[index].iov_len;
+	}
+	FRTestAssert(0, "byte %zu is past the end", position);
+	return 0;
+}
+
+static void FRTestCheck(const struct iovec *vectors, int count, size_t length, uint32_t expected,
+						const char *channel) {
+	FRTestAssert(length >= 8, "%s message %u: length %zu", channel, expected, length);
+	uint8_t header[8];
+	for (size_t position = 0; position < 8; position++) { header[position] = FRTestByte(vectors, count, position); }
+	uint32_t index = ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) | ((uint32_t)header[2] << 8) | header[3];
+	size_t encodedLength = ((size_t)header[4] << 24) | ((size_t)header[5] << 16) | ((size_t)header[6] << 8) | header[7];
+	FRTestAssert(index == expected, "%s message %u instead of %u", channel, index, expected);
+	FRTestAssert(encodedLength == length, "%s message %u: length %zu, sent %zu", channel, index, length, encodedLength);
+	size_t total = 0;
+	for (int vector = 0; vector < count; vector++) { total += vectors[vector].iov_len; }
+	FRTestAssert(total == length, "%s message %u: chunks add up to %zu", channel, index, total);
+	FRTestAssert(FRTestByte(vectors, count, length / 2) == (uint8_t)index &&
+				 FRTestByte(vectors, count, length - 1) == (uint8_t)index, "%s message %u: contents", channel, index);
+}
+
+int main(int argc, char **argv) {
+	double scale = FRTestScale(argc, argv);
+	FRTestTraffic traffic = { -1, (size_t)(40000 * scale), (size_t)(2000 * scale), 0 };
+	if (traffic.controlCount < 200) { traffic.controlCount = 200; }
+	if (traffic.bulkCount < 10) { traffic.bulkCount = 10; }
+	
+	int sockets[2];
+	FRTestLoopback(sockets);
+	traffic.socket = sockets[0];
+	FRFrameBuffer *buffer = FRFrameBufferCreate(1024 * 1024);
+	FRTestAssert(buffer != NULL, "create frame buffer");
+	
+	double start = FRTestTime();
+	pthread_t writer;
+	FRTestAssert(pthread_create(&writer, NULL, FRTestWriter, &traffic) == 0, "start writer");
+	
+	size_t received[FRFrameChannelCount] = { 0, 0 };
+	size_t bytes = 0;
+	size_t reads = 0;
+	for (;;) {
+		size_t available = 0;
+		uint8_t *space = FRFrameBufferReserve(buffer, &available);
+		FRTestAssert(space != NULL, "reserve");
+		ssize_t length = read(sockets[1], space, available);
+		if (length < 0 && errno == EINTR) { continue; }
+		FRTestAssert(length >= 0, "read: %s", strerror(errno));
+		if (length == 0) { break; }
+		FRFrameBufferCommit(buffer, (size_t)length);
+		reads++;
+		
+		const struct iovec *payload = NULL;
+		int count = 0;
+		size_t payloadLength = 0;
+		FRFrameBufferResult result = FRFrameBufferIncomplete;
+		while ((result = FRFrameBufferNextMessage(buffer, &payload, &count, &payloadLength)) == FRFrameBufferComplete) {
+			// the channel is in the header of the frame that finished the message, which is already gone,
+			// so short messages are told apart by their length
+			FRFrameChannel channel = (payloadLength <= 16 + 500) ? FRFrameChannelControl : FRFrameChannelBulk;
+			FRTestCheck(payload, count, payloadLength, (uint32_t)received[channel]++,
+						(channel == FRFrameChannelControl) ? "control" : "bulk");
+			bytes += payloadLength;
+		}
+		FRTestAssert(result == FRFrameBufferIncomplete, "next frame: %d", result);
+	}
+	double elapsed = FRTestTime() - start;
+	pthread_join(writer, NULL);
+	
+	FRTestAssert(received[FRFrameChannelControl] == traffic.controlCount &&
+				 received[FRFrameChannelBulk] == traffic.bulkCount, "all messages arrived");
+	size_t messages = traffic.controlCount + traffic.bulkCount;
+	printf("frame buffer: %zu messages, %.1f MB in %.3f s over loopback\n", messages, bytes / 1048576.0, elapsed);
+	printf("  %.0f MB/s, %.0f messages/s, %.1f KB per read\n", bytes / 1048576.0 / elapsed,
+		   messages / elapsed, bytes / 1024.0 / (double)reads);
+	
+	FRFrameBufferFree(buffer);
+	close(sockets[0]);
+	close(sockets[1]);
+	return 0;
+}
@@ -0,0 +1,105 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <string.h>
+
+#import "FRMessageCoding.h"
+#import "FRTests.h"
+
+// encodes and decodes the two kinds of messages that carry the most: resources messages with a strings file each
+// (mostly data) and manifests listing every strings file in a large application (mostly small fields)
+static FRMessageBytes FRTestBytes(const char *string) {
+	FRMessageBytes bytes = { string, strlen(string) };
+	return bytes;
+}
+
+static void FRTestMeasure(const FRMessage *message, size_t rounds, const char *kind) {
+	size_t length = FRMessageEncodedLength(message);
+	uint8_t *buffer = malloc(length);
+	FRTestAssert(buffer != NULL, "allocate");
+	
+	double start = FRTestTime();
+	for (size_t round = 0; round < rounds; round++) {
+		FRTestAssert(FRMessageEncode(message, buffer) == length, "encode");
+	}
+	double encoding = FRTestTime() - start;
+	
+	start = FRTestTime();
+	for (size_t round = 0; round < rounds; round++) {
+		FRMessage decoded;
+		FRTestAssert(FRMessageDecode(buffer, length, &decoded), "decode");
+		FRTestAssert(decoded.resourceCount == message->resourceCount, "resources");
+		FRMessageFreeDecoded(&decoded);
+	}
+	double decoding = FRTestTime() - start;
+	
+	double megabytes = (double)length * (double)rounds / 1e6;
+	printf("%s: %zu bytes, encode %.0f MB/s (%.1f us), decode %.0f MB/s (%.1f us)\n", kind, length,
+		   megabytes / encoding, encoding * 1e6 / (double)rounds,
+		   megabytes / decoding, decoding * 1e6 / (double)rounds);
+	free(buffer);
+}
+
+int main(int argc, char **argv) {
+	double scale = FRTestScale(argc, argv);
+	size_t rounds = (size_t)(2000 * scale);
+	if (rounds < 20) { rounds = 20; }
+	
+	size_t dataLength = 64 * 1024;
+	char *data = malloc(dataLength);
+	FRTestAssert(data != NULL, "allocate");
+	memset(data, 'x', dataLength);
+	FRMessageResource file;
+	memset(&file, 0, sizeof(file));
+	file.bundleIdentifier = FRTestBytes("com.example.application");
+	file.language = FRTestBytes("de");
+	file.name = FRTestBytes("Localizable");
+	file.data = (FRMessageBytes){ data, dataLength };
+	file.digest = FRTestBytes("da39a3ee5e6b4b0d3255bfef95601890afd80709");
+	file.offset = (FRMessageNumber){ 0, 1 };
+	file.length = (FRMessageNumber){ 65536, 1 };
+	
+	FRMessage message;
+	memset(&message, 0, sizeof(message));
+	message.type = FRMessageTypeLocalizationResources;
+	message.applicationIdentifier = FRTestBytes("com.example.application");
+	message.applicationName = FRTestBytes("Example");
+	message.remaining = (FRMessageNumber){ 12, 1 };
+	message.resources = &file;
+	message.resourceCount = 1;
+	FRTestMeasure(&message, rounds * 10, "resources");
+	
+	size_t count = 5000;
+	FRMessageResource *resources = calloc(count, sizeof(FRMessageResource));
+	FRTestAssert(resources != NULL, "allocate");
+	for (size_t index = 0; index < count; index++) {
+		resources[index] = file;
+		resources[index].data = (FRMessageBytes){ NULL, 0 };
+		resources[index].offset = (FRMessageNumber){ 0, 0 };
+		resources[index].length = (FRMessageNumber){ 0, 0 };
+	}
+	memset(&message, 0, sizeof(message));
+	message.type = FRMessageTypeLocalizationManifest;
+	message.applicationIdentifier = FRTestBytes("com.example.application");
+	message.resources = resources;
+	message.resourceCount = count;
+	FRTestMeasure(&message, rounds / 10 ? rounds / 10 : 1, "manifest");
+	
+	free(resources);
+	free(data);
+	return 0;
+}
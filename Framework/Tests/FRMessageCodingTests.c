@@ -0,0 +1,317 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <string.h>
+
+#import "FRMessageCoding.h"
+#import "FRTests.h"
+
+// encodes messages of every type and decodes them again, then feeds the decoder truncated, oversized and
+// malformed input. the decoder has to turn all of it down without reading outside of the input.
+static FRMessageBytes FRTestBytes(const char *string) {
+	FRMessageBytes bytes = { string, strlen(string) };
+	return bytes;
+}
+
+static FRMessageNumber FRTestNumber(uint64_t value) {
+	FRMessageNumber number = { value, 1 };
+	return number;
+}
+
+static int FRTestSameNumber(FRMessageNumber first, FRMessageNumber second) {
+	if (!first.present || !second.present) { return !first.present && !second.present; }
+	return first.value == second.value;
+}
+
+static int FRTestSameBytes(FRMessageBytes first, FRMessageBytes second) {
+	if (!first.bytes || !second.bytes) { return !first.bytes && !second.bytes; }
+	return first.length == second.length && memcmp(first.bytes, second.bytes, first.length) == 0;
+}
+
+static int FRTestInside(FRMessageBytes value, const uint8_t *start, size_t length) {
+	if (!value.bytes) { return 1; }
+	const uint8_t *bytes = value.bytes;
+	return bytes >= start && bytes + value.length <= start + length;
+}
+
+static void FRTestCheckResources(const FRMessageResource *expected, size_t expectedCount,
+								 const FRMessageResource *actual, size_t actualCount, const char *kind) {
+	FRTestAssert(expectedCount == actualCount, "%s: %zu resources, expected %zu", kind, actualCount, expectedCount);
+	for (size_t index = 0; index < expectedCount; index++) {
+		FRTestAssert(FRTestSameBytes(expected[index].bundleIdentifier, actual[index].bundleIdentifier) &&
+					 FRTestSameBytes(expected[index].language, actual[index].language) &&
+					 FRTestSameBytes(expected[index].name, actual[index].name) &&
+					 FRTestSameBytes(expected[index].data, actual[index].data) &&
+					 FRTestSameBytes(expected[index].digest, actual[index].digest) &&
+					 FRTestSameNumber(expected[index].offset, actual[index].offset) &&
+					 FRTestSameNumber(expected[index].length, actual[index].length), "%s: resource %zu", kind, index);
+	}
+}
+
+static void FRTestCheckInside(const FRMessage *message, const uint8_t *bytes, size_t length) {
+	// whatever the decoder accepts has to point into the input
+	FRTestAssert(FRTestInside(message->deviceName, bytes, length) &&
+				 FRTestInside(message->deviceIdentifier, bytes, length) &&
+				 FRTestInside(message->applicationIdentifier, bytes, length) &&
+				 FRTestInside(message->applicationName, bytes, length) &&
+				 FRTestInside(message->compression, bytes, length), "fields inside the input");
+	const FRMessageResource *lists[] = { message->resources, message->translations };
+	size_t counts[] = { message->resourceCount, message->translationCount };
+	for (size_t list = 0; list < 2; list++) {
+		for (size_t index = 0; index < counts[list]; index++) {
+			const FRMessageResource *resource = &lists[list][index];
+			FRTestAssert(FRTestInside(resource->bundleIdentifier, bytes, length) &&
+						 FRTestInside(resource->language, bytes, length) &&
+						 FRTestInside(resource->name, bytes, length) &&
+						 FRTestInside(resource->data, bytes, length) &&
+						 FRTestInside(resource->digest, bytes, length), "resource %zu inside the input", index);
+		}
+	}
+}
+
+static uint8_t *FRTestEncode(const FRMessage *message, size_t *length) {
+	*length = FRMessageEncodedLength(message);
+	uint8_t *buffer = malloc(*length);
+	FRTestAssert(buffer != NULL, "allocate %zu", *length);
+	FRTestAssert(FRMessageEncode(message, buffer) == *length, "encoded length");
+	return buffer;
+}
+
+static void FRTestRoundTrip(const FRMessage *message, const char *kind) {
+	size_t length = 0;
+	uint8_t *buffer = FRTestEncode(message, &length);
+	
+	FRMessage decoded;
+	FRTestAssert(FRMessageDecode(buffer, length, &decoded), "%s: decode", kind);
+	FRTestAssert(decoded.type == message->type, "%s: type", kind);
+	FRTestAssert(FRTestSameBytes(message->deviceName, decoded.deviceName) &&
+				 FRTestSameBytes(message->deviceIdentifier, decoded.deviceIdentifier) &&
+				 FRTestSameBytes(message->applicationIdentifier, decoded.applicationIdentifier) &&
+				 FRTestSameBytes(message->applicationName, decoded.applicationName) &&
+				 FRTestSameBytes(message->compression, decoded.compression) &&
+				 FRTestSameNumber(message->remaining, decoded.remaining), "%s: fields", kind);
+	FRTestCheckResources(message->resources, message->resourceCount, decoded.resources, decoded.resourceCount, kind);
+	FRTestCheckResources(message->translations, message->translationCount,
+						 decoded.translations, decoded.translationCount, kind);
+	FRMessageFreeDecoded(&decoded);
+	
+	// every prefix either ends between fields (and is a shorter message) or is turned down
+	for (size_t prefix = 0; prefix < length; prefix++) {
+		uint8_t *copy = malloc(prefix ? prefix : 1);
+		memcpy(copy, buffer, prefix);
+		if (FRMessageDecode(copy, prefix, &decoded)) {
+			FRTestCheckInside(&decoded, copy, prefix);
+			FRMessageFreeDecoded(&decoded);
+		}
+		free(copy);
+	}
+	free(buffer);
+}
+
+static void FRTestRoundTrips(void) {
+	FRMessage message;
+	memset(&message, 0, sizeof(message));
+	message.type = FRMessageTypeAuthentication;
+	message.deviceName = FRTestBytes("Test iPhone");
+	message.deviceIdentifier = FRTestBytes("0123456789abcdef");
+	message.compression = FRTestBytes("zlib");
+	FRTestRoundTrip(&message, "authentication");
+	
+	// a file long enough for lengths of several varint bytes, and an empty one that still has to arrive.
+	// numbers go from zero, which still has to be there after decoding, up to all ten varint bytes.
+	size_t dataLength = 3000;
+	char *data = malloc(dataLength);
+	for (size_t index = 0; index < dataLength; index++) { data[index] = (char)(index * 31); }
+	FRMessageResource resources[3];
+	memset(resources, 0, sizeof(resources));
+	resources[0].bundleIdentifier = FRTestBytes("com.example.app");
+	resources[0].language = FRTestBytes("de");
+	resources[0].name = FRTestBytes("Localizable");
+	resources[0].data = (FRMessageBytes){ data, dataLength };
+	resources[0].digest = FRTestBytes("da39a3ee5e6b4b0d3255bfef95601890afd80709");
+	resources[0].offset = FRTestNumber(0);
+	resources[0].length = FRTestNumber(dataLength);
+	resources[1] = resources[0];
+	resources[1].name = FRTestBytes("Empty");
+	resources[1].data = FRTestBytes("");
+	resources[1].offset = FRTestNumber(UINT64_MAX);
+	resources[2].bundleIdentifier = FRTestBytes("com.example.app");
+	
+	memset(&message, 0, sizeof(message));
+	message.type = FRMessageTypeLocalizationResources;
+	message.applicationIdentifier = FRTestBytes("com.example.app");
+	message.applicationName = FRTestBytes("Example");
+	message.compression = FRTestBytes("zlib");
+	message.remaining = FRTestNumber(2);
+	message.resources = resources;
+	message.resourceCount = 3;
+	FRTestRoundTrip(&message, "resources");
+	
+	memset(&message, 0, sizeof(message));
+	message.type = FRMessageTypeLocalizationManifest;
+	message.applicationIdentifier = FRTestBytes("com.example.app");
+	message.resources = resources + 1;
+	message.resourceCount = 2;
+	message.translations = resources;
+	message.translationCount = 1;
+	FRTestRoundTrip(&message, "manifest");
+	
+	FRMessageType types[] = { FRMessageTypeLocalizationChanges, FRMessageTypeLocalizationRequest,
+		FRMessageTypeLocalizationEdits };
+	for (size_t index = 0; index < 3; index++) {
+		memset(&message, 0, sizeof(message));
+		message.type = types[index];
+		message.resources = resources + 1;
+		message.resourceCount = 2;
+		FRTestRoundTrip(&message, "resources only");
+		message.resourceCount = 0;
+		FRTestRoundTrip(&message, "no resources");
+	}
+	free(data);
+}
+
+static int FRTestDecodes(const uint8_t *bytes, size_t length) {
+	// decodes from a copy of exactly the given length, so reading past it is caught
+	uint8_t *copy = malloc(length ? length : 1);
+	memcpy(copy, bytes, length);
+	FRMessage message;
+	int result = FRMessageDecode(copy, length, &message);
+	if (result) {
+		FRTestCheckInside(&message, copy, length);
+		FRMessageFreeDecoded(&message);
+	}
+	free(copy);
+	return result;
+}
+
+static void FRTestMalformedInput(void) {
+	// tags are the field number shifted past two kind bits: 0x04 is field 1 bytes, 0x0D field 3 resource
+	// and 0x16 field 5 varint
+	const uint8_t valid[] = { 0x47, 1, 1, 0x04, 2, 'h', 'i' };
+	FRTestAssert(FRTestDecodes(valid, sizeof(valid)), "valid message");
+	const uint8_t unknown[] = { 0x47, 1, 1, 0x24, 2, 'h', 'i', 0x26, 0xFF, 0x01, 0x04, 0 };
+	FRTestAssert(FRTestDecodes(unknown, sizeof(unknown)), "unknown fields are skipped");
+	const uint8_t number[] = { 0x47, 1, 2, 0x16, 0xAC, 0x02, 0x0D, 2, 0x1A, 0x07 };
+	FRMessage message;
+	FRTestAssert(FRMessageDecode(number, sizeof(number), &message) && message.remaining.present &&
+				 message.remaining.value == 300 && message.resourceCount == 1 && message.resources[0].offset.present &&
+				 message.resources[0].offset.value == 7 && !message.resources[0].length.present, "numbers");
+	FRMessageFreeDecoded(&message);
+	
+	const uint8_t magic[] = { 0x48, 1, 1 };
+	const uint8_t version[] = { 0x47, 2, 1 };
+	const uint8_t type[] = { 0x47, 1, 99 };
+	const uint8_t kind[] = { 0x47, 1, 1, 0x05, 0 };
+	const uint8_t nested[] = { 0x47, 1, 2, 0x0D, 2, 0x0D, 0 };
+	const uint8_t oversized[] = { 0x47, 1, 1, 0x04, 3, 'h', 'i' };
+	const uint8_t hugeLength[] = { 0x47, 1, 1, 0x04, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F };
+	const uint8_t longVarint[] = { 0x47, 1, 1, 0x84, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+		0x00, 0 };
+	const uint8_t overflow[] = { 0x47, 1, 1, 0x84, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x02, 2, 'h', 'i' };
+	const uint8_t unterminated[] = { 0x47, 1, 1, 0x04, 0x80 };
+	const uint8_t missingLength[] = { 0x47, 1, 1, 0x04 };
+	const uint8_t resourceOverrun[] = { 0x47, 1, 2, 0x0D, 4, 0x04, 5, 'h', 'i' };
+	const uint8_t numberKind[] = { 0x47, 1, 2, 0x14, 1, '2' };
+	const uint8_t unknownKind[] = { 0x47, 1, 2, 0x27, 0 };
+	const uint8_t numberUnterminated[] = { 0x47, 1, 2, 0x16, 0x80 };
+	const uint8_t numberOverrun[] = { 0x47, 1, 2, 0x0D, 2, 0x1A, 0x87, 0x01 };
+	struct { const uint8_t *bytes; size_t length; const char *name; } cases[] = {
+		{ valid, 2, "short header" },
+		{ magic, sizeof(magic), "magic" },
+		{ version, sizeof(version), "version" },
+		{ type, sizeof(type), "type" },
+		{ kind, sizeof(kind), "kind" },
+		{ nested, sizeof(nested), "nested resources" },
+		{ oversized, sizeof(oversized), "length past the end" },
+		{ hugeLength, sizeof(hugeLength), "huge length" },
+		{ longVarint, sizeof(longVarint), "varint longer than ten bytes" },
+		{ overflow, sizeof(overflow), "varint over 64 bits" },
+		{ unterminated, sizeof(unterminated), "unterminated varint" },
+		{ missingLength, sizeof(missingLength), "missing length" },
+		{ resourceOverrun, sizeof(resourceOverrun), "resource field past the resource" },
+		{ numberKind, sizeof(numberKind), "number sent as bytes" },
+		{ unknownKind, sizeof(unknownKind), "unknown kind" },
+		{ numberUnterminated, sizeof(numberUnterminated), "unterminated number" },
+		{ numberOverrun, sizeof(numberOverrun), "number past the resource" },
+	};
+	for (size_t index = 0; index < sizeof(cases) / sizeof(*cases); index++) {
+		FRTestAssert(!FRTestDecodes(cases[index].bytes, cases[index].length), "%s", cases[index].name);
+	}
+}
+
+static void FRTestResourceLimit(void) {
+	// empty resources are two bytes each, so a couple of megabytes could ask for a huge allocation
+	size_t limit = 1 << 20;
+	size_t length = 3 + (limit + 1) * 2;
+	uint8_t *bytes = malloc(length);
+	bytes[0] = 0x47;
+	bytes[1] = 1;
+	bytes[2] = FRMessageTypeLocalizationChanges;
+	for (size_t index = 3; index < length; index += 2) {
+		bytes[index] = 0x0D;
+		bytes[index + 1] = 0;
+	}
+	FRMessage message;
+	FRTestAssert(!FRMessageDecode(bytes, length, &message), "more resources than the limit");
+	FRTestAssert(FRMessageDecode(bytes, 3 + 1000 * 2, &message) && message.resourceCount == 1000, "under the limit");
+	FRMessageFreeDecoded(&message);
+	free(bytes);
+}
+
+static void FRTestRandomDamage(void) {
+	FRMessageResource resources[4];
+	memset(resources, 0, sizeof(resources));
+	for (size_t index = 0; index < 4; index++) {
+		resources[index].bundleIdentifier = FRTestBytes("com.example.app");
+		resources[index].language = FRTestBytes("fr");
+		resources[index].name = FRTestBytes("Localizable");
+		resources[index].data = FRTestBytes("\"key\" = \"value\";\n\"other\" = \"another value\";\n");
+		resources[index].digest = FRTestBytes("0123456789");
+	}
+	FRMessage message;
+	memset(&message, 0, sizeof(message));
+	message.type = FRMessageTypeLocalizationManifest;
+	message.applicationName = FRTestBytes("Example");
+	message.resources = resources;
+	message.resourceCount = 3;
+	message.translations = resources + 3;
+	message.translationCount = 1;
+	size_t length = 0;
+	uint8_t *encoded = FRTestEncode(&message, &length);
+	
+	uint32_t random = 7;
+	uint8_t *damaged = malloc(length);
+	for (size_t round = 0; round < 20000; round++) {
+		memcpy(damaged, encoded, length);
+		size_t changes = 1 + FRTestRandom(&random) % 4;
+		for (size_t change = 0; change < changes; change++) {
+			damaged[FRTestRandom(&random) % length] = (uint8_t)FRTestRandom(&random);
+		}
+		FRTestDecodes(damaged, 3 + FRTestRandom(&random) % (length - 2));
+	}
+	free(damaged);
+	free(encoded);
+}
+
+int main(int argc, char **argv) {
+	FRTestRoundTrips();
+	FRTestMalformedInput();
+	FRTestResourceLimit();
+	FRTestRandomDamage();
+	printf("message coding: ok\n");
+	return 0;
+}
@@ -0,0 +1,115 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <errno.h>
+
+#import "FRMessageCompression.h"
+#import "FRTests.h"
+
+// compresses a strings file with every method and decompresses it whole and in chunks split at random places,
+// including inside the header, then checks that damaged and oversized messages are turned down.
+static size_t FRTestStrings(char *text, size_t capacity) {
+	size_t length = 0;
+	for (unsigned line = 0; length + 128 < capacity; line++) {
+		length += (size_t)snprintf(text + length, capacity - length,
+								   "/* Class = \"NSButtonCell\"; title = \"Item %u\"; ObjectID = \"%u\"; */\n"
+								   "\"%u.title\" = \"Item %u\";\n\n", line, line * 7, line * 7, line);
+	}
+	return length;
+}
+
+static int FRTestSplit(const uint8_t *bytes, size_t length, struct iovec *vectors, int capacity, uint32_t *random) {
+	int count = 0;
+	size_t position = 0;
+	while (position < length && count < capacity - 1) {
+		size_t chunk = 1 + FRTestRandom(random) % ((count == 0) ? 4 : 3000);
+		if (chunk > length - position) { chunk = length - position; }
+		vectors[count].iov_base = (void *)(bytes + position);
+		vectors[count++].iov_len = chunk;
+		position += chunk;
+	}
+	if (position < length) {
+		vectors[count].iov_base = (void *)(bytes + position);
+		vectors[count++].iov_len = length - position;
+	}
+	return count;
+}
+
+int main(int argc, char **argv) {
+	size_t capacity = 200 * 1024;
+	char *text = malloc(capacity);
+	FRTestAssert(text != NULL, "allocate");
+	size_t length = FRTestStrings(text, capacity);
+	struct iovec vectors[1024];
+	uint32_t random = 5;
+	
+	FRMessageCompressionMethod methods[] = { FRMessageCompressionDeflate, FRMessageCompressionDeflateStrings };
+	for (size_t method = 0; method < sizeof(methods) / sizeof(methods[0]); method++) {
+		void *compressed = NULL;
+		size_t compressedLength = 0;
+		FRTestAssert(FRMessageCompress(methods[method], text, length, &compressed, &compressedLength) == 0 &&
+					 compressed != NULL && compressedLength < length, "compress with method %d", methods[method]);
+		FRTestAssert(FRMessageIsCompressed(compressed, compressedLength), "compressed");
+		
+		void *result = NULL;
+		size_t resultLength = 0;
+		FRTestAssert(FRMessageDecompress(compressed, compressedLength, length, &result, &resultLength) == 0 &&
+					 resultLength == length && memcmp(result, text, length) == 0, "decompress whole");
+		free(result);
+		
+		for (int round = 0; round < 50; round++) {
+			int count = FRTestSplit(compressed, compressedLength, vectors, 1024, &random);
+			FRTestAssert(FRMessageDecompressVectors(vectors, count, length, &result, &resultLength) == 0 &&
+						 resultLength == length && memcmp(result, text, length) == 0,
+						 "decompress in %d chunks", count);
+			free(result);
+			
+			// the last chunk cut short, an extra byte at the end, and flipped bits
+			vectors[count - 1].iov_len--;
+			FRTestAssert(FRMessageDecompressVectors(vectors, count, length, &result, &resultLength) == EINVAL &&
+						 result == NULL, "truncated");
+			vectors[count - 1].iov_len++;
+			uint8_t extra = 0;
+			vectors[count].iov_base = &extra;
+			vectors[count].iov_len = 1;
+			FRTestAssert(FRMessageDecompressVectors(vectors, count + 1, length, &result, &resultLength) == EINVAL &&
+						 result == NULL, "trailing bytes");
+		}
+		FRTestAssert(FRMessageDecompress(compressed, compressedLength, length - 1, &result, &resultLength) == EFBIG &&
+					 result == NULL, "longer than the maximum");
+		
+		uint8_t *damaged = malloc(compressedLength);
+		FRTestAssert(damaged != NULL, "allocate");
+		for (int round = 0; round < 200; round++) {
+			memcpy(damaged, compressed, compressedLength);
+			size_t position = 2 + FRTestRandom(&random) % (compressedLength - 2);
+			damaged[position] ^= (uint8_t)(1 + FRTestRandom(&random) % 255);
+			int count = FRTestSplit(damaged, compressedLength, vectors, 1024, &random);
+			if (FRMessageDecompressVectors(vectors, count, length, &result, &resultLength) == 0) {
+				FRTestAssert(resultLength == length, "damaged message has the wrong length");
+				free(result);
+			}
+			else { FRTestAssert(result == NULL, "failure leaves a result"); }
+		}
+		free(damaged);
+		free(compressed);
+	}
+	
+	printf("message compression: ok\n");
+	free(text);
+	return 0;
+}
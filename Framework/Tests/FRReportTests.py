@@ -0,0 +1,97 @@
+#!/usr/bin/env python
+# 
+# Copyright (c) 2013 FadingRed LLC
+# 
+# Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+# documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+# rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to the following conditions:
+# 
+# The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+# Software.
+# 
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+# WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+# OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+# 
+
+# Runs the report action on the strings files in Fixtures/Report and checks the counts it reports for each file,
+# bundle and language against Fixtures/Report/counts.txt. Run with the python the localization scripts use.
+
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+TESTS = os.path.dirname(os.path.abspath(__file__))
+SCRIPTS = os.path.join(os.path.dirname(TESTS), 'Scripts')
+FIXTURE = os.path.join(TESTS, 'Fixtures', 'Report')
+STATUSES = ('translated', 'untranslated', 'equal')
+
+
+# helpers
+# ----------------------------------------------------------------------
+
+def expected_counts():
+  'Reads the expected counts as a dictionary from path to counts'
+  counts = {}
+  for line in open(os.path.join(FIXTURE, 'counts.txt')):
+    if line.strip() and not line.startswith('#'):
+      fields = line.split()
+      counts[fields[0]] = dict(zip(STATUSES, [int(field) for field in fields[1:]]))
+  return counts
+
+def run_report(*options):
+  'Runs the report action on the fixture and returns the report'
+  directory = tempfile.mkdtemp()
+  try:
+    output = os.path.join(directory, 'report.json')
+    environment = dict(os.environ, PYTHONPATH=os.path.join(SCRIPTS, 'lib'))
+    command = [sys.executable, os.path.join(SCRIPTS, 'actions', 'report'), '-o', output] + list(options) + [FIXTURE]
+    subprocess.check_call(command, env=environment)
+    return json.load(open(output))
+  finally:
+    shutil.rmtree(directory)
+
+def add(totals, counts):
+  for status in STATUSES:
+    totals[status] = totals.get(status, 0) + counts[status]
+
+def check(condition, message):
+  if not condition:
+    sys.stderr.write('failed: %s\n' % message)
+    sys.exit(1)
+
+
+# tests
+# ----------------------------------------------------------------------
+
+def check_report(report, expected):
+  'Checks the files in a report and the totals for their bundles and languages'
+  files = dict((os.path.relpath(entry['path'], FIXTURE), entry) for entry in report['files'])
+  check(sorted(files.keys()) == sorted(expected.keys()), 'files %s' % sorted(files.keys()))
+
+  bundles = {}
+  languages = {}
+  for path, counts in expected.items():
+    entry = files[path]
+    bundle = os.path.join(os.path.basename(FIXTURE), os.path.dirname(os.path.dirname(path)))
+    language = os.path.splitext(os.path.basename(os.path.dirname(path)))[0]
+    check(entry['bundle'] == bundle and entry['language'] == language, 'bundle and language of %s' % path)
+    check(dict((status, entry[status]) for status in STATUSES) == counts, 'counts of %s: %s' % (path, entry))
+    add(bundles.setdefault(bundle, {}).setdefault(language, {}), counts)
+    add(languages.setdefault(language, {}), counts)
+
+  check(report['bundles'] == bundles, 'bundle totals %s' % report['bundles'])
+  check(report['languages'] == languages, 'language totals %s' % report['languages'])
+
+if __name__ == '__main__':
+  expected = expected_counts()
+
+  # the base language is only included when asked for
+  check_report(run_report('--include-base'), expected)
+  check_report(run_report(), dict((path, counts) for path, counts in expected.items() if '/en.lproj/' not in path))
+  print('report: ok')
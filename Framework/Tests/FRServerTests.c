@@ -0,0 +1,276 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+
+#import "FRServer.h"
+#import "FRFrameBuffer.h"
+#import "FRTests.h"
+
+// runs an echo server on an event loop and connects many clients to it over loopback at once. every client
+// sends a mix of short control messages and multi-frame bulk messages from one thread while another thread
+// checks the echoes. some clients hang up without reading their echoes and one sends a message that's too
+// long, so the server also has to close clients while the others keep going.
+enum {
+	kClientCount = 24,
+	kMessageCount = 150,
+	kMaximumPayloadLength = 256 * 1024,
+};
+
+typedef struct FRTestClient {
+	uint32_t identifier;
+	int socket;
+	int leaves;				// hangs up once everything is sent, without reading the echoes
+	size_t received[FRFrameChannelCount];
+	size_t expected[FRFrameChannelCount];
+} FRTestClient;
+
+typedef struct FRTestServer {
+	size_t accepted;
+	size_t closed;
+	size_t messages;
+	size_t drains;
+} FRTestServer;
+
+static pthread_mutex_t gFinishedLock = PTHREAD_MUTEX_INITIALIZER;
+static size_t gFinished;
+
+static size_t FRTestMessage(uint8_t *payload, uint32_t client, uint32_t index, uint32_t *random) {
+	// the first byte is the channel to echo on, then the client and the index, then bytes derived from them
+	FRFrameChannel channel = (FRTestRandom(random) % 4) ? FRFrameChannelControl : FRFrameChannelBulk;
+	size_t length = (channel == FRFrameChannelControl) ? 16 + FRTestRandom(random) % 500 :
+		16 + FRTestRandom(random) % (160 * 1024);
+	payload[0] = channel;
+	memcpy(payload + 1, &client, 4);
+	memcpy(payload + 5, &index, 4);
+	for (size_t position = 9; position < length; position++) {
+		payload[position] = (uint8_t)(client * 31 + index * 7 + position);
+	}
+	return length;
+}
+
+static void *FRTestReader(void *context) {
+	FRTestClient *client = context;
+	FRFrameBuffer *buffer = FRFrameBufferCreate(kMaximumPayloadLength);
+	FRTestAssert(buffer != NULL, "create frame buffer");
+	uint32_t last[FRFrameChannelCount] = { 0, 0 };
+	for (;;) {
+		size_t available = 0;
+		uint8_t *space = FRFrameBufferReserve(buffer, &available);
+		FRTestAssert(space != NULL, "reserve");
+		ssize_t length = read(client->socket, space, available);
+		if (length < 0 && errno == EINTR) { continue; }
+		FRTestAssert(length > 0, "client %u: connection lost: %s", client->identifier,
+					 length ? strerror(errno) : "closed");
+		FRFrameBufferCommit(buffer, (size_t)length);
+		
+		const uint8_t *payload = NULL;
+		size_t payloadLength = 0;
+		FRFrameBufferResult result = FRFrameBufferIncomplete;
+		while ((result = FRFrameBufferNextFrame(buffer, &payload, &payloadLength)) == FRFrameBufferComplete) {
+			FRTestAssert(payloadLength >= 16 && payload[0] < FRFrameChannelCount, "echo length %zu", payloadLength);
+			FRFrameChannel channel = payload[0];
+			uint32_t identifier = 0;
+			uint32_t index = 0;
+			memcpy(&identifier, payload + 1, 4);
+			memcpy(&index, payload + 5, 4);
+			FRTestAssert(identifier == client->identifier, "client %u got an echo for %u", client->identifier,
+						 identifier);
+			FRTestAssert(!client->received[channel] || index > last[channel],
+						 "client %u: echo %u after %u on channel %d", identifier, index, last[channel], channel);
+			for (size_t position = 9; position < payloadLength; position++) {
+				FRTestAssert(payload[position] == (uint8_t)(identifier * 31 + index * 7 + position),
+							 "client %u: echo %u damaged at %zu", identifier, index, position);
+			}
+			last[channel] = index;
+			client->received[channel]++;
+		}
+		FRTestAssert(result == FRFrameBufferIncomplete, "next frame: %d", result);
+		if (client->received[FRFrameChannelControl] == client->expected[FRFrameChannelControl] &&
+			client->received[FRFrameChannelBulk] == client->expected[FRFrameChannelBulk]) { break; }
+	}
+	FRFrameBufferFree(buffer);
+	return NULL;
+}
+
+static void *FRTestClientThread(void *context) {
+	FRTestClient *client = context;
+	uint8_t *payloads[kMessageCount];
+	size_t lengths[kMessageCount];
+	uint32_t random = 17 + client->identifier;
+	for (uint32_t index = 0; index < kMessageCount; index++) {
+		payloads[index] = malloc(160 * 1024 + 16);
+		FRTestAssert(payloads[index] != NULL, "allocate");
+		lengths[index] = FRTestMessage(payloads[index], client->identifier, index, &random);
+		client->expected[payloads[index][0]]++;
+	}
+	
+	pthread_t reader;
+	if (!client->leaves) { FRTestAssert(pthread_create(&reader, NULL, FRTestReader, client) == 0, "start reader"); }
+	
+	// the socket blocks, so every flush writes everything that's queued
+	FRWriteQueue *queue = FRWriteQueueCreate(SIZE_MAX);
+	FRTestAssert(queue != NULL, "create write queue");
+	for (uint32_t index = 0; index < kMessageCount; index++) {
+		FRFrameChannel channel = payloads[index][0];
+		FRTestAssert(FRWriteQueuePush(queue, channel, payloads[index], lengths[index], NULL, NULL) == 0, "push");
+		if (index % 8 == 7 || index == kMessageCount - 1) {
+			FRTestAssert(FRWriteQueueFlush(queue, FRWriteQueueWriteSocket, &client->socket) >= 0 &&
+						 FRWriteQueueLength(queue) == 0, "client %u: write: %s", client->identifier, strerror(errno));
+		}
+	}
+	FRWriteQueueFree(queue);
+	
+	if (!client->leaves) { pthread_join(reader, NULL); }
+	close(client->socket);
+	for (uint32_t index = 0; index < kMessageCount; index++) { free(payloads[index]); }
+	
+	pthread_mutex_lock(&gFinishedLock);
+	gFinished++;
+	pthread_mutex_unlock(&gFinishedLock);
+	return NULL;
+}
+
+static void FRTestRelease(void *owner) {
+	free(owner);
+}
+
+static void FRTestAccepted(FRServer *server, FRServerClient *client, void *info) {
+	FRTestServer *test = info;
+	test->accepted++;
+	FRTestAssert(FRServerClientGetInfo(client) == NULL, "new client has info");
+	FRServerClientSetInfo(client, test);
+}
+
+static void FRTestReceived(FRServer *server, FRServerClient *client, const struct iovec *payload, int count,
+						   size_t length, void *info) {
+	FRTestServer *test = info;
+	FRTestAssert(FRServerClientGetInfo(client) == test, "client info");
+	test->messages++;
+	uint8_t *echo = malloc(length ? length : 1);
+	FRTestAssert(echo != NULL, "allocate");
+	size_t position = 0;
+	for (int index = 0; index < count; index++) {
+		memcpy(echo + position, payload[index].iov_base, payload[index].iov_len);
+		position += payload[index].iov_len;
+	}
+	FRTestAssert(position == length, "chunks add up to %zu, not %zu", position, length);
+	
+	// sending fails once a client that hung up is noticed, which closes it
+	int error = FRServerSend(client, (length && echo[0] < FRFrameChannelCount) ? echo[0] : FRFrameChannelBulk,
+							 echo, length, echo, FRTestRelease);
+	FRTestAssert(!error || error == ENOTCONN, "send: %s", strerror(error));
+}
+
+static void FRTestDrained(FRServer *server, FRServerClient *client, void *info) {
+	((FRTestServer *)info)->drains++;
+}
+
+static void FRTestClosed(FRServer *server, FRServerClient *client, void *info) {
+	FRTestServer *test = info;
+	test->closed++;
+	FRTestAssert(FRServerClientGetInfo(client) == test, "closed client info");
+}
+
+static int FRTestConnect(const struct sockaddr_in *address) {
+	int client = socket(AF_INET, SOCK_STREAM, 0);
+	FRTestAssert(client >= 0 && connect(client, (const struct sockaddr *)address, sizeof(*address)) == 0,
+				 "connect: %s", strerror(errno));
+	return client;
+}
+
+static void FRTestRunUntil(FREventLoop *loop, FRTestServer *test, size_t closed, size_t finished) {
+	double deadline = FRTestTime() + 120;
+	for (;;) {
+		pthread_mutex_lock(&gFinishedLock);
+		size_t done = gFinished;
+		pthread_mutex_unlock(&gFinishedLock);
+		if (test->closed >= closed && done >= finished) { break; }
+		FRTestAssert(FRTestTime() < deadline, "%zu of %zu clients closed, %zu of %zu finished",
+					 test->closed, closed, done, finished);
+		FRTestAssert(FREventLoopRun(loop, 100) >= 0, "run: %s", strerror(errno));
+	}
+}
+
+int main(int argc, char **argv) {
+	// hung up clients are written to until the server notices
+	signal(SIGPIPE, SIG_IGN);
+	
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressLength = sizeof(address);
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	FRTestAssert(listener >= 0 && bind(listener, (struct sockaddr *)&address, addressLength) == 0 &&
+				 listen(listener, kClientCount) == 0 &&
+				 getsockname(listener, (struct sockaddr *)&address, &addressLength) == 0, "listen on loopback");
+	
+	FREventLoop *loop = FREventLoopCreate();
+	FRTestAssert(loop != NULL, "create event loop");
+	FRTestServer test;
+	memset(&test, 0, sizeof(test));
+	FRServerCallbacks callbacks = { &test, FRTestAccepted, FRTestReceived, FRTestDrained, FRTestClosed };
+	FRServer *server = FRServerCreate(loop, listener, kMaximumPayloadLength, &callbacks);
+	FRTestAssert(server != NULL, "create server: %s", strerror(errno));
+	
+	// every client at once
+	double start = FRTestTime();
+	FRTestClient clients[kClientCount];
+	pthread_t threads[kClientCount];
+	memset(clients, 0, sizeof(clients));
+	for (uint32_t index = 0; index < kClientCount; index++) {
+		clients[index].identifier = index;
+		clients[index].leaves = (index % 6 == 5);
+		clients[index].socket = FRTestConnect(&address);
+		FRTestAssert(pthread_create(&threads[index], NULL, FRTestClientThread, &clients[index]) == 0, "start client");
+	}
+	FRTestRunUntil(loop, &test, kClientCount, kClientCount);
+	for (size_t index = 0; index < kClientCount; index++) { pthread_join(threads[index], NULL); }
+	double elapsed = FRTestTime() - start;
+	FRTestAssert(test.accepted == kClientCount && test.closed == kClientCount && FRServerClientCount(server) == 0,
+				 "accepted %zu, closed %zu, %zu left", test.accepted, test.closed, FRServerClientCount(server));
+	size_t echoed = 0;
+	for (size_t index = 0; index < kClientCount; index++) {
+		if (clients[index].leaves) { continue; }
+		echoed += clients[index].received[FRFrameChannelControl] + clients[index].received[FRFrameChannelBulk];
+	}
+	
+	// a message over the maximum closes its client, and only that client
+	int keeper = FRTestConnect(&address);
+	int offender = FRTestConnect(&address);
+	uint8_t header[5] = { 0, 0x10, 0, 0, FRFrameChannelBulk };
+	FRTestAssert(write(offender, header, sizeof(header)) == sizeof(header), "write header");
+	FRTestRunUntil(loop, &test, kClientCount + 1, 0);
+	FRTestAssert(test.accepted == kClientCount + 2 && FRServerClientCount(server) == 1, "only the offender closed");
+	uint8_t byte = 0;
+	FRTestAssert(read(offender, &byte, 1) <= 0, "offender still connected");
+	close(offender);
+	
+	// freeing the server closes the clients that are left
+	FRServerFree(server);
+	FRTestAssert(test.closed == kClientCount + 2, "free closes clients");
+	FRTestAssert(read(keeper, &byte, 1) == 0, "keeper still connected");
+	close(keeper);
+	FREventLoopFree(loop);
+	
+	printf("server: %d clients, %zu messages received, %zu echoed in %.3f s (%zu drains)\n", kClientCount,
+		   test.messages, echoed, elapsed, test.drains);
+	return 0;
+}
@@ -0,0 +1,83 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <string.h>
+
+#import "FRStringsTokenizer.h"
+#import "FRTests.h"
+
+// edits a large strings file one keystroke at a time, the way the editor does, and compares the time per edit
+// with tokenizing the whole file again
+static FRStringsChar *gDocument;
+static size_t gLength;
+
+static void FRDocumentCharacters(void *info, size_t location, size_t length, FRStringsChar *buffer) {
+	memcpy(buffer, gDocument + location, length * sizeof(FRStringsChar));
+}
+
+int main(int argc, char **argv) {
+	double scale = FRTestScale(argc, argv);
+	size_t entries = (size_t)(100000 * scale);
+	if (entries < 100) { entries = 100; }
+	size_t edits = (size_t)(20000 * scale);
+	if (edits < 100) { edits = 100; }
+	
+	size_t capacity = entries * 96 + edits;
+	gDocument = malloc(capacity * sizeof(FRStringsChar));
+	FRTestAssert(gDocument != NULL, "allocate");
+	char line[128];
+	for (size_t index = 0; index < entries; index++) {
+		int length = snprintf(line, sizeof(line), "/* Label %zu */\n\"Entry number %zu\" = \"Eintrag %zu\";\n\n",
+							  index, index, index);
+		for (int position = 0; position < length; position++) { gDocument[gLength++] = line[position]; }
+	}
+	
+	FRStringsLexer *lexer = FRStringsLexerCreate();
+	size_t count = 0;
+	double start = FRTestTime();
+	FRStringsLexerEdit(lexer, FRDocumentCharacters, NULL, gLength, 0, 0, gLength, &count);
+	double full = FRTestTime() - start;
+	
+	// typing inside translations only touches the edited line. only the lexer is timed, not moving the rest of
+	// the document along for the inserted character.
+	uint32_t random = 7;
+	size_t lines = FRStringsLexerLineCount(lexer);
+	size_t retokenized = 0;
+	double incremental = 0;
+	for (size_t edit = 0; edit < edits; edit++) {
+		const FRStringsLine *target = NULL;
+		while (!target || target->kind != FRStringsLineEntry) {
+			target = FRStringsLexerLineAtIndex(lexer, FRTestRandom(&random) % lines);
+		}
+		size_t location = target->location + target->valueLocation + 1;
+		memmove(gDocument + location + 1, gDocument + location, (gLength - location) * sizeof(FRStringsChar));
+		gDocument[location] = 'a' + FRTestRandom(&random) % 26;
+		gLength++;
+		start = FRTestTime();
+		FRStringsLexerEdit(lexer, FRDocumentCharacters, NULL, gLength, location, 0, 1, &count);
+		incremental += FRTestTime() - start;
+		retokenized += count;
+	}
+	
+	printf("tokenizer: %zu entries (%.1f MB), full lex %.2f ms, %.2f us per edit (%.2f lines each)\n",
+		   entries, gLength * sizeof(FRStringsChar) / 1048576.0, full * 1e3, incremental / edits * 1e6,
+		   (double)retokenized / edits);
+	
+	FRStringsLexerFree(lexer);
+	free(gDocument);
+	return 0;
+}
@@ -0,0 +1,152 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <string.h>
+
+#import "FRStringsTokenizer.h"
+#import "FRTests.h"
+
+// documents are edited at random with pieces of strings file syntax, and after every edit the lines the lexer
+// has must match tokenizing the whole document again from the start
+static FRStringsChar gDocument[1 << 16];
+static size_t gLength;
+
+static const char *kPieces[] = {
+	"/* comment */\n", "/* == */\n", "\"a\" = \"a\";\n", "\"a\" = \"b\";\n", "\"x\\\" = \\\"\" = \"y\"", "\n", "\n",
+	"\r\n", "junk\n", "\"", "=", " ", ";", "\\", "/*", "*/",
+};
+
+static void FRDocumentCharacters(void *info, size_t location, size_t length, FRStringsChar *buffer) {
+	memcpy(buffer, gDocument + location, length * sizeof(FRStringsChar));
+}
+
+static void FRCheckAgainstFullLex(const FRStringsLexer *lexer) {
+	size_t location = 0;
+	size_t index = 0;
+	FRStringsLexState state = FRStringsLexStateInitial;
+	for (;;) {
+		FRStringsLine line;
+		FRStringsLexState next = FRStringsTokenizeLine(gDocument + location, gLength - location, state, &line);
+		const FRStringsLine *incremental = FRStringsLexerLineAtIndex(lexer, index);
+		FRTestAssert(incremental != NULL, "missing line %zu", index);
+		FRTestAssert(incremental->location == location, "line %zu location", index);
+		FRTestAssert(incremental->length == line.length && incremental->contentLength == line.contentLength,
+					 "line %zu length", index);
+		FRTestAssert(incremental->kind == line.kind && incremental->flags == line.flags &&
+					 incremental->state == state, "line %zu token", index);
+		FRTestAssert(incremental->keyLocation == line.keyLocation && incremental->keyLength == line.keyLength &&
+					 incremental->valueLocation == line.valueLocation &&
+					 incremental->valueLength == line.valueLength, "line %zu ranges", index);
+		FRTestAssert(FRStringsLexerLineIndexForLocation(lexer, location) == index, "line %zu lookup", index);
+		
+		index++;
+		location += line.length;
+		state = next;
+		if (line.length == 0 || gDocument[location - 1] != '\n') { break; }
+	}
+	FRTestAssert(index == FRStringsLexerLineCount(lexer), "%zu lines, lexer has %zu",
+				 index, FRStringsLexerLineCount(lexer));
+}
+
+static void FRTestRandomEdits(void) {
+	uint32_t random = 1;
+	for (int round = 0; round < 2000; round++) {
+		FRStringsLexer *lexer = FRStringsLexerCreate();
+		FRTestAssert(lexer != NULL, "create");
+		gLength = 0;
+		
+		for (int edit = 0; edit < 40; edit++) {
+			size_t location = gLength ? FRTestRandom(&random) % (gLength + 1) : 0;
+			size_t available = gLength - location;
+			size_t oldLength = (available && FRTestRandom(&random) % 3 == 0) ?
+				FRTestRandom(&random) % ((available < 24) ? available + 1 : 24) : 0;
+			const char *piece = kPieces[FRTestRandom(&random) % (sizeof(kPieces) / sizeof(*kPieces))];
+			size_t newLength = (FRTestRandom(&random) % 5 == 0) ? 0 : strlen(piece);
+			if (gLength - oldLength + newLength > sizeof(gDocument) / sizeof(*gDocument)) { break; }
+			
+			memmove(gDocument + location + newLength, gDocument + location + oldLength,
+					(gLength - location - oldLength) * sizeof(FRStringsChar));
+			for (size_t index = 0; index < newLength; index++) { gDocument[location + index] = piece[index]; }
+			gLength = gLength - oldLength + newLength;
+			
+			uint32_t generation = FRStringsLexerGeneration(lexer);
+			size_t count = 0;
+			size_t first = FRStringsLexerEdit(lexer, FRDocumentCharacters, NULL, gLength,
+											  location, oldLength, newLength, &count);
+			FRTestAssert(FRStringsLexerGeneration(lexer) > generation, "generation");
+			
+			// lines outside of the reported range weren't tokenized again
+			for (size_t index = 0; index < FRStringsLexerLineCount(lexer); index++) {
+				const FRStringsLine *line = FRStringsLexerLineAtIndex(lexer, index);
+				int changed = (index >= first && index < first + count);
+				FRTestAssert(changed || line->generation <= generation, "line %zu stamped outside of edit", index);
+			}
+			FRCheckAgainstFullLex(lexer);
+		}
+		FRStringsLexerFree(lexer);
+	}
+}
+
+static void FRTestTokens(void) {
+	static const char *text = "/* a == b */\n\"key\" = \"key\";\n\"a\\\"b\" = \"c\"\n";
+	gLength = strlen(text);
+	for (size_t index = 0; index < gLength; index++) { gDocument[index] = text[index]; }
+	
+	FRStringsLexer *lexer = FRStringsLexerCreate();
+	size_t count = 0;
+	FRStringsLexerEdit(lexer, FRDocumentCharacters, NULL, gLength, 0, 0, gLength, &count);
+	FRTestAssert(FRStringsLexerLineCount(lexer) == 4, "line count %zu", FRStringsLexerLineCount(lexer));
+	
+	const FRStringsLine *comment = FRStringsLexerLineAtIndex(lexer, 0);
+	const FRStringsLine *marked = FRStringsLexerLineAtIndex(lexer, 1);
+	const FRStringsLine *escaped = FRStringsLexerLineAtIndex(lexer, 2);
+	FRTestAssert(comment->kind == FRStringsLineComment && (comment->flags & FRStringsLineFlagMarker), "comment");
+	FRTestAssert(marked->kind == FRStringsLineEntry && (marked->flags & FRStringsLineFlagTerminated), "entry");
+	FRTestAssert(marked->keyLength == 3 && marked->valueLength == 3, "entry ranges");
+	FRTestAssert(escaped->kind == FRStringsLineEntry && !(escaped->flags & FRStringsLineFlagTerminated),
+				 "unterminated entry");
+	FRTestAssert(escaped->keyLength == 4 && (escaped->flags & FRStringsLineFlagTranslated), "escaped entry");
+	FRStringsLexerFree(lexer);
+}
+
+static void FRTestCommentsAcrossBlankLines(void) {
+	// a marker still applies after blank lines, but not after a line that isn't a comment
+	static const char *text = "/* == */\n\n\"a\" = \"a\";\n/* == */\njunk\n\"b\" = \"b\";\n";
+	gLength = strlen(text);
+	for (size_t index = 0; index < gLength; index++) { gDocument[index] = text[index]; }
+	
+	FRStringsLexer *lexer = FRStringsLexerCreate();
+	size_t count = 0;
+	FRStringsLexerEdit(lexer, FRDocumentCharacters, NULL, gLength, 0, 0, gLength, &count);
+	const FRStringsLine *blank = FRStringsLexerLineAtIndex(lexer, 1);
+	const FRStringsLine *marked = FRStringsLexerLineAtIndex(lexer, 2);
+	const FRStringsLine *unmarked = FRStringsLexerLineAtIndex(lexer, 5);
+	FRTestAssert(blank->kind == FRStringsLineBlank, "blank line");
+	FRTestAssert(marked->kind == FRStringsLineEntry && (marked->state & FRStringsLexStateComment) &&
+				 (marked->flags & FRStringsLineFlagTranslated), "marker across a blank line");
+	FRTestAssert(unmarked->kind == FRStringsLineEntry && !(unmarked->state & FRStringsLexStateComment) &&
+				 !(unmarked->flags & FRStringsLineFlagTranslated), "marker ends at other lines");
+	FRStringsLexerFree(lexer);
+}
+
+int main(void) {
+	FRTestTokens();
+	FRTestCommentsAcrossBlankLines();
+	FRTestRandomEdits();
+	printf("tokenizer: ok\n");
+	return 0;
+}
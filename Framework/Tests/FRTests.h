@@ -0,0 +1,93 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/*!
+ \brief		Check a condition
+ \details	Prints the location and message and exits with a failure status if the condition doesn't hold.
+ */
+#define FRTestAssert(condition, ...) do { \
+	if (!(condition)) { \
+		fprintf(stderr, "%s:%d: failed: %s: ", __FILE__, __LINE__, #condition); \
+		fprintf(stderr, __VA_ARGS__); \
+		fputc('\n', stderr); \
+		exit(1); \
+	} \
+} while (0)
+
+/*!
+ \brief		Current time
+ \details	Monotonic time in seconds.
+ */
+static inline double FRTestTime(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/*!
+ \brief		Pseudo random numbers
+ \details	A small xorshift generator, so every run (and every platform) sees the same inputs.
+ */
+static inline uint32_t FRTestRandom(uint32_t *state) {
+	uint32_t value = *state;
+	value ^= value << 13;
+	value ^= value >> 17;
+	value ^= value << 5;
+	return (*state = value);
+}
+
+/*!
+ \brief		Benchmark scale
+ \details	Benchmarks take an optional scale for their workload as the first argument, 1 by default.
+ */
+static inline double FRTestScale(int argc, char **argv) {
+	double scale = (argc > 1) ? atof(argv[1]) : 1;
+	return (scale > 0) ? scale : 1;
+}
+
+/*!
+ \brief		Loopback connection
+ \details	Connects two TCP sockets over the loopback interface, so tests see the same partial reads and
+			writes as a real connection.
+ */
+static inline void FRTestLoopback(int sockets[2]) {
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressLength = sizeof(address);
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	FRTestAssert(listener >= 0 && bind(listener, (struct sockaddr *)&address, addressLength) == 0 &&
+				 listen(listener, 1) == 0 && getsockname(listener, (struct sockaddr *)&address, &addressLength) == 0,
+				 "listen on loopback");
+	sockets[0] = socket(AF_INET, SOCK_STREAM, 0);
+	FRTestAssert(sockets[0] >= 0 && connect(sockets[0], (struct sockaddr *)&address, addressLength) == 0,
+				 "connect over loopback");
+	sockets[1] = accept(listener, NULL, NULL);
+	FRTestAssert(sockets[1] >= 0, "accept over loopback");
+	close(listener);
+}
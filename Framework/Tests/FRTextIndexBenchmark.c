@@ -0,0 +1,107 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <string.h>
+
+#import "FRTextIndex.h"
+#import "FRTests.h"
+
+// builds an index the size of a large project (keys, translations and comments of every entry in every strings
+// file) and measures how long searches take for the kind of queries typed into the search field
+static const char *gWords[] = {
+	"account", "add", "alert", "all", "allow", "archive", "back", "button", "cancel", "change", "choose", "close",
+	"confirm", "connect", "copy", "create", "delete", "device", "done", "download", "edit", "empty", "enter", "error",
+	"file", "folder", "help", "hide", "import", "item", "label", "language", "loading", "message", "name", "network",
+	"new", "next", "open", "password", "photo", "please", "preferences", "previous", "print", "quit", "remove",
+	"rename", "save", "search", "select", "send", "settings", "share", "show", "sign", "sync", "title", "translate",
+	"try", "undo", "update", "upload", "window",
+};
+
+static size_t FRTestText(FRStringsChar *buffer, size_t words, uint32_t *random) {
+	size_t length = 0;
+	for (size_t index = 0; index < words; index++) {
+		const char *word = gWords[FRTestRandom(random) % (sizeof(gWords) / sizeof(*gWords))];
+		if (index) { buffer[length++] = ' '; }
+		while (*word) { buffer[length++] = *word++; }
+	}
+	return length;
+}
+
+int main(int argc, char **argv) {
+	double scale = FRTestScale(argc, argv);
+	size_t documents = (size_t)(200 * scale);
+	if (documents < 4) { documents = 4; }
+	const size_t entries = 1000;
+	size_t queries = (size_t)(2000 * scale);
+	if (queries < 100) { queries = 100; }
+	
+	uint32_t random = 3;
+	FRTextIndex *index = FRTextIndexCreate();
+	FRTestAssert(index != NULL, "create index");
+	FRTextIndexItem *items = malloc(entries * 3 * sizeof(FRTextIndexItem));
+	FRStringsChar *text = malloc(entries * 3 * 16 * 12 * sizeof(FRStringsChar));
+	FRTestAssert(items && text, "allocate");
+	
+	size_t characters = 0;
+	double start = FRTestTime();
+	for (size_t document = 0; document < documents; document++) {
+		FRStringsChar *next = text;
+		for (size_t entry = 0; entry < entries; entry++) {
+			for (size_t field = 0; field < 3; field++) {
+				size_t words = (field == FRTextIndexFieldComment) ? 8 + FRTestRandom(&random) % 8 :
+					1 + FRTestRandom(&random) % 4;
+				size_t length = FRTestText(next, words, &random);
+				items[entry * 3 + field] = (FRTextIndexItem){ next, length, (uint32_t)entry, (FRTextIndexField)field };
+				next += length;
+				characters += length;
+			}
+		}
+		FRTextIndexSegment *segment = FRTextIndexSegmentCreate((uint32_t)document, items, entries * 3);
+		FRTestAssert(segment && FRTextIndexAddSegment(index, segment), "add segment");
+	}
+	double indexing = FRTestTime() - start;
+	
+	// queries are words, parts of words and short phrases, searched both ways. the slowest query matters as much
+	// as the average since searching happens as the query is typed.
+	size_t capacity = 1000;
+	FRTextIndexMatch *matches = malloc(capacity * sizeof(FRTextIndexMatch));
+	FRTestAssert(matches != NULL, "allocate");
+	double total = 0, slowest = 0;
+	size_t found = 0;
+	for (size_t query = 0; query < queries; query++) {
+		FRStringsChar buffer[64];
+		size_t length = FRTestText(buffer, 1 + (query % 5 == 0), &random);
+		size_t partial = 2 + FRTestRandom(&random) % 3;
+		if (query % 3 == 1 && partial < length) { length = partial; }
+		FRTextIndexMatchMode mode = (query % 2) ? FRTextIndexMatchPrefix : FRTextIndexMatchSubstring;
+		start = FRTestTime();
+		found += FRTextIndexSearch(index, buffer, length, mode, matches, capacity);
+		double elapsed = FRTestTime() - start;
+		total += elapsed;
+		if (elapsed > slowest) { slowest = elapsed; }
+	}
+	
+	printf("text index: %zu documents, %zu items (%.1f M characters), indexed in %.2f s, %.3f ms per query "
+		   "(slowest %.3f ms, %.1f matches each)\n", documents, documents * entries * 3, characters / 1e6,
+		   indexing, total / queries * 1e3, slowest * 1e3, (double)found / queries);
+	
+	free(matches);
+	free(text);
+	free(items);
+	FRTextIndexFree(index);
+	return 0;
+}
@@ -0,0 +1,140 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <string.h>
+
+#import "FRTextIndex.h"
+#import "FRTests.h"
+
+// searches an index of random text from a small alphabet, so queries have plenty of matches, and checks every
+// result against a linear scan over the same items
+#define FRDocumentCount 40
+#define FRItemCount 500
+#define FRItemCapacity 24
+
+typedef struct FRTestDocument {
+	uint32_t identifier;
+	int indexed;
+	FRStringsChar text[FRItemCount][FRItemCapacity];
+	size_t lengths[FRItemCount];
+} FRTestDocument;
+
+static FRTestDocument gDocuments[FRDocumentCount];
+
+static FRTextIndexSegment *FRTestSegment(FRTestDocument *document, uint32_t *random) {
+	FRTextIndexItem items[FRItemCount];
+	for (size_t index = 0; index < FRItemCount; index++) {
+		size_t length = FRTestRandom(random) % 20;
+		for (size_t position = 0; position < length; position++) {
+			document->text[index][position] = 'a' + FRTestRandom(random) % 5;
+		}
+		document->lengths[index] = length;
+		items[index] = (FRTextIndexItem){
+			.chars = document->text[index],
+			.length = length,
+			.entry = (uint32_t)index,
+			.field = (FRTextIndexField)(index % 3),
+		};
+	}
+	FRTextIndexSegment *segment = FRTextIndexSegmentCreate(document->identifier, items, FRItemCount);
+	FRTestAssert(segment != NULL, "create segment");
+	return segment;
+}
+
+static int FRTestMatches(const FRStringsChar *text, size_t length, const FRStringsChar *query, size_t queryLength,
+						 FRTextIndexMatchMode mode) {
+	if (queryLength == 0 || queryLength > length) { return 0; }
+	size_t last = (mode == FRTextIndexMatchPrefix) ? 0 : length - queryLength;
+	for (size_t offset = 0; offset <= last; offset++) {
+		if (memcmp(text + offset, query, queryLength * sizeof(FRStringsChar)) == 0) { return 1; }
+	}
+	return 0;
+}
+
+// every query is checked against the expected matches in order, including when there's only room for some
+static void FRTestSearch(const FRTextIndex *index, const FRStringsChar *query, size_t length,
+						 FRTextIndexMatchMode mode, size_t capacity) {
+	static FRTextIndexMatch matches[FRDocumentCount * FRItemCount];
+	size_t count = FRTextIndexSearch(index, query, length, mode, matches, capacity);
+	size_t expected = 0;
+	
+	// documents are ordered by identifier, which increases with the document number
+	for (size_t number = 0; number < FRDocumentCount; number++) {
+		FRTestDocument *document = &gDocuments[number];
+		if (!document->indexed) { continue; }
+		for (size_t item = 0; item < FRItemCount; item++) {
+			if (!FRTestMatches(document->text[item], document->lengths[item], query, length, mode)) { continue; }
+			if (expected < capacity) {
+				FRTestAssert(expected < count, "missing match in document %u item %zu", document->identifier, item);
+				FRTestAssert(matches[expected].document == document->identifier &&
+							 matches[expected].entry == item &&
+							 matches[expected].field == item % 3,
+							 "match %zu is document %u item %u, expected document %u item %zu", expected,
+							 matches[expected].document, matches[expected].entry, document->identifier, item);
+			}
+			expected++;
+		}
+	}
+	FRTestAssert(count == (expected < capacity ? expected : capacity), "%zu matches, expected %zu of %zu",
+				 count, expected, capacity);
+}
+
+int main(int argc, char **argv) {
+	uint32_t random = 11;
+	FRTextIndex *index = FRTextIndexCreate();
+	FRTestAssert(index != NULL, "create index");
+	
+	// add the segments out of order, since the index keeps them sorted by document
+	for (size_t step = 0; step < FRDocumentCount; step++) {
+		size_t number = (step * 7) % FRDocumentCount;
+		FRTestDocument *document = &gDocuments[number];
+		document->identifier = (uint32_t)number * 3;
+		document->indexed = 1;
+		FRTestAssert(FRTextIndexAddSegment(index, FRTestSegment(document, &random)), "add segment");
+	}
+	FRTestAssert(FRTextIndexDocumentCount(index) == FRDocumentCount, "document count");
+	
+	// removing documents and replacing others with new contents
+	for (size_t number = 1; number < FRDocumentCount; number += 9) {
+		FRTextIndexRemoveDocument(index, gDocuments[number].identifier);
+		gDocuments[number].indexed = 0;
+	}
+	for (size_t number = 2; number < FRDocumentCount; number += 9) {
+		FRTestAssert(FRTextIndexAddSegment(index, FRTestSegment(&gDocuments[number], &random)), "replace segment");
+	}
+	FRTextIndexRemoveDocument(index, 1);
+	FRTestAssert(FRTextIndexDocumentCount(index) == FRDocumentCount - 5, "document count after removal");
+	
+	for (size_t query = 0; query < 3000; query++) {
+		FRStringsChar text[8];
+		size_t length = FRTestRandom(&random) % 7;
+		for (size_t position = 0; position < length; position++) { text[position] = 'a' + FRTestRandom(&random) % 5; }
+		FRTextIndexMatchMode mode = FRTestRandom(&random) % 2 ? FRTextIndexMatchPrefix : FRTextIndexMatchSubstring;
+		size_t capacity = (query % 10 == 0) ? FRTestRandom(&random) % 50 : FRDocumentCount * FRItemCount;
+		FRTestSearch(index, text, length, mode, capacity);
+	}
+	
+	// queries with characters that never appear in the index
+	const FRStringsChar missing[] = { 'a', 'b', 'z' };
+	FRTestSearch(index, missing, 3, FRTextIndexMatchSubstring, FRDocumentCount * FRItemCount);
+	const FRStringsChar noncharacter[] = { 0xFFFF, 'a' };
+	FRTestSearch(index, noncharacter, 2, FRTextIndexMatchSubstring, FRDocumentCount * FRItemCount);
+	
+	FRTextIndexFree(index);
+	printf("text index: ok\n");
+	return 0;
+}
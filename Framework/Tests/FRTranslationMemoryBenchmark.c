@@ -0,0 +1,137 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <string.h>
+
+#import "FRTranslationMemory.h"
+#import "FRTests.h"
+
+// fills a translation memory with a million sentences made of words with a realistic (zipf) distribution and
+// times searches at the distance that suggestions use. most queries are stored sentences with a word changed and
+// a typo, the rest are new sentences with nothing close, which prune worst.
+#define FRWordCount 5000
+#define FRSentenceCapacity 160
+
+static char gWords[FRWordCount][16];
+static double gFrequencies[FRWordCount];
+
+static void FRTestVocabulary(uint32_t *random) {
+	static const char *syllables[] = {
+		"ka", "to", "re", "mi", "sa", "lo", "nu", "pe", "di", "ga",
+		"ver", "con", "ing", "tion", "str", "ab", "ex", "pro", "ment", "al",
+	};
+	double total = 0;
+	for (size_t word = 0; word < FRWordCount; word++) {
+		for (size_t count = 1 + FRTestRandom(random) % 3; count > 0; count--) {
+			strcat(gWords[word], syllables[FRTestRandom(random) % 20]);
+		}
+		total += 1.0 / (word + 1);
+		gFrequencies[word] = total;
+	}
+	for (size_t word = 0; word < FRWordCount; word++) { gFrequencies[word] /= total; }
+}
+
+static const char *FRTestWord(uint32_t *random) {
+	double value = (double)FRTestRandom(random) / UINT32_MAX;
+	size_t low = 0, high = FRWordCount - 1;
+	while (low < high) {
+		size_t middle = (low + high) / 2;
+		if (gFrequencies[middle] < value) { low = middle + 1; }
+		else { high = middle; }
+	}
+	return gWords[low];
+}
+
+static size_t FRTestSentence(FRStringsChar *sentence, uint32_t *random) {
+	size_t length = 0;
+	for (size_t count = 2 + FRTestRandom(random) % 10, word = 0; word < count; word++) {
+		if (word) { sentence[length++] = ' '; }
+		for (const char *next = FRTestWord(random); *next; next++) { sentence[length++] = *next; }
+	}
+	return length;
+}
+
+int main(int argc, char **argv) {
+	double scale = FRTestScale(argc, argv);
+	size_t entries = (size_t)(1000000 * scale);
+	if (entries < 1000) { entries = 1000; }
+	size_t queries = (size_t)(500 * scale);
+	if (queries < 50) { queries = 50; }
+	
+	uint32_t random = 7;
+	FRTestVocabulary(&random);
+	FRTranslationMemory *memory = FRTranslationMemoryCreate();
+	FRTestAssert(memory != NULL, "create memory");
+	FRStringsChar sentence[FRSentenceCapacity];
+	double start = FRTestTime();
+	for (size_t entry = 0; entry < entries; entry++) {
+		size_t length = FRTestSentence(sentence, &random);
+		FRTestAssert(FRTranslationMemoryAdd(memory, 0, sentence, length, sentence, length) != UINT32_MAX, "add");
+	}
+	double indexing = FRTestTime() - start;
+	
+	const size_t capacity = 10;
+	FRTranslationMemoryMatch matches[capacity];
+	double total = 0, slowest = 0;
+	size_t found = 0, changed = 0, reached = 0;
+	for (size_t query = 0; query < queries; query++) {
+		size_t length = 0;
+		const FRStringsChar *source = NULL;
+		size_t sourceLength = 0;
+		if (query % 4 == 3) {
+			length = FRTestSentence(sentence, &random);
+		}
+		else {
+			// replace the word around a random character with another word, then change one character
+			source = FRTranslationMemorySource(memory, FRTestRandom(&random) % entries, &length);
+			sourceLength = length;
+			size_t middle = FRTestRandom(&random) % length, first = middle, last = middle;
+			while (first > 0 && source[first - 1] != ' ') { first--; }
+			while (last < length && source[last] != ' ') { last++; }
+			const char *word = FRTestWord(&random);
+			size_t wordLength = strlen(word);
+			memcpy(sentence, source, first * sizeof(FRStringsChar));
+			for (size_t position = 0; position < wordLength; position++) {
+				sentence[first + position] = word[position];
+			}
+			memcpy(sentence + first + wordLength, source + last, (length - last) * sizeof(FRStringsChar));
+			length = first + wordLength + length - last;
+			sentence[FRTestRandom(&random) % length] = 'x';
+		}
+		
+		uint32_t maximum = FRTranslationMemorySuggestionDistance(length);
+		start = FRTestTime();
+		found += FRTranslationMemorySearch(memory, 0, sentence, length, maximum, matches, capacity);
+		double elapsed = FRTestTime() - start;
+		total += elapsed;
+		if (elapsed > slowest) { slowest = elapsed; }
+		
+		// a whole word changed is often more than suggestions allow, the share that is still close enough
+		// is reported along with the timings
+		if (source) {
+			changed++;
+			reached += (FRTranslationMemoryDistance(source, sourceLength, sentence, length, maximum) <= maximum);
+		}
+	}
+	
+	printf("translation memory: %zu pairs, added in %.2f s, %.2f ms per query (slowest %.2f ms, %.1f matches each, "
+		   "%.0f%% of changed sentences in reach)\n", entries, indexing, total / queries * 1e3, slowest * 1e3,
+		   (double)found / queries, 100.0 * reached / changed);
+	
+	FRTranslationMemoryFree(memory);
+	return 0;
+}
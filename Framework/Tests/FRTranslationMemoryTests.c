@@ -0,0 +1,270 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <string.h>
+
+#import "FRTranslationMemory.h"
+#import "FRTests.h"
+
+// checks the bounded edit distance and searches against a plain dynamic programming edit distance
+static uint32_t FRTestDistance(const FRStringsChar *a, size_t aLength, const FRStringsChar *b, size_t bLength) {
+	uint32_t *row = malloc((bLength + 1) * sizeof(uint32_t));
+	FRTestAssert(row != NULL, "allocate");
+	for (size_t column = 0; column <= bLength; column++) { row[column] = (uint32_t)column; }
+	for (size_t line = 1; line <= aLength; line++) {
+		uint32_t diagonal = row[0];
+		row[0] = (uint32_t)line;
+		for (size_t column = 1; column <= bLength; column++) {
+			uint32_t above = row[column];
+			uint32_t value = diagonal + (a[line - 1] != b[column - 1]);
+			if (above + 1 < value) { value = above + 1; }
+			if (row[column - 1] + 1 < value) { value = row[column - 1] + 1; }
+			diagonal = above;
+			row[column] = value;
+		}
+	}
+	uint32_t distance = row[bLength];
+	free(row);
+	return distance;
+}
+
+// mostly ascii from a small alphabet with some characters outside of it, since those take a different path
+static void FRTestText(FRStringsChar *text, size_t length, uint32_t alphabet, uint32_t *random) {
+	for (size_t position = 0; position < length; position++) {
+		uint32_t value = FRTestRandom(random);
+		text[position] = (value % 10 == 0) ? 0x400 + (value >> 8) % alphabet : 'a' + (value >> 8) % alphabet;
+	}
+}
+
+static void FRTestDistances(uint32_t *random) {
+	FRStringsChar a[200], b[200];
+	for (size_t test = 0; test < 50000; test++) {
+		// short strings use the bit-parallel distance, long ones the banded one
+		size_t aLength = FRTestRandom(random) % ((test % 2) ? 130 : 40);
+		size_t bLength = aLength + FRTestRandom(random) % 9;
+		bLength = (bLength < 4) ? 0 : bLength - 4;
+		FRTestText(a, aLength, 4, random);
+		memcpy(b, a, (aLength < bLength ? aLength : bLength) * sizeof(FRStringsChar));
+		if (bLength > aLength) { FRTestText(b + aLength, bLength - aLength, 4, random); }
+		for (size_t edit = FRTestRandom(random) % 6; edit > 0 && bLength; edit--) {
+			b[FRTestRandom(random) % bLength] = 'a' + FRTestRandom(random) % 4;
+		}
+		
+		uint32_t maximum = FRTestRandom(random) % 8;
+		uint32_t expected = FRTestDistance(a, aLength, b, bLength);
+		uint32_t distance = FRTranslationMemoryDistance(a, aLength, b, bLength, maximum);
+		if (expected <= maximum) {
+			FRTestAssert(distance == expected, "distance %u, expected %u (lengths %zu and %zu, maximum %u)",
+						 distance, expected, aLength, bLength, maximum);
+		}
+		else {
+			FRTestAssert(distance > maximum, "distance %u within %u, expected %u", distance, maximum, expected);
+		}
+	}
+}
+
+#define FREntryCount 5000
+#define FREntryCapacity 40
+
+static void FRTestSearches(uint32_t *random) {
+	static FRStringsChar sources[FREntryCount][FREntryCapacity];
+	static size_t lengths[FREntryCount];
+	static uint32_t languages[FREntryCount];
+	static FRTranslationMemoryMatch matches[FREntryCount];
+	
+	FRTranslationMemory *memory = FRTranslationMemoryCreate();
+	FRTestAssert(memory != NULL, "create memory");
+	for (uint32_t entry = 0; entry < FREntryCount; entry++) {
+		lengths[entry] = FRTestRandom(random) % 30;
+		languages[entry] = FRTestRandom(random) % 2;
+		FRTestText(sources[entry], lengths[entry], 6, random);
+		FRTestAssert(FRTranslationMemoryAdd(memory, languages[entry], sources[entry], lengths[entry],
+											sources[entry], lengths[entry]) == entry, "add entry");
+	}
+	FRTestAssert(FRTranslationMemoryCount(memory) == FREntryCount, "entry count");
+	FRTranslationMemoryRemove(memory, 5);
+	
+	for (size_t test = 0; test < 300; test++) {
+		uint32_t base = FRTestRandom(random) % FREntryCount;
+		FRStringsChar query[FREntryCapacity];
+		size_t length = lengths[base];
+		memcpy(query, sources[base], length * sizeof(FRStringsChar));
+		if (length) { query[FRTestRandom(random) % length] = 'z'; }
+		uint32_t maximum = FRTestRandom(random) % 4;
+		uint32_t language = FRTestRandom(random) % 2;
+		size_t capacity = (test % 4 == 0) ? 1 + FRTestRandom(random) % 10 : FREntryCount;
+		
+		// matches come closest first and then by entry, cut off at the capacity
+		size_t count = FRTranslationMemorySearch(memory, language, query, length, maximum, matches, capacity);
+		size_t expected = 0;
+		for (uint32_t distance = 0; distance <= maximum && expected < capacity; distance++) {
+			for (uint32_t entry = 0; entry < FREntryCount && expected < capacity; entry++) {
+				if (languages[entry] != language || entry == 5) { continue; }
+				if (FRTestDistance(query, length, sources[entry], lengths[entry]) != distance) { continue; }
+				FRTestAssert(expected < count, "missing entry %u at distance %u", entry, distance);
+				FRTestAssert(matches[expected].entry == entry && matches[expected].distance == distance,
+							 "match %zu is entry %u at %u, expected entry %u at %u", expected,
+							 matches[expected].entry, matches[expected].distance, entry, distance);
+				expected++;
+			}
+		}
+		FRTestAssert(count == expected, "%zu matches, expected %zu", count, expected);
+	}
+	
+	// languages that were never added have nothing
+	FRTestAssert(FRTranslationMemorySearch(memory, 7, sources[0], lengths[0], 4, matches, FREntryCount) == 0,
+				 "unknown language");
+	FRTranslationMemoryFree(memory);
+}
+
+static void FRTestCompaction(uint32_t *random) {
+	static FRStringsChar sources[FREntryCount][FREntryCapacity];
+	static size_t lengths[FREntryCount];
+	static uint32_t entries[FREntryCount];
+	static FRTranslationMemoryMatch before[FREntryCount][4], after[4];
+	static size_t counts[FREntryCount];
+	
+	FRTranslationMemory *memory = FRTranslationMemoryCreate();
+	FRTestAssert(memory != NULL, "create memory");
+	for (uint32_t entry = 0; entry < FREntryCount; entry++) {
+		lengths[entry] = 8 + FRTestRandom(random) % 20;
+		FRTestText(sources[entry], lengths[entry], 6, random);
+		FRTestAssert(FRTranslationMemoryAdd(memory, entry % 3, sources[entry], lengths[entry],
+											sources[entry], lengths[entry]) == entry, "add entry");
+	}
+	
+	// removing less than half doesn't call for compacting yet
+	size_t removed = 0;
+	for (uint32_t entry = 0; entry < FREntryCount; entry++) {
+		if (entry % 3 == 2 || FRTestRandom(random) % 3 == 0) {
+			FRTranslationMemoryRemove(memory, entry);
+			FRTranslationMemoryRemove(memory, entry);
+			removed++;
+		}
+		FRTestAssert(!FRTranslationMemoryNeedsCompaction(memory) || removed * 2 >= FREntryCount,
+					 "compaction after %zu of %u entries", removed, FREntryCount);
+	}
+	FRTestAssert(FRTranslationMemoryNeedsCompaction(memory), "compaction after %zu entries", removed);
+	
+	for (uint32_t entry = 0; entry < FREntryCount; entry++) {
+		counts[entry] = FRTranslationMemorySearch(memory, entry % 3, sources[entry], lengths[entry], 3,
+												  before[entry], 4);
+	}
+	FRTestAssert(FRTranslationMemoryCompact(memory, entries), "compact");
+	FRTestAssert(FRTranslationMemoryCount(memory) == FREntryCount - removed, "%zu entries after compacting",
+				 FRTranslationMemoryCount(memory));
+	FRTestAssert(!FRTranslationMemoryNeedsCompaction(memory), "compacted memory needs compaction");
+	
+	// the remaining entries keep their order and characters, and searches find the same entries
+	uint32_t next = 0;
+	for (uint32_t entry = 0; entry < FREntryCount; entry++) {
+		if (entries[entry] == UINT32_MAX) { continue; }
+		FRTestAssert(entries[entry] == next++, "entry %u moved to %u", entry, entries[entry]);
+		size_t length = 0;
+		const FRStringsChar *source = FRTranslationMemorySource(memory, entries[entry], &length);
+		FRTestAssert(length == lengths[entry] && memcmp(source, sources[entry], length * sizeof(FRStringsChar)) == 0,
+					 "source of entry %u", entry);
+	}
+	FRTestAssert(next == FREntryCount - removed, "%u entries kept", next);
+	for (uint32_t entry = 0; entry < FREntryCount; entry++) {
+		size_t count = FRTranslationMemorySearch(memory, entry % 3, sources[entry], lengths[entry], 3, after, 4);
+		FRTestAssert(count == counts[entry], "%zu matches after compacting, %zu before", count, counts[entry]);
+		for (size_t position = 0; position < count; position++) {
+			FRTestAssert(after[position].entry == entries[before[entry][position].entry] &&
+						 after[position].distance == before[entry][position].distance, "match %zu for entry %u",
+						 position, entry);
+		}
+	}
+	
+	// the language that lost all of its entries has none left, and new entries follow the remaining ones
+	FRTestAssert(FRTranslationMemorySearch(memory, 2, sources[2], lengths[2], 3, after, 4) == 0, "removed language");
+	FRTestAssert(FRTranslationMemoryAdd(memory, 2, sources[2], lengths[2], sources[2], lengths[2]) == next,
+				 "add after compacting");
+	FRTestAssert(FRTranslationMemorySearch(memory, 2, sources[2], lengths[2], 0, after, 4) == 1 &&
+				 after[0].entry == next, "search after compacting");
+	FRTranslationMemoryFree(memory);
+}
+
+// strings that were typed again with small changes have to be suggested at every length. these are a typo
+// or two, a plural and punctuation (three dots typed as an ellipsis, which takes three edits).
+static void FRTestSuggestionRecall(uint32_t *random) {
+	static const char *words[] = {
+		"open", "save", "the", "file", "document", "could", "not", "be", "selected", "items", "delete",
+		"window", "new", "folder", "name", "a", "with", "changes", "you", "made", "will", "lost", "are",
+		"sure", "want", "to", "close", "settings", "translation", "of", "all", "language", "search",
+	};
+	static FRStringsChar sources[FREntryCount][FREntryCapacity * 4];
+	static size_t lengths[FREntryCount];
+	static FRTranslationMemoryMatch matches[64];
+	const size_t wordCount = sizeof(words) / sizeof(words[0]);
+	
+	FRTranslationMemory *memory = FRTranslationMemoryCreate();
+	FRTestAssert(memory != NULL, "create memory");
+	for (uint32_t entry = 0; entry < FREntryCount; entry++) {
+		size_t length = 0;
+		for (size_t count = 1 + entry % 20, word = 0; word < count; word++) {
+			if (word) { sources[entry][length++] = ' '; }
+			for (const char *next = words[FRTestRandom(random) % wordCount]; *next; next++) {
+				sources[entry][length++] = *next;
+			}
+		}
+		for (size_t dot = 0; dot < 3; dot++) { sources[entry][length++] = '.'; }
+		lengths[entry] = length;
+		FRTestAssert(FRTranslationMemoryAdd(memory, 0, sources[entry], length, sources[entry], length) == entry,
+					 "add entry");
+	}
+	
+	for (uint32_t entry = 0; entry < FREntryCount; entry++) {
+		FRStringsChar query[FREntryCapacity * 4 + 1];
+		size_t length = lengths[entry];
+		memcpy(query, sources[entry], length * sizeof(FRStringsChar));
+		size_t edits = 1 + entry % 3;
+		switch (edits) {
+			case 1:
+				query[FRTestRandom(random) % (length - 3)] = 'x';
+				break;
+			case 2:
+				query[length - 3] = 's';
+				query[FRTestRandom(random) % (length - 3)] = 'x';
+				break;
+			default:
+				query[length - 3] = 0x2026;
+				length -= 2;
+				break;
+		}
+		uint32_t distance = FRTranslationMemoryDistance(sources[entry], lengths[entry], query, length, 3);
+		if (length < 4 * edits) { continue; }
+		
+		uint32_t maximum = FRTranslationMemorySuggestionDistance(length);
+		size_t count = FRTranslationMemorySearch(memory, 0, query, length, maximum, matches, 64);
+		size_t position = 0;
+		while (position < count && matches[position].entry != entry) { position++; }
+		FRTestAssert(distance <= maximum && position < count, "entry %u not suggested with %u edits in %zu characters",
+					 entry, distance, length);
+	}
+	FRTranslationMemoryFree(memory);
+}
+
+int main(int argc, char **argv) {
+	uint32_t random = 5;
+	FRTestDistances(&random);
+	FRTestSearches(&random);
+	FRTestCompaction(&random);
+	FRTestSuggestionRecall(&random);
+	printf("translation memory: ok\n");
+	return 0;
+}
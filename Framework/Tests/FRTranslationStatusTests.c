@@ -0,0 +1,185 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <string.h>
+
+#import "FRStringsTokenizer.h"
+#import "FRTranslationStatus.h"
+#import "FRTests.h"
+
+// checks the vectorized comparisons against plain loops, the classifier and the bitmaps, and that strings files
+// are classified the same way the localization scripts classify them. the fixture is shared with the tests of the
+// scripts, and both check it against the same expected counts.
+static void FRTestCharsEqual(uint32_t *random) {
+	FRStringsChar a[80] = {}, b[80] = {};
+	for (size_t length = 0; length <= 64; length++) {
+		for (size_t position = 0; position < length; position++) { a[position] = b[position] = 'a' + position % 26; }
+		FRTestAssert(FRTranslationStatusCharsEqual(a, b, length), "equal characters of length %zu", length);
+		
+		// a difference anywhere has to be found, including in the upper byte and the last vector or word
+		for (size_t position = 0; position < length; position++) {
+			FRStringsChar saved = b[position];
+			b[position] = (FRTestRandom(random) % 2) ? saved + 1 : saved + 0x100;
+			FRTestAssert(!FRTranslationStatusCharsEqual(a, b, length), "difference at %zu of %zu", position, length);
+			FRTestAssert(!FRTranslationStatusCharsEqual(b, a, length), "difference at %zu of %zu", position, length);
+			b[position] = saved;
+		}
+	}
+	
+	// unaligned starts
+	for (size_t offset = 1; offset < 8; offset++) {
+		FRTestAssert(FRTranslationStatusCharsEqual(a + offset, b + offset, 40), "offset %zu", offset);
+	}
+}
+
+static void FRTestContainsMarker(uint32_t *random) {
+	FRStringsChar chars[64];
+	for (size_t test = 0; test < 100000; test++) {
+		size_t length = FRTestRandom(random) % 40;
+		int expected = 0;
+		for (size_t position = 0; position < length; position++) {
+			// mostly single equal signs, and = in the upper byte, which is not an equal sign
+			uint32_t value = FRTestRandom(random) % 16;
+			chars[position] = (value < 2) ? '=' : (value == 2) ? 0x3D00 | '=' : 'a' + value;
+			if (position && chars[position] == '=' && chars[position - 1] == '=') { expected = 1; }
+		}
+		FRTestAssert(FRTranslationStatusContainsMarker(chars, length) == expected, "marker in %zu characters", length);
+	}
+	
+	// the marker on every position, including across the end of a vector
+	for (size_t length = 2; length <= 40; length++) {
+		for (size_t position = 0; position + 1 < length; position++) {
+			for (size_t index = 0; index < length; index++) { chars[index] = (index % 2) ? '=' : ' '; }
+			chars[position] = chars[position + 1] = '=';
+			FRTestAssert(FRTranslationStatusContainsMarker(chars, length), "marker at %zu of %zu", position, length);
+		}
+		FRTestAssert(!FRTranslationStatusContainsMarker(chars, 1), "marker in one character");
+	}
+}
+
+static void FRTestClassify(void) {
+	static const FRStringsChar save[] = { 'S', 'a', 'v', 'e' };
+	static const FRStringsChar saved[] = { 'S', 'a', 'v', 'e', 'd' };
+	static const FRStringsChar other[] = { 'S', 'a', 'v', 'E' };
+	
+	// untranslated and equal entries only differ by the marker
+	FRTestAssert(FRTranslationStatusClassify(save, 4, save, 4, 0) == FRTranslationStatusUntranslated, "untranslated");
+	FRTestAssert(FRTranslationStatusClassify(save, 4, save, 4, 1) == FRTranslationStatusEqual, "equal");
+	FRTestAssert(FRTranslationStatusClassify(save, 4, other, 4, 0) == FRTranslationStatusTranslated, "translated");
+	FRTestAssert(FRTranslationStatusClassify(save, 4, other, 4, 1) == FRTranslationStatusTranslated,
+				 "translated with marker");
+	FRTestAssert(FRTranslationStatusClassify(save, 4, saved, 5, 0) == FRTranslationStatusTranslated,
+				 "translated with prefix");
+	FRTestAssert(FRTranslationStatusClassify(save, 4, save, 0, 0) == FRTranslationStatusTranslated, "empty value");
+	FRTestAssert(FRTranslationStatusClassify(save, 0, save, 0, 0) == FRTranslationStatusUntranslated, "empty entry");
+}
+
+static void FRTestMap(uint32_t *random) {
+	static FRTranslationStatus statuses[1000];
+	for (size_t count = 0; count < 200; count += 1 + count / 4) {
+		FRTranslationStatusMap *map = FRTranslationStatusMapCreate(count);
+		FRTestAssert(map != NULL, "create map");
+		memset(statuses, FRTranslationStatusUntranslated, sizeof(statuses));
+		
+		// statuses are set more than once, so bits have to be cleared as well as set
+		for (size_t set = 0; count && set < count * 3; set++) {
+			size_t index = FRTestRandom(random) % count;
+			statuses[index] = FRTestRandom(random) % 3;
+			FRTranslationStatusMapSet(map, index, statuses[index]);
+		}
+		
+		size_t expected[3] = {};
+		for (size_t index = 0; index < count; index++) {
+			FRTestAssert(FRTranslationStatusMapGet(map, index) == statuses[index], "status %zu of %zu", index, count);
+			expected[statuses[index]]++;
+		}
+		for (FRTranslationStatus status = 0; status < 3; status++) {
+			FRTestAssert(FRTranslationStatusMapCount(map, status) == expected[status], "count of status %u in %zu",
+						 status, count);
+		}
+		FRTranslationStatusMapFree(map);
+	}
+}
+
+static void FRTestFixture(const char *directory) {
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/counts.txt", directory);
+	FILE *counts = fopen(path, "r");
+	FRTestAssert(counts != NULL, "open %s", path);
+	
+	char line[1024], name[512];
+	size_t files = 0;
+	while (fgets(line, sizeof(line), counts)) {
+		size_t expected[3] = {};
+		if (line[0] == '#' || sscanf(line, "%511s %zu %zu %zu", name, &expected[FRTranslationStatusTranslated],
+									 &expected[FRTranslationStatusUntranslated],
+									 &expected[FRTranslationStatusEqual]) != 4) { continue; }
+		
+		// the fixture is ascii, so the characters are the bytes
+		static FRStringsChar document[1 << 16];
+		snprintf(path, sizeof(path), "%s/%s", directory, name);
+		FILE *file = fopen(path, "rb");
+		FRTestAssert(file != NULL, "open %s", path);
+		size_t length = 0;
+		for (int c; (c = fgetc(file)) != EOF && length < sizeof(document) / sizeof(*document);) {
+			document[length++] = (FRStringsChar)c;
+		}
+		fclose(file);
+		
+		// the same walk the lexer does, classifying entries with the state they start in
+		size_t found[3] = {};
+		FRStringsLexState state = FRStringsLexStateInitial;
+		for (size_t location = 0; location < length;) {
+			FRStringsLine parsed;
+			FRStringsLexState next = FRStringsTokenizeLine(document + location, length - location, state, &parsed);
+			if (parsed.kind == FRStringsLineEntry) {
+				const FRStringsChar *chars = document + location;
+				FRTranslationStatus status = FRTranslationStatusClassify(chars + parsed.keyLocation, parsed.keyLength,
+																		 chars + parsed.valueLocation,
+																		 parsed.valueLength,
+																		 (state & FRStringsLexStateMarker) != 0);
+				FRTestAssert(((parsed.flags & FRStringsLineFlagTranslated) != 0) ==
+							 (status != FRTranslationStatusUntranslated), "flags of the entry at %zu in %s",
+							 location, name);
+				found[status]++;
+			}
+			FRTestAssert(parsed.length > 0, "empty line at %zu in %s", location, name);
+			location += parsed.length;
+			state = next;
+		}
+		
+		for (FRTranslationStatus status = 0; status < 3; status++) {
+			FRTestAssert(found[status] == expected[status], "%zu entries of status %u in %s, expected %zu",
+						 found[status], status, name, expected[status]);
+		}
+		files++;
+	}
+	fclose(counts);
+	FRTestAssert(files > 0, "no files in %s/counts.txt", directory);
+}
+
+int main(int argc, char **argv) {
+	uint32_t random = 9;
+	FRTestAssert(argc > 1, "usage: %s fixture-directory", argv[0]);
+	FRTestCharsEqual(&random);
+	FRTestContainsMarker(&random);
+	FRTestClassify();
+	FRTestMap(&random);
+	FRTestFixture(argv[1]);
+	printf("translation status: ok\n");
+	return 0;
+}
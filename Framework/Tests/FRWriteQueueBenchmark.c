@@ -0,0 +1,186 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+
+#import "FRWriteQueue.h"
+#import "FRTests.h"
+
+// measures how long short control messages take to arrive while the write queue is kept full of strings files
+// for a reader that's slower than the writer, the way a device sending resources to a translator over Wi-Fi
+// is. it's run once with the control messages on their own channel and once with everything on the bulk
+// channel, which is how a single write buffer behaves.
+enum {
+	kControlLength = 16,
+	kBulkLength = 1024 * 1024,
+};
+static const size_t kBulkBacklog = 4 * 1024 * 1024;
+static const double kControlInterval = 0.002;
+static const double kReadRate = 40 * 1024 * 1024;	// bytes per second
+static const size_t kReadLength = 64 * 1024;
+
+typedef struct FRTestLatency {
+	int socket;
+	FRFrameChannel controlChannel;
+	size_t controlCount;
+	uint8_t *bulk;
+} FRTestLatency;
+
+static void FRTestReleaseControl(void *owner) {
+	free(owner);
+}
+
+static void *FRTestLatencyWriter(void *context) {
+	FRTestLatency *test = context;
+	FRWriteQueue *queue = FRWriteQueueCreate(kBulkBacklog);
+	FRTestAssert(queue != NULL, "create write queue");
+	
+	// control messages hold their index and when they were queued
+	size_t sent = 0;
+	double nextControl = FRTestTime();
+	while (sent < test->controlCount || FRWriteQueueLength(queue)) {
+		double now = FRTestTime();
+		if (sent < test->controlCount && now >= nextControl) {
+			uint8_t *control = malloc(kControlLength);
+			FRTestAssert(control != NULL, "allocate");
+			uint64_t index = sent++;
+			memcpy(control, &index, sizeof(index));
+			memcpy(control + sizeof(index), &now, sizeof(now));
+			FRTestAssert(FRWriteQueuePush(queue, test->controlChannel, control, kControlLength, control,
+										  FRTestReleaseControl) == 0, "push control message");
+			nextControl += kControlInterval;
+		}
+		while (sent < test->controlCount && FRWriteQueueLength(queue) < kBulkBacklog) {
+			FRTestAssert(FRWriteQueuePush(queue, FRFrameChannelBulk, test->bulk, kBulkLength, NULL, NULL) == 0,
+						 "push bulk message");
+		}
+		FRTestAssert(FRWriteQueueFlush(queue, FRWriteQueueWriteSocket, &test->socket) >= 0, "write: %s",
+					 strerror(errno));
+		
+		// wait until more can be written or the next control message is due
+		int timeout = (int)((nextControl - FRTestTime()) * 1000);
+		if (sent == test->controlCount) { timeout = -1; }
+		struct pollfd descriptor = { test->socket, POLLOUT, 0 };
+		if (FRWriteQueueLength(queue)) { poll(&descriptor, 1, (timeout > 0 || timeout == -1) ? timeout : 0); }
+		else if (timeout > 0) { poll(NULL, 0, timeout); }
+	}
+	FRWriteQueueFree(queue);
+	shutdown(test->socket, SHUT_WR);
+	return NULL;
+}
+
+static int FRTestCompare(const void *first, const void *second) {
+	double a = *(const double *)first;
+	double b = *(const double *)second;
+	return (a > b) - (a < b);
+}
+
+static void FRTestMeasure(FRTestLatency *test, const char *name) {
+	int sockets[2];
+	FRTestLoopback(sockets);
+	int size = 64 * 1024;
+	setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	setsockopt(sockets[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	FRTestAssert(FRWriteQueueSetSocketOptions(sockets[0]) == 0, "socket options");
+	int flags = fcntl(sockets[0], F_GETFL, 0);
+	FRTestAssert(flags >= 0 && fcntl(sockets[0], F_SETFL, flags | O_NONBLOCK) == 0, "non-blocking socket");
+	test->socket = sockets[0];
+	
+	FRFrameBuffer *buffer = FRFrameBufferCreate(2 * kBulkLength);
+	FRTestAssert(buffer != NULL, "create frame buffer");
+	double *latencies = calloc(test->controlCount, sizeof(double));
+	FRTestAssert(latencies != NULL, "allocate");
+	pthread_t writer;
+	FRTestAssert(pthread_create(&writer, NULL, FRTestLatencyWriter, test) == 0, "start writer");
+	
+	// reads at a steady rate, well below what loopback can take
+	double start = FRTestTime();
+	size_t bytes = 0;
+	size_t controls = 0;
+	size_t bulks = 0;
+	for (;;) {
+		double due = start + bytes / kReadRate;
+		double now = FRTestTime();
+		if (due > now) {
+			struct timespec pause = { (time_t)(due - now), (long)((due - now - (time_t)(due - now)) * 1e9) };
+			nanosleep(&pause, NULL);
+		}
+		size_t available = 0;
+		uint8_t *space = FRFrameBufferReserve(buffer, &available);
+		FRTestAssert(space != NULL, "reserve");
+		ssize_t length = read(sockets[1], space, available < kReadLength ? available : kReadLength);
+		if (length < 0 && errno == EINTR) { continue; }
+		FRTestAssert(length >= 0, "read: %s", strerror(errno));
+		if (length == 0) { break; }
+		FRFrameBufferCommit(buffer, (size_t)length);
+		bytes += (size_t)length;
+		
+		const struct iovec *payload = NULL;
+		int count = 0;
+		size_t payloadLength = 0;
+		FRFrameBufferResult result = FRFrameBufferIncomplete;
+		while ((result = FRFrameBufferNextMessage(buffer, &payload, &count, &payloadLength)) == FRFrameBufferComplete) {
+			if (payloadLength == kBulkLength) {
+				bulks++;
+				continue;
+			}
+			FRTestAssert(payloadLength == kControlLength && count == 1, "message length %zu", payloadLength);
+			uint64_t index = 0;
+			double queued = 0;
+			memcpy(&index, payload[0].iov_base, sizeof(index));
+			memcpy(&queued, (const uint8_t *)payload[0].iov_base + sizeof(index), sizeof(queued));
+			FRTestAssert(index == controls, "control message %llu instead of %zu", (unsigned long long)index, controls);
+			latencies[controls++] = FRTestTime() - queued;
+		}
+		FRTestAssert(result == FRFrameBufferIncomplete, "next frame: %d", result);
+	}
+	pthread_join(writer, NULL);
+	FRTestAssert(controls == test->controlCount, "%zu of %zu control messages arrived", controls, test->controlCount);
+	
+	qsort(latencies, controls, sizeof(double), FRTestCompare);
+	printf("  %-14s median %7.2f ms, 99th percentile %7.2f ms, worst %7.2f ms (%zu bulk messages)\n", name,
+		   latencies[controls / 2] * 1000, latencies[controls * 99 / 100] * 1000, latencies[controls - 1] * 1000,
+		   bulks);
+	free(latencies);
+	FRFrameBufferFree(buffer);
+	close(sockets[0]);
+	close(sockets[1]);
+}
+
+int main(int argc, char **argv) {
+	double scale = FRTestScale(argc, argv);
+	FRTestLatency test;
+	memset(&test, 0, sizeof(test));
+	test.controlCount = (size_t)(1000 * scale);
+	if (test.controlCount < 50) { test.controlCount = 50; }
+	test.bulk = malloc(kBulkLength);
+	FRTestAssert(test.bulk != NULL, "allocate");
+	memset(test.bulk, 0x5a, kBulkLength);
+	
+	printf("write queue: %zu control messages behind %.0f MB of strings files, read at %.0f MB/s\n",
+		   test.controlCount, kBulkBacklog / 1048576.0, kReadRate / 1048576.0);
+	test.controlChannel = FRFrameChannelControl;
+	FRTestMeasure(&test, "control channel");
+	test.controlChannel = FRFrameChannelBulk;
+	FRTestMeasure(&test, "one channel");
+	
+	free(test.bulk);
+	return 0;
+}
@@ -0,0 +1,311 @@
+// 
+// Copyright (c) 2013 FadingRed LLC
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+// documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+// Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+// WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+// OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// 
+
+#include <errno.h>
+#include <fcntl.h>
+
+#import "FRWriteQueue.h"
+#import "FRTests.h"
+
+// writes queued messages through a writer that takes a few bytes at a time and through a socket pair that fills
+// up, then reads the frames back with a frame buffer. payloads are wiped when they're released, so anything the
+// queue writes after releasing it shows up as damaged contents.
+enum { kMessageCount = 400 };
+
+typedef struct FRTestMessage {
+	uint8_t *payload;
+	size_t length;
+	FRFrameChannel channel;
+	int releases;
+} FRTestMessage;
+
+static FRTestMessage gMessages[kMessageCount];
+
+static void FRTestRelease(void *owner) {
+	FRTestMessage *message = owner;
+	message->releases++;
+	memset(message->payload, 0xEE, message->length);
+}
+
+static void FRTestMakeMessages(uint32_t seed) {
+	// the first bytes of each payload hold its index, the rest are derived from it
+	uint32_t random = seed;
+	for (size_t index = 0; index < kMessageCount; index++) {
+		FRTestMessage *message = &gMessages[index];
+		free(message->payload);
+		message->channel = (FRTestRandom(&random) % 3) ? FRFrameChannelControl : FRFrameChannelBulk;
+		message->length = (message->channel == FRFrameChannelControl) ? 4 + FRTestRandom(&random) % 300 :
+			4 + FRTestRandom(&random) % (100 * 1024);
+		message->payload = malloc(message->length);
+		message->releases = 0;
+		FRTestAssert(message->payload != NULL, "allocate");
+		uint32_t value = (uint32_t)index;
+		memcpy(message->payload, &value, 4);
+		for (size_t position = 4; position < message->length; position++) {
+			message->payload[position] = (uint8_t)(index * 7 + position);
+		}
+	}
+}
+
+static void FRTestPush(FRWriteQueue *queue, size_t index) {
+	FRTestMessage *message = &gMessages[index];
+	FRTestAssert(FRWriteQueuePush(queue, message->channel, message->payload, message->length,
+								  message, FRTestRelease) == 0, "push %zu", index);
+}
+
+static void FRTestCheckReleases(void) {
+	for (size_t index = 0; index < kMessageCount; index++) {
+		FRTestAssert(gMessages[index].releases == 1, "message %zu released %d times", index, gMessages[index].releases);
+	}
+}
+
+// takes every complete message out of the frame buffer and checks that each channel's messages come in order
+typedef struct FRTestReceiver {
+	FRFrameBuffer *buffer;
+	size_t next[FRFrameChannelCount];
+	size_t received;
+	size_t lastControl; // number of messages received when the last control message arrived
+} FRTestReceiver;
+
+static void FRTestReceiverInit(FRTestReceiver *receiver) {
+	memset(receiver, 0, sizeof(FRTestReceiver));
+	receiver->buffer = FRFrameBufferCreate(1024 * 1024);
+	FRTestAssert(receiver->buffer != NULL, "create frame buffer");
+}
+
+static void FRTestReceive(FRTestReceiver *receiver) {
+	const uint8_t *payload = NULL;
+	size_t length = 0;
+	FRFrameBufferResult result = FRFrameBufferIncomplete;
+	while ((result = FRFrameBufferNextFrame(receiver->buffer, &payload, &length)) == FRFrameBufferComplete) {
+		FRTestAssert(length >= 4, "message length %zu", length);
+		uint32_t index = 0;
+		memcpy(&index, payload, 4);
+		FRTestAssert(index < kMessageCount, "message index %u", index);
+		FRFrameChannel channel = gMessages[index].channel;
+		size_t *next = &receiver->next[channel];
+		while (*next < kMessageCount && gMessages[*next].channel != channel) { (*next)++; }
+		FRTestAssert(index == *next, "message %u on channel %d, expected %zu", index, channel, *next);
+		(*next)++;
+		FRTestAssert(length == gMessages[index].length, "message %u: length %zu", index, length);
+		for (size_t position = 4; position < length; position++) {
+			FRTestAssert(payload[position] == (uint8_t)(index * 7 + position), "message %u: byte %zu", index, position);
+		}
+		receiver->received++;
+		if (channel == FRFrameChannelControl) { receiver->lastControl = receiver->received; }
+	}
+	FRTestAssert(result == FRFrameBufferIncomplete, "next frame: %d", result);
+}
+
+static void FRTestReceiveBytes(FRTestReceiver *receiver, const uint8_t *bytes, size_t length) {
+	while (length) {
+		size_t space = 0;
+		uint8_t *destination = FRFrameBufferReserve(receiver->buffer, &space);
+		FRTestAssert(destination != NULL, "reserve");
+		size_t amount = (length < space) ? length : space;
+		memcpy(destination, bytes, amount);
+		FRFrameBufferCommit(receiver->buffer, amount);
+		FRTestReceive(receiver);
+		bytes += amount;
+		length -= amount;
+	}
+}
+
+// a writer that takes a few bytes at a time (sometimes none, often less than a header) and hands them over
+typedef struct FRTestTrickle {
+	FRTestReceiver *receiver;
+	uint32_t random;
+	size_t calls;
+	size_t partialVectors;
+} FRTestTrickle;
+
+static ssize_t FRTestTrickleWrite(void *context, const struct iovec *vectors, int count) {
+	FRTestTrickle *trickle = context;
+	size_t allowed = (trickle->calls++ % 3) ? FRTestRandom(&trickle->random) % 40000 :
+		FRTestRandom(&trickle->random) % 7;
+	size_t written = 0;
+	for (int index = 0; index < count && written < allowed; index++) {
+		size_t amount = vectors[index].iov_len;
+		if (amount > allowed - written) {
+			amount = allowed - written;
+			trickle->partialVectors++;
+		}
+		FRTestReceiveBytes(trickle->receiver, vectors[index].iov_base, amount);
+		written += amount;
+	}
+	return (ssize_t)written;
+}
+
+static void FRTestPartialWrites(void) {
+	// messages are pushed while earlier ones are half written, so new chunks have to wait for the partial one
+	FRTestMakeMessages(5);
+	FRWriteQueue *queue = FRWriteQueueCreate(256 * 1024);
+	FRTestReceiver receiver;
+	FRTestReceiverInit(&receiver);
+	FRTestTrickle trickle = { &receiver, 9, 0, 0 };
+	
+	size_t pushed = 0;
+	size_t flushes = 0;
+	while (pushed < kMessageCount || FRWriteQueueLength(queue)) {
+		for (size_t count = FRTestRandom(&trickle.random) % 4; count && pushed < kMessageCount; count--) {
+			FRTestPush(queue, pushed++);
+		}
+		size_t before = FRWriteQueueLength(queue);
+		ssize_t written = FRWriteQueueFlush(queue, FRTestTrickleWrite, &trickle);
+		FRTestAssert(written >= 0 && (size_t)written == before - FRWriteQueueLength(queue), "flushed bytes counted");
+		FRTestAssert(flushes++ < 1000000, "queue drains");
+	}
+	FRTestAssert(receiver.received == kMessageCount, "received %zu messages", receiver.received);
+	FRTestAssert(trickle.partialVectors > 100, "headers and payloads were split");
+	FRTestCheckReleases();
+	
+	FRWriteQueueFree(queue);
+	FRFrameBufferFree(receiver.buffer);
+}
+
+static size_t FRTestReadSocket(int socket, FRTestReceiver *receiver) {
+	size_t total = 0;
+	for (;;) {
+		size_t space = 0;
+		uint8_t *destination = FRFrameBufferReserve(receiver->buffer, &space);
+		FRTestAssert(destination != NULL, "reserve");
+		ssize_t length = read(socket, destination, space);
+		if (length < 0 && errno == EINTR) { continue; }
+		if (length < 0 && errno == EAGAIN) { break; }
+		FRTestAssert(length > 0, "read: %s", strerror(errno));
+		FRFrameBufferCommit(receiver->buffer, (size_t)length);
+		FRTestReceive(receiver);
+		total += (size_t)length;
+	}
+	return total;
+}
+
+static void FRTestBackpressure(void) {
+	// the socket only holds so much, so the queue fills up and has to drain before more is pushed
+	FRTestMakeMessages(17);
+	int sockets[2];
+	FRTestAssert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0, "socket pair");
+	int size = 32 * 1024;
+	setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	setsockopt(sockets[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	fcntl(sockets[0], F_SETFL, fcntl(sockets[0], F_GETFL) | O_NONBLOCK);
+	fcntl(sockets[1], F_SETFL, fcntl(sockets[1], F_GETFL) | O_NONBLOCK);
+	
+	size_t highWaterMark = 128 * 1024;
+	FRWriteQueue *queue = FRWriteQueueCreate(highWaterMark);
+	FRTestReceiver receiver;
+	FRTestReceiverInit(&receiver);
+	
+	size_t pushed = 0;
+	size_t fullCount = 0;
+	size_t blockedFlushes = 0;
+	int full = 0;
+	while (pushed < kMessageCount || FRWriteQueueLength(queue)) {
+		// push until the queue is full, then wait for it to drain like a sender would
+		if (full && FRWriteQueueIsDrained(queue)) { full = 0; }
+		while (!full && pushed < kMessageCount) {
+			FRTestPush(queue, pushed++);
+			if (FRWriteQueueIsFull(queue)) {
+				full = 1;
+				fullCount++;
+			}
+		}
+		FRTestAssert(!full || FRWriteQueueLength(queue) < highWaterMark + 100 * 1024 + 64,
+					 "pushing stops at the high water mark");
+		
+		size_t before = FRWriteQueueLength(queue);
+		ssize_t written = FRWriteQueueFlush(queue, FRWriteQueueWriteSocket, &sockets[0]);
+		FRTestAssert(written >= 0 && (size_t)written == before - FRWriteQueueLength(queue), "flushed bytes counted");
+		if (FRWriteQueueLength(queue)) {
+			blockedFlushes++;
+			// nothing more goes in once the socket is full
+			FRTestAssert(FRWriteQueueFlush(queue, FRWriteQueueWriteSocket, &sockets[0]) == 0, "full socket");
+		}
+		FRTestReadSocket(sockets[1], &receiver);
+	}
+	FRTestReadSocket(sockets[1], &receiver);
+	
+	FRTestAssert(receiver.received == kMessageCount, "received %zu messages", receiver.received);
+	FRTestAssert(fullCount > 1 && blockedFlushes > 10, "the queue filled up (%zu) and the socket blocked (%zu)",
+				 fullCount, blockedFlushes);
+	FRTestCheckReleases();
+	
+	FRWriteQueueFree(queue);
+	FRFrameBufferFree(receiver.buffer);
+	close(sockets[0]);
+	close(sockets[1]);
+}
+
+static void FRTestControlFirst(void) {
+	// a control message pushed behind a lot of bulk data only waits for the chunk that's being written
+	FRTestMakeMessages(23);
+	gMessages[0].channel = FRFrameChannelBulk;
+	gMessages[0].length = 200 * 1024;
+	gMessages[0].payload = realloc(gMessages[0].payload, gMessages[0].length);
+	FRTestAssert(gMessages[0].payload != NULL, "allocate");
+	for (size_t position = 4; position < gMessages[0].length; position++) {
+		gMessages[0].payload[position] = (uint8_t)position;
+	}
+	gMessages[1].channel = FRFrameChannelControl;
+	gMessages[1].length = 40;
+	FRWriteQueue *queue = FRWriteQueueCreate(1024 * 1024);
+	FRTestReceiver receiver;
+	FRTestReceiverInit(&receiver);
+	FRTestTrickle trickle = { &receiver, 31, 1, 0 };
+	
+	FRTestPush(queue, 0);
+	FRTestAssert(FRWriteQueueFlush(queue, FRTestTrickleWrite, &trickle) >= 0, "flush");
+	FRTestPush(queue, 1);
+	while (FRWriteQueueLength(queue)) {
+		FRTestAssert(FRWriteQueueFlush(queue, FRTestTrickleWrite, &trickle) >= 0, "flush");
+	}
+	FRTestAssert(receiver.received == 2 && receiver.lastControl == 1, "control message first");
+	FRTestAssert(gMessages[0].releases == 1 && gMessages[1].releases == 1, "both released");
+	FRWriteQueueFree(queue);
+	FRFrameBufferFree(receiver.buffer);
+}
+
+static ssize_t FRTestFailingWrite(void *context, const struct iovec *vectors, int count) {
+	return -1;
+}
+
+static void FRTestFailures(void) {
+	FRTestMakeMessages(29);
+	FRWriteQueue *queue = FRWriteQueueCreate(1024);
+	FRTestMessage *message = &gMessages[0];
+	FRTestAssert(FRWriteQueuePush(queue, FRFrameChannelCount, message->payload, message->length,
+								  message, FRTestRelease) == EINVAL, "no such channel");
+	FRTestAssert(message->releases == 1, "released when it can't be pushed");
+	
+	// messages that can't be written are released when the queue is reset or freed
+	for (size_t index = 1; index < kMessageCount; index++) { FRTestPush(queue, index); }
+	FRTestAssert(FRWriteQueueFlush(queue, FRTestFailingWrite, NULL) == -1, "writer failure");
+	FRWriteQueueReset(queue);
+	FRTestAssert(FRWriteQueueLength(queue) == 0, "empty after a reset");
+	FRTestCheckReleases();
+	FRWriteQueueFree(queue);
+}
+
+int main(int argc, char **argv) {
+	FRTestPartialWrites();
+	FRTestBackpressure();
+	FRTestControlFirst();
+	FRTestFailures();
+	for (size_t index = 0; index < kMessageCount; index++) { free(gMessages[index].payload); }
+	printf("write queue: ok\n");
+	return 0;
+}